@@ -628,6 +628,21 @@ extern DSN_API void          dsn_msg_write_next(
 /*! commit the write buffer after the message content is written with the real written size */
 extern DSN_API void          dsn_msg_write_commit(dsn_message_t msg, size_t size);
 
+/*!
+ append the given memory to the message without copying it
+
+ \param msg   message handle
+ \param ptr   the memory to be appended, which must not be changed until the message is sent
+ \param size  size of the memory
+ \param owner the message the memory belongs to, which is referenced until msg is released
+ */
+extern DSN_API void          dsn_msg_write_append(
+                                dsn_message_t msg,
+                                const void* ptr,
+                                size_t size,
+                                dsn_message_t owner
+                                );
+
 /*!
  get message read buffer
 
@@ -751,6 +766,41 @@ extern DSN_API void          dsn_rpc_call_one_way(
                                 dsn_message_t request
                                 );
 
+/*!
+ bytes of the rpc messages queued or being sent to the server, which can be used
+ by the callers for throttling before the send queue limits in [network] are hit,
+ after which the calls fail fast with ERR_CAPACITY_EXCEEDED
+ */
+extern DSN_API uint64_t      dsn_rpc_get_send_queue_bytes(dsn_address_t server);
+
+/*!
+ connect to the servers in advance (without waiting), so that the first rpc calls
+ to them do not pay the connect latency, e.g., after restart or configuration changes;
+ the servers already connected are skipped, see also warm_up_servers in [network]
+ */
+extern DSN_API void          dsn_rpc_warm_up(const dsn_address_t* servers, int count);
+
+/*! callback prototype for \ref dsn_rpc_register_session_disconnected_handler */
+typedef void(*dsn_rpc_session_disconnected_handler_t)(
+    dsn_address_t,  ///< remote server of the disconnected client session
+    void*           ///< context when the handler is registered
+    );
+
+/*!
+ register the handler called when a client session of this node to a server is
+ disconnected, e.g., for the callers to warm it up again by \ref dsn_rpc_warm_up;
+ the handler is called in the network threads, so it must be short and non-blocking
+
+ \return the handle for \ref dsn_rpc_unregister_session_disconnected_handler
+ */
+extern DSN_API dsn_handle_t  dsn_rpc_register_session_disconnected_handler(
+                                dsn_rpc_session_disconnected_handler_t handler,
+                                void* context
+                                );
+
+/*! remove the handler registered by \ref dsn_rpc_register_session_disconnected_handler */
+extern DSN_API void          dsn_rpc_unregister_session_disconnected_handler(dsn_handle_t handle);
+
 /*!
  get response message from the response task, note
  returned msg must be explicitly released using \ref dsn_msg_release_ref
@@ -783,11 +833,19 @@ typedef struct
     int size;
 }dsn_file_buffer_t;
 
+/*!
+ open flag for direct io (O_DIRECT on linux, ignored elsewhere), which bypasses
+ the page cache. Writes are padded to aligned blocks, where the rest of the last
+ block of each write is zero-filled (so a write must not end in the middle of a
+ block with data after it, as appending does), and the padding is trimmed on close.
+ */
+# define DSN_FILE_DIRECT_IO 0x40000000
+
 /*!
  open file
 
  \param file_name filename of the file.
- \param flag      flags such as O_RDONLY | O_BINARY used by ::open 
+ \param flag      flags such as O_RDONLY | O_BINARY used by ::open, and DSN_FILE_DIRECT_IO
  \param pmode     permission mode used by ::open
 
  \return file handle
@@ -95,6 +95,7 @@ namespace dsn {
                 double succ_latency_avg_ns;
                 double succ_qps;
                 double succ_throughput_MB_s;
+                double wire_bytes_per_request; // bytes sent on the wire per request, headers included
 
                 perf_test_case& operator = (const perf_test_case& r)
                 {
@@ -115,6 +116,7 @@ namespace dsn {
                     succ_latency_avg_ns = r.succ_latency_avg_ns;
                     succ_qps = r.succ_qps;
                     succ_throughput_MB_s = r.succ_throughput_MB_s;
+                    wire_bytes_per_request = r.wire_bytes_per_request;
 
                     return *this;
                 }
@@ -124,10 +126,10 @@ namespace dsn {
                     *this = r;
                 }
 
-                perf_test_case() : id(0), seconds(0), payload_bytes(0), concurrency(0),
-                    timeout_ms(0), timeout_rounds(0), error_rounds(0), succ_rounds(0),
+                perf_test_case() : id(0), seconds(0), payload_bytes(0), key_space_size(1000),
+                    concurrency(0), timeout_ms(0), timeout_rounds(0), error_rounds(0), succ_rounds(0),
                     succ_latency_avg_ns(0), succ_qps(0), succ_throughput_MB_s(0),
-                    key_space_size(1000)
+                    wire_bytes_per_request(0)
                 {}
             };
 
@@ -167,6 +169,8 @@ namespace dsn {
             std::atomic<int> _live_rpc_count;
             uint64_t         _case_start_ts_ns;
             uint64_t         _case_end_ts_ns;
+            dsn_handle_t     _sent_bytes_counter; // see network::on_bytes_sent
+            uint64_t         _case_start_sent_bytes;
 
             std::vector<perf_test_suite> _suits;
             int                         _current_suit_index;
@@ -129,6 +129,8 @@ public:
     int  worker_count() const { return static_cast<int>(_workers.size()); }
 
     int  master_count() const { return static_cast<int>(_masters.size()); }
+
+    uint32_t get_lease_ms() const { return _lease_milliseconds; }
     
 protected:
     void on_ping_internal(const beacon_msg& beacon, /*out*/ beacon_ack& ack);
@@ -104,7 +104,18 @@ MAKE_EVENT_CODE_RPC(RPC_CONFIG_PROPOSAL, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_QUERY_PN_DECREE, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_QUERY_REPLICA_INFO, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_PREPARE, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE_RPC(RPC_PREPARE_BATCH, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE_RPC(RPC_BATCHED_PREPARE_ACK, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE(LPC_PREPARE_BATCH_TIMER, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE(LPC_REPLICATION_CLIENT_READ, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_PREPARE_BATCH_DISPATCH, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE(LPC_APPLY_MUTATION_FAILED, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE(LPC_APPLY_QUEUE_AVAILABLE, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE(LPC_REPLAY_DECODE_LOG_FILE, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_REPLAY_APPLY_MUTATIONS, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_RPC(RPC_GROUP_CHECK, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE_RPC(RPC_GROUP_CHECK_BATCH, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_GROUP_CHECK_BATCH_DISPATCH, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_RPC(RPC_LEARN, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_LEARN_COMPLETION_NOTIFY, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_LEARN_ADD_LEARNER, TASK_PRIORITY_HIGH)
@@ -116,6 +127,7 @@ MAKE_EVENT_CODE_AIO(LPC_REPLICA_COPY_LAST_CHECKPOINT_DONE, TASK_PRIORITY_COMMON)
 // THREAD_POOL_LOCAL_APP
 #define CURRENT_THREAD_POOL THREAD_POOL_LOCAL_APP
 MAKE_EVENT_CODE(LPC_WRITE, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_APPLY_MUTATION, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_RPC(RPC_REPLICATION_CLIENT_READ, TASK_PRIORITY_COMMON)
 #undef CURRENT_THREAD_POOL
 
@@ -125,7 +137,10 @@ MAKE_EVENT_CODE(LPC_LEARN_REMOTE_DELTA_FILES, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_AIO(LPC_REPLICATION_COPY_REMOTE_FILES, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_GARBAGE_COLLECT_LOGS_AND_REPLICAS, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_OPEN_REPLICA, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_LOAD_REPLICA, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_OPEN_SHARED_LOG, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_CLOSE_REPLICA, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_CHECKPOINT_REPLICA, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_CATCHUP_WITH_PRIVATE_LOGS, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_PREPARE_LOG_FILE, TASK_PRIORITY_COMMON)
 #undef CURRENT_THREAD_POOL
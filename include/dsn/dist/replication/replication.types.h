@@ -41,6 +41,7 @@ namespace dsn { namespace replication {
         ReadLastUpdate = 1,
         ReadOutdated = 2,
         ReadSnapshot = 3,
+        ReadBoundedStaleness = 4,
     };
 
     DEFINE_POD_SERIALIZATION(read_semantic);
@@ -296,6 +297,8 @@ namespace dsn { namespace replication {
         ::dsn::task_code code;
         read_semantic semantic;
         int64_t version_decree;
+        int64_t max_staleness_decrees;
+        int32_t max_staleness_ms;
     };
 
     inline void marshall(::dsn::binary_writer& writer, const read_request_header& val)
@@ -304,6 +307,8 @@ namespace dsn { namespace replication {
         marshall(writer, val.code);
         marshall(writer, val.semantic);
         marshall(writer, val.version_decree);
+        marshall(writer, val.max_staleness_decrees);
+        marshall(writer, val.max_staleness_ms);
     }
 
     inline void unmarshall(::dsn::binary_reader& reader, /*out*/ read_request_header& val)
@@ -312,6 +317,8 @@ namespace dsn { namespace replication {
         unmarshall(reader, val.code);
         unmarshall(reader, val.semantic);
         unmarshall(reader, val.version_decree);
+        unmarshall(reader, val.max_staleness_decrees);
+        unmarshall(reader, val.max_staleness_ms);
     }
 
     // ---------- write_request_header -------------
@@ -319,18 +326,24 @@ namespace dsn { namespace replication {
     {
         global_partition_id gpid;
         ::dsn::task_code code;
+        int64_t client_id;
+        int64_t request_seq;
     };
 
     inline void marshall(::dsn::binary_writer& writer, const write_request_header& val)
     {
         marshall(writer, val.gpid);
         marshall(writer, val.code);
+        marshall(writer, val.client_id);
+        marshall(writer, val.request_seq);
     }
 
     inline void unmarshall(::dsn::binary_reader& reader, /*out*/ write_request_header& val)
     {
         unmarshall(reader, val.gpid);
         unmarshall(reader, val.code);
+        unmarshall(reader, val.client_id);
+        unmarshall(reader, val.request_seq);
     }
 
     // ---------- rw_response_header -------------
@@ -44,6 +44,7 @@
 # include <dsn/dist/replication/replication.types.h>
 # include <dsn/dist/replication/replication_other_types.h>
 # include <dsn/dist/replication/replication.codes.h>
+# include <dsn/dist/replication/write_dedup_table.h>
 # include <dsn/cpp/perf_counter_.h>
 
 namespace dsn { namespace replication {
@@ -209,6 +210,15 @@ public:
     const std::string& data_dir() const { return _dir_data; }
     const std::string& learn_dir() const { return _dir_learn; }
     bool is_delta_state_learning_supported() const { return _is_delta_state_learning_supported; }
+    bool is_read_thread_safe() const { return _is_read_thread_safe; }
+    bool is_write_dedup_supported() const { return _is_write_dedup_supported; }
+
+    //
+    // the table for deduplicating the retried writes, which is to be saved in the
+    // checkpoints and loaded on open or apply_checkpoint by the apps which declare
+    // set_write_dedup_supported (see write_dedup_table::write_to and read_from)
+    //
+    write_dedup_table& dedup_table() { return _dedup_table; }
 
     //
     // set physical error (e.g., disk error) so that the app is dropped by replication later
@@ -216,6 +226,23 @@ public:
     void set_physical_error(int err) { _physical_error = err; }
     void set_delta_state_learning_supported() { _is_delta_state_learning_supported = true; }
 
+    //
+    // declare that the read handlers can run concurrently with each other and with the writes,
+    // so that the reads are served in the pool of RPC_REPLICATION_CLIENT_READ directly (where
+    // the reads of a partition can use all threads when the pool is not partitioned), instead
+    // of being serialized with the writes in the replica thread; apply_async_enabled only
+    // takes effect for these apps
+    //
+    void set_read_thread_safe() { _is_read_thread_safe = true; }
+
+    //
+    // declare that the write handlers reply synchronously and that the dedup table is
+    // checkpointed with the app state, so that the retries of the writes from the same
+    // client (see write_request_header) are answered from the dedup table instead of
+    // being executed again, when [replication] write_dedup_enabled is set
+    //
+    void set_write_dedup_supported() { _is_write_dedup_supported = true; }
+
 protected:
     //
     // rpc handler registration
@@ -251,9 +278,17 @@ private:
     // routines for replica internal usage
     friend class replica;
     friend class replica_stub;
+    friend class apply_queue;
     error_code open_internal(replica* r, bool create_new);
     error_code write_internal(mutation_ptr& mu);
     void       dispatch_rpc_call(dsn_task_code_t code, binary_reader& reader, dsn_message_t response);
+    // the response of a write to be kept in the dedup table, empty if it is too large
+    blob       get_dedup_response(dsn_message_t response) const;
+    // answer a retried write with the kept response, or ERR_DUPLICATE_WRITE if it is not kept,
+    // which is always the case for the writes applied before this replica becomes primary
+    static void reply_duplicate_write(dsn_message_t request, const blob& response);
+    // answer a retried write which is out of the window of the dedup table with ERR_DEDUP_EXPIRED
+    static void reply_expired_write(dsn_message_t request);
     const replica_init_info& init_info() const { return _info; }
     error_code update_init_info(replica* r, int64_t shared_log_offset, int64_t private_log_offset);
 
@@ -277,6 +312,9 @@ private:
 
     int         _physical_error; // physical error (e.g., io error) indicates the app needs to be dropped
     bool        _is_delta_state_learning_supported;
+    bool        _is_read_thread_safe;
+    bool        _is_write_dedup_supported;
+    write_dedup_table _dedup_table;
     replica_init_info    _info;
     batch_state         _batch_state;
     std::atomic<decree> _last_committed_decree;
@@ -57,6 +57,9 @@ namespace dsn { namespace replication {
     DEFINE_ERR_CODE(ERR_APP_NOT_EXIST)
     DEFINE_ERR_CODE(ERR_BUSY_CREATING)
     DEFINE_ERR_CODE(ERR_BUSY_DROPPING)
+    DEFINE_ERR_CODE(ERR_STALE_READ)
+    DEFINE_ERR_CODE(ERR_DUPLICATE_WRITE) // the write is applied but its response is not kept, e.g., a retry after failover
+    DEFINE_ERR_CODE(ERR_DEDUP_EXPIRED) // the write is out of the dedup window, and is not executed
     
 #pragma pack(push, 4)
     class replication_app_client_base : public virtual clientlet
@@ -109,7 +112,34 @@ namespace dsn { namespace replication {
         {
             dsn_message_t msg = dsn_msg_create_request(RPC_REPLICATION_CLIENT_READ, static_cast<int>(timeout.count()), 0);
             task_ptr task = ::dsn::rpc::create_rpc_response_task(msg, owner, std::forward<TCallback>(callback), reply_hash);
-            auto rc = create_read_context(key_hash, code, msg, task, semantic, snapshot_decree, reply_hash);
+            auto rc = create_read_context(key_hash, code, msg, task, semantic, snapshot_decree, -1, -1, reply_hash);
+            ::marshall(msg, std::forward<TRequest>(req));
+            call(rc);
+            return task;
+        }
+
+        // read from a secondary (or the primary if there is none) whose state is no more stale
+        // than the given number of decrees and milliseconds (-1 for no limit) behind the
+        // primary, and retry on the primary if the chosen replica is too stale
+        template<typename TRequest, typename TCallback>
+        //where TCallback = void(error_code, TResponse&&)
+        //  where TResponse = DefaultConstructible + DSNSerializable
+        ::dsn::task_ptr read_bounded_staleness(
+            uint64_t key_hash,
+            dsn_task_code_t code,
+            TRequest&& req,
+            clientlet* owner,
+            TCallback&& callback,
+            int64_t max_staleness_decrees,
+            int max_staleness_ms,
+            std::chrono::milliseconds timeout = std::chrono::milliseconds(0),
+            int reply_hash = 0
+            )
+        {
+            dsn_message_t msg = dsn_msg_create_request(RPC_REPLICATION_CLIENT_READ, static_cast<int>(timeout.count()), 0);
+            task_ptr task = ::dsn::rpc::create_rpc_response_task(msg, owner, std::forward<TCallback>(callback), reply_hash);
+            auto rc = create_read_context(key_hash, code, msg, task, read_semantic::ReadBoundedStaleness, 
+                invalid_decree, max_staleness_decrees, max_staleness_ms, reply_hash);
             ::marshall(msg, std::forward<TRequest>(req));
             call(rc);
             return task;
@@ -172,6 +202,8 @@ namespace dsn { namespace replication {
             ::dsn::task_ptr& callback,
             dsn::replication::read_semantic semantic = read_semantic::ReadOutdated,
             decree snapshot_decree = invalid_decree, // only used when ReadSnapshot
+            int64_t max_staleness_decrees = -1, // only used when ReadBoundedStaleness
+            int max_staleness_ms = -1, // only used when ReadBoundedStaleness
             int reply_hash = 0
             );
 
@@ -184,6 +216,23 @@ namespace dsn { namespace replication {
         int                                     _app_id;
         int                                     _app_partition_count;
 
+        // the writes are identified by (client id, request seq) across the retries,
+        // see write_request_header
+        int64_t                                 _client_id;
+        int                                     _write_attempt_timeout_ms; // 0 for the whole request timeout
+
+        // the request seqs are consecutive in each partition, and the writes which fall out of
+        // the dedup window of the partition are given up, see write_dedup_table
+        struct partition_write_seqs
+        {
+            int64_t                                 last_seq;
+            std::map<int64_t, request_context_ptr>  pending; // seq => write waiting for the reply
+            partition_write_seqs() : last_seq(0) {}
+        };
+        ::dsn::service::zlock                   _write_seqs_lock;
+        std::unordered_map<int, partition_write_seqs> _write_seqs; // partition index => seqs
+        int                                     _write_dedup_window; // 0 for no dedup
+
     private:
         // local routines
         dsn::rpc_address get_address(bool is_write, read_semantic semantic, const partition_configuration& config);
@@ -195,6 +244,7 @@ namespace dsn { namespace replication {
         void call_with_address(dsn::rpc_address address, request_context_ptr request);
         void replica_rw_reply(error_code err, dsn_message_t request, dsn_message_t response, request_context_ptr rc);
         void end_request(request_context_ptr& request, error_code err, dsn_message_t resp);
+        int64_t next_write_seq(request_context_ptr& request);
         void on_replica_request_timeout(request_context_ptr& rc);
 
         // with meta server
@@ -84,6 +84,7 @@ namespace dsn {
             ENUM_REG(ReadLastUpdate)
             ENUM_REG(ReadOutdated)
             ENUM_REG(ReadSnapshot)
+            ENUM_REG(ReadBoundedStaleness)
         ENUM_END(read_semantic)
 
         ENUM_BEGIN(learn_type, LT_INVALID)
@@ -34,7 +34,8 @@ enum read_semantic {
     ReadInvalid = 0,
     ReadLastUpdate = 1,
     ReadOutdated = 2,
-    ReadSnapshot = 3
+    ReadSnapshot = 3,
+    ReadBoundedStaleness = 4
 };
 
 
@@ -625,11 +626,13 @@ inline std::ostream& operator<<(std::ostream& out, const prepare_msg& obj)
 }
 
 typedef struct _read_request_header__isset {
-  _read_request_header__isset() : gpid(false), code(false), semantic(true), version_decree(true) {}
+  _read_request_header__isset() : gpid(false), code(false), semantic(true), version_decree(true), max_staleness_decrees(true), max_staleness_ms(true) {}
   bool gpid :1;
   bool code :1;
   bool semantic :1;
   bool version_decree :1;
+  bool max_staleness_decrees :1;
+  bool max_staleness_ms :1;
 } _read_request_header__isset;
 
 class read_request_header {
@@ -637,7 +640,7 @@ class read_request_header {
 
   read_request_header(const read_request_header&);
   read_request_header& operator=(const read_request_header&);
-  read_request_header() : semantic((read_semantic)1), version_decree(-1LL) {
+  read_request_header() : semantic((read_semantic)1), version_decree(-1LL), max_staleness_decrees(-1LL), max_staleness_ms(-1) {
     semantic = (read_semantic)1;
 
   }
@@ -647,6 +650,8 @@ class read_request_header {
    ::dsn::task_code code;
   read_semantic semantic;
   int64_t version_decree;
+  int64_t max_staleness_decrees;
+  int32_t max_staleness_ms;
 
   _read_request_header__isset __isset;
 
@@ -658,6 +663,10 @@ class read_request_header {
 
   void __set_version_decree(const int64_t val);
 
+  void __set_max_staleness_decrees(const int64_t val);
+
+  void __set_max_staleness_ms(const int32_t val);
+
   bool operator == (const read_request_header & rhs) const
   {
     if (!(gpid == rhs.gpid))
@@ -668,6 +677,10 @@ class read_request_header {
       return false;
     if (!(version_decree == rhs.version_decree))
       return false;
+    if (!(max_staleness_decrees == rhs.max_staleness_decrees))
+      return false;
+    if (!(max_staleness_ms == rhs.max_staleness_ms))
+      return false;
     return true;
   }
   bool operator != (const read_request_header &rhs) const {
@@ -691,9 +704,11 @@ inline std::ostream& operator<<(std::ostream& out, const read_request_header& ob
 }
 
 typedef struct _write_request_header__isset {
-  _write_request_header__isset() : gpid(false), code(false) {}
+  _write_request_header__isset() : gpid(false), code(false), client_id(true), request_seq(true) {}
   bool gpid :1;
   bool code :1;
+  bool client_id :1;
+  bool request_seq :1;
 } _write_request_header__isset;
 
 class write_request_header {
@@ -701,12 +716,14 @@ class write_request_header {
 
   write_request_header(const write_request_header&);
   write_request_header& operator=(const write_request_header&);
-  write_request_header() {
+  write_request_header() : client_id(0LL), request_seq(0LL) {
   }
 
   virtual ~write_request_header() throw();
   global_partition_id gpid;
    ::dsn::task_code code;
+  int64_t client_id;
+  int64_t request_seq;
 
   _write_request_header__isset __isset;
 
@@ -714,12 +731,20 @@ class write_request_header {
 
   void __set_code(const  ::dsn::task_code& val);
 
+  void __set_client_id(const int64_t val);
+
+  void __set_request_seq(const int64_t val);
+
   bool operator == (const write_request_header & rhs) const
   {
     if (!(gpid == rhs.gpid))
       return false;
     if (!(code == rhs.code))
       return false;
+    if (!(client_id == rhs.client_id))
+      return false;
+    if (!(request_seq == rhs.request_seq))
+      return false;
     return true;
   }
   bool operator != (const write_request_header &rhs) const {
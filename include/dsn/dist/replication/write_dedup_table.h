@@ -0,0 +1,127 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Per-partition table of the applied client writes, so that the retries
+ *     of a write (with the same client id and request seq, see
+ *     write_request_header) are answered from the table instead of being
+ *     executed again.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#pragma once
+
+# include <dsn/service_api_cpp.h>
+# include <map>
+# include <list>
+# include <unordered_map>
+
+namespace dsn { namespace replication {
+
+//
+// The table is part of the replicated app state: it is updated when the
+// writes are applied (in the order of the decrees, so that all replicas
+// evict the same entries), and is persisted in the checkpoints of the app
+// (see write_to and read_from).
+//
+// Memory is bounded by:
+// - max_clients: the least recently written clients are evicted, whose
+//   retries are then executed again;
+// - max_requests_per_client: the applied seqs of a client are tracked
+//   exactly in the window of its latest max_requests_per_client seqs.
+//   The request seqs of a client are consecutive in a partition, so the
+//   watermark, up to which all the seqs are applied, follows the window,
+//   and the retries of the seqs up to it get ERR_DUPLICATE_WRITE after
+//   they slide out of the window. The client gives up the writes which
+//   fall out of the window (see replication_app_client_base), so the other
+//   seqs out of the window, which are not known to be applied, are not
+//   executed but get ERR_DEDUP_EXPIRED, which no client waits for;
+// - max_response_bytes: larger responses are not kept, the retries of
+//   these writes get ERR_DUPLICATE_WRITE as well.
+//
+// The responses are only kept on the replica which serves the writes as
+// primary, the others keep the request seqs only. So after a failover, the
+// retries of the writes applied by the old primary get ERR_DUPLICATE_WRITE
+// without the response from the new primary.
+//
+class write_dedup_table
+{
+public:
+    write_dedup_table();
+
+    // max_clients = 0 for disabled, which is the default
+    void set_limits(int max_clients, int max_requests_per_client, int max_response_bytes);
+    bool is_enabled() const { return _max_clients > 0; }
+    int  max_response_bytes() const { return _max_response_bytes; }
+
+    enum write_state
+    {
+        WS_NOT_APPLIED,
+        WS_APPLIED,
+        WS_EXPIRED   // evicted without knowing whether it is applied
+    };
+
+    // the state of the write, with its response if it is applied and the response is kept
+    write_state find(int64_t client_id, int64_t request_seq, /*out*/ blob& response) const;
+
+    // record an applied write, with an empty response if it is not kept
+    void add(int64_t client_id, int64_t request_seq, const blob& response);
+
+    void clear();
+    int  client_count() const;
+
+    void write_to(binary_writer& writer) const;
+    // ERR_INVALID_DATA if the format is unknown, so that the checkpoint is rejected
+    error_code read_from(binary_reader& reader);
+
+private:
+    struct client_entry
+    {
+        std::map<int64_t, blob>      responses; // request seq => response
+        int64_t                      watermark; // seqs up to it are all applied
+        int64_t                      evicted;   // the max seq out of the window
+        std::list<int64_t>::iterator lru_pos;
+    };
+
+    // _lock must be held
+    client_entry& touch_client(int64_t client_id);
+    void trim_client(client_entry& entry);
+
+private:
+    mutable ::dsn::service::zlock _lock;
+    std::unordered_map<int64_t, client_entry> _clients;
+    std::list<int64_t> _lru; // client ids, the most recently written first
+
+    int _max_clients;
+    int _max_requests_per_client;
+    int _max_response_bytes;
+};
+
+}} // namespace
@@ -68,8 +68,9 @@ public:
     virtual ~aio_provider() {}
     service_node* node() const;
 
-    // return DSN_INVALID_FILE_HANDLE if failed
-    virtual dsn_handle_t open(const char* file_name, int flag, int pmode) = 0;
+    // return DSN_INVALID_FILE_HANDLE if failed, with the error in err, which is
+    // ERR_INVALID_PARAMETERS when the flags are not supported (e.g., O_DIRECT)
+    virtual dsn_handle_t open(const char* file_name, int flag, int pmode, /*out*/ error_code& err) = 0;
     virtual error_code   close(dsn_handle_t fh) = 0;
     virtual error_code   flush(dsn_handle_t fh) = 0;
     virtual void         aio(aio_task* aio) = 0;
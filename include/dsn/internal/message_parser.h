@@ -40,6 +40,7 @@
 # include <dsn/internal/rpc_message.h>
 # include <dsn/internal/singleton.h>
 # include <vector>
+# include <atomic>
 
 namespace dsn 
 {
@@ -68,6 +69,7 @@ namespace dsn
         int read_buffer_capacity() const;
 
         // after read, see if we can compose a message
+        // read_next returns -1 when the data received is invalid, and the session must be closed
         virtual message_ex* get_message_on_receive(int read_length, /*out*/ int& read_next) = 0;
 
         // before send, prepare buffer
@@ -94,6 +96,15 @@ namespace dsn
 
         // all current read-ed content are discarded
         virtual void truncate_read() { _read_buffer_occupied = 0; }
+
+        // whether replies must be sent in the same order as the requests are received
+        // (e.g., pipelined http), in which case the parser must number the received
+        // requests as 1, 2, 3, ... in header->id, see rpc_session::send_message
+        virtual bool is_reply_ordered() const { return false; }
+
+        // whether the connection should be closed once the messages prepared for sending
+        // so far are sent (e.g., an http reply with 'Connection: close'), see rpc_session::on_send_completed
+        virtual bool is_close_after_sent() const { return false; }
         
     protected:
         void create_new_buffer(int sz);
@@ -131,8 +142,42 @@ namespace dsn
         std::vector<parser_factory_info> _factory_vec;
     };
 
+    //
+    // NET_HDR_DSN, each message goes with the full message_header, except that the small
+    // messages following a full header on the same connection go with compact headers
+    // carrying only what may differ (see compact_message_header and is_compactable),
+    // so a batch of small messages to the same peer is sent as one frame (the full header
+    // of the first message plus a compact header for each of the rest), and they are
+    // unpacked into ordinary messages against the last full header on receive.
+    //
+    // compact headers are not understood by the peers of earlier versions, so they are
+    // off unless [network] message_batching_max_body_size is set.
+    //
     class dsn_message_parser : public message_parser
     {
+    public:
+        struct compact_message_header
+        {
+            uint32_t          magic;       // compact_message_magic
+            int32_t           body_length;
+            uint32_t          rpc_code;    // rpc_name_fast.local_rpc_id
+            int32_t           hash;        // client.hash
+            dsn_msg_context_t context;
+            uint64_t          id;
+            uint64_t          rpc_id;
+        };
+
+        enum
+        {
+            // never equal to the hdr_crc32 of full headers, which is always CRC_INVALID
+            // when compact headers are used on the connection (see is_compactable)
+            compact_message_magic = 0xdeadba7c,
+
+            // rpc_session batches at most max_buffer_block_count_per_send (<= 128)
+            // buffers per send, and each message takes at least one
+            compact_header_slot_count = 128
+        };
+
     public:
         dsn_message_parser(int buffer_block_size, bool is_write_only);
 
@@ -141,5 +186,24 @@ namespace dsn
         virtual int prepare_buffers_on_send(message_ex* msg, int offset, /*out*/ send_buf* buffers) override;
 
         virtual int get_send_buffers_count_and_total_length(message_ex* msg, /*out*/ int* total_length) override;
+
+    private:
+        // whether msg can be sent with a compact header against the last full header sent
+        bool is_compactable(message_ex* msg) const;
+
+        // body buffers of msg, i.e., msg->buffers without the leading message_header
+        static int get_body_buffers(message_ex* msg, /*out*/ send_buf* buffers);
+
+    private:
+        // for sending, always called by rpc_session in lock
+        message_header         _send_template; // the last full header sent
+        bool                   _has_send_template;
+        compact_message_header _compact_headers[compact_header_slot_count];
+        int                    _next_compact_header;
+
+        // for receiving
+        message_header         _recv_template; // the last full header received
+        bool                   _has_recv_template;
+        std::atomic<uint32_t>  _peer_local_hash; // rpc_name_fast.local_hash of the peer, 0 for unknown
     };
 }
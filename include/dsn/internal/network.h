@@ -41,6 +41,8 @@
 # include <dsn/cpp/address.h>
 # include <dsn/internal/priority_queue.h>
 # include <dsn/internal/exp_delay.h>
+# include <dsn/internal/perf_counter.h>
+# include <map>
 
 namespace dsn {
 
@@ -129,6 +131,35 @@ namespace dsn {
         rpc_engine* engine() const { return _engine; }
         int max_buffer_block_count_per_send() const { return _max_buffer_block_count_per_send; }
 
+        //
+        // outbound backpressure
+        //   when either limit is exceeded, new rpc requests are rejected with ERR_CAPACITY_EXCEEDED
+        //   instead of being queued; replies are never rejected (see rpc_session::send_message)
+        //
+        int session_send_queue_max_messages() const { return _session_send_queue_max_messages; }
+        uint64_t session_send_queue_max_bytes() const { return _session_send_queue_max_bytes; }
+        uint64_t send_queue_max_bytes() const { return _send_queue_max_bytes; }
+        uint64_t send_queue_bytes() const { return _send_queue_bytes.load(std::memory_order_relaxed); }
+        void on_send_queue_bytes_added(uint64_t bytes) { _send_queue_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+        void on_send_queue_bytes_removed(uint64_t bytes) { _send_queue_bytes.fetch_sub(bytes, std::memory_order_relaxed); }
+        void on_send_queue_rejected() { _send_queue_rejected_counter->increment(); }
+
+        // bytes on the wire (headers included) handed to the sessions for sending
+        void on_bytes_sent(uint64_t bytes) { _sent_bytes_counter->add(bytes); }
+
+        //
+        // bytes queued and not yet sent out on the way to the remote address
+        // (0 for networks without send queues)
+        //
+        virtual uint64_t get_send_queue_bytes(::dsn::rpc_address remote) { return 0; }
+
+        //
+        // establish the connection to the remote address in advance (without waiting for it),
+        // so that the first rpc call does not pay the connect latency
+        // (no-op for networks without connections)
+        //
+        virtual void warm_up(::dsn::rpc_address remote) {}
+
     protected:
         static uint32_t get_local_ipv4();
 
@@ -138,6 +169,12 @@ namespace dsn {
         int                           _message_buffer_block_size;
         int                           _max_buffer_block_count_per_send;
         int                           _send_queue_threshold;
+        int                           _session_send_queue_max_messages; // 0 for unlimited
+        uint64_t                      _session_send_queue_max_bytes;    // 0 for unlimited
+        uint64_t                      _send_queue_max_bytes;            // 0 for unlimited
+        std::atomic<uint64_t>         _send_queue_bytes;                // of all sessions
+        perf_counter_ptr              _send_queue_rejected_counter;
+        perf_counter_ptr              _sent_bytes_counter;
 
     private:
         friend class rpc_engine;
@@ -165,11 +202,24 @@ namespace dsn {
         // called upon RPC call, rpc client session is created on demand
         virtual void send_message(message_ex* request) override;
 
+        // sum of the send queues of the client session to remote
+        virtual uint64_t get_send_queue_bytes(::dsn::rpc_address remote) override;
+
         // called by rpc engine
         virtual void inject_drop_message(message_ex* msg, bool is_send) override;
 
+        // client session is created and connected if not yet
+        virtual void warm_up(::dsn::rpc_address remote) override;
+
+        // called by client sessions upon connected
+        void on_client_session_connected(uint64_t connect_latency_ns) { _connect_latency_counter->set(connect_latency_ns); }
+
         // to be defined
         virtual rpc_session_ptr create_client_session(::dsn::rpc_address server_addr) = 0;
+
+    private:
+        // the client session to remote, created and connected on demand
+        rpc_session_ptr get_or_create_client_session(::dsn::rpc_address remote);
         
     protected:
         typedef std::unordered_map< ::dsn::rpc_address, rpc_session_ptr> client_sessions;
@@ -179,6 +229,8 @@ namespace dsn {
         typedef std::unordered_map< ::dsn::rpc_address, rpc_session_ptr> server_sessions;
         server_sessions               _servers; // from_address => rpc_session
         utils::rw_lock_nr             _servers_lock;
+
+        perf_counter_ptr              _connect_latency_counter;
     };
 
     //
@@ -197,14 +249,28 @@ namespace dsn {
         virtual ~rpc_session();
 
         virtual void close_on_fault_injection() = 0;
+
+        // close the socket, the session is then removed upon the io failure
+        virtual void close() = 0;
                 
         bool has_pending_out_msgs();
         bool is_client() const { return _is_client; }
         ::dsn::rpc_address remote_address() const { return _remote_addr; }
         connection_oriented_network& net() const { return _net; }
-        void send_message(message_ex* msg);
+        uint64_t send_queue_bytes() const { return _message_bytes.load(std::memory_order_relaxed); }
+        bool is_reply_ordered() const { return _parser->is_reply_ordered(); }
+
+        // return false when the request is rejected as the send queue is full,
+        // in which case the message is not referenced by the session
+        bool send_message(message_ex* msg);
         bool cancel(message_ex* request);
         void delay_recv(int delay_ms);
+
+        // reply-ordered sessions (e.g., pipelined http) cannot skip a reply, otherwise all
+        // the later replies are held back, so a request dropped without running its handler
+        // (unknown, expired or by fault injection) is answered with err in its turn;
+        // no-op for other sessions
+        void reply_dropped_request(message_ex* request, error_code err);
         void on_recv_message(message_ex* msg, int delay_ms);
 
     // for client session
@@ -241,6 +307,14 @@ namespace dsn {
         // return whether there are messages for sending; should always be called in lock
         bool unlink_message_for_send();
         void clear_send_queue(bool resend_msgs);
+        bool is_send_queue_full(uint64_t bytes) const;
+        void on_send_queue_bytes_added(uint64_t bytes);
+        void on_send_queue_bytes_removed(uint64_t bytes);
+        // link the message into _messages, or hold it back when it is a reply
+        // ahead of its turn on a reply-ordered session; should always be called in lock
+        void link_message_for_send(message_ex* msg);
+        // a closed reply-ordered session holds back no reply, and drops the queued ones
+        void release_replies_on_disconnected(bool is_write);
 
     protected:
         // constant info
@@ -266,13 +340,18 @@ namespace dsn {
         };
 
         // TODO: expose the queue to be customizable
-        std::atomic<int>                   _message_count;
+        std::atomic<int>                   _message_count; // queued but not being sent
+        std::atomic<uint64_t>              _message_bytes; // queued or being sent
+        perf_counter_ptr                   _message_bytes_counter; // client session only
         ::dsn::utils::ex_lock_nr           _lock; // [
         bool                               _is_sending_next;
         dlink                              _messages;        
         volatile session_state             _connect_state;
         uint64_t                           _message_sent;
+        uint64_t                           _connect_start_ns; // of the latest connect attempt
         int                                _delay_server_receive_ms;
+        std::map<uint64_t, message_ex*>    _held_replies; // id => reply, for reply-ordered sessions
+        uint64_t                           _next_reply_id;
         // ]
     };
 
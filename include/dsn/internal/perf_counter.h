@@ -82,6 +82,7 @@ public:
     virtual void   increment() = 0;
     virtual void   decrement() = 0;
     virtual void   add(uint64_t val) = 0;
+    virtual void   subtract(uint64_t val) = 0; // reverse of add, for the numbers going down
     virtual void   set(uint64_t val) = 0;
     virtual double get_value() = 0;
     virtual uint64_t get_integer_value() = 0;
@@ -72,11 +72,13 @@ public:
     static std::string get_counter_value_i(const std::vector<std::string>& args);
     static std::string get_counter_sample_i(const std::vector<std::string>& args);
     static std::string get_counter_index(const std::vector<std::string>& args);
+    static std::string dump_counters(const std::vector<std::string>& args);
 
     typedef std::map<std::string, perf_counter_ptr > all_counters;
 
 private:
     std::string list_counter_internal(const std::vector<std::string>& args);
+    std::string dump_counters_internal(const std::vector<std::string>& args);
     mutable utils::rw_lock_nr  _lock;
     all_counters               _counters;
     perf_counter::factory      _factory;
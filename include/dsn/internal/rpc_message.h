@@ -149,6 +149,7 @@ namespace dsn
         //        
         void write_next(void** ptr, size_t* size, size_t min_size);
         void write_commit(size_t size);
+        void write_append(const blob& data);
         bool read_next(void** ptr, size_t* size);
         void read_commit(size_t size);        
         size_t body_size() { return (size_t)header->body_length; }
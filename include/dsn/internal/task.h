@@ -289,16 +289,7 @@ public:
 
     message_ex*  get_request() { return _request; }
     virtual void enqueue() override;
-
-    virtual void  exec() override
-    {
-        if (0 == _enqueue_ts_ns
-            || dsn_now_ns() - _enqueue_ts_ns < 
-            (uint64_t)_request->header->client.timeout_ms * 1000000ULL)
-        {
-            _handler->run(_request);
-        }
-    }
+    virtual void exec() override;
 
 protected:
     message_ex      *_request;
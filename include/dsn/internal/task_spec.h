@@ -154,6 +154,7 @@ ENUM_END(throttling_mode_t)
 DEFINE_CUSTOMIZED_ID_TYPE(network_header_format);
 DEFINE_CUSTOMIZED_ID(network_header_format, NET_HDR_DSN);
 DEFINE_CUSTOMIZED_ID(network_header_format, NET_HDR_HTTP);
+DEFINE_CUSTOMIZED_ID(network_header_format, NET_HDR_THRIFT_COMPACT);
 
 // define network channel types for RPC
 DEFINE_CUSTOMIZED_ID_TYPE(rpc_channel)
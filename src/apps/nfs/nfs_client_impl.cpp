@@ -319,7 +319,8 @@ namespace dsn {
                 hfile = reqc->file_ctx->file.load();
                 if (!hfile)
                 {
-                    hfile = dsn_file_open(file_path.c_str(), O_RDWR | O_CREAT | O_BINARY, 0666);
+                    hfile = dsn_file_open(file_path.c_str(),
+                        O_RDWR | O_CREAT | O_BINARY | (_opts.write_direct_io ? DSN_FILE_DIRECT_IO : 0), 0666);
                     reqc->file_ctx->file = hfile;
                 }
             }
@@ -49,6 +49,7 @@ namespace dsn {
             int file_close_expire_time_ms;
             int file_close_timer_interval_ms_on_server;
             int max_file_copy_request_count_per_file;
+            bool write_direct_io;
 
             void init()
             {
@@ -64,6 +65,16 @@ namespace dsn {
                     30 * 1000, "time interval for checking whether cached file handles need to be closed");
                 max_file_copy_request_count_per_file = (int)dsn_config_get_value_uint64("nfs", "max_file_copy_request_count_per_file", 
                     10, "maximum concurrent remote copy requests for the same file on nfs client"); // limit each file copy speed
+                write_direct_io = dsn_config_get_value_bool("nfs", "write_direct_io",
+                    false, "whether to write the received files with direct io, which bypasses the page cache");
+
+                // the blocks of a file may be written in any order, so only the last one
+                // may end in the middle of an aligned block (see DSN_FILE_DIRECT_IO)
+                if (write_direct_io && nfs_copy_block_bytes % 4096 != 0)
+                {
+                    dwarn("nfs_copy_block_bytes %u is not 4KB aligned, direct io is disabled", nfs_copy_block_bytes);
+                    write_direct_io = false;
+                }
             }
         };
 
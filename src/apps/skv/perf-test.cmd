@@ -10,9 +10,16 @@ FOR %%R IN (1,2,3) DO (
         FOR %%U IN (dsn::tools::sim_network_provider dsn::tools::asio_udp_provider) DO (
             :: %aio_provider% - what kind of aio provider we use
             FOR %%A IN (dsn::tools::empty_aio_provider dsn::tools::native_aio_provider) DO (
-                CALL dsn.replication.simple_kv perf-config.ini -cargs replica_count=%%R;tcp_network_provider=%%T;udp_network_provider=%%U;aio_provider=%%A
-                XCOPY /Y data\client.perf.test\perf-result-* .\perf-result\
-                @RMDIR /Q /S data
+                :: %mutation_batch_adaptive% - fixed or adaptive 2pc concurrency
+                FOR %%B IN (false true) DO (
+                    :: %read_thread_count% - threads serving the reads of the hot partition
+                    FOR %%C IN (1 8) DO (
+                        CALL dsn.replication.simple_kv perf-config.ini -cargs replica_count=%%R;tcp_network_provider=%%T;udp_network_provider=%%U;aio_provider=%%A;mutation_batch_adaptive=%%B;read_thread_count=%%C
+                        @MKDIR perf-result\adaptive-%%B-readers-%%C
+                        XCOPY /Y data\client.perf.test\perf-result-* .\perf-result\adaptive-%%B-readers-%%C\
+                        @RMDIR /Q /S data
+                    )
+                )
             )
         )
     )
@@ -18,9 +18,16 @@ for rep_cnt in {1..3};do
         for udp in ${udp_network_providers};do
             #%aio_provider% - what kind of aio provider we use
             for aio in ${aio_providers};do
-                ./dsn.replication.simple_kv perf-config.ini -cargs replica_count=${rep_cnt},tcp_network_provider=${tcp},udp_network_provider=${udp},aio_provider=${aio}
-                cp data/client.perf.test/perf-result-* ./perf-result/
-                rm -rf data
+                #%mutation_batch_adaptive% - fixed or adaptive 2pc concurrency
+                for adaptive in false true;do
+                    #%read_thread_count% - threads serving the reads of the hot partition
+                    for readers in 1 8;do
+                        ./dsn.replication.simple_kv perf-config.ini -cargs replica_count=${rep_cnt},tcp_network_provider=${tcp},udp_network_provider=${udp},aio_provider=${aio},mutation_batch_adaptive=${adaptive},read_thread_count=${readers}
+                        mkdir -p perf-result/adaptive-${adaptive}-readers-${readers}
+                        cp data/client.perf.test/perf-result-* ./perf-result/adaptive-${adaptive}-readers-${readers}/
+                        rm -rf data
+                    done
+                done
             done
         done
     done
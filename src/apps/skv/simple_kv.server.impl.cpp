@@ -36,6 +36,7 @@
 #include "simple_kv.server.impl.h"
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 # ifdef __TITLE__
 # undef __TITLE__
@@ -52,6 +53,21 @@ namespace dsn {
                 : simple_kv_service(replica), _lock(true)
             {
                 _test_file_learning = false;
+                set_read_thread_safe();
+                set_write_dedup_supported();
+                _write_delay_us = (uint32_t)dsn_config_get_value_uint64("simple_kv",
+                    "write_delay_us",
+                    0,
+                    "artificial delay (us) of each write, to test slow apps"
+                    );
+            }
+
+            void simple_kv_service_impl::delay_write()
+            {
+                if (_write_delay_us > 0)
+                {
+                    std::this_thread::sleep_for(std::chrono::microseconds(_write_delay_us));
+                }
             }
 
             // RPC_SIMPLE_KV_READ
@@ -75,6 +91,7 @@ namespace dsn {
             // RPC_SIMPLE_KV_WRITE
             void simple_kv_service_impl::on_write(const kv_pair& pr, ::dsn::rpc_replier<int32_t>& reply)
             {
+                delay_write();
                 {
                     zauto_lock l(_lock);
                     _store[pr.key] = pr.value;
@@ -87,6 +104,7 @@ namespace dsn {
             // RPC_SIMPLE_KV_APPEND
             void simple_kv_service_impl::on_append(const kv_pair& pr, ::dsn::rpc_replier<int32_t>& reply)
             {
+                delay_write();
                 {
                     zauto_lock l(_lock);
                     auto it = _store.find(pr.key);
@@ -115,7 +133,9 @@ namespace dsn {
                 }
                 else
                 {
-                    recover();
+                    auto err = recover();
+                    if (err != ERR_OK)
+                        return err;
                 }
                 return ERR_OK;
             }
@@ -134,7 +154,7 @@ namespace dsn {
             }
 
             // checkpoint related
-            void simple_kv_service_impl::recover()
+            ::dsn::error_code simple_kv_service_impl::recover()
             {
                 zauto_lock l(_lock);
 
@@ -166,18 +186,21 @@ namespace dsn {
 
                 if (maxVersion > 0)
                 {
-                    recover(name, maxVersion);
+                    auto err = recover(name, maxVersion);
+                    if (err != ERR_OK)
+                        return err;
                     _last_durable_decree = maxVersion;
                 }
+                return ERR_OK;
             }
 
-            void simple_kv_service_impl::recover(const std::string& name, decree version)
+            ::dsn::error_code simple_kv_service_impl::recover(const std::string& name, decree version)
             {
                 zauto_lock l(_lock);
 
                 std::ifstream is(name.c_str(), std::ios::binary);
                 if (!is.is_open())
-                    return;
+                    return ERR_OK;
                 
                 _store.clear();
 
@@ -207,7 +230,27 @@ namespace dsn {
                     _store[key] = value;
                 }
 
+                // the dedup table, which is absent in the checkpoints of the older versions
+                uint32_t table_size;
+                if (is.read((char*)&table_size, (uint32_t)sizeof(table_size)))
+                {
+                    std::shared_ptr<char> buffer(new char[table_size], [](char* ptr){ delete[] ptr; });
+                    is.read(buffer.get(), table_size);
+                    binary_reader reader(blob(buffer, 0, (int)table_size));
+                    auto err = dedup_table().read_from(reader);
+                    if (err != ERR_OK)
+                    {
+                        derror("simple_kv_service_impl recover from checkpoint %s failed, err = %s", name.c_str(), err.to_string());
+                        return err;
+                    }
+                }
+                else
+                {
+                    dedup_table().clear();
+                }
+
                 init_last_commit_decree(version);
+                return ERR_OK;
             }
 
             ::dsn::error_code simple_kv_service_impl::checkpoint()
@@ -250,6 +293,13 @@ namespace dsn {
                     os.write((const char*)&sz, (uint32_t)sizeof(sz));
                     os.write((const char*)&v[0], sz);
                 }
+
+                binary_writer writer;
+                dedup_table().write_to(writer);
+                blob table = writer.get_buffer();
+                uint32_t table_size = (uint32_t)table.length();
+                os.write((const char*)&table_size, (uint32_t)sizeof(table_size));
+                os.write(table.data(), table_size);
                 
                 os.close();
 
@@ -288,8 +338,7 @@ namespace dsn {
             {
                 if (mode == CHKPT_LEARN)
                 {
-                    recover(state.files[0], state.to_decree_included);
-                    return ERR_OK;
+                    return recover(state.files[0], state.to_decree_included);
                 }
                 else
                 {
@@ -61,14 +61,16 @@ namespace dsn {
                 virtual ::dsn::error_code apply_checkpoint(learn_state& state, chkpt_apply_mode mode) override;
 
             private:
-                void recover();
-                void recover(const std::string& name, decree version);
+                ::dsn::error_code recover();
+                ::dsn::error_code recover(const std::string& name, decree version);
+                void delay_write();
 
             private:
                 typedef std::map<std::string, std::string> simple_kv;
                 simple_kv _store;
                 ::dsn::service::zlock _lock;
                 bool      _test_file_learning;
+                uint32_t  _write_delay_us; // for testing slow apps
             };
 
         }
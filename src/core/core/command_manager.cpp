@@ -322,6 +322,103 @@ namespace dsn {
         dsn_rpc_reply(resp);
     }
 
+    DEFINE_TASK_CODE_RPC(RPC_DSN_HTTP_METRICS, TASK_PRIORITY_HIGH, THREAD_POOL_DEFAULT);
+    DEFINE_TASK_CODE_RPC(RPC_DSN_HTTP_CLI, TASK_PRIORITY_HIGH, THREAD_POOL_DEFAULT);
+
+    void http_metrics_handler(dsn_message_t req, void*)
+    {
+        command_manager::instance().on_http_metrics(req);
+    }
+
+    void http_cli_handler(dsn_message_t req, void*)
+    {
+        command_manager::instance().on_http_cli(req);
+    }
+
+    // http requests are mapped to rpc handlers by the url path (see http_message_parser),
+    // so these are served at /metrics and /cli?cmd=...
+    void command_manager::start_http_cli()
+    {
+        ::dsn::service_engine::fast_instance().register_system_rpc_handler(RPC_DSN_HTTP_METRICS, "metrics", http_metrics_handler, nullptr);
+        ::dsn::service_engine::fast_instance().register_system_rpc_handler(RPC_DSN_HTTP_CLI, "cli", http_cli_handler, nullptr);
+    }
+
+    // http bodies are raw bytes rather than marshalled values
+    static std::string read_http_body(dsn_message_t req)
+    {
+        std::string body;
+        size_t remaining = dsn_msg_body_size(req);
+        void* ptr;
+        size_t size;
+        while (remaining > 0 && dsn_msg_read_next(req, &ptr, &size))
+        {
+            size = std::min(size, remaining);
+            body.append((const char*)ptr, size);
+            dsn_msg_read_commit(req, size);
+            remaining -= size;
+        }
+        return body;
+    }
+
+    static void reply_http(dsn_message_t req, const std::string& output)
+    {
+        auto resp = dsn_msg_create_response(req);
+        {
+            ::dsn::rpc_write_stream writer(resp);
+            writer.write(output.c_str(), (int)output.length());
+        }
+        dsn_rpc_reply(resp);
+    }
+
+    // value of 'name' in query 'k1=v1&k2=v2', with '+' and %XX decoded
+    static std::string get_query_value(const std::string& query, const char* name)
+    {
+        std::string key = std::string(name) + "=";
+        size_t pos = 0;
+        while (pos < query.length() && query.compare(pos, key.length(), key) != 0)
+        {
+            pos = query.find('&', pos);
+            if (pos == std::string::npos)
+                return "";
+            pos++;
+        }
+        if (pos >= query.length())
+            return "";
+
+        std::string value;
+        for (size_t i = pos + key.length(); i < query.length() && query[i] != '&'; i++)
+        {
+            if (query[i] == '+')
+                value.push_back(' ');
+            else if (query[i] == '%' && i + 2 < query.length())
+            {
+                value.push_back((char)strtol(query.substr(i + 1, 2).c_str(), nullptr, 16));
+                i += 2;
+            }
+            else
+                value.push_back(query[i]);
+        }
+        return value;
+    }
+
+    void command_manager::on_http_metrics(dsn_message_t req)
+    {
+        std::string output;
+        run_command("counter.dump", std::vector<std::string>(), output);
+        reply_http(req, output);
+    }
+
+    void command_manager::on_http_cli(dsn_message_t req)
+    {
+        std::string cmd = get_query_value(read_http_body(req), "cmd");
+        std::string output;
+        if (cmd.empty())
+            output = "usage: /cli?cmd=<command line>, e.g., /cli?cmd=help";
+        else
+            run_command(cmd, output);
+        reply_http(req, output);
+    }
+
     void command_manager::set_cli_target_address(dsn_handle_t handle, dsn::rpc_address address)
     {
         reinterpret_cast<command*>(handle)->address = address;
@@ -55,6 +55,9 @@ namespace dsn {
         void start_local_cli();
         void start_remote_cli();
         void on_remote_cli(dsn_message_t req);
+        void start_http_cli();
+        void on_http_metrics(dsn_message_t req);
+        void on_http_cli(dsn_message_t req);
         void set_cli_target_address(dsn_handle_t handle, dsn::rpc_address address);
 
     private:
@@ -39,6 +39,12 @@
 # include <dsn/cpp/utils.h>
 # include "transient_memory.h"
 
+# ifdef __linux__
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/stat.h>
+# endif
+
 # ifdef __TITLE__
 # undef __TITLE__
 # endif
@@ -49,6 +55,83 @@ using namespace dsn::utils;
 namespace dsn {
 
 DEFINE_TASK_CODE_AIO(LPC_AIO_BATCH_WRITE, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
+DEFINE_TASK_CODE_AIO(LPC_AIO_DIRECT_READ, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
+
+//----------------- aligned_buffer_pool ------------------------
+static char* aligned_buffer_alloc(uint32_t alignment, uint32_t size)
+{
+# ifdef _WIN32
+    char* buffer = (char*)_aligned_malloc(size, alignment);
+# else
+    char* buffer = nullptr;
+    if (posix_memalign((void**)&buffer, alignment, size) != 0)
+        buffer = nullptr;
+# endif
+    dassert(buffer != nullptr, "allocate aligned buffer failed, size = %u", size);
+    return buffer;
+}
+
+static void aligned_buffer_free(char* buffer)
+{
+# ifdef _WIN32
+    _aligned_free(buffer);
+# else
+    free(buffer);
+# endif
+}
+
+aligned_buffer_pool::aligned_buffer_pool(uint32_t alignment, uint32_t buffer_size, int max_free_buffers)
+    : _alignment(alignment), _buffer_size(buffer_size), _max_free_buffers(max_free_buffers)
+{
+    dassert((alignment & (alignment - 1)) == 0 && buffer_size % alignment == 0,
+        "invalid alignment %u or buffer size %u", alignment, buffer_size);
+}
+
+aligned_buffer_pool::~aligned_buffer_pool()
+{
+    for (auto buffer : _free_buffers)
+        aligned_buffer_free(buffer);
+}
+
+blob aligned_buffer_pool::allocate(uint32_t size)
+{
+    if (size > _buffer_size)
+    {
+        std::shared_ptr<char> buffer(aligned_buffer_alloc(_alignment, size), aligned_buffer_free);
+        return blob(std::move(buffer), (int)size);
+    }
+
+    char* buffer = nullptr;
+    {
+        scope_lk l(_lock);
+        if (!_free_buffers.empty())
+        {
+            buffer = _free_buffers.back();
+            _free_buffers.pop_back();
+        }
+    }
+
+    if (buffer == nullptr)
+        buffer = aligned_buffer_alloc(_alignment, _buffer_size);
+
+    // the pool is kept until all its buffers are released, which may outlive the disk engine
+    auto pool = shared_from_this();
+    std::shared_ptr<char> holder(buffer, [pool](char* b) { pool->release(b); });
+    return blob(std::move(holder), (int)size);
+}
+
+void aligned_buffer_pool::release(char* buffer)
+{
+    {
+        scope_lk l(_lock);
+        if ((int)_free_buffers.size() < _max_free_buffers)
+        {
+            _free_buffers.push_back(buffer);
+            return;
+        }
+    }
+    aligned_buffer_free(buffer);
+}
 
 //----------------- disk_file ------------------------
 aio_task* disk_write_queue::unlink_next_workload(void* plength)
@@ -103,7 +186,46 @@ aio_task* disk_write_queue::unlink_next_workload(void* plength)
 disk_file::disk_file(dsn_handle_t handle)
     : _handle(handle)
 {
+    _direct_io = false;
+    _alignment = 0;
+    _file_size = 0;
+    _padded_size = 0;
+    _last_block_offset = (uint64_t)-1;
+}
 
+void disk_file::set_direct_io(uint64_t file_size, uint32_t alignment)
+{
+    _direct_io = true;
+    _alignment = alignment;
+    _file_size = file_size;
+    _padded_size = file_size;
+    _last_block.reset(new char[alignment]);
+    _write_queue.serialize_writes();
+}
+
+void disk_file::load_block(uint64_t offset, char* buffer)
+{
+    if (offset == _last_block_offset)
+    {
+        memcpy(buffer, _last_block.get(), _alignment);
+        return;
+    }
+
+    // only happens for the first write to an existing file at an unaligned offset
+    int64_t r = 0;
+# ifdef __linux__
+    if (offset < _file_size)
+    {
+        r = ::pread((int)(uintptr_t)_handle, buffer, _alignment, (off_t)offset);
+        if (r < 0)
+        {
+            derror("read block at offset %" PRIu64 " for direct write failed, err = %s",
+                offset, strerror(errno));
+            r = 0;
+        }
+    }
+# endif
+    memset(buffer + r, 0, _alignment - (size_t)r);
 }
 
 void disk_file::ctrl(dsn_ctrl_code_t code, int param)
@@ -136,6 +258,12 @@ aio_task* disk_file::on_read_completed(aio_task* wk, error_code err, size_t size
 
 aio_task* disk_file::on_write_completed(aio_task* wk, void* ctx, error_code err, size_t size)
 {
+    // the cached block may not be on disk
+    if (_direct_io && err != ERR_OK)
+    {
+        _last_block_offset = (uint64_t)-1;
+    }
+
     auto ret = _write_queue.on_work_completed(wk, ctx);
     auto tail = wk;
     
@@ -164,6 +292,8 @@ aio_task* disk_file::on_write_completed(aio_task* wk, void* ctx, error_code err,
 
 //----------------- disk_engine ------------------------
 disk_engine::disk_engine(service_node* node)
+    // batched writes plus their aligned head and tail
+    : _direct_io_buffers(std::make_shared<aligned_buffer_pool>(4096, 1024 * 1024 + 2 * 4096, 8))
 {
     _is_running = false;    
     _provider = nullptr;
@@ -194,16 +324,50 @@ void disk_engine::ctrl(dsn_handle_t fh, dsn_ctrl_code_t code, int param)
 }
 
 dsn_handle_t disk_engine::open(const char* file_name, int flag, int pmode)
-{            
-    dsn_handle_t nh = _provider->open(file_name, flag, pmode);
-    if (nh != DSN_INVALID_FILE_HANDLE)
+{
+    bool direct_io = (flag & DSN_FILE_DIRECT_IO) != 0;
+    flag &= ~DSN_FILE_DIRECT_IO;
+
+    dsn_handle_t nh = DSN_INVALID_FILE_HANDLE;
+# ifdef __linux__
+    if (direct_io)
     {
-        return new disk_file(nh);
+        // the aligned writes are kept when the file system does not support O_DIRECT,
+        // so that the file content does not depend on it
+        error_code err;
+        nh = _provider->open(file_name, flag | O_DIRECT, pmode, err);
+        if (nh == DSN_INVALID_FILE_HANDLE && err == ERR_INVALID_PARAMETERS)
+        {
+            dwarn("open %s with O_DIRECT failed, fall back to buffered io", file_name);
+            nh = _provider->open(file_name, flag, pmode, err);
+        }
     }
     else
+# else
+    direct_io = false;
+# endif
+    {
+        error_code err;
+        nh = _provider->open(file_name, flag, pmode, err);
+    }
+
+    if (nh == DSN_INVALID_FILE_HANDLE)
     {
         return nullptr;
-    }   
+    }
+
+    auto df = new disk_file(nh);
+# ifdef __linux__
+    if (direct_io)
+    {
+        struct stat st;
+        uint64_t file_size = 0;
+        if (::fstat((int)(uintptr_t)nh, &st) == 0)
+            file_size = (uint64_t)st.st_size;
+        df->set_direct_io(file_size, _direct_io_buffers->alignment());
+    }
+# endif
+    return df;
 }
 
 error_code disk_engine::close(dsn_handle_t fh)
@@ -211,6 +375,16 @@ error_code disk_engine::close(dsn_handle_t fh)
     if (nullptr != fh)
     {
         auto df = (disk_file*)fh;
+# ifdef __linux__
+        // trim the padding of the last block
+        if (df->is_direct_io() && df->_padded_size > df->_file_size)
+        {
+            if (::ftruncate((int)(uintptr_t)df->native_handle(), (off_t)df->_file_size) != 0)
+            {
+                derror("trim the padding of direct io file failed, err = %s", strerror(errno));
+            }
+        }
+# endif
         auto ret = _provider->close(df->native_handle());
         delete df;
         return ret;
@@ -258,8 +432,82 @@ void disk_engine::read(aio_task* aio)
     auto wk = df->read(aio);
     if (wk)
     {
-        return _provider->aio(wk);
+        process_read(wk);
+    }
+}
+
+class direct_read_io_task : public aio_task
+{
+public:
+    direct_read_io_task(aio_task* task, blob& buffer)
+        : aio_task(LPC_AIO_DIRECT_READ, nullptr, task, nullptr)
+    {
+        _buffer = buffer;
+    }
+
+    virtual void exec() override
+    {
+        aio_task* task = (aio_task*)_context;
+        auto tio = task->aio();
+        auto df = (disk_file*)tio->file_object;
+
+        // copy out what is read within the aligned range, except the padding
+        error_code err = error();
+        size_t size = 0;
+        size_t skip = (size_t)(tio->file_offset - aio()->file_offset);
+        uint64_t file_size = df->direct_io_file_size();
+        if (err == ERR_OK)
+        {
+            if (_transferred_size > skip && tio->file_offset < file_size)
+            {
+                size = std::min(_transferred_size - skip, (size_t)tio->buffer_size);
+                size = (size_t)std::min((uint64_t)size, file_size - tio->file_offset);
+                memcpy(tio->buffer, _buffer.data() + skip, size);
+            }
+            else
+            {
+                err = ERR_HANDLE_EOF;
+            }
+        }
+
+        auto wk = df->on_read_completed(task, err, size);
+        if (wk)
+        {
+            wk->aio()->engine->process_read(wk);
+        }
+    }
+
+public:
+    blob         _buffer;
+};
+
+void disk_engine::process_read(aio_task* aio)
+{
+    auto df = (disk_file*)aio->aio()->file_object;
+    if (!df->is_direct_io())
+    {
+        return _provider->aio(aio);
     }
+
+    // read the aligned range into a bounce buffer
+    uint64_t alignment = _direct_io_buffers->alignment();
+    uint64_t begin = aio->aio()->file_offset / alignment * alignment;
+    uint64_t end = (aio->aio()->file_offset + aio->aio()->buffer_size + alignment - 1) / alignment * alignment;
+    auto bb = _direct_io_buffers->allocate((uint32_t)(end - begin));
+
+    auto new_task = new direct_read_io_task(aio, bb);
+    auto dio = new_task->aio();
+    dio->buffer = (void*)bb.data();
+    dio->buffer_size = (uint32_t)(end - begin);
+    dio->file_offset = begin;
+
+    dio->file = aio->aio()->file;
+    dio->file_object = aio->aio()->file_object;
+    dio->engine = aio->aio()->engine;
+    dio->type = AIO_Read;
+
+    new_task->add_ref(); // released in complete_io
+    return _provider->aio(new_task);
 }
 
 class batch_write_io_task : public aio_task
@@ -319,6 +567,11 @@ void disk_engine::write(aio_task* aio)
 
 void disk_engine::process_write(aio_task* aio, uint32_t sz)
 {
+    if (((disk_file*)aio->aio()->file_object)->is_direct_io())
+    {
+        return process_direct_write(aio, sz);
+    }
+
     // no batching
     if (aio->aio()->buffer_size == sz)
     {
@@ -363,6 +616,72 @@ void disk_engine::process_write(aio_task* aio, uint32_t sz)
     }
 }
 
+//
+// writes (possibly batched) [offset, offset + sz) as the aligned range
+// [aligned_begin, aligned_end), where the head of the first block is
+// the data on disk (mostly cached from the last write when appending),
+// and the rest of the last block is zero-filled
+//
+void disk_engine::process_direct_write(aio_task* aio, uint32_t sz)
+{
+    auto df = (disk_file*)aio->aio()->file_object;
+    uint64_t alignment = _direct_io_buffers->alignment();
+    uint64_t begin = aio->aio()->file_offset;
+    uint64_t end = begin + sz;
+    uint64_t aligned_begin = begin / alignment * alignment;
+    uint64_t aligned_end = (end + alignment - 1) / alignment * alignment;
+
+    auto bb = _direct_io_buffers->allocate((uint32_t)(aligned_end - aligned_begin));
+    char* buffer = (char*)bb.data();
+    if (aligned_begin < begin)
+    {
+        df->load_block(aligned_begin, buffer);
+    }
+
+    char* ptr = buffer + (begin - aligned_begin);
+    auto current_wk = aio;
+    do
+    {
+        current_wk->copy_to(ptr);
+        ptr += current_wk->aio()->buffer_size;
+        current_wk = (aio_task*)current_wk->next;
+    } while (current_wk);
+
+    dassert(ptr == buffer + (end - aligned_begin), "");
+    memset(ptr, 0, (size_t)(aligned_end - end));
+
+    // cache the last block for the next append
+    if (aligned_end > end)
+    {
+        df->_last_block_offset = aligned_end - alignment;
+        memcpy(df->_last_block.get(), buffer + (aligned_end - alignment - aligned_begin), (size_t)alignment);
+    }
+    else
+    {
+        df->_last_block_offset = (uint64_t)-1;
+    }
+    df->_file_size = std::max(df->_file_size, end);
+    df->_padded_size = std::max(df->_padded_size, aligned_end);
+
+    // setup io task, whose completion is the same as batching
+    auto new_task = new batch_write_io_task(
+        aio,
+        bb
+        );
+    auto dio = new_task->aio();
+    dio->buffer = (void*)bb.data();
+    dio->buffer_size = (uint32_t)(aligned_end - aligned_begin);
+    dio->file_offset = aligned_begin;
+
+    dio->file = aio->aio()->file;
+    dio->file_object = aio->aio()->file_object;
+    dio->engine = aio->aio()->engine;
+    dio->type = AIO_Write;
+
+    new_task->add_ref(); // released in complete_io
+    return _provider->aio(new_task);
+}
+
 void disk_engine::complete_io(aio_task* aio, error_code err, uint32_t bytes, int delay_milliseconds)
 {
     if (err != ERR_OK)
@@ -375,8 +694,8 @@ void disk_engine::complete_io(aio_task* aio, error_code err, uint32_t bytes, int
             );
     }
     
-    // batching
-    if (aio->code() == LPC_AIO_BATCH_WRITE)
+    // batching, or direct io
+    if (aio->code() == LPC_AIO_BATCH_WRITE || aio->code() == LPC_AIO_DIRECT_READ)
     {
         aio->enqueue(err, (size_t)bytes);
         aio->release_ref(); // added in process_write
@@ -391,7 +710,7 @@ void disk_engine::complete_io(aio_task* aio, error_code err, uint32_t bytes, int
             auto wk = df->on_read_completed(aio, err, (size_t)bytes);
             if (wk)
             {
-                _provider->aio(wk);
+                process_read(wk);
             }            
         }
 
@@ -39,9 +39,39 @@
 # include <dsn/internal/synchronize.h>
 # include <dsn/internal/aio_provider.h>
 # include <dsn/internal/work_queue.h>
+# include <dsn/cpp/utils.h>
+# include <memory>
+# include <vector>
 
 namespace dsn {
 
+//
+// aligned buffers for direct io, whose buffer address, file offset and size
+// must all be aligned; buffers up to buffer_size are recycled, and the
+// larger ones are allocated on demand; the recycled buffers hold a ref to
+// the pool, so it must be created by std::make_shared
+//
+class aligned_buffer_pool : public std::enable_shared_from_this<aligned_buffer_pool>
+{
+public:
+    aligned_buffer_pool(uint32_t alignment, uint32_t buffer_size, int max_free_buffers);
+    ~aligned_buffer_pool();
+
+    blob     allocate(uint32_t size);
+    uint32_t alignment() const { return _alignment; }
+
+private:
+    void release(char* buffer);
+
+private:
+    typedef utils::auto_lock<utils::ex_lock_nr_spin> scope_lk;
+    utils::ex_lock_nr_spin _lock;
+    std::vector<char*> _free_buffers;
+    uint32_t _alignment;
+    uint32_t _buffer_size;
+    int      _max_free_buffers;
+};
+
 class disk_write_queue : public work_queue<aio_task>
 {
 public:
@@ -51,6 +81,12 @@ public:
         _max_batch_bytes = 1024 * 1024; // 1 MB
     }
 
+    // adjacent direct io writes may share the same aligned block,
+    // so they must not be in flight at the same time
+    void serialize_writes() { reset_max_concurrent_ops(1); }
+
+    uint32_t max_batch_bytes() const { return _max_batch_bytes; }
+
 private:
     virtual aio_task* unlink_next_workload(void* plength) override;
 
@@ -71,10 +107,29 @@ public:
     
     dsn_handle_t native_handle() const { return _handle; }
 
+    // direct io mode, see DSN_FILE_DIRECT_IO and disk_engine::process_direct_write
+    void set_direct_io(uint64_t file_size, uint32_t alignment);
+    bool is_direct_io() const { return _direct_io; }
+    uint64_t direct_io_file_size() const { return _file_size; }
+
+private:
+    friend class disk_engine;
+
+    // fill the aligned block at the given offset with the data on disk
+    void load_block(uint64_t offset, char* buffer);
+
 private:
     dsn_handle_t     _handle;
     disk_write_queue _write_queue;
     work_queue<aio_task> _read_queue;
+
+    // direct io states, which are only touched by the (serialized) writes
+    bool             _direct_io;
+    uint32_t         _alignment;
+    uint64_t         _file_size;         // size without the padding of the last block
+    uint64_t         _padded_size;       // size on disk
+    uint64_t         _last_block_offset; // offset of _last_block, or -1 when it is invalid
+    std::unique_ptr<char[]> _last_block; // the last partially written block, so appends need not read it back
 };
 
 class disk_engine
@@ -99,13 +154,17 @@ public:
 private:
     friend class aio_provider;
     friend class batch_write_io_task;
+    friend class direct_read_io_task;
+    void process_read(aio_task* wk);
     void process_write(aio_task* wk, uint32_t sz);
+    void process_direct_write(aio_task* wk, uint32_t sz);
     void complete_io(aio_task* aio, error_code err, uint32_t bytes, int delay_milliseconds = 0);
 
 private:
     volatile bool   _is_running;
     aio_provider    *_provider;
     service_node    *_node;
+    std::shared_ptr<aligned_buffer_pool> _direct_io_buffers;
 };
 
 } // end namespace
@@ -124,8 +124,12 @@ namespace dsn {
 
     //-------------------- dsn message --------------------
 
+    # define CRC_INVALID 0xdead0c2c
+
     dsn_message_parser::dsn_message_parser(int buffer_block_size, bool is_write_only)
-        : message_parser(buffer_block_size, is_write_only)
+        : message_parser(buffer_block_size, is_write_only),
+        _has_send_template(false), _next_compact_header(0),
+        _has_recv_template(false), _peer_local_hash(0)
     {
     }
     
@@ -133,6 +137,62 @@ namespace dsn {
     {
         mark_read(read_length);
 
+        // compact message against the last full header
+        if (_has_recv_template
+            && _read_buffer_occupied >= sizeof(uint32_t)
+            && *(uint32_t*)_read_buffer.data() == compact_message_magic)
+        {
+            if (_read_buffer_occupied < sizeof(compact_message_header))
+            {
+                read_next = sizeof(compact_message_header) - _read_buffer_occupied;
+                return nullptr;
+            }
+
+            auto chdr = (const compact_message_header*)_read_buffer.data();
+            int msg_sz = sizeof(compact_message_header) + chdr->body_length;
+            if (_read_buffer_occupied < msg_sz)
+            {
+                read_next = msg_sz - _read_buffer_occupied;
+                return nullptr;
+            }
+
+            // restore the full header, and the body is copied along as
+            // it is small (see [network] message_batching_max_body_size)
+            int full_sz = sizeof(message_header) + chdr->body_length;
+            std::shared_ptr<char> buffer(new char[full_sz], std::default_delete<char[]>{});
+            auto& hdr = *(message_header*)buffer.get();
+            hdr = _recv_template;
+            hdr.body_length = chdr->body_length;
+            hdr.client.hash = chdr->hash;
+            hdr.context = chdr->context;
+            hdr.id = chdr->id;
+            hdr.rpc_id = chdr->rpc_id;
+            if (chdr->rpc_code != hdr.rpc_name_fast.local_rpc_id)
+            {
+                if (hdr.rpc_name_fast.local_hash != message_ex::s_local_hash)
+                {
+                    // the rpc code cannot be mapped as the peer has other rpc codes, which
+                    // means the peer is broken, so the rest of the stream is not trusted
+                    derror("compact message with rpc code %u from a peer with inconsistent rpc codes, "
+                        "drop it and close the session",
+                        chdr->rpc_code
+                        );
+                    read_next = -1;
+                    return nullptr;
+                }
+                hdr.rpc_name_fast.local_rpc_id = chdr->rpc_code;
+                strncpy(hdr.rpc_name, dsn_task_code_to_string(chdr->rpc_code), sizeof(hdr.rpc_name));
+            }
+            memcpy(buffer.get() + sizeof(message_header), _read_buffer.data() + sizeof(compact_message_header), chdr->body_length);
+
+            message_ex* msg = message_ex::create_receive_message(blob(buffer, 0, full_sz));
+
+            _read_buffer = _read_buffer.range(msg_sz);
+            _read_buffer_occupied -= msg_sz;
+            read_next = sizeof(compact_message_header);
+            return msg;
+        }
+
         if (_read_buffer_occupied >= sizeof(message_header))
         {            
             int msg_sz = sizeof(message_header) +
@@ -146,6 +206,15 @@ namespace dsn {
 
                 dassert(msg->is_right_header() && msg->is_right_body(false), "");
 
+                // compact messages may follow only when crc is disabled by the peer
+                _has_recv_template = (msg->header->hdr_crc32 == CRC_INVALID);
+                if (_has_recv_template)
+                    _recv_template = *msg->header;
+
+                // forwarded messages carry the rpc codes of their original senders
+                if (!msg->header->context.u.is_forwarded)
+                    _peer_local_hash.store(msg->header->rpc_name_fast.local_hash, std::memory_order_relaxed);
+
                 _read_buffer = _read_buffer.range(msg_sz);
                 _read_buffer_occupied -= msg_sz;
                 read_next = sizeof(message_header);
@@ -165,8 +234,95 @@ namespace dsn {
         }
     }
 
+    bool dsn_message_parser::is_compactable(message_ex* msg) const
+    {
+        static const int max_body_size = (int)dsn_config_get_value_uint64(
+            "network", "message_batching_max_body_size",
+            0, "messages (of NET_HDR_DSN) with body no larger than this are sent with compact headers when batched after a full header to the same peer, 0 (default) to disable; "
+            "compact headers change the wire format, so enable it only when all the peers understand them"
+            );
+
+        auto& hdr = *msg->header;
+        auto& t = _send_template;
+        if (!_has_send_template
+            || hdr.body_length > max_body_size
+            || hdr.hdr_crc32 != CRC_INVALID
+            || hdr.body_crc32 != CRC_INVALID
+            || hdr.version != t.version
+            || hdr.vnid != t.vnid
+            || hdr.from_address != t.from_address
+            || hdr.client.timeout_ms != t.client.timeout_ms
+            || hdr.server.error != t.server.error
+            || hdr.rpc_name_fast.local_hash != t.rpc_name_fast.local_hash)
+        {
+            return false;
+        }
+
+        if (hdr.rpc_name_fast.local_rpc_id == t.rpc_name_fast.local_rpc_id)
+        {
+            return strcmp(hdr.rpc_name, t.rpc_name) == 0;
+        }
+
+        // other rpc codes are restored on the peer only when the code mappings are the same
+        else
+        {
+            return hdr.rpc_name_fast.local_hash == message_ex::s_local_hash
+                && _peer_local_hash.load(std::memory_order_relaxed) == message_ex::s_local_hash
+                && strcmp(hdr.rpc_name, dsn_task_code_to_string(hdr.rpc_name_fast.local_rpc_id)) == 0;
+        }
+    }
+
+    int dsn_message_parser::get_body_buffers(message_ex* msg, /*out*/ send_buf* buffers)
+    {
+        int offset = (int)sizeof(message_header);
+        int i = 0;
+        for (auto& buf : msg->buffers)
+        {
+            if (offset >= buf.length())
+            {
+                offset -= buf.length();
+                continue;
+            }
+
+            if (buffers)
+            {
+                buffers[i].buf = (void*)(buf.data() + offset);
+                buffers[i].sz = (uint32_t)(buf.length() - offset);
+            }
+            offset = 0;
+            ++i;
+        }
+        return i;
+    }
+
     int dsn_message_parser::prepare_buffers_on_send(message_ex* msg, int offset, /*out*/ send_buf* buffers)
     {
+        if (offset == 0 && is_compactable(msg))
+        {
+            auto& hdr = *msg->header;
+            auto& chdr = _compact_headers[_next_compact_header];
+            _next_compact_header = (_next_compact_header + 1) % compact_header_slot_count;
+
+            chdr.magic = compact_message_magic;
+            chdr.body_length = hdr.body_length;
+            chdr.rpc_code = hdr.rpc_name_fast.local_rpc_id;
+            chdr.hash = hdr.client.hash;
+            chdr.context = hdr.context;
+            chdr.id = hdr.id;
+            chdr.rpc_id = hdr.rpc_id;
+
+            buffers[0].buf = (void*)&chdr;
+            buffers[0].sz = sizeof(chdr);
+            return 1 + get_body_buffers(msg, buffers + 1);
+        }
+
+        if (offset == 0)
+        {
+            _has_send_template = (msg->header->hdr_crc32 == CRC_INVALID);
+            if (_has_send_template)
+                _send_template = *msg->header;
+        }
+
         int i = 0;        
         for (auto& buf : msg->buffers)
         {
@@ -187,6 +343,12 @@ namespace dsn {
 
     int dsn_message_parser::get_send_buffers_count_and_total_length(message_ex* msg, int* total_length)
     {
+        if (is_compactable(msg))
+        {
+            *total_length = (int)msg->body_size() + sizeof(compact_message_header);
+            return 1 + get_body_buffers(msg, nullptr);
+        }
+
         *total_length = (int)msg->body_size() + sizeof(message_header);
         return (int)msg->buffers.size();
     }
@@ -38,7 +38,9 @@
 # endif
 # include <dsn/internal/network.h>
 # include <dsn/internal/factory_store.h>
+# include <dsn/internal/perf_counters.h>
 # include "rpc_engine.h"
+# include "service_engine.h"
 
 # ifdef __TITLE__
 # undef __TITLE__
@@ -47,6 +49,12 @@
 
 namespace dsn 
 {
+    // bytes accounted in the send queues for a message
+    static inline uint64_t get_send_queue_bytes_of(message_ex* msg)
+    {
+        return static_cast<uint64_t>(msg->header->body_length) + sizeof(message_header);
+    }
+
     rpc_session::~rpc_session()
     {
         clear_send_queue(false);
@@ -55,6 +63,8 @@ namespace dsn
             utils::auto_lock<utils::ex_lock_nr> l(_lock);
             dassert(0 == _sending_msgs.size(), "sending queue is not cleared yet");
             dassert(0 == _message_count.load(), "sending queue is not cleared yet");
+            dassert(0 == _message_bytes.load(), "sending queue is not cleared yet");
+            dassert(0 == _held_replies.size(), "sending queue is not cleared yet");
         }
     }
 
@@ -64,6 +74,7 @@ namespace dsn
         if (_connect_state == SS_DISCONNECTED)
         {
             _connect_state = SS_CONNECTING;
+            _connect_start_ns = dsn_now_ns();
             return true;
         }
         else
@@ -78,6 +89,8 @@ namespace dsn
             _connect_state = SS_CONNECTED;
         }
 
+        _net.on_client_session_connected(dsn_now_ns() - _connect_start_ns);
+
         dinfo("client session connected to %s", remote_address().to_string());
     }
 
@@ -101,16 +114,31 @@ namespace dsn
         //
 
         std::vector<message_ex*> swapped_sending_msgs;
+        std::map<uint64_t, message_ex*> swapped_held_replies;
         {
             // protect _sending_msgs and _sending_buffers in lock
             utils::auto_lock<utils::ex_lock_nr> l(_lock);
             _sending_msgs.swap(swapped_sending_msgs);
             _sending_buffers.clear();
+            _held_replies.swap(swapped_held_replies);
+            _message_count.fetch_sub((int)swapped_held_replies.size(), std::memory_order_relaxed);
+        }
+
+        // replies held back are never resent, as their requests come with this session
+        for (auto& kv : swapped_held_replies)
+        {
+            on_send_queue_bytes_removed(get_send_queue_bytes_of(kv.second));
+            kv.second->io_session = nullptr;
+
+            // added in rpc_engine::reply
+            kv.second->release_ref();
         }
 
         // resend pending messages if need
         for (auto& msg : swapped_sending_msgs)
         {
+            on_send_queue_bytes_removed(get_send_queue_bytes_of(msg));
+
             if (resend_msgs)
             {
                 _net.send_message(msg);
@@ -144,6 +172,7 @@ namespace dsn
                         
             auto rmsg = CONTAINING_RECORD(msg, message_ex, dl);            
             rmsg->io_session = nullptr;
+            on_send_queue_bytes_removed(get_send_queue_bytes_of(rmsg));
 
             if (resend_msgs)
             {
@@ -168,6 +197,7 @@ namespace dsn
         auto n = _messages.next();
         int bcount = 0;
         int tlen = 0;
+        uint64_t total_length = 0;
 
         dbg_dassert(0 == _sending_buffers.size(), "");
         dbg_dassert(0 == _sending_msgs.size(), "");
@@ -184,6 +214,7 @@ namespace dsn
             _sending_buffers.resize(bcount + lcount);
             _parser->prepare_buffers_on_send(lmsg, 0, &_sending_buffers[bcount]);
             bcount += lcount;
+            total_length += tlen;
             _sending_msgs.push_back(lmsg);
 
             n = n->next();
@@ -192,6 +223,8 @@ namespace dsn
         
         // added in send_message
         _message_count.fetch_sub((int)_sending_msgs.size(), std::memory_order_relaxed);
+        if (total_length > 0)
+            _net.on_bytes_sent(total_length);
         return _sending_msgs.size() > 0;
     }
     
@@ -238,29 +271,148 @@ namespace dsn
         }
     }
     
-    void rpc_session::send_message(message_ex* msg)
+    bool rpc_session::is_send_queue_full(uint64_t bytes) const
+    {
+        // a message is always allowed into an empty queue so that messages
+        // larger than the byte limits can still be sent out
+        auto max_messages = _net.session_send_queue_max_messages();
+        if (max_messages > 0 && _message_count.load(std::memory_order_relaxed) >= max_messages)
+            return true;
+
+        auto queued = _message_bytes.load(std::memory_order_relaxed);
+        auto max_bytes = _net.session_send_queue_max_bytes();
+        if (max_bytes > 0 && queued > 0 && queued + bytes > max_bytes)
+            return true;
+
+        auto net_queued = _net.send_queue_bytes();
+        auto net_max_bytes = _net.send_queue_max_bytes();
+        if (net_max_bytes > 0 && net_queued > 0 && net_queued + bytes > net_max_bytes)
+            return true;
+
+        return false;
+    }
+
+    // the counter is shared by all client sessions to the same peer, so
+    // the changes are applied instead of this session's own total
+    void rpc_session::on_send_queue_bytes_added(uint64_t bytes)
+    {
+        _message_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        _net.on_send_queue_bytes_added(bytes);
+        if (_message_bytes_counter != nullptr)
+            _message_bytes_counter->add(bytes);
+    }
+
+    void rpc_session::on_send_queue_bytes_removed(uint64_t bytes)
+    {
+        _message_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        _net.on_send_queue_bytes_removed(bytes);
+        if (_message_bytes_counter != nullptr)
+            _message_bytes_counter->subtract(bytes);
+    }
+
+    bool rpc_session::send_message(message_ex* msg)
     {
         //dinfo("%s: rpc_id = %016llx, code = %s", __FUNCTION__, msg->header->rpc_id, msg->header->rpc_name);
+        auto bytes = get_send_queue_bytes_of(msg);
+
+        // only requests are throttled, as replies are for the requests already accepted
+        if (msg->header->context.u.is_request && is_send_queue_full(bytes))
+        {
+            dinfo("rpc request %s (%016llx) to %s is rejected as the send queue is full, "
+                "queued messages = %d, queued bytes = %" PRIu64,
+                msg->header->rpc_name,
+                msg->header->rpc_id,
+                remote_address().to_string(),
+                _message_count.load(std::memory_order_relaxed),
+                _message_bytes.load(std::memory_order_relaxed)
+                );
+            _net.on_send_queue_rejected();
+            return false;
+        }
+
         _message_count.fetch_add(1, std::memory_order_relaxed); // -- in unlink_message
+        on_send_queue_bytes_added(bytes); // -- in on_send_completed, cancel, or clear_send_queue
 
         msg->add_ref(); // released in on_send_completed        
         uint64_t sig;
         {
             utils::auto_lock<utils::ex_lock_nr> l(_lock);
-            msg->dl.insert_before(&_messages);
-            if (SS_CONNECTED == _connect_state && !_is_sending_next)
+            link_message_for_send(msg);
+            if (SS_CONNECTED == _connect_state && !_is_sending_next && unlink_message_for_send())
             {
                 _is_sending_next = true;
                 sig = _message_sent + 1;
-                unlink_message_for_send();
+            }
+            else if (SS_DISCONNECTED != _connect_state || _is_sending_next || !is_reply_ordered())
+            {
+                return true;
             }
             else
             {
-                return;
+                sig = 0;
             }
         }
 
+        // replies to a closed reply-ordered session go nowhere, see release_replies_on_disconnected
+        if (sig == 0)
+        {
+            clear_send_queue(false);
+            return true;
+        }
+
         this->send(sig);
+        return true;
+    }
+
+    void rpc_session::link_message_for_send(message_ex* msg)
+    {
+        if (msg->header->context.u.is_request
+            || !_parser->is_reply_ordered()
+            || SS_DISCONNECTED == _connect_state)
+        {
+            msg->dl.insert_before(&_messages);
+            return;
+        }
+
+        if (msg->header->id != _next_reply_id)
+        {
+            dbg_dassert(msg->header->id > _next_reply_id, "reply %" PRIu64 " is sent twice", msg->header->id);
+            _held_replies[msg->header->id] = msg;
+            return;
+        }
+
+        msg->dl.insert_before(&_messages);
+        ++_next_reply_id;
+
+        // release the replies held back for this one
+        auto it = _held_replies.begin();
+        while (it != _held_replies.end() && it->first == _next_reply_id)
+        {
+            it->second->dl.insert_before(&_messages);
+            ++_next_reply_id;
+            it = _held_replies.erase(it);
+        }
+    }
+
+    void rpc_session::release_replies_on_disconnected(bool is_write)
+    {
+        {
+            utils::auto_lock<utils::ex_lock_nr> l(_lock);
+            _connect_state = SS_DISCONNECTED;
+
+            // nothing is held back any more, as the held replies refer to this session
+            for (auto& kv : _held_replies)
+            {
+                kv.second->dl.insert_before(&_messages);
+            }
+            _held_replies.clear();
+
+            // the sending in flight goes on with the queue, and its failure clears the queue
+            if (_is_sending_next && !is_write)
+                return;
+        }
+
+        clear_send_queue(false);
     }
 
     bool rpc_session::cancel(message_ex* request)
@@ -274,8 +426,11 @@ namespace dsn
                 return false;
 
             request->dl.remove();  
+            _message_count.fetch_sub(1, std::memory_order_relaxed);
         }
 
+        on_send_queue_bytes_removed(get_send_queue_bytes_of(request));
+
         // added in rpc_engine::reply (for server) or rpc_session::send_message (for client)
         request->release_ref();
         request->io_session = nullptr;
@@ -285,6 +440,7 @@ namespace dsn
     void rpc_session::on_send_completed(uint64_t signature)
     {
         uint64_t sig = 0;
+        bool close_after_sent = false;
         {
             utils::auto_lock<utils::ex_lock_nr> l(_lock);
             if (signature != 0)
@@ -302,17 +458,25 @@ namespace dsn
                     return;
                 }
                 
+                uint64_t sent_bytes = 0;
                 for (auto& msg : _sending_msgs)
                 {
+                    sent_bytes += get_send_queue_bytes_of(msg);
+
                     // added in rpc_engine::reply (for server) or rpc_session::send_message (for client)
                     msg->release_ref();
                     _message_sent++;
                 }
+                on_send_queue_bytes_removed(sent_bytes);
                 _sending_msgs.clear();
                 _sending_buffers.clear();
+
+                // the peer is told to close (e.g., 'Connection: close' of http), and the
+                // socket failure then removes the session and clears the send queue
+                close_after_sent = _parser->is_close_after_sent();
             }
             
-            if (!_is_sending_next)
+            if (!close_after_sent && !_is_sending_next)
             {
                 if (unlink_message_for_send())
                 {
@@ -322,11 +486,26 @@ namespace dsn
             }
         }
 
+        if (close_after_sent)
+            close();
+
         // for next send messages
-        if (sig != 0)
+        else if (sig != 0)
             this->send(sig);
     }
 
+    void rpc_session::reply_dropped_request(message_ex* request, error_code err)
+    {
+        if (!is_reply_ordered())
+            return;
+
+        auto resp = request->create_response();
+        resp->header->server.error = err.get();
+        resp->add_ref();
+        send_message(resp);
+        resp->release_ref();
+    }
+
     bool rpc_session::has_pending_out_msgs()
     {
         utils::auto_lock<utils::ex_lock_nr> l(_lock);
@@ -346,11 +525,27 @@ namespace dsn
         _is_client(is_client),
         _matcher(_net.engine()->matcher()),
         _message_count(0),
+        _message_bytes(0),
         _is_sending_next(false),
         _connect_state(is_client ? SS_DISCONNECTED : SS_CONNECTED),
         _message_sent(0),
-        _delay_server_receive_ms(0)
+        _connect_start_ns(0),
+        _delay_server_receive_ms(0),
+        _next_reply_id(1)
     {
+        if (is_client)
+        {
+            // shared by the client sessions to the same remote address
+            std::string name = std::string("send.queue.bytes@") + remote_addr.to_string();
+            _message_bytes_counter = perf_counters::instance().get_counter(
+                _net.node()->name(),
+                "network",
+                name.c_str(),
+                COUNTER_TYPE_NUMBER,
+                "bytes queued or being sent to the remote address",
+                true
+                );
+        }
     }
 
     bool rpc_session::on_disconnected(bool is_write)
@@ -368,7 +563,12 @@ namespace dsn
             _net.on_server_session_disconnected(sp);
         }
 
-        if (is_write)
+        if (is_reply_ordered())
+        {
+            release_replies_on_disconnected(is_write);
+        }
+
+        else if (is_write)
         {
             clear_send_queue(false);
         }
@@ -407,6 +607,35 @@ namespace dsn
             "network", "send_queue_threshold",
             4 * 1024, "send queue size above which throttling is applied"
             );
+        _session_send_queue_max_messages = (int)dsn_config_get_value_uint64(
+            "network", "session_send_queue_max_messages",
+            0, "maximum number of queued messages per session above which new rpc requests are rejected with ERR_CAPACITY_EXCEEDED, 0 for unlimited"
+            );
+        _session_send_queue_max_bytes = dsn_config_get_value_uint64(
+            "network", "session_send_queue_max_bytes",
+            0, "maximum bytes queued or being sent per session above which new rpc requests are rejected with ERR_CAPACITY_EXCEEDED, 0 for unlimited"
+            );
+        _send_queue_max_bytes = dsn_config_get_value_uint64(
+            "network", "send_queue_max_bytes",
+            0, "maximum bytes queued or being sent by all sessions of a network above which new rpc requests are rejected with ERR_CAPACITY_EXCEEDED, 0 for unlimited"
+            );
+        _send_queue_bytes = 0;
+        _send_queue_rejected_counter = perf_counters::instance().get_counter(
+            node()->name(),
+            "network",
+            "send.queue.rejected",
+            COUNTER_TYPE_RATE,
+            "rpc requests rejected per second as the send queues are full",
+            true
+            );
+        _sent_bytes_counter = perf_counters::instance().get_counter(
+            node()->name(),
+            "network",
+            "sent.bytes",
+            COUNTER_TYPE_NUMBER,
+            "bytes on the wire (headers included) sent by the sessions",
+            true
+            );
     }
 
     void network::reset_parser(network_header_format name, int message_buffer_block_size)
@@ -486,7 +715,15 @@ namespace dsn
 
     connection_oriented_network::connection_oriented_network(rpc_engine* srv, network* inner_provider)
         : network(srv, inner_provider)
-    {        
+    {
+        _connect_latency_counter = perf_counters::instance().get_counter(
+            node()->name(),
+            "network",
+            "connect.latency(ns)",
+            COUNTER_TYPE_NUMBER_PERCENTILES,
+            "latency of establishing the client sessions",
+            true
+            );
     }
 
     void connection_oriented_network::inject_drop_message(message_ex* msg, bool is_send)
@@ -513,11 +750,10 @@ namespace dsn
         }
     }
 
-    void connection_oriented_network::send_message(message_ex* request)
+    rpc_session_ptr connection_oriented_network::get_or_create_client_session(::dsn::rpc_address to)
     {
         rpc_session_ptr client = nullptr;
         bool new_client = false;
-        auto& to = request->to_address;
 
         // TODO: thread-local client ptr cache
         {
@@ -551,8 +787,35 @@ namespace dsn
             client->connect();
         }
 
+        return client;
+    }
+
+    void connection_oriented_network::warm_up(::dsn::rpc_address remote)
+    {
+        get_or_create_client_session(remote);
+    }
+
+    void connection_oriented_network::send_message(message_ex* request)
+    {
+        auto client = get_or_create_client_session(request->to_address);
+
         // rpc call
-        client->send_message(request);
+        if (!client->send_message(request))
+        {
+            // fail fast so the caller can throttle instead of waiting for the timeout
+            if (!_engine->matcher()->on_recv_reply(this, request->header->id, nullptr, 0, ERR_CAPACITY_EXCEEDED))
+            {
+                // one-way call, as ref_count for request may be zero
+                request->add_ref();
+                request->release_ref();
+            }
+        }
+    }
+
+    uint64_t connection_oriented_network::get_send_queue_bytes(::dsn::rpc_address remote)
+    {
+        auto client = get_client_session(remote);
+        return client != nullptr ? client->send_queue_bytes() : 0;
     }
 
     rpc_session_ptr connection_oriented_network::get_server_session(::dsn::rpc_address ep)
@@ -632,6 +895,9 @@ namespace dsn
         if (r)
         {
             ddebug("client session %s disconnected (%d in total)", s->remote_address().to_string(), scount);
+
+            if (_engine != nullptr)
+                _engine->on_client_session_disconnected(s->remote_address());
         }
     }
 }
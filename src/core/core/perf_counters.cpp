@@ -151,6 +151,12 @@ perf_counters::perf_counters(void)
         &perf_counters::get_counter_index
         );
 
+    ::dsn::register_command("counter.dump",
+        "counter.dump - get current values of all counters, one per line",
+        "counter.dump [full-name-substring]",
+        &perf_counters::dump_counters
+        );
+
 }
 
 perf_counters::~perf_counters(void)
@@ -448,5 +454,35 @@ std::string perf_counters::get_counter_index(const std::vector<std::string>& arg
     return ss.str();
 }
 
+std::string perf_counters::dump_counters(const std::vector<std::string>& args)
+{
+    return perf_counters::instance().dump_counters_internal(args);
+}
+
+std::string perf_counters::dump_counters_internal(const std::vector<std::string>& args)
+{
+    std::vector<perf_counter_ptr> counters;
+    {
+        utils::auto_read_lock l(_lock);
+        counters.reserve(_counters.size());
+        for (auto& c : _counters)
+        {
+            if (args.empty() || strstr(c.first.c_str(), args[0].c_str()) != nullptr)
+                counters.push_back(c.second);
+        }
+    }
+
+    // one counter per line as 'full-name value', in the order of the full names
+    std::stringstream ss;
+    for (auto& c : counters)
+    {
+        if (c->type() == COUNTER_TYPE_NUMBER_PERCENTILES)
+            ss << c->full_name() << ".p99 " << c->get_percentile(COUNTER_PERCENTILE_99) << "\n";
+        else
+            ss << c->full_name() << " " << c->get_value() << "\n";
+    }
+    return ss.str();
+}
+
 } // end namespace
 
@@ -92,7 +92,7 @@ namespace dsn {
         }
     }
 
-    bool rpc_client_matcher::on_recv_reply(network* net, uint64_t key, message_ex* reply, int delay_ms)
+    bool rpc_client_matcher::on_recv_reply(network* net, uint64_t key, message_ex* reply, int delay_ms, error_code empty_reply_err)
     {       
         rpc_response_task* call;
         task* timeout_task;
@@ -132,7 +132,7 @@ namespace dsn {
         {
             call->set_delay(delay_ms);
             // TODO(qinzuoyan): maybe set err as ERR_NETWORK_FAILURE to differ with ERR_TIMEOUT
-            call->enqueue(ERR_TIMEOUT, reply);
+            call->enqueue(empty_reply_err, reply);
             call->release_ref(); // added in on_call
             return true;
         }
@@ -664,6 +664,25 @@ namespace dsn {
             _node->name(), _local_primary_address.to_string());
 
         _is_running = true;
+
+        // e.g., warm_up_servers = 10.0.0.1:34601, 10.0.0.2:34601
+        std::vector<std::string> server_names;
+        utils::split_args(dsn_config_get_value_string("network", "warm_up_servers", "",
+            "comma-separated host:port list of the servers to be connected in advance at startup"
+            ), server_names, ',');
+        if (!server_names.empty())
+        {
+            std::vector<rpc_address> servers;
+            for (auto& name : server_names)
+            {
+                rpc_address server;
+                if (server.from_string_ipv4(name.c_str()))
+                    servers.push_back(server);
+                else
+                    dwarn("invalid warm up server '%s', should be host:port", name.c_str());
+            }
+            warm_up(servers);
+        }
         return ERR_OK;
     }
 
@@ -748,6 +767,12 @@ namespace dsn {
                 msg->header->rpc_id
                 );
 
+            if (msg->io_session != nullptr)
+            {
+                msg->local_rpc_code = TASK_CODE_INVALID;
+                msg->io_session->reply_dropped_request(msg, ERR_HANDLER_NOT_FOUND);
+            }
+
             dassert(msg->get_count() == 0,
                 "request should not be referenced by anybody so far");
             delete msg;
@@ -772,6 +797,11 @@ namespace dsn {
             // call network failure model
             net->inject_drop_message(msg, false);
 
+            if (msg->io_session != nullptr)
+            {
+                msg->io_session->reply_dropped_request(msg, ERR_TIMEOUT);
+            }
+
             // because (1) initially, the ref count is zero
             //         (2) upper apps may call add_ref already
             tsk->add_ref();
@@ -824,6 +854,66 @@ namespace dsn {
         return;
     }
 
+    uint64_t rpc_engine::get_send_queue_bytes(rpc_address addr)
+    {
+        uint64_t bytes = 0;
+        for (auto& nets : _client_nets)
+        {
+            for (auto& net : nets)
+            {
+                if (net != nullptr)
+                    bytes += net->get_send_queue_bytes(addr);
+            }
+        }
+        return bytes;
+    }
+
+    void rpc_engine::warm_up(const std::vector<rpc_address>& servers)
+    {
+        // rpc calls go through the tcp client network of NET_HDR_DSN by default (see task_spec),
+        // and the connects are non-blocking, so the servers are connected in parallel
+        auto net = _client_nets[NET_HDR_DSN][RPC_CHANNEL_TCP];
+        if (net == nullptr)
+            return;
+
+        for (auto& server : servers)
+        {
+            if (server.type() == HOST_TYPE_IPV4)
+                net->warm_up(server);
+        }
+    }
+
+    dsn_handle_t rpc_engine::register_session_disconnected_handler(dsn_rpc_session_disconnected_handler_t handler, void* context)
+    {
+        auto h = new session_disconnected_handler;
+        h->engine = this;
+        h->callback = handler;
+        h->context = context;
+
+        utils::auto_write_lock l(_session_disconnected_handlers_lock);
+        _session_disconnected_handlers.push_back(h);
+        return h;
+    }
+
+    void rpc_engine::unregister_session_disconnected_handler(dsn_handle_t handle)
+    {
+        auto h = (session_disconnected_handler*)handle;
+        {
+            utils::auto_write_lock l(h->engine->_session_disconnected_handlers_lock);
+            h->engine->_session_disconnected_handlers.remove(h);
+        }
+        delete h;
+    }
+
+    void rpc_engine::on_client_session_disconnected(rpc_address server)
+    {
+        utils::auto_read_lock l(_session_disconnected_handlers_lock);
+        for (auto& h : _session_disconnected_handlers)
+        {
+            h->callback(server.c_addr(), h->context);
+        }
+    }
+
     void rpc_engine::call_ip(rpc_address addr, message_ex* request, rpc_response_task* call, bool reset_request_id, bool set_forwarded)
     {
         dbg_dassert(addr.type() == HOST_TYPE_IPV4, "only IPV4 is now supported");
@@ -929,6 +1019,17 @@ namespace dsn {
                 else
                 {
                     s->net().inject_drop_message(response, true);
+
+                    // reply-ordered sessions cannot skip a reply (see rpc_session::reply_dropped_request),
+                    // so the dropped reply still fills its slot, as an error without body
+                    if (s->is_reply_ordered())
+                    {
+                        response->header->server.error = ERR_TIMEOUT.get();
+                        response->header->body_length = 0;
+                        response->buffers.resize(1);
+                        response->buffers[0] = response->buffers[0].range(0, (int)sizeof(message_header));
+                        s->send_message(response);
+                    }
                 }
             }
 
@@ -39,6 +39,7 @@
 # include <dsn/internal/network.h>
 # include <dsn/internal/synchronize.h>
 # include <dsn/internal/global_config.h>
+# include <list>
 
 namespace dsn {
 
@@ -81,9 +82,12 @@ public:
     //  reply - rpc response message
     //  delay_ms - sometimes we want to delay the delivery of the message for certain purposes
     //
-    // we may receive an empty reply to early terminate the rpc
+    // we may receive an empty reply to early terminate the rpc, in which case the
+    // rpc is completed with empty_reply_err
     //
-    bool on_recv_reply(network* net, uint64_t key, message_ex* reply, int delay_ms);
+    // return false when there is no pending rpc for the key
+    //
+    bool on_recv_reply(network* net, uint64_t key, message_ex* reply, int delay_ms, error_code empty_reply_err = ERR_TIMEOUT);
 
 private:
     friend class rpc_timeout_task;
@@ -157,6 +161,19 @@ public:
     ::dsn::rpc_address primary_address() const { return _local_primary_address; }
     rpc_client_matcher* matcher() { return &_rpc_matcher; }
 
+    // bytes queued in the client networks to the remote address
+    uint64_t get_send_queue_bytes(rpc_address addr);
+
+    // connect to the servers in parallel in advance, see network::warm_up
+    void warm_up(const std::vector<rpc_address>& servers);
+
+    // see dsn_rpc_register_session_disconnected_handler, the handle is released by unregister
+    dsn_handle_t register_session_disconnected_handler(dsn_rpc_session_disconnected_handler_t handler, void* context);
+    static void unregister_session_disconnected_handler(dsn_handle_t handle);
+
+    // called by the client networks when a client session is disconnected
+    void on_client_session_disconnected(rpc_address server);
+
     // call with ip address only
     void call_ip(rpc_address addr, message_ex* request, rpc_response_task* call, bool reset_request_id = false, bool set_forwarded = false);
 
@@ -178,6 +195,15 @@ private:
 
     utils::rw_lock_nr                                    _vnodes_lock;
     std::unordered_map<uint64_t, rpc_server_dispatcher*> _vnodes;
+
+    struct session_disconnected_handler
+    {
+        rpc_engine                             *engine;
+        dsn_rpc_session_disconnected_handler_t callback;
+        void                                   *context;
+    };
+    utils::rw_lock_nr                                    _session_disconnected_handlers_lock;
+    std::list<session_disconnected_handler*>             _session_disconnected_handlers;
     
     volatile bool                 _is_running;
     static bool                   _message_crc_required;
@@ -78,6 +78,16 @@ DSN_API void dsn_msg_write_commit(dsn_message_t msg, size_t size)
     ((::dsn::message_ex*)msg)->write_commit(size);
 }
 
+DSN_API void dsn_msg_write_append(dsn_message_t msg, const void* ptr, size_t size, dsn_message_t owner)
+{
+    dsn_msg_add_ref(owner);
+    std::shared_ptr<char> holder(
+        (char*)ptr,
+        [owner](char*) { dsn_msg_release_ref(owner); }
+        );
+    ((::dsn::message_ex*)msg)->write_append(::dsn::blob(std::move(holder), 0, (int)size));
+}
+
 DSN_API bool dsn_msg_read_next(dsn_message_t msg, void** ptr, size_t* size)
 {
     return ((::dsn::message_ex*)msg)->read_next(ptr, size);
@@ -550,6 +560,20 @@ void message_ex::write_commit(size_t size)
     this->header->body_length += (int)size;
 }
 
+void message_ex::write_append(const ::dsn::blob& data)
+{
+    dassert(!this->_is_read && this->_rw_committed, "there are pending msg write not committed"
+        ", please invoke dsn_msg_write_next and dsn_msg_write_commit in pairs");
+
+    // the next write_next starts a new buffer as the appended one is not in tls_trans_memory
+    this->_rw_index++;
+    this->_rw_offset = data.length();
+    this->buffers.push_back(data);
+    this->header->body_length += data.length();
+
+    dassert(this->_rw_index + 1 == (int)this->buffers.size(), "message write buffer count is not right");
+}
+
 bool message_ex::read_next(void** ptr, size_t* size)
 {
     // printf("%p %s %d\n", this, __FUNCTION__, utils::get_current_tid());
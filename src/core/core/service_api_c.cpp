@@ -684,6 +684,29 @@ DSN_API void dsn_rpc_call_one_way(dsn_address_t server, dsn_message_t request)
     ::dsn::task::get_current_rpc()->call(msg, nullptr);
 }
 
+DSN_API uint64_t dsn_rpc_get_send_queue_bytes(dsn_address_t server)
+{
+    return ::dsn::task::get_current_rpc()->get_send_queue_bytes(::dsn::rpc_address(server));
+}
+
+DSN_API void dsn_rpc_warm_up(const dsn_address_t* servers, int count)
+{
+    std::vector< ::dsn::rpc_address> addrs;
+    for (int i = 0; i < count; i++)
+        addrs.emplace_back(servers[i]);
+    ::dsn::task::get_current_rpc()->warm_up(addrs);
+}
+
+DSN_API dsn_handle_t dsn_rpc_register_session_disconnected_handler(dsn_rpc_session_disconnected_handler_t handler, void* context)
+{
+    return ::dsn::task::get_current_rpc()->register_session_disconnected_handler(handler, context);
+}
+
+DSN_API void dsn_rpc_unregister_session_disconnected_handler(dsn_handle_t handle)
+{
+    ::dsn::rpc_engine::unregister_session_disconnected_handler(handle);
+}
+
 DSN_API void dsn_rpc_reply(dsn_message_t response)
 {
     auto msg = ((::dsn::message_ex*)response);
@@ -1307,6 +1330,12 @@ bool run(const char* config_file, const char* config_arguments, bool sleep_after
         ::dsn::command_manager::instance().start_remote_cli();
     }
 
+    if (dsn_all.config->get_value<bool>("core", "cli_http", true,
+        "whether to serve /metrics and /cli?cmd= on http (NET_HDR_HTTP) ports"))
+    {
+        ::dsn::command_manager::instance().start_http_cli();
+    }
+
     // register local cli commands
     ::dsn::register_command("config-dump",
         "config-dump - dump configuration",
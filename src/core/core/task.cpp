@@ -537,6 +537,22 @@ void rpc_request_task::enqueue()
     task::enqueue(node()->computation()->get_pool(spec().pool_code));
 }
 
+void rpc_request_task::exec()
+{
+    if (0 == _enqueue_ts_ns
+        || dsn_now_ns() - _enqueue_ts_ns < 
+        (uint64_t)_request->header->client.timeout_ms * 1000000ULL)
+    {
+        _handler->run(_request);
+    }
+
+    // dropped as timeout before execution
+    else if (_request->io_session != nullptr)
+    {
+        _request->io_session->reply_dropped_request(_request, ERR_TIMEOUT);
+    }
+}
+
 rpc_response_task::rpc_response_task(
     message_ex* request, 
     dsn_rpc_response_handler_t cb,
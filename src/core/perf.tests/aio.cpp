@@ -26,7 +26,8 @@
 
 /*
  * Description:
- *     Disk IO performance test
+ *     Disk IO performance test, including the append latency and page cache
+ *     footprint of direct io
  *
  * Revision history:
  *     2016-01-05, Tianyi Wang, first version
@@ -40,6 +41,12 @@
 #include "test_utils.h"
 #include <boost/lexical_cast.hpp>
 
+#ifdef __linux__
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 DEFINE_TASK_CODE_AIO(LPC_AIO_TEST, TASK_PRIORITY_COMMON, THREAD_POOL_TEST_SERVER)
 void aio_testcase(uint64_t block_size, size_t concurrency, bool is_write, bool random_offset)
 {
@@ -118,4 +125,85 @@ TEST(core, aio_perf_test)
             }
         }
     }
-}
\ No newline at end of file
+}
+// page cache footprint (MB) of the given file
+static double page_cache_mb(const char* path)
+{
+#ifdef __linux__
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    off_t size = ::lseek(fd, 0, SEEK_END);
+    void* addr = size > 0 ? ::mmap(nullptr, (size_t)size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    double mb = -1;
+    if (addr != MAP_FAILED)
+    {
+        size_t page_size = (size_t)::sysconf(_SC_PAGESIZE);
+        std::vector<unsigned char> pages(((size_t)size + page_size - 1) / page_size);
+        if (::mincore(addr, (size_t)size, &pages[0]) == 0)
+        {
+            size_t resident = 0;
+            for (auto p : pages)
+                resident += (p & 1);
+            mb = double(resident * page_size) / 1024 / 1024;
+        }
+        ::munmap(addr, (size_t)size);
+    }
+    ::close(fd);
+    return mb;
+#else
+    return -1;
+#endif
+}
+
+// sequential appends one by one, as log writes do
+void aio_direct_io_testcase(int block_size, bool direct_io)
+{
+    std::chrono::steady_clock clock;
+    std::unique_ptr<char[]> buffer(new char[block_size]);
+    memset(buffer.get(), 'x', block_size);
+    utils::filesystem::remove_path("temp_direct");
+
+    auto file_handle = dsn_file_open("temp_direct", O_CREAT | O_RDWR | (direct_io ? DSN_FILE_DIRECT_IO : 0), 0666);
+    const int64_t total_size_bytes = 64 * 1024 * 1024;
+    int64_t count = total_size_bytes / block_size;
+    std::vector<int64_t> latencies;
+    latencies.reserve((size_t)count);
+
+    for (int64_t i = 0; i < count; i++)
+    {
+        auto tic = clock.now();
+        auto t = file::write(file_handle, buffer.get(), block_size, (uint64_t)(i * block_size), LPC_AIO_TEST, nullptr, dsn::empty_callback);
+        t->wait();
+        dassert(t->error() == ERR_OK, "write failed, err = %s", t->error().to_string());
+        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(clock.now() - tic).count());
+    }
+    dsn_file_flush(file_handle);
+    dsn_file_close(file_handle);
+
+    std::sort(latencies.begin(), latencies.end());
+    int64_t total = 0;
+    for (auto l : latencies)
+        total += l;
+
+    std::cout << "direct_io = " << direct_io
+        << " block_size = " << block_size
+        << " avg latency = " << total / count << " us"
+        << " p99 latency = " << latencies[(size_t)(count * 99 / 100)] << " us"
+        << " page cache = " << page_cache_mb("temp_direct") << " MB"
+        << std::endl;
+
+    utils::filesystem::remove_path("temp_direct");
+}
+
+TEST(core, aio_direct_io_perf_test)
+{
+    // unaligned sizes need the head block from the cache and padding
+    for (auto block_size : { 1000, 4096, 64 * 1024 })
+    {
+        for (auto direct_io : { false, true })
+        {
+            aio_direct_io_testcase(block_size, direct_io);
+        }
+    }
+}
@@ -0,0 +1,122 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Http performance test, many concurrent keep-alive connections with
+ *     pipelined requests against the NET_HDR_HTTP port of the test server
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <gtest/gtest.h>
+# include <dsn/service_api_cpp.h>
+# include <boost/asio.hpp>
+# include "test_utils.h"
+# include <chrono>
+# include <thread>
+# include <atomic>
+
+// see [apps.server] in config-test.ini
+static const char* http_test_port = "20102";
+
+// send 'pipeline' requests at a time and wait for all their replies, return the replies received
+static int http_keep_alive_connection(int request_count, int pipeline)
+{
+    using boost::asio::ip::tcp;
+
+    boost::asio::io_service ios;
+    tcp::socket socket(ios);
+    boost::asio::connect(socket, tcp::resolver(ios).resolve(tcp::resolver::query("localhost", http_test_port)));
+
+    // RPC_TEST_HASH takes an int as the request
+    std::string request("POST /RPC_TEST_HASH HTTP/1.1\r\nHost: localhost\r\nContent-Length: 4\r\n\r\n");
+    request.append(4, '\0');
+
+    std::string requests;
+    for (int i = 0; i < pipeline; i++)
+        requests.append(request);
+
+    boost::asio::streambuf response;
+    int replied = 0;
+    while (replied < request_count)
+    {
+        boost::asio::write(socket, boost::asio::buffer(requests));
+
+        for (int i = 0; i < pipeline; i++)
+        {
+            auto header_length = boost::asio::read_until(socket, response, "\r\n\r\n");
+            std::string header(boost::asio::buffers_begin(response.data()), boost::asio::buffers_begin(response.data()) + header_length);
+            response.consume(header_length);
+
+            auto pos = header.find("Content-Length: ");
+            if (header.compare(0, 12, "HTTP/1.1 200") != 0 || pos == std::string::npos)
+                return replied;
+
+            size_t body_length = (size_t)atoi(header.c_str() + pos + strlen("Content-Length: "));
+            if (response.size() < body_length)
+                boost::asio::read(socket, response, boost::asio::transfer_exactly(body_length - response.size()));
+            response.consume(body_length);
+            replied++;
+        }
+    }
+    return replied;
+}
+
+TEST(core, http_keep_alive_perf_test)
+{
+    for (auto connection_count : { 1, 16, 128 })
+    {
+        for (auto pipeline : { 1, 16 })
+        {
+            const int request_count_per_connection = 200000 / connection_count / pipeline * pipeline;
+            std::atomic<int> replied(0);
+            std::vector<std::thread> connections;
+
+            std::chrono::steady_clock clock;
+            auto tic = clock.now();
+            for (int i = 0; i < connection_count; i++)
+            {
+                connections.emplace_back([&]()
+                {
+                    replied += http_keep_alive_connection(request_count_per_connection, pipeline);
+                });
+            }
+            for (auto& c : connections)
+                c.join();
+            auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - tic).count();
+
+            EXPECT_EQ(request_count_per_connection * connection_count, replied.load());
+            std::cout << "http keep-alive perf test: connections = " << connection_count
+                << ", pipeline = " << pipeline
+                << ", requests = " << replied.load()
+                << ", throughput = " << replied.load() * 1000 / (duration_ms + 1)
+                << " #/s" << std::endl;
+        }
+    }
+}
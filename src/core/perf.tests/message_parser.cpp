@@ -0,0 +1,112 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Message parser performance test, comparing encode/decode cost and
+ *     bytes on the wire of the dsn header (full and compact when batched)
+ *     and thrift compact framing
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <gtest/gtest.h>
+# include <dsn/service_api_cpp.h>
+# include <dsn/internal/message_parser.h>
+# include "../tools/common/thrift_message_parser.h"
+# include "test_utils.h"
+# include <chrono>
+
+DEFINE_TASK_CODE_RPC(RPC_PERF_TEST_PREPARE, TASK_PRIORITY_COMMON, THREAD_POOL_TEST_SERVER)
+
+static void message_parser_perf_test(const char* name, message_parser& writer, message_parser& reader, int body_size)
+{
+    const int round = 100000;
+    message_ex* msg = message_ex::create_request(RPC_PERF_TEST_PREPARE, 0, 0);
+    ::marshall(msg, std::string(body_size, 'x'));
+    msg->seal(false);
+
+    // the first message on a connection, which always goes with the full header
+    int total_length;
+    int count = writer.get_send_buffers_count_and_total_length(msg, &total_length);
+    std::vector<message_parser::send_buf> buffers(count);
+    writer.prepare_buffers_on_send(msg, 0, &buffers[0]);
+
+    std::string data;
+    for (auto& buf : buffers)
+        data.append((const char*)buf.buf, buf.sz);
+
+    // encode, where the following small messages may be batched with compact headers
+    std::chrono::steady_clock clock;
+    auto tic = clock.now();
+    for (int i = 0; i < round; i++)
+    {
+        count = writer.get_send_buffers_count_and_total_length(msg, &total_length);
+        buffers.resize(count);
+        writer.prepare_buffers_on_send(msg, 0, &buffers[0]);
+    }
+    auto encode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock.now() - tic).count();
+
+    // decode
+    tic = clock.now();
+    for (int i = 0; i < round; i++)
+    {
+        int read_next;
+        void* ptr = reader.read_buffer_ptr((int)data.size());
+        memcpy(ptr, data.data(), data.size());
+        message_ex* recv = reader.get_message_on_receive((int)data.size(), read_next);
+        dassert(recv != nullptr, "decode failed");
+        delete recv;
+    }
+    auto decode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock.now() - tic).count();
+
+    std::cout << "message parser perf test: " << name
+        << ", body = " << msg->body_size()
+        << " bytes, wire = " << data.size()
+        << " bytes, wire (batched) = " << total_length
+        << " bytes, encode = " << encode_ns / round
+        << " ns, decode (with copy-in) = " << decode_ns / round
+        << " ns" << std::endl;
+
+    delete msg;
+}
+
+TEST(core, message_parser_perf_test)
+{
+    // from small client writes to prepares carrying batched mutations
+    for (auto body_size : { 32, 256, 1024, 4096, 65536 })
+    {
+        dsn_message_parser dsn_writer(1024 * 64, true);
+        dsn_message_parser dsn_reader(1024 * 64, false);
+        message_parser_perf_test("dsn", dsn_writer, dsn_reader, body_size);
+
+        thrift_compact_message_parser thrift_writer(1024 * 64, true);
+        thrift_compact_message_parser thrift_reader(1024 * 64, false);
+        message_parser_perf_test("thrift-compact", thrift_writer, thrift_reader, body_size);
+    }
+}
@@ -210,3 +210,91 @@ TEST(core, operation_failed)
 
     EXPECT_TRUE(utils::filesystem::remove_path("tmp_test_file"));
 }
+
+TEST(core, aio_direct_io)
+{
+    // if in dsn_mimic_app() and disk_io_mode == IOE_PER_QUEUE
+    if (task::get_current_disk() == nullptr) return;
+
+    const char* buffer = "hello, direct io world";
+    int len = (int)strlen(buffer);
+    std::string expected;
+
+    auto fp = dsn_file_open("tmp_direct", O_RDWR | O_CREAT | O_TRUNC | O_BINARY | DSN_FILE_DIRECT_IO, 0666);
+    ASSERT_TRUE(fp != nullptr);
+
+    // unaligned appends, which are batched and padded
+    std::list<task_ptr> tasks;
+    uint64_t offset = 0;
+    for (int i = 0; i < 1000; i++)
+    {
+        tasks.push_back(::dsn::file::write(fp, buffer, len, offset, LPC_AIO_TEST, nullptr, dsn::empty_callback));
+        expected.append(buffer, len);
+        offset += len;
+    }
+    for (auto& t : tasks)
+    {
+        t->wait();
+        EXPECT_EQ(ERR_OK, t->error());
+        EXPECT_EQ((size_t)len, t->io_size());
+    }
+
+    // vector write across the aligned blocks
+    dsn_file_buffer_t buffers[300];
+    for (auto& b : buffers)
+    {
+        b.buffer = reinterpret_cast<void*>(const_cast<char*>(buffer));
+        b.size = len;
+        expected.append(buffer, len);
+    }
+    auto t = ::dsn::file::write_vector(fp, buffers, 300, offset, LPC_AIO_TEST, nullptr, dsn::empty_callback);
+    t->wait();
+    EXPECT_EQ(ERR_OK, t->error());
+    EXPECT_EQ((size_t)(300 * len), t->io_size());
+    offset += 300 * len;
+
+    // unaligned reads with the same handle
+    std::unique_ptr<char[]> buffer2(new char[5000]);
+    for (uint64_t read_offset : { (uint64_t)0, (uint64_t)1, (uint64_t)4095, (uint64_t)5000, offset - 100 })
+    {
+        t = ::dsn::file::read(fp, buffer2.get(), 5000, read_offset, LPC_AIO_TEST, nullptr, dsn::empty_callback);
+        t->wait();
+        EXPECT_EQ(ERR_OK, t->error());
+        size_t sz = std::min((size_t)5000, (size_t)(offset - read_offset));
+        EXPECT_EQ(sz, t->io_size());
+        EXPECT_TRUE(memcmp(expected.data() + read_offset, buffer2.get(), sz) == 0);
+    }
+
+    t = ::dsn::file::read(fp, buffer2.get(), 100, offset + 5000, LPC_AIO_TEST, nullptr, dsn::empty_callback);
+    t->wait();
+    EXPECT_EQ(ERR_HANDLE_EOF, t->error());
+
+    EXPECT_EQ(ERR_OK, dsn_file_close(fp));
+
+    // the padding is trimmed on close
+    int64_t file_size;
+    ASSERT_TRUE(utils::filesystem::file_size("tmp_direct", file_size));
+    EXPECT_EQ((int64_t)offset, file_size);
+
+    // append to the existing file, where the head block is read back
+    fp = dsn_file_open("tmp_direct", O_RDWR | O_BINARY | DSN_FILE_DIRECT_IO, 0);
+    ASSERT_TRUE(fp != nullptr);
+    t = ::dsn::file::write(fp, buffer, len, offset, LPC_AIO_TEST, nullptr, dsn::empty_callback);
+    t->wait();
+    EXPECT_EQ(ERR_OK, t->error());
+    expected.append(buffer, len);
+    offset += len;
+    EXPECT_EQ(ERR_OK, dsn_file_close(fp));
+
+    // verify with buffered io
+    fp = dsn_file_open("tmp_direct", O_RDONLY | O_BINARY, 0);
+    ASSERT_TRUE(fp != nullptr);
+    std::unique_ptr<char[]> content(new char[offset]);
+    t = ::dsn::file::read(fp, content.get(), (int)offset, 0, LPC_AIO_TEST, nullptr, dsn::empty_callback);
+    t->wait();
+    EXPECT_EQ(offset, (uint64_t)t->io_size());
+    EXPECT_TRUE(memcmp(expected.data(), content.get(), offset) == 0);
+    EXPECT_EQ(ERR_OK, dsn_file_close(fp));
+
+    utils::filesystem::remove_path("tmp_direct");
+}
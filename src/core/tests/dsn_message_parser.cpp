@@ -0,0 +1,151 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for dsn message parser with batched (compact) messages.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <dsn/service_api_cpp.h>
+# include <dsn/internal/rpc_message.h>
+# include <dsn/internal/message_parser.h>
+# include <gtest/gtest.h>
+
+using namespace ::dsn;
+
+DEFINE_TASK_CODE_RPC(RPC_CODE_FOR_BATCH_TEST, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+DEFINE_TASK_CODE_RPC(RPC_CODE_FOR_BATCH_TEST_2, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+static std::string dsn_encode(message_parser& writer, message_ex* msg)
+{
+    int total_length;
+    int count = writer.get_send_buffers_count_and_total_length(msg, &total_length);
+
+    std::vector<message_parser::send_buf> buffers(count);
+    EXPECT_EQ(count, writer.prepare_buffers_on_send(msg, 0, &buffers[0]));
+
+    std::string data;
+    for (auto& buf : buffers)
+        data.append((const char*)buf.buf, buf.sz);
+    EXPECT_EQ((size_t)total_length, data.size());
+    return data;
+}
+
+TEST(core, dsn_message_parser_batching)
+{
+    dsn_message_parser writer(4096, true);
+    dsn_message_parser reader(4096, false);
+
+    message_ex* msgs[3];
+    std::string data;
+    for (int i = 0; i < 3; i++)
+    {
+        msgs[i] = message_ex::create_request(RPC_CODE_FOR_BATCH_TEST, 0, i);
+        ::marshall(msgs[i], std::string("value ") + std::to_string(i));
+        data += dsn_encode(writer, msgs[i]);
+    }
+
+    // one full header, and compact ones for the rest
+    size_t body_length = msgs[0]->header->body_length;
+    ASSERT_EQ(3 * body_length + sizeof(message_header) + 2 * sizeof(dsn_message_parser::compact_message_header), data.size());
+
+    // the peer's rpc codes are unknown yet, so other codes go with full headers
+    message_ex* other = message_ex::create_request(RPC_CODE_FOR_BATCH_TEST_2, 0, 0);
+    ::marshall(other, std::string("other"));
+    int total_length;
+    writer.get_send_buffers_count_and_total_length(other, &total_length);
+    ASSERT_EQ(other->header->body_length + sizeof(message_header), (size_t)total_length);
+    delete other;
+
+    // unpacked into ordinary messages, the last one split across reads
+    int read_next;
+    void* ptr = reader.read_buffer_ptr((int)data.size() - 3);
+    memcpy(ptr, data.data(), data.size() - 3);
+    message_ex* recvs[3];
+    recvs[0] = reader.get_message_on_receive((int)data.size() - 3, read_next);
+    recvs[1] = reader.get_message_on_receive(0, read_next);
+    ASSERT_EQ(nullptr, reader.get_message_on_receive(0, read_next));
+    ptr = reader.read_buffer_ptr(3);
+    memcpy(ptr, data.data() + data.size() - 3, 3);
+    recvs[2] = reader.get_message_on_receive(3, read_next);
+
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_NE(nullptr, recvs[i]);
+        ASSERT_STREQ(msgs[i]->header->rpc_name, recvs[i]->header->rpc_name);
+        ASSERT_EQ(msgs[i]->header->id, recvs[i]->header->id);
+        ASSERT_EQ(i, recvs[i]->header->client.hash);
+        ASSERT_EQ(msgs[i]->header->context.context, recvs[i]->header->context.context);
+        ASSERT_EQ(msgs[i]->header->client.timeout_ms, recvs[i]->header->client.timeout_ms);
+
+        std::string body;
+        ::unmarshall((dsn_message_t)recvs[i], body);
+        ASSERT_EQ(std::string("value ") + std::to_string(i), body);
+
+        delete msgs[i];
+        delete recvs[i];
+    }
+}
+
+TEST(core, dsn_message_parser_inconsistent_rpc_codes)
+{
+    dsn_message_parser writer(4096, true);
+    dsn_message_parser reader(4096, false);
+
+    message_ex* msgs[2];
+    std::string data;
+    for (int i = 0; i < 2; i++)
+    {
+        msgs[i] = message_ex::create_request(RPC_CODE_FOR_BATCH_TEST, 0, i);
+        ::marshall(msgs[i], std::string("value ") + std::to_string(i));
+        data += dsn_encode(writer, msgs[i]);
+    }
+
+    // the peer has other rpc codes, and its compact message carries another code
+    size_t body_length = msgs[0]->header->body_length;
+    auto hdr = (message_header*)&data[0];
+    hdr->rpc_name_fast.local_hash = message_ex::s_local_hash + 1;
+    auto chdr = (dsn_message_parser::compact_message_header*)&data[sizeof(message_header) + body_length];
+    chdr->rpc_code = hdr->rpc_name_fast.local_rpc_id + 1;
+
+    // the compact message is dropped and the session is to be closed, instead of a crash
+    int read_next;
+    void* ptr = reader.read_buffer_ptr((int)data.size());
+    memcpy(ptr, data.data(), data.size());
+    message_ex* recv = reader.get_message_on_receive((int)data.size(), read_next);
+    ASSERT_NE(nullptr, recv);
+    ASSERT_EQ(msgs[0]->header->id, recv->header->id);
+    ASSERT_EQ(nullptr, reader.get_message_on_receive(0, read_next));
+    ASSERT_EQ(-1, read_next);
+
+    delete msgs[0];
+    delete msgs[1];
+    delete recv;
+}
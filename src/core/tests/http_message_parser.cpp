@@ -0,0 +1,126 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for http message parser.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <dsn/service_api_cpp.h>
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include "../tools/common/http_message_parser.h"
+
+using namespace ::dsn;
+
+static message_ex* http_decode(message_parser& reader, const std::string& data)
+{
+    int read_next;
+    void* ptr = reader.read_buffer_ptr((int)data.size());
+    memcpy(ptr, data.data(), data.size());
+    return reader.get_message_on_receive((int)data.size(), read_next);
+}
+
+static std::string http_encode(message_parser& writer, message_ex* msg)
+{
+    int total_length;
+    int count = writer.get_send_buffers_count_and_total_length(msg, &total_length);
+
+    std::vector<message_parser::send_buf> buffers(count);
+    EXPECT_EQ(count, writer.prepare_buffers_on_send(msg, 0, &buffers[0]));
+
+    std::string data;
+    for (auto& buf : buffers)
+        data.append((const char*)buf.buf, buf.sz);
+    EXPECT_EQ((size_t)total_length, data.size());
+    return data;
+}
+
+static std::string http_body(message_ex* msg)
+{
+    return std::string((const char*)msg->buffers[0].data(), msg->body_size());
+}
+
+TEST(tools_common, http_message_parser)
+{
+    http_message_parser parser(4096, false);
+
+    // two pipelined requests, the second one split across reads
+    std::string data =
+        "POST /RPC_HTTP_TEST/3 HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello"
+        "GET /cli?cmd=help HTTP/1.0\r\n\r\n";
+    message_ex* req1 = http_decode(parser, data.substr(0, data.size() - 5));
+    ASSERT_NE(nullptr, req1);
+    ASSERT_STREQ("RPC_HTTP_TEST", req1->header->rpc_name);
+    ASSERT_EQ(3, req1->header->client.hash);
+    ASSERT_EQ(1u, req1->header->id);
+    ASSERT_EQ("hello", http_body(req1));
+
+    int read_next;
+    ASSERT_EQ(nullptr, parser.get_message_on_receive(0, read_next));
+    message_ex* req2 = http_decode(parser, data.substr(data.size() - 5));
+    ASSERT_NE(nullptr, req2);
+    ASSERT_STREQ("cli", req2->header->rpc_name);
+    ASSERT_EQ(2u, req2->header->id);
+    ASSERT_EQ("cmd=help", http_body(req2));
+
+    // http/1.1 reply with multiple buffers is chunked
+    {
+        message_ex* resp = req1->create_response();
+        ::marshall((dsn_message_t)resp, std::string("world"));
+        resp->buffers.push_back(blob("!", 0, 1));
+        resp->header->body_length += 1;
+
+        std::string reply = http_encode(parser, resp);
+        ASSERT_EQ(0u, reply.find("HTTP/1.1 200 OK\r\n"));
+        ASSERT_NE(std::string::npos, reply.find("Transfer-Encoding: chunked\r\n"));
+        ASSERT_EQ(std::string::npos, reply.find("Connection: close"));
+        ASSERT_EQ(std::string("\r\n1\r\n!\r\n0\r\n\r\n"), reply.substr(reply.size() - 13));
+        ASSERT_FALSE(parser.is_close_after_sent());
+        delete resp;
+    }
+
+    // http/1.0 reply of an error, with the error name as the body
+    {
+        message_ex* resp = req2->create_response();
+        resp->header->server.error = ERR_HANDLER_NOT_FOUND.get();
+
+        std::string reply = http_encode(parser, resp);
+        ASSERT_EQ(0u, reply.find("HTTP/1.1 404 Not Found\r\n"));
+        ASSERT_NE(std::string::npos, reply.find("Connection: close\r\n"));
+        std::string body(ERR_HANDLER_NOT_FOUND.to_string());
+        ASSERT_EQ("\r\n\r\n" + body, reply.substr(reply.size() - body.size() - 4));
+        ASSERT_TRUE(parser.is_close_after_sent());
+        delete resp;
+    }
+
+    delete req1;
+    delete req2;
+}
@@ -218,3 +218,118 @@ TEST(tools_common, sim_net_provider)
 
     TEST_PORT++;
 }
+
+class send_queue_limited_network : public sim_network_provider
+{
+public:
+    send_queue_limited_network(rpc_engine* rpc, int max_messages, uint64_t max_bytes)
+        : sim_network_provider(rpc, nullptr)
+    {
+        _session_send_queue_max_messages = max_messages;
+        _session_send_queue_max_bytes = max_bytes;
+    }
+};
+
+static message_ex* create_send_queue_test_request()
+{
+    message_ex* msg = message_ex::create_request(RPC_TEST_NETPROVIDER, 0, 0);
+    ::marshall(msg, std::string("hello world"));
+    return msg;
+}
+
+TEST(tools_common, rpc_session_send_queue_limits)
+{
+    message_ex* msgs[3];
+    for (auto& msg : msgs)
+        msg = create_send_queue_test_request();
+    uint64_t bytes = msgs[0]->header->body_length + sizeof(message_header);
+
+    // message count limit
+    {
+        send_queue_limited_network net(task::get_current_rpc(), 2, 0);
+
+        // never connected, so the messages stay in the send queue
+        rpc_session_ptr session = net.create_client_session(rpc_address("localhost", TEST_PORT));
+        ASSERT_TRUE(session->send_message(msgs[0]));
+        ASSERT_TRUE(session->send_message(msgs[1]));
+        ASSERT_FALSE(session->send_message(msgs[2]));
+        ASSERT_EQ(2 * bytes, session->send_queue_bytes());
+        ASSERT_EQ(2 * bytes, net.send_queue_bytes());
+
+        // rejected message is not referenced by the session
+        ASSERT_EQ(0, msgs[2]->get_count());
+        delete msgs[2];
+
+        // queued messages are released together with the session
+        session = nullptr;
+        ASSERT_EQ(0u, net.send_queue_bytes());
+    }
+
+    for (auto& msg : msgs)
+        msg = create_send_queue_test_request();
+
+    // byte limit, the first message is always accepted
+    {
+        send_queue_limited_network net(task::get_current_rpc(), 0, bytes / 2);
+
+        rpc_session_ptr session = net.create_client_session(rpc_address("localhost", TEST_PORT));
+        ASSERT_TRUE(session->send_message(msgs[0]));
+        ASSERT_FALSE(session->send_message(msgs[1]));
+        ASSERT_FALSE(session->send_message(msgs[2]));
+        ASSERT_EQ(bytes, session->send_queue_bytes());
+
+        delete msgs[1];
+        delete msgs[2];
+
+        session = nullptr;
+        ASSERT_EQ(0u, net.send_queue_bytes());
+    }
+}
+
+TEST(tools_common, network_warm_up)
+{
+    if (dsn::service_engine::fast_instance().spec().semaphore_factory_name == "dsn::tools::sim_semaphore_provider")
+        return;
+
+    sim_network_provider* sim_net = new sim_network_provider(task::get_current_rpc(), nullptr);
+    io_modifer modifer;
+    modifer.mode = IOE_PER_NODE;
+    modifer.queue = nullptr;
+    ASSERT_EQ(ERR_OK, sim_net->start(RPC_CHANNEL_TCP, TEST_PORT, false, modifer));
+
+    // session is created (and connected) in advance, and reused by later warm-ups and calls
+    rpc_address server("localhost", TEST_PORT);
+    ASSERT_EQ(nullptr, sim_net->get_client_session(server));
+    sim_net->warm_up(server);
+    rpc_session_ptr session = sim_net->get_client_session(server);
+    ASSERT_NE(nullptr, session);
+    sim_net->warm_up(server);
+    ASSERT_EQ(session.get(), sim_net->get_client_session(server).get());
+
+    // the registered handlers are told of the disconnected sessions, so as to warm up again
+    std::vector<rpc_address> disconnected;
+    dsn_handle_t handle = dsn_rpc_register_session_disconnected_handler(
+        [](dsn_address_t addr, void* context)
+        {
+            ((std::vector<rpc_address>*)context)->push_back(rpc_address(addr));
+        },
+        &disconnected
+        );
+    sim_net->on_client_session_disconnected(session);
+    ASSERT_EQ(1u, disconnected.size());
+    ASSERT_EQ(server, disconnected[0]);
+    ASSERT_EQ(nullptr, sim_net->get_client_session(server));
+
+    sim_net->warm_up(server);
+    rpc_session_ptr session2 = sim_net->get_client_session(server);
+    ASSERT_NE(nullptr, session2);
+    ASSERT_NE(session.get(), session2.get());
+
+    // not told after unregistered, nor for the sessions already removed
+    dsn_rpc_unregister_session_disconnected_handler(handle);
+    sim_net->on_client_session_disconnected(session);
+    sim_net->on_client_session_disconnected(session2);
+    ASSERT_EQ(1u, disconnected.size());
+
+    TEST_PORT++;
+}
@@ -0,0 +1,176 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for thrift compact message parser.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <dsn/service_api_cpp.h>
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include "../tools/common/thrift_message_parser.h"
+
+using namespace ::dsn;
+
+DEFINE_TASK_CODE_RPC(RPC_CODE_FOR_THRIFT_TEST, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+static std::string thrift_encode(message_parser& writer, message_ex* msg)
+{
+    int total_length;
+    int count = writer.get_send_buffers_count_and_total_length(msg, &total_length);
+
+    std::vector<message_parser::send_buf> buffers(count);
+    EXPECT_EQ(count, writer.prepare_buffers_on_send(msg, 0, &buffers[0]));
+
+    std::string data;
+    for (auto& buf : buffers)
+        data.append((const char*)buf.buf, buf.sz);
+    EXPECT_EQ((size_t)total_length, data.size());
+    return data;
+}
+
+static message_ex* thrift_decode(message_parser& reader, const std::string& data)
+{
+    int read_next;
+    void* ptr = reader.read_buffer_ptr((int)data.size());
+    memcpy(ptr, data.data(), data.size());
+    return reader.get_message_on_receive((int)data.size(), read_next);
+}
+
+static message_ex* create_thrift_test_message(const std::string& body, bool is_request)
+{
+    message_ex* msg = message_ex::create_request(RPC_CODE_FOR_THRIFT_TEST, 0, 0);
+    ::marshall(msg, body);
+    if (!is_request)
+    {
+        msg->header->context.u.is_request = false;
+        strncat(msg->header->rpc_name, "_ACK", sizeof(msg->header->rpc_name) - 1);
+    }
+    return msg;
+}
+
+TEST(tools_common, thrift_compact_message_parser)
+{
+    thrift_compact_message_parser writer(4096, true);
+    thrift_compact_message_parser reader(4096, false);
+    const char* rpc_name = dsn_task_code_to_string(RPC_CODE_FOR_THRIFT_TEST);
+
+    // request
+    {
+        message_ex* msg = create_thrift_test_message("hello thrift", true);
+        std::string data = thrift_encode(writer, msg);
+
+        // framed transport and compact protocol message begin
+        ASSERT_EQ(data.size() - 4, ((uint32_t)(uint8_t)data[2] << 8) | (uint8_t)data[3]);
+        ASSERT_EQ((char)0x82, data[4]);
+        ASSERT_EQ((char)0x21, data[5]);
+
+        // partial frame first
+        int read_next;
+        void* ptr = reader.read_buffer_ptr(3);
+        memcpy(ptr, data.data(), 3);
+        ASSERT_EQ(nullptr, reader.get_message_on_receive(3, read_next));
+        ASSERT_EQ(1, read_next);
+        message_ex* recv = thrift_decode(reader, data.substr(3));
+        ASSERT_NE(nullptr, recv);
+
+        ASSERT_STREQ(rpc_name, recv->header->rpc_name);
+        ASSERT_EQ((uint32_t)msg->header->id, recv->header->id);
+        ASSERT_TRUE(recv->header->context.u.is_request);
+        ASSERT_EQ(msg->header->body_length, recv->header->body_length);
+
+        std::string body;
+        ::unmarshall((dsn_message_t)recv, body);
+        ASSERT_EQ("hello thrift", body);
+
+        delete msg;
+        delete recv;
+    }
+
+    // reply carries the name of the call, two frames in one read
+    {
+        message_ex* msg1 = create_thrift_test_message("reply 1", false);
+        message_ex* msg2 = create_thrift_test_message("reply 2", false);
+        std::string data = thrift_encode(writer, msg1) + thrift_encode(writer, msg2);
+
+        int read_next;
+        message_ex* recv1 = thrift_decode(reader, data);
+        message_ex* recv2 = reader.get_message_on_receive(0, read_next);
+        ASSERT_NE(nullptr, recv1);
+        ASSERT_NE(nullptr, recv2);
+        ASSERT_EQ(nullptr, reader.get_message_on_receive(0, read_next));
+
+        ASSERT_STREQ(rpc_name, recv1->header->rpc_name);
+        ASSERT_FALSE(recv1->header->context.u.is_request);
+        ASSERT_EQ((uint32_t)msg2->header->id, recv2->header->id);
+
+        std::string body;
+        ::unmarshall((dsn_message_t)recv2, body);
+        ASSERT_EQ("reply 2", body);
+
+        delete msg1;
+        delete msg2;
+        delete recv1;
+        delete recv2;
+    }
+
+    // error reply without body is sent as exception
+    {
+        message_ex* msg = message_ex::create_request(RPC_CODE_FOR_THRIFT_TEST, 0, 0);
+        msg->header->context.u.is_request = false;
+        msg->header->server.error = ERR_HANDLER_NOT_FOUND.get();
+
+        std::string data = thrift_encode(writer, msg);
+        ASSERT_EQ((char)0x61, data[5]);
+
+        message_ex* recv = thrift_decode(reader, data);
+        ASSERT_NE(nullptr, recv);
+        ASSERT_EQ(ERR_HANDLER_NOT_FOUND, recv->error());
+
+        delete msg;
+        delete recv;
+    }
+
+    // malformed frame is skipped
+    {
+        message_ex* msg = create_thrift_test_message("after garbage", true);
+        std::string garbage("\0\0\0\3\x80\x01\x00", 7);
+        message_ex* recv = thrift_decode(reader, garbage + thrift_encode(writer, msg));
+        ASSERT_NE(nullptr, recv);
+
+        std::string body;
+        ::unmarshall((dsn_message_t)recv, body);
+        ASSERT_EQ("after garbage", body);
+
+        delete msg;
+        delete recv;
+    }
+}
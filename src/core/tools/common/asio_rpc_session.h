@@ -59,6 +59,9 @@ namespace dsn {
             virtual void close_on_fault_injection() override {
                 _socket->close();
             }
+            virtual void close() override {
+                _socket->close();
+            }
 
         public:
             virtual void connect() override;            
@@ -48,8 +48,9 @@ namespace dsn {
         {
         }
 
-        dsn_handle_t empty_aio_provider::open(const char* file_name, int flag, int pmode)
+        dsn_handle_t empty_aio_provider::open(const char* file_name, int flag, int pmode, /*out*/ error_code& err)
         {
+            err = ERR_OK;
             return (dsn_handle_t)(size_t)(1);
         }
 
@@ -47,7 +47,7 @@ namespace dsn {
             empty_aio_provider(disk_engine* disk, aio_provider* inner_provider);
             ~empty_aio_provider();
 
-            virtual dsn_handle_t   open(const char* file_name, int flag, int pmode) override;
+            virtual dsn_handle_t   open(const char* file_name, int flag, int pmode, /*out*/ error_code& err) override;
             virtual error_code close(dsn_handle_t fh) override;
             virtual error_code flush(dsn_handle_t fh) override;
             virtual void       aio(aio_task* aio) override;
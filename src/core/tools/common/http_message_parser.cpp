@@ -36,71 +36,167 @@
 # include <dsn/internal/ports.h>
 # include <dsn/internal/rpc_message.h>
 # include <dsn/internal/singleton.h>
+# include <dsn/cpp/utils.h>
 # include <vector>
-# include <iomanip>
-#include "http_message_parser.h"
-#include <dsn/cpp/serialization.h>
+# include "http_message_parser.h"
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "message.parser.http"
 
 namespace dsn{
+
+template <typename TFunc>
+static void for_each_body_buffer(message_ex* msg, TFunc f)
+{
+    // skip message header as it is replaced by the http header
+    int offset = (int)sizeof(message_header);
+    for (auto& buf : msg->buffers)
+    {
+        if (offset >= buf.length())
+        {
+            offset -= buf.length();
+            continue;
+        }
+        f(buf.data() + offset, buf.length() - offset);
+        offset = 0;
+    }
+}
+
+static blob copy_to_blob(const char* data, size_t length)
+{
+    std::shared_ptr<char> buffer(new char[length], std::default_delete<char[]>{});
+    memcpy(buffer.get(), data, length);
+    return blob(buffer, 0, (int)length);
+}
+
 http_message_parser::http_message_parser(int buffer_block_size, bool is_write_only)
-    : message_parser(buffer_block_size, is_write_only)
+    : message_parser(buffer_block_size, is_write_only), _last_request_id(0), _next_reply_header(0), _close_after_sent(false)
 {
     memset(&_parser_setting, 0, sizeof(_parser_setting));
     _parser.data = this;
+    _parser_setting.on_message_begin = [](http_parser* parser)->int
+    {
+        auto owner = static_cast<http_message_parser*>(parser->data);
+        owner->_url.clear();
+        owner->_body.clear();
+        return 0;
+    };
     _parser_setting.on_url = [](http_parser* parser, const char *at, size_t length)->int
     {
+        // the url may come in pieces
         auto owner = static_cast<http_message_parser*>(parser->data);
-        http_parser_url url;
-        http_parser_parse_url(at, length, 1, &url);
-        if (((url.field_set >> UF_PATH) & 1) == 0)
-        {
-            derror("url has no path field");
-            //error, reset parser state
-            return 1;
-        }
-        std::vector<std::string> args;
-        utils::split_args(std::string(at, length).c_str(), args, '/');
-        if (args.size() != 2)
-        {
-            derror("invalid url");
-            //error, reset parser state
-            return 1;
-        }
-        owner->_last_url_info.rpc_name = std::move(args[0]);
-        owner->_last_url_info.hash = std::stoi(args[1]);
+        owner->_url.append(at, length);
         return 0;
     };
     _parser_setting.on_body = [](http_parser* parser, const char *at, size_t length)->int
     {
+        // the body may come in pieces too (e.g., chunked, or across reads),
+        // each of which refers to the read buffer directly
         auto owner = static_cast<http_message_parser*>(parser->data);
         dassert(owner->_read_buffer.buffer() != nullptr, "the read buffer is not owning");
-        owner->_received_messages.emplace(
-            message_ex::create_receive_message_with_standalone_header(
-                blob(owner->_read_buffer.buffer(), at - owner->_read_buffer.buffer_ptr(), length)));
-        strcpy(owner->_received_messages.back()->header->rpc_name, owner->_last_url_info.rpc_name.c_str());
-        owner->_received_messages.back()->header->client.hash = owner->_last_url_info.hash;
-        owner->_received_messages.back()->header->context.u.is_request = 1;
+        owner->_body.emplace_back(owner->_read_buffer.buffer(), (int)(at - owner->_read_buffer.buffer_ptr()), (int)length);
+        return 0;
+    };
+    _parser_setting.on_message_complete = [](http_parser* parser)->int
+    {
+        auto owner = static_cast<http_message_parser*>(parser->data);
+        owner->on_request_complete();
         return 0;
     };
     http_parser_init(&_parser, HTTP_REQUEST);
-    
 }
 
-message_ex* http_message_parser::get_message_on_receive(int read_length, /*out*/ int& read_next)
+void http_message_parser::on_request_complete()
 {
-    read_next = 4096;
-    auto nparsed = http_parser_execute(&_parser, &_parser_setting, _read_buffer.data() + _read_buffer_occupied, read_length);
-    if (_parser.upgrade)
+    std::string rpc_name, query;
+    int hash = 0;
+
+    http_parser_url url;
+    if (0 == http_parser_parse_url(_url.c_str(), _url.length(), 0, &url)
+        && ((url.field_set >> UF_PATH) & 1))
     {
-        derror("unsupported protocol");
-        return nullptr;
+        std::vector<std::string> args;
+        utils::split_args(_url.substr(url.field_data[UF_PATH].off, url.field_data[UF_PATH].len).c_str(), args, '/');
+        if (args.size() >= 1)
+            rpc_name = std::move(args[0]);
+        if (args.size() >= 2)
+            hash = atoi(args[1].c_str());
+
+        if ((url.field_set >> UF_QUERY) & 1)
+            query = _url.substr(url.field_data[UF_QUERY].off, url.field_data[UF_QUERY].len);
+    }
+    else
+    {
+        // still goes up as a request with an empty rpc name, so that
+        // it is replied with ERR_HANDLER_NOT_FOUND in turn
+        derror("invalid url '%s'", _url.c_str());
+    }
+
+    blob body;
+    if (_body.size() == 1)
+    {
+        body = _body[0];
     }
-    if (nparsed != read_length)
+    else if (_body.size() > 1)
     {
-        derror("malformed http packet, we cannot handle it now");
-        return nullptr;
+        std::string data;
+        for (auto& bb : _body)
+            data.append(bb.data(), bb.length());
+        body = copy_to_blob(data.c_str(), data.length());
+    }
+    else if (!query.empty())
+    {
+        body = copy_to_blob(query.c_str(), query.length());
+    }
+
+    message_ex* msg = message_ex::create_receive_message_with_standalone_header(body);
+    auto& hdr = *msg->header;
+    if (rpc_name.length() < sizeof(hdr.rpc_name))
+        strcpy(hdr.rpc_name, rpc_name.c_str());
+    hdr.client.hash = hash;
+    hdr.context.u.is_request = 1;
+    hdr.id = hdr.rpc_id = ++_last_request_id;
+    hdr.body_length = body.length();
+
+    {
+        utils::auto_lock<utils::ex_lock_nr_spin> l(_requests_lock);
+        _requests.push_back(request_info{
+            hdr.id,
+            http_should_keep_alive(&_parser) != 0,
+            _parser.http_major > 1 || (_parser.http_major == 1 && _parser.http_minor >= 1)
+            });
     }
-    mark_read(read_length);
+
+    _received_messages.emplace(msg);
+    _url.clear();
+    _body.clear();
+}
+
+message_ex* http_message_parser::get_message_on_receive(int read_length, /*out*/ int& read_next)
+{
+    read_next = 4096;
+
+    if (read_length > 0)
+    {
+        auto nparsed = http_parser_execute(&_parser, &_parser_setting, _read_buffer.data() + _read_buffer_occupied, read_length);
+
+        // all read content is consumed by http_parser, and what is still
+        // needed is referenced by the body blobs, so the read buffer moves on
+        _read_buffer = _read_buffer.range(_read_buffer_occupied + read_length);
+        _read_buffer_occupied = 0;
+
+        if (_parser.upgrade || nparsed != (size_t)read_length)
+        {
+            derror("malformed http packet (%s), discard the request being parsed",
+                _parser.upgrade ? "upgrade is not supported" : http_errno_name(HTTP_PARSER_ERRNO(&_parser)));
+            http_parser_init(&_parser, HTTP_REQUEST);
+            _url.clear();
+            _body.clear();
+        }
+    }
+
     if (!_received_messages.empty())
     {
         auto message = std::move(_received_messages.front());
@@ -113,54 +209,135 @@ message_ex* http_message_parser::get_message_on_receive(int read_length, /*out*/
     }
 }
 
-int http_message_parser::prepare_buffers_on_send(message_ex* msg, int offset, send_buf* buffers)
+http_message_parser::request_info http_message_parser::get_request_info(message_ex* msg, bool remove)
 {
-    //skip message header for browser
-    if (offset == 0)
+    utils::auto_lock<utils::ex_lock_nr_spin> l(_requests_lock);
+
+    // replies are sent in request order, see rpc_session::send_message
+    if (!_requests.empty() && _requests.front().id == msg->header->id)
     {
-        sprintf(http_header_send_buffer, "%s%s%09lld%s", header_prefix, header_contentlen_prefix, msg->body_size(), header_contentlen_suffix);
+        auto info = _requests.front();
+        if (remove)
+            _requests.pop_front();
+        return info;
     }
-    int buffer_iter = 0;
-    if (offset < header_size)
+    else
     {
-        buffers[0].buf = http_header_send_buffer + offset;
-        buffers[0].sz = header_size - offset;
-        buffer_iter = 1;
-        offset = 0;
+        return request_info{ msg->header->id, true, false };
     }
+}
+
+int http_message_parser::encode_reply_header(message_ex* msg, const request_info& info, /*out*/ std::string& header, /*out*/ int* total_length)
+{
+    error_code err = msg->error();
+    int body_count = 0;
+    for_each_body_buffer(msg, [&body_count](const char*, int) { ++body_count; });
+
+    header.clear();
+    _separator_offsets.clear();
+    header.append("HTTP/1.1 ");
+    if (err == ERR_OK)
+        header.append("200 OK\r\n");
+    else if (err == ERR_HANDLER_NOT_FOUND)
+        header.append("404 Not Found\r\n");
     else
+        header.append("500 Internal Server Error\r\n");
+    header.append(
+        "Content-Type: text/plain; charset=UTF-8\r\n"
+        "Access-Control-Allow-Origin: *\r\n"
+        );
+    if (!info.keep_alive)
+        header.append("Connection: close\r\n");
+
+    char hex[16];
+
+    // error without body, the error name is the body
+    if (err != ERR_OK && body_count == 0)
     {
-        offset -= header_size;
+        std::string text = err.to_string();
+        header.append("Content-Length: ").append(std::to_string(text.length())).append("\r\n\r\n").append(text);
+        *total_length = (int)header.length();
+        return 1;
     }
-    offset += sizeof(message_header);
-    for (auto& buf : msg->buffers)
+
+    // chunked, one chunk per body buffer
+    else if (info.chunked_allowed && body_count > 1)
     {
-        if (offset >= buf.length())
+        header.append("Transfer-Encoding: chunked\r\n\r\n");
+
+        int i = 0;
+        for_each_body_buffer(msg, [&](const char*, int length)
         {
-            offset -= buf.length();
-            continue;
-        }
-        buffers[buffer_iter].buf = const_cast<char*>(buf.data() + offset);
-        buffers[buffer_iter].sz = buf.length() - offset;
-        offset = 0;
-        buffer_iter += 1;
+            sprintf(hex, "%x\r\n", length);
+            if (i++ > 0)
+            {
+                _separator_offsets.push_back((int)header.length());
+                header.append("\r\n");
+            }
+            header.append(hex);
+        });
+        _separator_offsets.push_back((int)header.length());
+        header.append("\r\n0\r\n\r\n");
+
+        *total_length = (int)header.length() + (int)msg->body_size();
+        return 1 + 2 * body_count;
+    }
+
+    else
+    {
+        header.append("Content-Length: ").append(std::to_string(msg->body_size())).append("\r\n\r\n");
+        *total_length = (int)header.length() + (int)msg->body_size();
+        return 1 + body_count;
     }
+}
+
+int http_message_parser::prepare_buffers_on_send(message_ex* msg, int offset, send_buf* buffers)
+{
+    dassert(offset == 0, "partial send of http replies is not supported");
+
+    // several replies may be batched in one send, so each one gets its own header
+    auto& header = _reply_headers[_next_reply_header];
+    _next_reply_header = (_next_reply_header + 1) % reply_header_slot_count;
+
+    int total_length;
+    auto info = get_request_info(msg, true);
+    int count = encode_reply_header(msg, info, header, &total_length);
+    if (!info.keep_alive)
+        _close_after_sent = true;
+
+    // status line and headers, plus the size of the first chunk when chunked
+    int header_end = _separator_offsets.empty() ? (int)header.length() : _separator_offsets.front();
+    buffers[0].buf = (void*)header.data();
+    buffers[0].sz = header_end;
+    if (count == 1)
+        return 1;
+
+    int i = 1;
+    int chunk = 0;
+    for_each_body_buffer(msg, [&](const char* data, int length)
+    {
+        buffers[i].buf = (void*)data;
+        buffers[i].sz = length;
+        ++i;
+
+        if (!_separator_offsets.empty())
+        {
+            int begin = _separator_offsets[chunk];
+            int end = chunk + 1 < (int)_separator_offsets.size() ? _separator_offsets[chunk + 1] : (int)header.length();
+            buffers[i].buf = (void*)(header.data() + begin);
+            buffers[i].sz = end - begin;
+            ++i;
+            ++chunk;
+        }
+    });
 
-    buffers[buffer_iter].buf = const_cast<char*>(suffix_padding);
-    buffers[buffer_iter].sz = sizeof(suffix_padding);
-    buffer_iter += 1;
-    return buffer_iter;
+    dassert(i == count, "buffer count mismatch, %d vs %d", i, count);
+    return i;
 }
 
 int http_message_parser::get_send_buffers_count_and_total_length(message_ex* msg, int* total_length)
 {
-    //message + http header + suffix_padding
-    *total_length = msg->body_size() + header_size + sizeof(suffix_padding);
-    return msg->buffers.size() + 2;
+    return encode_reply_header(msg, get_request_info(msg, false), _probe_header, total_length);
 }
 
-constexpr const char http_message_parser::header_prefix[];
-constexpr const char http_message_parser::header_contentlen_prefix[];
-constexpr const char http_message_parser::header_contentlen_suffix[];
-constexpr const char http_message_parser::suffix_padding[];
 }
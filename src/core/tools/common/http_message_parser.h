@@ -39,12 +39,24 @@
 # include <dsn/internal/rpc_message.h>
 # include <dsn/internal/singleton.h>
 # include <dsn/internal/message_parser.h>
+# include <dsn/internal/synchronize.h>
 # include <vector>
 # include <queue>
+# include <deque>
 # include "http_parser.h"
 
 namespace dsn
 {
+//
+// keep-alive http/1.1 server side parser, requests are mapped to rpc handlers by url path:
+//   /$rpc_name[/$hash]  -- $rpc_name is either the rpc code or the name given upon registration,
+//                          e.g., /metrics and /cli?cmd=help (see command_manager::start_http_cli)
+// the request body (or the query string when there is no body) becomes the message body.
+//
+// pipelined requests are numbered per connection, and the replies are sent back in
+// the same order (see is_reply_ordered). replies whose body spans multiple buffers are
+// streamed as chunks of http/1.1 chunked transfer encoding, one chunk per buffer.
+//
 class http_message_parser : public message_parser
 {
 public:
@@ -54,26 +66,54 @@ public:
     int prepare_buffers_on_send(message_ex* msg, int offset, /*out*/ send_buf* buffers) override;
 
     int get_send_buffers_count_and_total_length(message_ex* msg, /*out*/ int* total_length) override;
+
+    bool is_reply_ordered() const override { return true; }
+
+    bool is_close_after_sent() const override { return _close_after_sent; }
+
+private:
+    void on_request_complete();
+
+    struct request_info
+    {
+        uint64_t id;
+        bool     keep_alive;
+        bool     chunked_allowed; // http/1.1 and above
+    };
+
+    // info of the request that msg replies to, removed when 'remove' is true
+    request_info get_request_info(message_ex* msg, bool remove);
+
+    // encode status line, headers and the chunk separators of the reply into 'header',
+    // return the count of the send buffers, see prepare_buffers_on_send
+    int encode_reply_header(message_ex* msg, const request_info& info, /*out*/ std::string& header, /*out*/ int* total_length);
+
 private:
     http_parser _parser;
     http_parser_settings _parser_setting;
     std::queue<std::unique_ptr<message_ex>> _received_messages;
-    struct
-    {
-        std::string rpc_name;
-        int hash;
-    } _last_url_info;
-
-    constexpr static const char header_prefix[] =
-        "HTTP/1.1 200 OK\r\n"
-        "Content-Type: text/html; charset=UTF-8\r\n"
-        "Access-Control-Allow-Origin: *\r\n";
-    constexpr static const char header_contentlen_prefix[] = "Content-Length: ";
-    constexpr static size_t contentlen_placeholder_length = 9;
-    constexpr static const char header_contentlen_suffix[] = "\r\n\r\n";
-    constexpr static size_t header_size = sizeof(header_prefix) + sizeof(header_contentlen_prefix) + contentlen_placeholder_length + sizeof(header_contentlen_suffix);
-    constexpr static const char suffix_padding[] = "\r\n";
-
-    char http_header_send_buffer[header_size];
+
+    // the request being parsed
+    std::string       _url;
+    std::vector<blob> _body;
+    uint64_t          _last_request_id;
+
+    // the requests received but not replied yet, shared by the receiving and sending paths
+    ::dsn::utils::ex_lock_nr_spin _requests_lock;
+    std::deque<request_info>      _requests;
+
+    // rpc_session batches at most max_buffer_block_count_per_send (<= 128) buffers
+    // per send, so 128 headers are never reused within a batch
+    enum { reply_header_slot_count = 128 };
+    std::string _reply_headers[reply_header_slot_count];
+    int         _next_reply_header;
+    std::string _probe_header; // for get_send_buffers_count_and_total_length
+
+    // a reply with 'Connection: close' is prepared for sending
+    bool        _close_after_sent;
+
+    // offsets of the chunk separators in the reply header being encoded,
+    // the i-th one follows the i-th body buffer
+    std::vector<int> _separator_offsets;
 };
-}
\ No newline at end of file
+}
@@ -71,9 +71,18 @@ namespace dsn {
             });
         }
 
-        dsn_handle_t native_linux_aio_provider::open(const char* file_name, int flag, int pmode)
+        dsn_handle_t native_linux_aio_provider::open(const char* file_name, int flag, int pmode, /*out*/ error_code& err)
         {
-            return (dsn_handle_t)(uintptr_t)::open(file_name, flag, pmode);
+            dsn_handle_t fh = (dsn_handle_t)(uintptr_t)::open(file_name, flag, pmode);
+            if (fh == DSN_INVALID_FILE_HANDLE)
+            {
+                err = (errno == EINVAL ? ERR_INVALID_PARAMETERS : ERR_FILE_OPERATION_FAILED);
+            }
+            else
+            {
+                err = ERR_OK;
+            }
+            return fh;
         }
 
         error_code native_linux_aio_provider::close(dsn_handle_t fh)
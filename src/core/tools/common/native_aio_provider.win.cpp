@@ -86,7 +86,7 @@ void native_win_aio_provider::start(io_modifer& ctx)
     ::SetThreadPriority(_worker_thr->native_handle(), THREAD_PRIORITY_HIGHEST);
 }
 
-dsn_handle_t native_win_aio_provider::open(const char* file_name, int oflag, int pmode)
+dsn_handle_t native_win_aio_provider::open(const char* file_name, int oflag, int pmode, /*out*/ error_code& err)
 {
     DWORD dwDesiredAccess = 0;
     DWORD dwShareMode = FILE_SHARE_READ | FILE_SHARE_WRITE;
@@ -186,16 +186,20 @@ dsn_handle_t native_win_aio_provider::open(const char* file_name, int oflag, int
         if (_iocp != ::CreateIoCompletionPort(fileHandle, _iocp, 0, 0))
         {
             dassert(false, "cannot associate file handle %s to io completion port, err = 0x%x\n", file_name, ::GetLastError());
+            err = ERR_FILE_OPERATION_FAILED;
             return 0;
         }
         else
         {
+            err = ERR_OK;
             return (dsn_handle_t)(fileHandle);
         }
     }
     else
     {
-        derror("cannot create file %s, err = 0x%x\n", file_name, ::GetLastError());
+        DWORD last_error = ::GetLastError();
+        derror("cannot create file %s, err = 0x%x\n", file_name, last_error);
+        err = (last_error == ERROR_INVALID_PARAMETER ? ERR_INVALID_PARAMETERS : ERR_FILE_OPERATION_FAILED);
         return 0;
     }
 }
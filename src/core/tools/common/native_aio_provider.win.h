@@ -48,7 +48,7 @@ namespace dsn {
             native_win_aio_provider(disk_engine* disk, aio_provider* inner_provider);
             ~native_win_aio_provider();
 
-            virtual dsn_handle_t open(const char* file_name, int flag, int pmode);
+            virtual dsn_handle_t open(const char* file_name, int flag, int pmode, /*out*/ error_code& err);
             virtual error_code close(dsn_handle_t fh);
             virtual error_code flush(dsn_handle_t fh);
             virtual void    aio(aio_task* aio);            
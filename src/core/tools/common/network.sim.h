@@ -56,6 +56,8 @@ namespace dsn { namespace tools {
         virtual void do_read(int sz) override {}
 
         virtual void close_on_fault_injection() override {}
+
+        virtual void close() override {}
     };
 
     class sim_server_session : public rpc_session
@@ -76,6 +78,8 @@ namespace dsn { namespace tools {
 
         virtual void close_on_fault_injection() override {}
 
+        virtual void close() override {}
+
     private:
         rpc_session_ptr _client;
     };
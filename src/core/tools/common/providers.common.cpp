@@ -48,6 +48,7 @@
 # include "simple_logger.h"
 # include "empty_aio_provider.h"
 #include "http_message_parser.h"
+#include "thrift_message_parser.h"
 
 namespace dsn {
     namespace tools {
@@ -70,6 +71,7 @@ namespace dsn {
             
             register_message_header_parser<dsn_message_parser>(NET_HDR_DSN);
             register_message_header_parser<http_message_parser>(NET_HDR_HTTP);
+            register_message_header_parser<thrift_compact_message_parser>(NET_HDR_THRIFT_COMPACT);
 #if defined(_WIN32)
             register_component_provider<native_win_aio_provider>("dsn::tools::native_aio_provider");
 #elif defined(__linux__)
@@ -78,6 +78,11 @@ namespace dsn {
                 uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
                 _val[task_id % DIVIDE_CONTAINER].fetch_add(val, std::memory_order_relaxed);
             }
+            virtual void   subtract(uint64_t val)
+            {
+                uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
+                _val[task_id % DIVIDE_CONTAINER].fetch_sub(val, std::memory_order_relaxed);
+            }
             virtual void   set(uint64_t val)
             {
                 uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
@@ -138,6 +143,11 @@ namespace dsn {
                 uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
                 _val[task_id % DIVIDE_CONTAINER].fetch_add(val, std::memory_order_relaxed);
             }
+            virtual void   subtract(uint64_t val)
+            {
+                uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
+                _val[task_id % DIVIDE_CONTAINER].fetch_sub(val, std::memory_order_relaxed);
+            }
             virtual void   set(uint64_t val) { dassert(false, "invalid execution flow"); }
             virtual double get_value()
             {
@@ -210,6 +220,7 @@ namespace dsn {
             virtual void   increment() { dassert(false, "invalid execution flow"); }
             virtual void   decrement() { dassert(false, "invalid execution flow"); }
             virtual void   add(uint64_t val) { dassert(false, "invalid execution flow"); }
+            virtual void   subtract(uint64_t val) { dassert(false, "invalid execution flow"); }
             virtual void   set(uint64_t val)
             {
                 auto idx = _tail++;
@@ -77,6 +77,11 @@ namespace dsn {
                 uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
                 _val[task_id % DIVIDE_CONTAINER] += val;
             }
+            virtual void   subtract(uint64_t val)
+            {
+                uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
+                _val[task_id % DIVIDE_CONTAINER] -= val;
+            }
             virtual void   set(uint64_t val)
             {
                 uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
@@ -137,6 +142,11 @@ namespace dsn {
                 uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
                 _val[task_id % DIVIDE_CONTAINER] += val;
             }
+            virtual void   subtract(uint64_t val)
+            {
+                uint64_t task_id = static_cast<int>(::dsn::utils::get_current_tid());
+                _val[task_id % DIVIDE_CONTAINER] -= val;
+            }
             virtual void   set(uint64_t val) { dassert(false, "invalid execution flow"); }
             virtual double get_value()
             {
@@ -209,6 +219,7 @@ namespace dsn {
             virtual void   increment() { dassert(false, "invalid execution flow"); }
             virtual void   decrement() { dassert(false, "invalid execution flow"); }
             virtual void   add(uint64_t val) { dassert(false, "invalid execution flow"); }
+            virtual void   subtract(uint64_t val) { dassert(false, "invalid execution flow"); }
             virtual void   set(uint64_t val)
             {
                 auto idx = _tail++;
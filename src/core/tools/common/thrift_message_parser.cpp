@@ -0,0 +1,385 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     message parser for thrift compact protocol over framed transport
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "thrift_message_parser.h"
+# include <dsn/service_api_c.h>
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "message.parser.thrift"
+
+namespace dsn
+{
+    static const uint8_t thrift_compact_protocol_id = 0x82;
+    static const uint8_t thrift_compact_version = 1;
+    static const uint8_t thrift_compact_version_mask = 0x1f;
+    static const int     thrift_compact_type_shift = 5;
+
+    // frames beyond this are regarded as garbage on the wire
+    static const int32_t thrift_max_frame_length = 256 * 1024 * 1024;
+
+    static const char    reply_name_suffix[] = "_ACK";
+
+    // field headers (delta id << 4 | compact type) and type value of TApplicationException
+    static const uint8_t thrift_exception_message_field = 0x18;
+    static const uint8_t thrift_exception_type_field = 0x15;
+    static const int32_t thrift_exception_internal_error = 6;
+
+    static inline int write_varint32(char* ptr, uint32_t v)
+    {
+        int i = 0;
+        while (v >= 0x80)
+        {
+            ptr[i++] = (char)((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        ptr[i++] = (char)v;
+        return i;
+    }
+
+    // return the consumed length, or -1 if the varint is truncated or too long
+    static inline int read_varint32(const char* ptr, int length, /*out*/ uint32_t& v)
+    {
+        v = 0;
+        for (int i = 0; i < length && i < 5; i++)
+        {
+            uint8_t b = (uint8_t)ptr[i];
+            v |= (uint32_t)(b & 0x7f) << (7 * i);
+            if ((b & 0x80) == 0)
+                return i + 1;
+        }
+        return -1;
+    }
+
+    static inline int32_t read_frame_length(const char* ptr)
+    {
+        const uint8_t* p = (const uint8_t*)ptr;
+        return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3]);
+    }
+
+    static inline void write_frame_length(char* ptr, uint32_t v)
+    {
+        ptr[0] = (char)(v >> 24);
+        ptr[1] = (char)(v >> 16);
+        ptr[2] = (char)(v >> 8);
+        ptr[3] = (char)v;
+    }
+
+    static inline int varint32_size(uint32_t v)
+    {
+        int n = 1;
+        while (v >= 0x80)
+        {
+            v >>= 7;
+            ++n;
+        }
+        return n;
+    }
+
+    // thrift replies carry the name of the call, so the suffix added by create_response is stripped
+    static inline size_t get_method_name_length(const message_header& hdr)
+    {
+        size_t name_length = strnlen(hdr.rpc_name, sizeof(hdr.rpc_name));
+        const size_t suffix_length = sizeof(reply_name_suffix) - 1;
+        if (!hdr.context.u.is_request
+            && name_length > suffix_length
+            && 0 == memcmp(hdr.rpc_name + name_length - suffix_length, reply_name_suffix, suffix_length))
+        {
+            name_length -= suffix_length;
+        }
+        return name_length;
+    }
+
+    // error replies without body are sent as thrift exceptions
+    static inline bool is_exception(const message_header& hdr)
+    {
+        return !hdr.context.u.is_request && hdr.server.error != ERR_OK.get() && hdr.body_length == 0;
+    }
+
+    thrift_compact_message_parser::thrift_compact_message_parser(int buffer_block_size, bool is_write_only)
+        : message_parser(buffer_block_size, is_write_only), _next_header_slot(0)
+    {
+    }
+
+    /*static*/ dsn_error_t thrift_compact_message_parser::decode_exception(const char* body, int body_length)
+    {
+        // TApplicationException { 1: string message, 2: i32 type }, message holds the error name
+        uint32_t length;
+        int n;
+        if (body_length < 2
+            || (uint8_t)body[0] != thrift_exception_message_field
+            || (n = read_varint32(body + 1, body_length - 1, length)) < 0
+            || length >= max_error_name_length
+            || length > (uint32_t)(body_length - 1 - n))
+        {
+            return ERR_UNKNOWN.get();
+        }
+
+        char name[max_error_name_length];
+        memcpy(name, body + 1 + n, length);
+        name[length] = '\0';
+        return dsn_error_from_string(name, ERR_UNKNOWN.get());
+    }
+
+    /*static*/ int thrift_compact_message_parser::decode_header(const char* frame, int frame_length, /*out*/ message_header& hdr)
+    {
+        if (frame_length < 2 || (uint8_t)frame[0] != thrift_compact_protocol_id)
+        {
+            derror("invalid thrift compact protocol id");
+            return -1;
+        }
+
+        uint8_t version_and_type = (uint8_t)frame[1];
+        if ((version_and_type & thrift_compact_version_mask) != thrift_compact_version)
+        {
+            derror("unsupported thrift compact protocol version %d", (int)(version_and_type & thrift_compact_version_mask));
+            return -1;
+        }
+
+        int pos = 2;
+        uint32_t seqid, name_length;
+        int n = read_varint32(frame + pos, frame_length - pos, seqid);
+        if (n < 0)
+        {
+            derror("invalid thrift seqid");
+            return -1;
+        }
+        pos += n;
+
+        n = read_varint32(frame + pos, frame_length - pos, name_length);
+        if (n < 0
+            || name_length >= sizeof(hdr.rpc_name)
+            || name_length > (uint32_t)(frame_length - pos - n))
+        {
+            derror("invalid thrift method name");
+            return -1;
+        }
+        pos += n;
+
+        memcpy(hdr.rpc_name, frame + pos, name_length);
+        hdr.rpc_name[name_length] = '\0';
+        pos += (int)name_length;
+
+        hdr.id = hdr.rpc_id = seqid;
+        hdr.body_length = frame_length - pos;
+        switch (version_and_type >> thrift_compact_type_shift)
+        {
+        case TMT_CALL:
+        case TMT_ONEWAY:
+            hdr.context.u.is_request = 1;
+            break;
+        case TMT_REPLY:
+            hdr.context.u.is_request = 0;
+            break;
+        case TMT_EXCEPTION:
+            hdr.context.u.is_request = 0;
+            hdr.server.error = decode_exception(frame + pos, hdr.body_length);
+            break;
+        default:
+            derror("invalid thrift message type %d", (int)(version_and_type >> thrift_compact_type_shift));
+            return -1;
+        }
+        return pos;
+    }
+
+    message_ex* thrift_compact_message_parser::get_message_on_receive(int read_length, /*out*/ int& read_next)
+    {
+        mark_read(read_length);
+
+        while (_read_buffer_occupied >= frame_length_size)
+        {
+            int32_t frame_length = read_frame_length(_read_buffer.data());
+            if (frame_length <= 0 || frame_length > thrift_max_frame_length)
+            {
+                derror("invalid thrift frame length %d, discard read content", frame_length);
+                truncate_read();
+                break;
+            }
+
+            int msg_sz = frame_length_size + frame_length;
+            if (_read_buffer_occupied < msg_sz)
+            {
+                read_next = msg_sz - _read_buffer_occupied;
+                return nullptr;
+            }
+
+            message_header hdr{};
+            int hdr_sz = decode_header(_read_buffer.data() + frame_length_size, frame_length, hdr);
+
+            message_ex* msg = nullptr;
+            if (hdr_sz >= 0)
+            {
+                // the body refers to the read buffer directly, no copy
+                msg = message_ex::create_receive_message_with_standalone_header(
+                    _read_buffer.range(frame_length_size + hdr_sz, hdr.body_length));
+                *msg->header = hdr;
+            }
+            else
+            {
+                derror("malformed thrift frame with length %d is skipped", frame_length);
+            }
+
+            _read_buffer = _read_buffer.range(msg_sz);
+            _read_buffer_occupied -= msg_sz;
+
+            if (msg != nullptr)
+            {
+                read_next = frame_length_size;
+                return msg;
+            }
+        }
+
+        read_next = frame_length_size - _read_buffer_occupied;
+        return nullptr;
+    }
+
+    /*static*/ int thrift_compact_message_parser::encode_header(message_ex* msg, /*out*/ char* buffer, /*out*/ int* exception_length)
+    {
+        auto& hdr = *msg->header;
+
+        uint8_t type;
+        if (hdr.context.u.is_request)
+            type = TMT_CALL;
+        else if (is_exception(hdr))
+            type = TMT_EXCEPTION;
+        else
+            type = TMT_REPLY;
+
+        size_t name_length = get_method_name_length(hdr);
+
+        char* ptr = buffer + frame_length_size;
+        *ptr++ = (char)thrift_compact_protocol_id;
+        *ptr++ = (char)((type << thrift_compact_type_shift) | thrift_compact_version);
+        ptr += write_varint32(ptr, (uint32_t)hdr.id);
+        ptr += write_varint32(ptr, (uint32_t)name_length);
+        memcpy(ptr, hdr.rpc_name, name_length);
+        ptr += name_length;
+
+        // error replies without body carry a TApplicationException as the body
+        *exception_length = 0;
+        if (type == TMT_EXCEPTION)
+        {
+            char* exception_begin = ptr;
+            const char* error_name = error_code(hdr.server.error).to_string();
+            size_t error_name_length = strnlen(error_name, max_error_name_length - 1);
+
+            *ptr++ = (char)thrift_exception_message_field;
+            ptr += write_varint32(ptr, (uint32_t)error_name_length);
+            memcpy(ptr, error_name, error_name_length);
+            ptr += error_name_length;
+            *ptr++ = (char)thrift_exception_type_field;
+            ptr += write_varint32(ptr, (uint32_t)(thrift_exception_internal_error << 1)); // zigzag
+            *ptr++ = 0; // field stop
+            *exception_length = (int)(ptr - exception_begin);
+        }
+
+        write_frame_length(buffer, (uint32_t)(ptr - buffer - frame_length_size + hdr.body_length));
+        return (int)(ptr - buffer);
+    }
+
+    int thrift_compact_message_parser::prepare_buffers_on_send(message_ex* msg, int offset, /*out*/ send_buf* buffers)
+    {
+        // several messages may be batched in one send, so each one gets its own header slot
+        char* hdr_buffer = _header_slots[_next_header_slot].buffer;
+        _next_header_slot = (_next_header_slot + 1) % header_slot_count;
+
+        int exception_length;
+        int hdr_sz = encode_header(msg, hdr_buffer, &exception_length);
+        if (exception_length > 0)
+        {
+            // message begin and exception body are sent as two buffers, see header_slot_count
+            dassert(offset == 0, "partial send of thrift exceptions is not supported");
+            buffers[0].buf = (void*)hdr_buffer;
+            buffers[0].sz = (uint32_t)(hdr_sz - exception_length);
+            buffers[1].buf = (void*)(hdr_buffer + hdr_sz - exception_length);
+            buffers[1].sz = (uint32_t)exception_length;
+            return 2;
+        }
+
+        int i = 0;
+        if (offset < hdr_sz)
+        {
+            buffers[i].buf = (void*)(hdr_buffer + offset);
+            buffers[i].sz = (uint32_t)(hdr_sz - offset);
+            offset = 0;
+            ++i;
+        }
+        else
+        {
+            offset -= hdr_sz;
+        }
+
+        // skip message_header as it is replaced by the thrift message begin
+        offset += (int)sizeof(message_header);
+        for (auto& buf : msg->buffers)
+        {
+            if (offset >= buf.length())
+            {
+                offset -= buf.length();
+                continue;
+            }
+
+            buffers[i].buf = (void*)(buf.data() + offset);
+            buffers[i].sz = (uint32_t)(buf.length() - offset);
+            offset = 0;
+            ++i;
+        }
+
+        return i;
+    }
+
+    int thrift_compact_message_parser::get_send_buffers_count_and_total_length(message_ex* msg, /*out*/ int* total_length)
+    {
+        auto& hdr = *msg->header;
+        if (is_exception(hdr))
+        {
+            char hdr_buffer[max_header_length];
+            int exception_length;
+            *total_length = encode_header(msg, hdr_buffer, &exception_length);
+            return 2;
+        }
+
+        size_t name_length = get_method_name_length(hdr);
+        *total_length = frame_length_size + 2 + varint32_size((uint32_t)hdr.id)
+            + varint32_size((uint32_t)name_length) + (int)name_length + hdr.body_length;
+
+        // header buffer + body buffers, the first one of which may hold nothing but message_header
+        int count = 1 + (int)msg->buffers.size();
+        if (msg->buffers[0].length() == (int)sizeof(message_header))
+            --count;
+        return count;
+    }
+}
@@ -0,0 +1,116 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     message parser for thrift compact protocol over framed transport
+ *
+ *     frame := frame_length(4 bytes, big endian) message_begin body
+ *     message_begin := 0x82 (version | type << 5) varint(seqid) varint(name_length) name
+ *
+ *     the body (the thrift args/result struct) is neither decoded nor copied,
+ *     the received message refers to it directly in the read buffer, and
+ *     the rpc handler is located by the thrift method name which must be
+ *     the same as the rpc code name (e.g., RPC_REPLICA_CLIENT_WRITE).
+ *
+ *     error replies without body are sent as thrift exceptions whose message
+ *     is the error name, and are mapped back to the error code on receive.
+ *
+ *     the thrift seqid is 32 bits, so message_header::id is truncated
+ *     on send and rpc ids beyond 32 bits cannot be matched with their replies
+ *     when this format is used for client sessions.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#pragma once
+
+# include <dsn/internal/ports.h>
+# include <dsn/internal/rpc_message.h>
+# include <dsn/internal/message_parser.h>
+
+namespace dsn
+{
+class thrift_compact_message_parser : public message_parser
+{
+public:
+    enum thrift_message_type
+    {
+        TMT_CALL = 1,
+        TMT_REPLY = 2,
+        TMT_EXCEPTION = 3,
+        TMT_ONEWAY = 4
+    };
+
+    enum
+    {
+        frame_length_size = 4,
+
+        max_error_name_length = 48,
+
+        // frame length + protocol id + version/type + seqid + name length + name,
+        // and the TApplicationException body for error replies without body
+        max_header_length = frame_length_size + 1 + 1 + 5 + 5 + DSN_MAX_TASK_CODE_NAME_LENGTH
+            + 1 + 5 + max_error_name_length + 1 + 5 + 1,
+
+        // rpc_session batches at most max_buffer_block_count_per_send (<= 128)
+        // buffers per send, and each message takes at least two of them (message
+        // begin and body), so 64 header slots are never reused within a batch
+        header_slot_count = 64
+    };
+
+public:
+    thrift_compact_message_parser(int buffer_block_size, bool is_write_only);
+
+    virtual message_ex* get_message_on_receive(int read_length, /*out*/ int& read_next) override;
+
+    virtual int prepare_buffers_on_send(message_ex* msg, int offset, /*out*/ send_buf* buffers) override;
+
+    virtual int get_send_buffers_count_and_total_length(message_ex* msg, /*out*/ int* total_length) override;
+
+    // encode frame length and message begin of msg into buffer (at least max_header_length bytes),
+    // plus the exception body for error replies without body, return the encoded length
+    static int encode_header(message_ex* msg, /*out*/ char* buffer, /*out*/ int* exception_length);
+
+private:
+    // return the header length, or -1 when the frame is malformed
+    static int decode_header(const char* frame, int frame_length, /*out*/ message_header& hdr);
+
+    // map the message of a TApplicationException back to the error code
+    static dsn_error_t decode_exception(const char* body, int body_length);
+
+private:
+    struct header_slot
+    {
+        char buffer[max_header_length];
+    };
+
+    header_slot _header_slots[header_slot_count];
+    int         _next_header_slot;
+};
+}
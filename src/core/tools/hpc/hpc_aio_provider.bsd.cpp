@@ -136,10 +136,19 @@ hpc_aio_provider::~hpc_aio_provider()
 {
 }
 
-dsn_handle_t hpc_aio_provider::open(const char* file_name, int oflag, int pmode)
+dsn_handle_t hpc_aio_provider::open(const char* file_name, int oflag, int pmode, /*out*/ error_code& err)
 {
     // No need to bind handle since EVFILT_AIO is registered when aio_* is called.
-    return  (dsn_handle_t)(uintptr_t)::open(file_name, oflag, pmode);
+    dsn_handle_t fh = (dsn_handle_t)(uintptr_t)::open(file_name, oflag, pmode);
+    if (fh == DSN_INVALID_FILE_HANDLE)
+    {
+        err = (errno == EINVAL ? ERR_INVALID_PARAMETERS : ERR_FILE_OPERATION_FAILED);
+    }
+    else
+    {
+        err = ERR_OK;
+    }
+    return fh;
 }
 
 error_code hpc_aio_provider::close(dsn_handle_t fh)
@@ -95,7 +95,7 @@ hpc_aio_provider::~hpc_aio_provider()
 {
 }
 
-dsn_handle_t hpc_aio_provider::open(const char* file_name, int oflag, int pmode)
+dsn_handle_t hpc_aio_provider::open(const char* file_name, int oflag, int pmode, /*out*/ error_code& err)
 {
     DWORD dwDesiredAccess = 0;
     DWORD dwShareMode = FILE_SHARE_READ | FILE_SHARE_WRITE;
@@ -192,7 +192,7 @@ dsn_handle_t hpc_aio_provider::open(const char* file_name, int oflag, int pmode)
 
     if (fileHandle != INVALID_HANDLE_VALUE && fileHandle != nullptr)
     {
-        auto err = _looper->bind_io_handle((dsn_handle_t)fileHandle, &_callback);
+        err = _looper->bind_io_handle((dsn_handle_t)fileHandle, &_callback);
         if (err != ERR_OK)
         {
             dassert(false, "cannot associate file handle %s to io completion port, err = 0x%x\n", file_name, ::GetLastError());
@@ -205,7 +205,9 @@ dsn_handle_t hpc_aio_provider::open(const char* file_name, int oflag, int pmode)
     }
     else
     {
-        derror("cannot create file %s, err = 0x%x\n", file_name, ::GetLastError());
+        DWORD last_error = ::GetLastError();
+        derror("cannot create file %s, err = 0x%x\n", file_name, last_error);
+        err = (last_error == ERROR_INVALID_PARAMETER ? ERR_INVALID_PARAMETERS : ERR_FILE_OPERATION_FAILED);
         return 0;
     }
 }
@@ -125,12 +125,13 @@ namespace dsn {
                 close();
             }
 
+            virtual void close() override;
+
             void bind_looper(io_looper* looper, bool delay = false);
             virtual void do_read(int sz) override;
 
         private:            
             void do_write(uint64_t signature);
-            void close();
             void on_failure(bool is_write = false);
             void on_read_completed(message_ex* msg)
             {
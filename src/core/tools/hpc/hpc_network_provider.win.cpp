@@ -360,7 +360,15 @@ namespace dsn
                         msg = _parser->get_message_on_receive(0, read_next);
                     }
 
-                    start_read_next(read_next);
+                    if (read_next < 0)
+                    {
+                        derror("invalid data received from %s", _remote_addr.to_string());
+                        on_failure();
+                    }
+                    else
+                    {
+                        start_read_next(read_next);
+                    }
                 }
 
                 release_ref();
@@ -49,6 +49,8 @@ namespace dsn {
         {
             _case_count = 0;
             _live_rpc_count = 0;
+            _sent_bytes_counter = nullptr;
+            _case_start_sent_bytes = 0;
 
             if (!read_config("task..default", _default_opts))
             {
@@ -111,6 +113,8 @@ namespace dsn {
             _suits = suits;
             _current_suit_index = -1;
             _current_case_index = 0xffffff;            
+            _sent_bytes_counter = dsn_perf_counter_create("network", "sent.bytes", COUNTER_TYPE_NUMBER,
+                "bytes on the wire (headers included) sent by the sessions");
 
             start_next_case();
         }
@@ -193,6 +197,8 @@ namespace dsn {
             cs.succ_qps = (double)cs.succ_rounds / ((double)(nts - _case_start_ts_ns) / 1000.0 / 1000.0 / 1000.0);
             cs.succ_throughput_MB_s = (double)cs.succ_rounds * (double)cs.payload_bytes / 1024.0 / 1024.0 / ((double)(nts - _case_start_ts_ns) / 1000.0 / 1000.0 / 1000.0);
             cs.succ_latency_avg_ns = (double)cs.succ_rounds_sum_ns / (double)cs.succ_rounds;
+            cs.wire_bytes_per_request = (double)(dsn_perf_counter_get_integer_value(_sent_bytes_counter) - _case_start_sent_bytes)
+                / (double)(cs.succ_rounds + cs.timeout_rounds + cs.error_rounds);
 
             std::stringstream ss;
             ss << "TEST " << _name << "(" << cs.id << "/" << _case_count << ")::"
@@ -205,6 +211,7 @@ namespace dsn {
                 << cs.max_latency_ns << "(max)"
                 << ", qps: " << cs.succ_qps << "#/s"
                 << ", thp: " << cs.succ_throughput_MB_s << "MB/s"                
+                << ", wire: " << cs.wire_bytes_per_request << "byte/req"
                 ;
 
             dwarn(ss.str().c_str());
@@ -246,6 +253,7 @@ namespace dsn {
                                 << cs.max_latency_ns << "(max)"
                                 << ", qps: " << cs.succ_qps << "#/s"
                                 << ", thp: " << cs.succ_throughput_MB_s << "MB/s"
+                                << ", wire: " << cs.wire_bytes_per_request << "byte/req"
                                 << std::endl;
                                 ;
                         }
@@ -294,6 +302,7 @@ namespace dsn {
             _name = suit.name;
             _timeout = std::chrono::milliseconds(cs.timeout_ms);
             _case_start_ts_ns = dsn_now_ns();
+            _case_start_sent_bytes = dsn_perf_counter_get_integer_value(_sent_bytes_counter);
             _case_end_ts_ns = _case_start_ts_ns + (uint64_t)cs.seconds * 1000 * 1000 * 1000;
             _quiting_current_case = false;
             dassert(_live_rpc_count == 0, "all live requests must be completed");
@@ -34,6 +34,8 @@
  */
 
 #include "replication_common.h"
+#include <limits>
+#include <atomic>
 
 # ifdef __TITLE__
 # undef __TITLE__
@@ -83,6 +85,30 @@ replication_app_client_base::replication_app_client_base(
     for (auto& m : meta_servers)
         dsn_group_add(_meta_servers.group_handle(), m.c_addr());
 
+    _client_id = static_cast<int64_t>(random64(1, std::numeric_limits<int64_t>::max()));
+    _write_attempt_timeout_ms = (int)dsn_config_get_value_uint64(
+        "replication",
+        "client_write_attempt_timeout_ms",
+        0,
+        "timeout (ms) of each try of a client write, which is retried until the request times out, "
+        "0 for trying once until the request times out if the replica is not reachable"
+        );
+
+    // the same options as the replicas, so that the writes waited for are in the window of the dedup table
+    bool dedup_enabled = dsn_config_get_value_bool(
+        "replication",
+        "write_dedup_enabled",
+        false,
+        "whether the retries of client writes are answered from a per-partition dedup table instead of "
+        "being executed again, for the apps which declare set_write_dedup_supported"
+        );
+    _write_dedup_window = dedup_enabled ? (int)dsn_config_get_value_uint64(
+        "replication",
+        "write_dedup_max_requests_per_client",
+        64,
+        "size of the window of the latest request seqs of a client tracked in the dedup table, "
+        "the client gives up the writes falling out of it"
+        ) : 0;
 }
 
 replication_app_client_base::~replication_app_client_base()
@@ -134,6 +160,8 @@ replication_app_client_base::request_context* replication_app_client_base::creat
     rc->write_header.gpid.app_id = _app_id;
     rc->write_header.gpid.pidx = -1;
     rc->write_header.code = task_code(code);
+    rc->write_header.client_id = _client_id;
+    rc->write_header.request_seq = 0; // assigned when the partition is known
     rc->timeout_timer = nullptr;
     rc->timeout_ms = opts.timeout_ms;
     rc->timeout_ts_us = now_us() + opts.timeout_ms * 1000;
@@ -153,6 +181,8 @@ replication_app_client_base::request_context* replication_app_client_base::creat
     ::dsn::task_ptr& callback,
     read_semantic semantic,
     decree snapshot_decree, // only used when ReadSnapshot
+    int64_t max_staleness_decrees, // only used when ReadBoundedStaleness
+    int max_staleness_ms, // only used when ReadBoundedStaleness
     int reply_hash
     )
 {
@@ -170,6 +200,8 @@ replication_app_client_base::request_context* replication_app_client_base::creat
     rc->read_header.code = task_code(code);
     rc->read_header.semantic = semantic;
     rc->read_header.version_decree = snapshot_decree;
+    rc->read_header.max_staleness_decrees = max_staleness_decrees;
+    rc->read_header.max_staleness_ms = max_staleness_ms;
     rc->timeout_timer = nullptr;
     rc->timeout_ms = opts.timeout_ms;
     rc->timeout_ts_us = now_us() + opts.timeout_ms * 1000;
@@ -202,6 +234,43 @@ void replication_app_client_base::end_request(request_context_ptr& request, erro
 
     request->callback_task->enqueue_rpc_response(err, resp);
     request->completed = true;
+
+    if (!request->is_read && _write_dedup_window > 0 && request->write_header.request_seq != 0)
+    {
+        zauto_lock l2(_write_seqs_lock);
+        auto it = _write_seqs.find(request->partition_index);
+        if (it != _write_seqs.end())
+            it->second.pending.erase(request->write_header.request_seq);
+    }
+}
+
+int64_t replication_app_client_base::next_write_seq(request_context_ptr& request)
+{
+    int64_t seq;
+    std::vector<request_context_ptr> expired;
+    {
+        zauto_lock l(_write_seqs_lock);
+        partition_write_seqs& ws = _write_seqs[request->partition_index];
+        seq = ++ws.last_seq;
+        if (_write_dedup_window > 0)
+        {
+            // the replicas do not know whether the writes out of the window are applied
+            auto end = ws.pending.upper_bound(seq - _write_dedup_window);
+            for (auto it = ws.pending.begin(); it != end; ++it)
+                expired.push_back(it->second);
+            ws.pending.erase(ws.pending.begin(), end);
+            ws.pending[seq] = request;
+        }
+    }
+
+    dsn_message_t nil(nullptr);
+    for (auto& rc : expired)
+    {
+        dwarn("%s.client: give up the write out of the dedup window, partition_index = %d, request_seq = %" PRId64,
+            _app_name.c_str(), rc->partition_index, rc->write_header.request_seq);
+        end_request(rc, ERR_TIMEOUT, nil);
+    }
+    return seq;
 }
 
 void replication_app_client_base::call(request_context_ptr request, bool from_meta_ack)
@@ -330,6 +399,7 @@ void replication_app_client_base::call_with_address(dsn::rpc_address addr, reque
         {
             request->write_header.gpid.app_id = _app_id;
             request->write_header.gpid.pidx = request->partition_index;
+            request->write_header.request_seq = next_write_seq(request);
             blob buffer(request->header_pos, 0, sizeof(request->write_header));
             binary_writer writer(buffer);
             marshall(writer, request->write_header);
@@ -344,6 +414,18 @@ void replication_app_client_base::call_with_address(dsn::rpc_address addr, reque
         request->header_pos = 0;
     }
 
+    // a write try times out earlier than the request so that it is retried,
+    // and the retries are deduplicated by the replicas with the same request seq
+    if (!request->is_read && _write_attempt_timeout_ms > 0)
+    {
+        auto nts = ::dsn_now_us();
+        int left_ms = (request->timeout_ts_us > nts + 1000 ? static_cast<int>((request->timeout_ts_us - nts) / 1000) : 1);
+
+        dsn_msg_options_t opts;
+        opts.timeout_ms = std::min(_write_attempt_timeout_ms, left_ms);
+        dsn_msg_set_options(msg, &opts, DSN_MSGM_TIMEOUT);
+    }
+
     {
         zauto_lock l(request->lock);
         rpc::call(
@@ -386,12 +468,21 @@ void replication_app_client_base::replica_rw_reply(
     //
     // some error codes do not need retry
     //
-    if (err == ERR_OK || err == ERR_HANDLER_NOT_FOUND)
+    if (err == ERR_OK || err == ERR_HANDLER_NOT_FOUND || err == ERR_DUPLICATE_WRITE || err == ERR_DEDUP_EXPIRED)
     {
         end_request(rc, err, response);
         return;
     }
 
+    // the replica is too stale, retry on the primary, 
+    // where the configuration is still valid
+    else if (err == ERR_STALE_READ)
+    {
+        rc->read_header.semantic = read_semantic::ReadLastUpdate;
+        call(rc.get(), false);
+        return;
+    }
+
     // retry 
     else
     {
@@ -571,6 +662,14 @@ dsn::rpc_address replication_app_client_base::get_address(bool is_write, read_se
     if (is_write || semantic == read_semantic::ReadLastUpdate)
         return config.primary;
 
+    // bounded staleness, using random secondary to offload the primary,
+    // which serves the read only when the secondary is too stale
+    else if (semantic == read_semantic::ReadBoundedStaleness && !config.secondaries.empty())
+    {
+        int r = random32(0, 1000) % static_cast<int>(config.secondaries.size());
+        return config.secondaries[r];
+    }
+
     // readsnapshot or readoutdated, using random
     else
     {
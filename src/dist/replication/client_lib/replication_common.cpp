@@ -52,9 +52,24 @@ replication_options::replication_options()
     staleness_for_commit = 10;
     max_mutation_count_in_prepare_list = 110;
     mutation_2pc_min_replica_count = 1;    
+    prepare_send_queue_throttling_bytes = 0;
+    prepare_batch_max_wait_ms = 0;
+    prepare_batch_max_kb = 64;
+    mutation_batch.max_kb = 1024;
+    mutation_batch.max_requests = 0;
+    mutation_batch.target_requests = 16;
+    mutation_batch.max_delay_ms = 5;
+    mutation_batch.adaptive = false;
+    apply_async_enabled = false;
+    apply_max_pending_count = 100;
+    write_dedup_enabled = false;
+    write_dedup_max_clients = 10000;
+    write_dedup_max_requests_per_client = 64;
+    write_dedup_max_response_bytes = 1024;
 
     group_check_disabled = false;
     group_check_interval_ms = 100000;
+    group_check_batch_enabled = false;
 
     checkpoint_disabled = false;
     checkpoint_interval_seconds = 100;
@@ -71,15 +86,29 @@ replication_options::replication_options()
     fd_beacon_interval_seconds = 3;
     fd_lease_seconds = 10;
     fd_grace_seconds = 15;
+    fd_read_lease_enabled = true;
 
     log_private_disabled = false;
     log_private_file_size_mb = 32;
     log_private_batch_buffer_kb = 512;
     log_private_force_flush = true;
+    log_private_learn_inline_kb = 1024;
+    log_private_compress = false;
 
     log_shared_file_size_mb = 32;
     log_shared_batch_buffer_kb = 0;
     log_shared_force_flush = false;
+    log_shared_group_commit_max_wait_us = 0;
+    log_shared_group_commit_max_batch_kb = 256;
+    log_shared_max_writes_in_flight = 1;
+    log_shared_compress = false;
+
+    log_replay_thread_count = 4;
+    replica_load_thread_count = 4;
+
+    log_preallocate = false;
+    log_recycle_file_count = 0;
+    log_direct_io = false;
 
     config_sync_disabled = false;
     config_sync_interval_ms = 30000;
@@ -91,6 +120,55 @@ replication_options::~replication_options()
 {
 }
 
+mutation_batch_options replication_options::get_mutation_batch_options(const char* app_type) const
+{
+    std::string section("replication");
+    if (app_type != nullptr)
+    {
+        section.append(".").append(app_type);
+    }
+
+    mutation_batch_options opts;
+    opts.max_kb =
+        (int)dsn_config_get_value_uint64(section.c_str(),
+        "mutation_batch_max_kb",
+        mutation_batch.max_kb,
+        "a mutation is full when the data of its requests reaches this size (KB)"
+        );
+    opts.max_requests =
+        (int)dsn_config_get_value_uint64(section.c_str(),
+        "mutation_batch_max_requests",
+        mutation_batch.max_requests,
+        "a mutation is full when it has this many requests, 0 for no limit"
+        );
+    opts.target_requests =
+        (int)dsn_config_get_value_uint64(section.c_str(),
+        "mutation_batch_target_requests",
+        mutation_batch.target_requests,
+        "expected requests per mutation under high load, for adaptive 2pc concurrency"
+        );
+    opts.max_delay_ms =
+        (int)dsn_config_get_value_uint64(section.c_str(),
+        "mutation_batch_max_delay_ms",
+        mutation_batch.max_delay_ms,
+        "expected max time (ms) a request waits for its mutation to be prepared, for adaptive 2pc concurrency"
+        );
+    opts.adaptive =
+        dsn_config_get_value_bool(section.c_str(),
+        "mutation_batch_adaptive",
+        mutation_batch.adaptive,
+        "whether to adapt the 2pc concurrency (up to staleness_for_commit) to the load and 2pc round-trip time"
+        );
+
+    if (opts.max_kb <= 0)
+        opts.max_kb = 1;
+    if (opts.target_requests <= 0)
+        opts.target_requests = 1;
+    if (opts.max_delay_ms <= 0)
+        opts.max_delay_ms = 1;
+    return opts;
+}
+
 void replication_options::read_meta_servers()
 {
     // read meta_servers from machine list file
@@ -125,19 +203,37 @@ void replication_options::initialize()
     app_name = app_info.name;
     app_dir = app_info.data_dir;
 
-    // slog_dir:
+    // slog_dirs, one shared log in each dir:
     // - if config[slog_dir] is empty: "app_dir/slog"
-    // - else: "config[slog_dir]/app_name/slog"
-    slog_dir = dsn_config_get_value_string("replication", "slog_dir", "", "shared log directory");
-    if (slog_dir.empty())
+    // - else if config[slog_dir] has one dir: "config[slog_dir]/app_name/slog"
+    // - else: "config[slog_dir][i]/app_name/slog.{i}.{count}"
+    // so the shared logs of a different count are not taken as the current ones
+    std::string slog_dirs_str = dsn_config_get_value_string("replication", "slog_dir", "", "shared log directory list, one shared log in each");
+    std::vector<std::string> sdirs;
+    ::dsn::utils::split_args(slog_dirs_str.c_str(), sdirs, ',');
+    if (sdirs.empty())
     {
-        slog_dir = app_dir;
+        sdirs.push_back(app_dir);
     }
     else
     {
-        slog_dir = utils::filesystem::path_combine(slog_dir, app_name);
+        for (auto& dir : sdirs)
+        {
+            dir = utils::filesystem::path_combine(dir, app_name);
+        }
+    }
+    for (size_t i = 0; i < sdirs.size(); i++)
+    {
+        if (sdirs.size() == 1)
+        {
+            slog_dirs.push_back(utils::filesystem::path_combine(sdirs[i], "slog"));
+        }
+        else
+        {
+            slog_dirs.push_back(utils::filesystem::path_combine(sdirs[i],
+                "slog." + std::to_string(i) + "." + std::to_string(sdirs.size())));
+        }
     }
-    slog_dir = utils::filesystem::path_combine(slog_dir, "slog");
 
     // data_dirs
     // - if config[data_dirs] is empty: "app_dir/reps"
@@ -198,6 +294,65 @@ void replication_options::initialize()
         mutation_2pc_min_replica_count,
         "minimum number of alive replicas under which write is allowed"
         );
+    prepare_send_queue_throttling_bytes =
+        dsn_config_get_value_uint64("replication",
+        "prepare_send_queue_throttling_bytes",
+        prepare_send_queue_throttling_bytes,
+        "client writes are rejected with ERR_CAPACITY_EXCEEDED when the bytes queued to any secondary exceed this value, 0 for disabled"
+        );
+    prepare_batch_max_wait_ms =
+        (int)dsn_config_get_value_uint64("replication",
+        "prepare_batch_max_wait_ms",
+        prepare_batch_max_wait_ms,
+        "maximum time (ms) a prepare waits for the prepares of other partitions to the same secondary to be sent in one message, 0 to disable prepare batching"
+        );
+    prepare_batch_max_kb =
+        (int)dsn_config_get_value_uint64("replication",
+        "prepare_batch_max_kb",
+        prepare_batch_max_kb,
+        "a prepare batch is sent once it reaches this size (KB)"
+        );
+    mutation_batch = get_mutation_batch_options(nullptr);
+    apply_async_enabled =
+        dsn_config_get_value_bool("replication",
+        "apply_async_enabled",
+        apply_async_enabled,
+        "whether to apply the committed mutations of primaries and secondaries in THREAD_POOL_LOCAL_APP "
+        "instead of the replica thread, only for the apps which declare set_read_thread_safe"
+        );
+    apply_max_pending_count =
+        (int)dsn_config_get_value_uint64("replication",
+        "apply_max_pending_count",
+        apply_max_pending_count,
+        "when this many committed mutations are not applied yet, the primary rejects client writes "
+        "and the secondaries defer their prepare acks"
+        );
+    write_dedup_enabled =
+        dsn_config_get_value_bool("replication",
+        "write_dedup_enabled",
+        write_dedup_enabled,
+        "whether the retries of client writes are answered from a per-partition dedup table instead of "
+        "being executed again, for the apps which declare set_write_dedup_supported"
+        );
+    write_dedup_max_clients =
+        (int)dsn_config_get_value_uint64("replication",
+        "write_dedup_max_clients",
+        write_dedup_max_clients,
+        "maximum count of clients in the dedup table of a partition, the least recently written ones are evicted"
+        );
+    write_dedup_max_requests_per_client =
+        (int)dsn_config_get_value_uint64("replication",
+        "write_dedup_max_requests_per_client",
+        write_dedup_max_requests_per_client,
+        "size of the window of the latest request seqs of a client tracked in the dedup table, "
+        "the client gives up the writes falling out of it"
+        );
+    write_dedup_max_response_bytes =
+        (int)dsn_config_get_value_uint64("replication",
+        "write_dedup_max_response_bytes",
+        write_dedup_max_response_bytes,
+        "responses larger than this are not kept in the dedup table, whose retries get ERR_DUPLICATE_WRITE instead"
+        );
 
     group_check_disabled =
         dsn_config_get_value_bool("replication",
@@ -211,6 +366,12 @@ void replication_options::initialize()
         group_check_interval_ms,
         "every what period (ms) we check the replica healthness"
         );
+    group_check_batch_enabled =
+        dsn_config_get_value_bool("replication",
+        "group_check_batch_enabled",
+        group_check_batch_enabled,
+        "whether the group checks of all primaries on a node are started by one timer and sent in one message per peer"
+        );
 
     checkpoint_disabled =
         dsn_config_get_value_bool("replication",
@@ -292,6 +453,12 @@ void replication_options::initialize()
         fd_grace_seconds,
         "grace (seconds) assigned to remote FD slaves (grace > lease)"
         );
+    fd_read_lease_enabled =
+        dsn_config_get_value_bool("replication",
+        "fd_read_lease_enabled",
+        fd_read_lease_enabled,
+        "whether primaries reject ReadLastUpdate reads once the FD lease from the meta server may have expired"
+        );
 
     log_private_disabled =
         dsn_config_get_value_bool("replication",
@@ -317,6 +484,18 @@ void replication_options::initialize()
         log_private_force_flush,
         "when write private log, whether to flush file after write done"
         );
+    log_private_learn_inline_kb =
+        (int)dsn_config_get_value_uint64("replication",
+        "log_private_learn_inline_kb",
+        log_private_learn_inline_kb,
+        "when the private log data to be learned is no larger than this (KB), only the data is sent instead of the log files, 0 to disable"
+        );
+    log_private_compress =
+        dsn_config_get_value_bool("replication",
+        "log_private_compress",
+        log_private_compress,
+        "whether to compress the private log blocks when they are written"
+        );
 
     log_shared_file_size_mb =
         (int)dsn_config_get_value_uint64("replication", 
@@ -336,6 +515,62 @@ void replication_options::initialize()
         log_shared_force_flush,
         "when write shared log, whether to flush file after write done"
         );
+    log_shared_group_commit_max_wait_us =
+        (int)dsn_config_get_value_uint64("replication",
+        "log_shared_group_commit_max_wait_us",
+        log_shared_group_commit_max_wait_us,
+        "maximum time (us) a shared log write waits for more mutations to join the batch, 0 to disable group commit"
+        );
+    log_shared_group_commit_max_batch_kb =
+        (int)dsn_config_get_value_uint64("replication",
+        "log_shared_group_commit_max_batch_kb",
+        log_shared_group_commit_max_batch_kb,
+        "maximum target batch size (KB) of shared log group commit"
+        );
+    log_shared_max_writes_in_flight =
+        (int)dsn_config_get_value_uint64("replication",
+        "log_shared_max_writes_in_flight",
+        log_shared_max_writes_in_flight,
+        "maximum count of concurrent shared log writes, which are still completed in order"
+        );
+    log_shared_compress =
+        dsn_config_get_value_bool("replication",
+        "log_shared_compress",
+        log_shared_compress,
+        "whether to compress the shared log blocks when they are written"
+        );
+
+    log_replay_thread_count =
+        (int)dsn_config_get_value_uint64("replication",
+        "log_replay_thread_count",
+        log_replay_thread_count,
+        "task count (in THREAD_POOL_REPLICATION) for reading, decoding and applying the shared log on startup, 1 for sequential replay"
+        );
+    replica_load_thread_count =
+        (int)dsn_config_get_value_uint64("replication",
+        "replica_load_thread_count",
+        replica_load_thread_count,
+        "thread count for loading the replicas on startup, divided among the data dirs, 1 for sequential loading"
+        );
+
+    log_preallocate =
+        dsn_config_get_value_bool("replication",
+        "log_preallocate",
+        log_preallocate,
+        "whether to preallocate the next log file in the background before it is used"
+        );
+    log_recycle_file_count =
+        (int)dsn_config_get_value_uint64("replication",
+        "log_recycle_file_count",
+        log_recycle_file_count,
+        "maximum count of garbage collected log files kept for reuse as the next log files, for each log"
+        );
+    log_direct_io =
+        dsn_config_get_value_bool("replication",
+        "log_direct_io",
+        log_direct_io,
+        "whether to write the log files with direct io, which bypasses the page cache"
+        );
 
     config_sync_disabled =
         dsn_config_get_value_bool("replication", 
@@ -63,6 +63,16 @@ inline int gpid_to_hash(global_partition_id gpid)
 typedef std::unordered_map< ::dsn::rpc_address, partition_status> node_statuses;
 typedef std::unordered_map< ::dsn::rpc_address, dsn::task_ptr> node_tasks;
 
+// how client writes are batched into mutations on the primary
+struct mutation_batch_options
+{
+    int32_t max_kb;          // a mutation is full when its data reaches this size
+    int32_t max_requests;    // or when it has this many requests, 0 for no limit
+    int32_t target_requests; // expected requests per mutation under high load
+    int32_t max_delay_ms;    // expected max time a request waits for its mutation to be prepared
+    bool    adaptive;        // adapt the 2pc concurrency to the load and 2pc round-trip time
+};
+
 class replication_options
 {
 public:
@@ -70,7 +80,7 @@ public:
 
     std::string app_name;
     std::string app_dir;
-    std::string slog_dir;
+    std::vector<std::string> slog_dirs; // one shared log in each dir
     std::vector<std::string> data_dirs;
 
     int32_t prepare_timeout_ms_for_secondaries;
@@ -80,9 +90,20 @@ public:
     int32_t staleness_for_commit;
     int32_t max_mutation_count_in_prepare_list;
     int32_t mutation_2pc_min_replica_count;
+    uint64_t prepare_send_queue_throttling_bytes;
+    int32_t prepare_batch_max_wait_ms;
+    int32_t prepare_batch_max_kb;
+    mutation_batch_options mutation_batch;
+    bool    apply_async_enabled;
+    int32_t apply_max_pending_count;
+    bool    write_dedup_enabled;
+    int32_t write_dedup_max_clients;
+    int32_t write_dedup_max_requests_per_client;
+    int32_t write_dedup_max_response_bytes;
     
     bool    group_check_disabled;
     int32_t group_check_interval_ms;
+    bool    group_check_batch_enabled;
 
     bool    checkpoint_disabled;
     int32_t checkpoint_interval_seconds;
@@ -99,15 +120,29 @@ public:
     int32_t fd_beacon_interval_seconds;
     int32_t fd_lease_seconds;
     int32_t fd_grace_seconds;
+    bool    fd_read_lease_enabled;
 
     bool    log_private_disabled;
     int32_t log_private_file_size_mb;
     int32_t log_private_batch_buffer_kb;
     bool    log_private_force_flush;
+    int32_t log_private_learn_inline_kb;
+    bool    log_private_compress;
 
     int32_t log_shared_file_size_mb;
     int32_t log_shared_batch_buffer_kb;
     bool    log_shared_force_flush;
+    int32_t log_shared_group_commit_max_wait_us;
+    int32_t log_shared_group_commit_max_batch_kb;
+    int32_t log_shared_max_writes_in_flight;
+    bool    log_shared_compress;
+
+    int32_t log_replay_thread_count;
+    int32_t replica_load_thread_count;
+
+    bool    log_preallocate;
+    int32_t log_recycle_file_count;
+    bool    log_direct_io;
 
     bool    config_sync_disabled;
     int32_t config_sync_interval_ms;
@@ -119,6 +154,9 @@ public:
     void initialize();
     ~replication_options();
 
+    // mutation_batch, overridden by the ones in [replication.<app_type>] if any
+    mutation_batch_options get_mutation_batch_options(const char* app_type) const;
+
 private:
     void read_meta_servers();
     void sanity_check();
@@ -35,13 +35,15 @@ int _kread_semanticValues[] = {
   read_semantic::ReadInvalid,
   read_semantic::ReadLastUpdate,
   read_semantic::ReadOutdated,
-  read_semantic::ReadSnapshot
+  read_semantic::ReadSnapshot,
+  read_semantic::ReadBoundedStaleness
 };
 const char* _kread_semanticNames[] = {
   "ReadInvalid",
   "ReadLastUpdate",
   "ReadOutdated",
-  "ReadSnapshot"
+  "ReadSnapshot",
+  "ReadBoundedStaleness"
 };
 
 int _klearn_typeValues[] = {
@@ -1205,6 +1207,14 @@ void read_request_header::__set_version_decree(const int64_t val) {
   this->version_decree = val;
 }
 
+void read_request_header::__set_max_staleness_decrees(const int64_t val) {
+  this->max_staleness_decrees = val;
+}
+
+void read_request_header::__set_max_staleness_ms(const int32_t val) {
+  this->max_staleness_ms = val;
+}
+
 uint32_t read_request_header::read(::apache::thrift::protocol::TProtocol* iprot) {
 
   apache::thrift::protocol::TInputRecursionTracker tracker(*iprot);
@@ -1260,6 +1270,22 @@ uint32_t read_request_header::read(::apache::thrift::protocol::TProtocol* iprot)
           xfer += iprot->skip(ftype);
         }
         break;
+      case 5:
+        if (ftype == ::apache::thrift::protocol::T_I64) {
+          xfer += iprot->readI64(this->max_staleness_decrees);
+          this->__isset.max_staleness_decrees = true;
+        } else {
+          xfer += iprot->skip(ftype);
+        }
+        break;
+      case 6:
+        if (ftype == ::apache::thrift::protocol::T_I32) {
+          xfer += iprot->readI32(this->max_staleness_ms);
+          this->__isset.max_staleness_ms = true;
+        } else {
+          xfer += iprot->skip(ftype);
+        }
+        break;
       default:
         xfer += iprot->skip(ftype);
         break;
@@ -1293,6 +1319,14 @@ uint32_t read_request_header::write(::apache::thrift::protocol::TProtocol* oprot
   xfer += oprot->writeI64(this->version_decree);
   xfer += oprot->writeFieldEnd();
 
+  xfer += oprot->writeFieldBegin("max_staleness_decrees", ::apache::thrift::protocol::T_I64, 5);
+  xfer += oprot->writeI64(this->max_staleness_decrees);
+  xfer += oprot->writeFieldEnd();
+
+  xfer += oprot->writeFieldBegin("max_staleness_ms", ::apache::thrift::protocol::T_I32, 6);
+  xfer += oprot->writeI32(this->max_staleness_ms);
+  xfer += oprot->writeFieldEnd();
+
   xfer += oprot->writeFieldStop();
   xfer += oprot->writeStructEnd();
   return xfer;
@@ -1304,6 +1338,8 @@ void swap(read_request_header &a, read_request_header &b) {
   swap(a.code, b.code);
   swap(a.semantic, b.semantic);
   swap(a.version_decree, b.version_decree);
+  swap(a.max_staleness_decrees, b.max_staleness_decrees);
+  swap(a.max_staleness_ms, b.max_staleness_ms);
   swap(a.__isset, b.__isset);
 }
 
@@ -1312,6 +1348,8 @@ read_request_header::read_request_header(const read_request_header& other34) {
   code = other34.code;
   semantic = other34.semantic;
   version_decree = other34.version_decree;
+  max_staleness_decrees = other34.max_staleness_decrees;
+  max_staleness_ms = other34.max_staleness_ms;
   __isset = other34.__isset;
 }
 read_request_header& read_request_header::operator=(const read_request_header& other35) {
@@ -1319,6 +1357,8 @@ read_request_header& read_request_header::operator=(const read_request_header& o
   code = other35.code;
   semantic = other35.semantic;
   version_decree = other35.version_decree;
+  max_staleness_decrees = other35.max_staleness_decrees;
+  max_staleness_ms = other35.max_staleness_ms;
   __isset = other35.__isset;
   return *this;
 }
@@ -1329,6 +1369,8 @@ void read_request_header::printTo(std::ostream& out) const {
   out << ", " << "code=" << to_string(code);
   out << ", " << "semantic=" << to_string(semantic);
   out << ", " << "version_decree=" << to_string(version_decree);
+  out << ", " << "max_staleness_decrees=" << to_string(max_staleness_decrees);
+  out << ", " << "max_staleness_ms=" << to_string(max_staleness_ms);
   out << ")";
 }
 
@@ -1345,6 +1387,14 @@ void write_request_header::__set_code(const  ::dsn::task_code& val) {
   this->code = val;
 }
 
+void write_request_header::__set_client_id(const int64_t val) {
+  this->client_id = val;
+}
+
+void write_request_header::__set_request_seq(const int64_t val) {
+  this->request_seq = val;
+}
+
 uint32_t write_request_header::read(::apache::thrift::protocol::TProtocol* iprot) {
 
   apache::thrift::protocol::TInputRecursionTracker tracker(*iprot);
@@ -1382,6 +1432,22 @@ uint32_t write_request_header::read(::apache::thrift::protocol::TProtocol* iprot
           xfer += iprot->skip(ftype);
         }
         break;
+      case 3:
+        if (ftype == ::apache::thrift::protocol::T_I64) {
+          xfer += iprot->readI64(this->client_id);
+          this->__isset.client_id = true;
+        } else {
+          xfer += iprot->skip(ftype);
+        }
+        break;
+      case 4:
+        if (ftype == ::apache::thrift::protocol::T_I64) {
+          xfer += iprot->readI64(this->request_seq);
+          this->__isset.request_seq = true;
+        } else {
+          xfer += iprot->skip(ftype);
+        }
+        break;
       default:
         xfer += iprot->skip(ftype);
         break;
@@ -1407,6 +1473,14 @@ uint32_t write_request_header::write(::apache::thrift::protocol::TProtocol* opro
   xfer += this->code.write(oprot);
   xfer += oprot->writeFieldEnd();
 
+  xfer += oprot->writeFieldBegin("client_id", ::apache::thrift::protocol::T_I64, 3);
+  xfer += oprot->writeI64(this->client_id);
+  xfer += oprot->writeFieldEnd();
+
+  xfer += oprot->writeFieldBegin("request_seq", ::apache::thrift::protocol::T_I64, 4);
+  xfer += oprot->writeI64(this->request_seq);
+  xfer += oprot->writeFieldEnd();
+
   xfer += oprot->writeFieldStop();
   xfer += oprot->writeStructEnd();
   return xfer;
@@ -1416,17 +1490,23 @@ void swap(write_request_header &a, write_request_header &b) {
   using ::std::swap;
   swap(a.gpid, b.gpid);
   swap(a.code, b.code);
+  swap(a.client_id, b.client_id);
+  swap(a.request_seq, b.request_seq);
   swap(a.__isset, b.__isset);
 }
 
 write_request_header::write_request_header(const write_request_header& other36) {
   gpid = other36.gpid;
   code = other36.code;
+  client_id = other36.client_id;
+  request_seq = other36.request_seq;
   __isset = other36.__isset;
 }
 write_request_header& write_request_header::operator=(const write_request_header& other37) {
   gpid = other37.gpid;
   code = other37.code;
+  client_id = other37.client_id;
+  request_seq = other37.request_seq;
   __isset = other37.__isset;
   return *this;
 }
@@ -1435,6 +1515,8 @@ void write_request_header::printTo(std::ostream& out) const {
   out << "write_request_header(";
   out << "gpid=" << to_string(gpid);
   out << ", " << "code=" << to_string(code);
+  out << ", " << "client_id=" << to_string(client_id);
+  out << ", " << "request_seq=" << to_string(request_seq);
   out << ")";
 }
 
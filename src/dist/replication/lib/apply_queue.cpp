@@ -0,0 +1,199 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Ordered per-replica queue for applying committed mutations to the app
+ *     in THREAD_POOL_LOCAL_APP.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#include "apply_queue.h"
+#include "replica.h"
+#include "mutation.h"
+#include "mutation_log.h"
+#include <dsn/dist/replication/replication_app_base.h>
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "replica.apply"
+
+namespace dsn { namespace replication {
+
+apply_queue::apply_queue(replica* r, int max_pending_count)
+    : _replica(r), _max_pending_count(max_pending_count)
+{
+    _last_enqueued_decree = 0;
+    _err = ERR_OK;
+    _notify_available = false;
+}
+
+apply_queue::~apply_queue()
+{
+    dassert(_apply_task == nullptr, "apply queue is deleted with mutations not applied yet");
+}
+
+void apply_queue::enqueue(mutation_ptr& mu)
+{
+    zauto_lock l(_lock);
+    if (_err != ERR_OK)
+    {
+        // replica is to be in PS_ERROR
+        _last_enqueued_decree = mu->data.header.decree;
+        return;
+    }
+
+    dassert(_queue.empty() || _last_enqueued_decree + 1 == mu->data.header.decree,
+        "%s: mutation %s is not applied in order, last enqueued decree = %" PRId64,
+        _replica->name(), mu->name(), _last_enqueued_decree);
+
+    _queue.push_back(mu);
+    _last_enqueued_decree = mu->data.header.decree;
+
+    if (_apply_task == nullptr)
+    {
+        // the replica is kept alive by the task
+        replica_ptr r = _replica;
+        _apply_task = tasking::enqueue(
+            LPC_APPLY_MUTATION,
+            nullptr,
+            [this, r]() { apply(); },
+            gpid_to_hash(_replica->get_gpid())
+            );
+    }
+}
+
+void apply_queue::drain()
+{
+    while (true)
+    {
+        ::dsn::task_ptr t;
+        {
+            zauto_lock l(_lock);
+            t = _apply_task;
+        }
+
+        if (t == nullptr)
+            return;
+
+        t->wait();
+    }
+}
+
+decree apply_queue::last_committed_decree() const
+{
+    zauto_lock l(_lock);
+    return (_queue.empty() && _err == ERR_OK) ? _replica->_app->last_committed_decree() : _last_enqueued_decree;
+}
+
+int apply_queue::pending_count() const
+{
+    zauto_lock l(_lock);
+    return static_cast<int>(_queue.size());
+}
+
+bool apply_queue::is_full() const
+{
+    zauto_lock l(_lock);
+    return static_cast<int>(_queue.size()) >= _max_pending_count;
+}
+
+bool apply_queue::is_full_and_notify()
+{
+    zauto_lock l(_lock);
+    if (static_cast<int>(_queue.size()) < _max_pending_count)
+        return false;
+
+    _notify_available = true;
+    return true;
+}
+
+void apply_queue::apply()
+{
+    while (true)
+    {
+        mutation_ptr mu;
+        {
+            zauto_lock l(_lock);
+            if (_queue.empty())
+            {
+                _apply_task = nullptr;
+                return;
+            }
+            mu = _queue.front();
+        }
+
+        error_code err = _replica->_app->write_internal(mu);
+
+        bool notify = false;
+        {
+            zauto_lock l(_lock);
+            _queue.pop_front();
+            if (err != ERR_OK)
+            {
+                _err = err;
+                _queue.clear();
+                _apply_task = nullptr;
+            }
+            if (_notify_available && static_cast<int>(_queue.size()) < _max_pending_count)
+            {
+                _notify_available = false;
+                notify = true;
+            }
+        }
+
+        if (notify)
+        {
+            replica_ptr r = _replica;
+            tasking::enqueue(
+                LPC_APPLY_QUEUE_AVAILABLE,
+                r.get(),
+                [r]() { r->on_apply_queue_available(); },
+                gpid_to_hash(r->get_gpid())
+                );
+        }
+
+        if (err != ERR_OK)
+        {
+            derror("%s: apply mutation %s failed, err = %s", _replica->name(), mu->name(), err.to_string());
+
+            replica_ptr r = _replica;
+            tasking::enqueue(
+                LPC_APPLY_MUTATION_FAILED,
+                r.get(),
+                [r, err]() { r->handle_local_failure(err); },
+                gpid_to_hash(r->get_gpid())
+                );
+            return;
+        }
+    }
+}
+
+}} // namespace
@@ -0,0 +1,93 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Ordered per-replica queue for applying committed mutations to the app
+ *     in THREAD_POOL_LOCAL_APP, so that slow app writes do not stall the
+ *     2pc of the replica (and of the others hashed to the same thread).
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#pragma once
+
+#include "replication_common.h"
+#include <deque>
+
+namespace dsn { namespace replication {
+
+//
+// mutations are enqueued in the replica thread in decree order, and are
+// applied one after another by a single task at a time; the replica thread
+// only tracks the decree of the last enqueued mutation, and is never blocked
+// by the queue: when max_pending_count mutations are not applied yet, the
+// primary rejects new client writes and the secondary defers its prepare
+// acks until the queue is available again (see replica::on_apply_queue_available)
+//
+class apply_queue
+{
+public:
+    apply_queue(replica* r, int max_pending_count);
+    ~apply_queue();
+
+    // called in the replica thread
+    void enqueue(mutation_ptr& mu);
+
+    // called in the replica thread, whether max_pending_count mutations are not applied yet
+    bool is_full() const;
+
+    // called in the replica thread, same as is_full, and if it is full, the replica
+    // is notified by on_apply_queue_available in its thread once it is not
+    bool is_full_and_notify();
+
+    // called in the replica thread, wait until all the enqueued mutations are applied
+    void drain();
+
+    // last committed decree of the app, including the enqueued mutations
+    decree last_committed_decree() const;
+
+    int pending_count() const;
+
+private:
+    // run in THREAD_POOL_LOCAL_APP
+    void apply();
+
+private:
+    replica                  *_replica;
+    int                      _max_pending_count;
+
+    mutable zlock            _lock;
+    std::deque<mutation_ptr> _queue; // the front one is being applied
+    decree                   _last_enqueued_decree;
+    ::dsn::task_ptr          _apply_task; // not null when there are mutations to apply
+    bool                     _notify_available;
+    error_code               _err; // no more mutations are applied after the first failure
+};
+
+}} // namespace
@@ -0,0 +1,235 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Block compression of the mutation log, see block_compression.h.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#include "block_compression.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace dsn { namespace replication {
+
+// a sequence is: token (literal length : 4, match length - min_match : 4), more literal length bytes,
+// literals, match offset (2 bytes, little endian), more match length bytes, where a length of 15
+// in the token is continued with bytes until one less than 255;
+// the last sequence has only literals, and the last 5 bytes are always literals
+static const int min_match = 4;
+static const int last_literals = 5;
+static const int match_find_limit = 12;
+static const int max_offset = 65535;
+static const int hash_bits = 12;
+
+static inline uint32_t read_u32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash_u32(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - hash_bits);
+}
+
+static inline uint8_t* write_length(uint8_t* op, int len)
+{
+    for (; len >= 255; len -= 255)
+    {
+        *op++ = 255;
+    }
+    *op++ = static_cast<uint8_t>(len);
+    return op;
+}
+
+static uint8_t* write_sequence(uint8_t* op, const uint8_t* literals, int literal_length, int offset, int match_length)
+{
+    uint8_t* token = op++;
+    *token = static_cast<uint8_t>((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15)
+    {
+        op = write_length(op, literal_length - 15);
+    }
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+
+    if (match_length > 0)
+    {
+        *op++ = static_cast<uint8_t>(offset & 0xff);
+        *op++ = static_cast<uint8_t>(offset >> 8);
+
+        int code = match_length - min_match;
+        *token |= static_cast<uint8_t>(code >= 15 ? 15 : code);
+        if (code >= 15)
+        {
+            op = write_length(op, code - 15);
+        }
+    }
+    return op;
+}
+
+int block_compress_bound(int size)
+{
+    return size + size / 255 + 16;
+}
+
+int block_compress(const char* src, int size, char* dst)
+{
+    const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+    uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+    int anchor = 0;
+
+    if (size > match_find_limit)
+    {
+        std::vector<int> table(1 << hash_bits, -1);
+        int match_start_limit = size - match_find_limit;
+        int match_end_limit = size - last_literals;
+        int ip = 0;
+
+        while (ip < match_start_limit)
+        {
+            uint32_t seq = read_u32(in + ip);
+            uint32_t h = hash_u32(seq);
+            int ref = table[h];
+            table[h] = ip;
+
+            if (ref < 0 || ip - ref > max_offset || read_u32(in + ref) != seq)
+            {
+                ip++;
+                continue;
+            }
+
+            int match_length = min_match;
+            while (ip + match_length < match_end_limit && in[ref + match_length] == in[ip + match_length])
+            {
+                match_length++;
+            }
+
+            op = write_sequence(op, in + anchor, ip - anchor, ip - ref, match_length);
+            ip += match_length;
+            anchor = ip;
+        }
+    }
+
+    op = write_sequence(op, in + anchor, size - anchor, 0, 0);
+    return static_cast<int>(op - reinterpret_cast<uint8_t*>(dst));
+}
+
+static inline bool read_length(const uint8_t*& ip, const uint8_t* iend, /*inout*/ size_t& len)
+{
+    uint8_t b;
+    do
+    {
+        if (ip >= iend)
+        {
+            return false;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+int block_decompress(const char* src, int size, char* dst, int capacity)
+{
+    const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+    const uint8_t* iend = ip + size;
+    uint8_t* ostart = reinterpret_cast<uint8_t*>(dst);
+    uint8_t* op = ostart;
+    uint8_t* oend = ostart + capacity;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(ip, iend, literal_length))
+        {
+            return -1;
+        }
+        if (static_cast<size_t>(iend - ip) < literal_length || static_cast<size_t>(oend - op) < literal_length)
+        {
+            return -1;
+        }
+        memcpy(op, ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+
+        // the last sequence
+        if (ip == iend)
+        {
+            break;
+        }
+
+        if (iend - ip < 2)
+        {
+            return -1;
+        }
+        size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > static_cast<size_t>(op - ostart))
+        {
+            return -1;
+        }
+
+        size_t match_length = token & 15;
+        if (match_length == 15 && !read_length(ip, iend, match_length))
+        {
+            return -1;
+        }
+        match_length += min_match;
+        if (static_cast<size_t>(oend - op) < match_length)
+        {
+            return -1;
+        }
+
+        const uint8_t* match = op - offset;
+        if (offset >= match_length)
+        {
+            memcpy(op, match, match_length);
+            op += match_length;
+        }
+        else
+        {
+            // overlapped, e.g., repeated bytes
+            for (size_t i = 0; i < match_length; i++)
+            {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return static_cast<int>(op - ostart);
+}
+
+}} // namespace
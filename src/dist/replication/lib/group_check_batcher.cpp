@@ -0,0 +1,225 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Node-level group check, see group_check_batcher.h.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#include "group_check_batcher.h"
+#include "replica.h"
+#include "mutation.h"
+#include "mutation_log.h"
+#include "replica_stub.h"
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "replica.check.batch"
+
+namespace dsn { namespace replication {
+
+//----------------- group_check_batcher ------------------------
+group_check_batcher::group_check_batcher(replica_stub* stub)
+    : _stub(stub)
+{
+    _pending_replica_count = 0;
+}
+
+void group_check_batcher::start_round()
+{
+    replicas rs = _stub->get_replicas_copy();
+
+    {
+        zauto_lock l(_lock);
+        if (_pending_replica_count > 0)
+        {
+            dwarn("last round of group check is not finished yet (%d replicas pending), skip this round",
+                _pending_replica_count);
+            return;
+        }
+        if (rs.empty())
+            return;
+        _pending_replica_count = static_cast<int>(rs.size());
+    }
+
+    for (auto& kv : rs)
+    {
+        replica_ptr r = kv.second;
+        tasking::enqueue(
+            LPC_GROUP_CHECK,
+            _stub,
+            [this, r]()
+            {
+                if (r->status() == PS_PRIMARY)
+                {
+                    r->broadcast_group_check();
+                }
+                finish_one();
+            },
+            gpid_to_hash(kv.first)
+            );
+    }
+}
+
+bool group_check_batcher::add(replica* r, const std::shared_ptr<group_check_request>& request)
+{
+    pending_check c;
+    c.r = r;
+    c.request = request;
+
+    zauto_lock l(_lock);
+    if (_pending_targets.find(request->node) != _pending_targets.end())
+    {
+        return false;
+    }
+
+    auto& checks = _batches[request->node];
+    if (checks == nullptr)
+    {
+        checks.reset(new std::vector<pending_check>());
+    }
+    checks->push_back(c);
+    return true;
+}
+
+void group_check_batcher::finish_one()
+{
+    std::unordered_map< ::dsn::rpc_address, pending_checks> batches;
+    {
+        zauto_lock l(_lock);
+        if (--_pending_replica_count > 0)
+            return;
+
+        batches.swap(_batches);
+        for (auto& kv : batches)
+        {
+            _pending_targets.insert(kv.first);
+        }
+    }
+
+    for (auto& kv : batches)
+    {
+        send_batch(kv.first, kv.second);
+    }
+}
+
+void group_check_batcher::send_batch(::dsn::rpc_address target, pending_checks checks)
+{
+    dinfo("send %d group checks to %s in a batch",
+        static_cast<int>(checks->size()), target.to_string());
+
+    std::vector<group_check_request> requests;
+    requests.reserve(checks->size());
+    for (auto& c : *checks)
+    {
+        requests.push_back(*c.request);
+    }
+
+    _stub->_counter_replicas_group_check_rpc.increment();
+    rpc::call(target, RPC_GROUP_CHECK_BATCH, requests, _stub,
+        [this, target, checks](error_code err, dsn_message_t request, dsn_message_t reply)
+        {
+            on_batch_reply(target, checks, err, reply);
+        }
+        );
+}
+
+void group_check_batcher::on_batch_reply(
+    ::dsn::rpc_address target,
+    pending_checks checks,
+    error_code err,
+    dsn_message_t reply
+    )
+{
+    std::vector<group_check_response> resps;
+    if (err == ERR_OK)
+    {
+        ::unmarshall(reply, resps);
+        if (resps.size() != checks->size())
+        {
+            derror("invalid group check batch reply from %s, %d responses for %d requests",
+                target.to_string(), static_cast<int>(resps.size()), static_cast<int>(checks->size()));
+            err = ERR_INVALID_DATA;
+        }
+    }
+
+    for (size_t i = 0; i < checks->size(); i++)
+    {
+        const pending_check& c = (*checks)[i];
+        auto resp = std::make_shared<group_check_response>();
+        if (err == ERR_OK)
+        {
+            *resp = resps[i];
+        }
+
+        replica_ptr r = c.r;
+        auto req = c.request;
+        tasking::enqueue(
+            LPC_GROUP_CHECK_BATCH_DISPATCH,
+            r.get(),
+            [r, err, req, resp]()
+            {
+                r->on_group_check_reply(err, req, resp);
+            },
+            gpid_to_hash(r->get_gpid())
+            );
+    }
+
+    // the replies are dispatched before the next batch to the target is sent
+    zauto_lock l(_lock);
+    _pending_targets.erase(target);
+}
+
+//----------------- group_check_batch_responder ------------------------
+group_check_batch_responder::group_check_batch_responder(dsn_message_t request, int count)
+    : _request(request), _responses(count), _pending_count(count)
+{
+    dsn_msg_add_ref(_request); // released in dctor
+}
+
+group_check_batch_responder::~group_check_batch_responder()
+{
+    dsn_msg_release_ref(_request);
+}
+
+void group_check_batch_responder::respond(int index, const group_check_response& resp)
+{
+    zauto_lock l(_lock);
+    _responses[index] = resp;
+    if (--_pending_count > 0)
+        return;
+
+    auto msg = dsn_msg_create_response(_request);
+    ::marshall(msg, _responses);
+    dsn_rpc_reply(msg);
+}
+
+}} // namespace
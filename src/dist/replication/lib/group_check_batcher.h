@@ -0,0 +1,116 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Node-level group check, where the group check requests of all the
+ *     primaries on this node to the same peer are sent in one
+ *     RPC_GROUP_CHECK_BATCH message every group_check_interval_ms, and
+ *     are responded in one reply.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#pragma once
+
+#include "replication_common.h"
+#include <vector>
+#include <unordered_set>
+
+namespace dsn { namespace replication {
+
+class replica_stub;
+
+//
+// on the primary node: each round asks all the replicas (in their threads)
+// to add their group check requests, and once all have been asked, sends
+// one batch to each peer; the responses in the reply are dispatched back to
+// the threads of the replicas, so on_group_check_reply works the same as
+// with the separate RPC_GROUP_CHECK
+//
+// a round is skipped if the replicas have not all added their requests in the
+// last round yet; a peer with a batch not replied yet is skipped in the round,
+// so that a slow peer does not delay the checks of the others, and a reply
+// is always handled before the next request to the same peer is made
+//
+class group_check_batcher
+{
+public:
+    explicit group_check_batcher(replica_stub* stub);
+
+    void start_round();
+
+    // called by the primaries in their threads during the round, returns false
+    // if the request is not added as the last batch to its peer is still pending
+    bool add(replica* r, const std::shared_ptr<group_check_request>& request);
+
+private:
+    struct pending_check
+    {
+        replica_ptr                          r;
+        std::shared_ptr<group_check_request> request;
+    };
+    typedef std::shared_ptr<std::vector<pending_check>> pending_checks;
+
+    // one replica has added its requests
+    void finish_one();
+    void send_batch(::dsn::rpc_address target, pending_checks checks);
+    void on_batch_reply(::dsn::rpc_address target, pending_checks checks, error_code err, dsn_message_t reply);
+
+private:
+    replica_stub *_stub;
+
+    zlock        _lock;
+    std::unordered_map< ::dsn::rpc_address, pending_checks> _batches; // of the current round
+    int          _pending_replica_count; // not added their requests yet
+    std::unordered_set< ::dsn::rpc_address> _pending_targets; // with the batches not replied yet
+};
+
+//
+// on the peer node: the requests in the same RPC_GROUP_CHECK_BATCH message
+// are handled in the threads of the replicas, and the responses are replied
+// in one message once all are done
+//
+class group_check_batch_responder : public ref_counter
+{
+public:
+    group_check_batch_responder(dsn_message_t request, int count);
+    ~group_check_batch_responder();
+
+    void respond(int index, const group_check_response& resp);
+
+private:
+    zlock                             _lock;
+    dsn_message_t                     _request;
+    std::vector<group_check_response> _responses;
+    int                               _pending_count;
+};
+
+typedef ::dsn::ref_ptr<group_check_batch_responder> group_check_batch_responder_ptr;
+
+}} // namespace
@@ -36,17 +36,34 @@
 # include "mutation.h"
 # include "mutation_log.h"
 # include "replica.h"
+# include <cmath>
+# include <climits>
 
 namespace dsn { namespace replication {
 
 std::atomic<uint64_t> mutation::s_tid(0);
 
+// the format marker of the log encoding in messages, which is never a valid app id
+// as the old encoding (marshalled mutation_data) starts with it
+static const int32_t MUTATION_LOG_ENCODING_MARKER = static_cast<int32_t>(0xdeadbeee);
+
+// size of the marshalled mutation_header: gpid, ballot, decree, log_offset, last_committed_decree
+static const int MUTATION_HEADER_BYTES = static_cast<int>(sizeof(int32_t) * 2 + sizeof(int64_t) * 4);
+
+// the updates of the client requests of at least this size are appended to the prepare
+// messages without copying
+static const int MUTATION_ZERO_COPY_MIN_BYTES = 256;
+
+// the mutations read from a buffer share it only when they take at least 1/n of it,
+// so that a retained mutation pins at most n times its own size
+static const int64_t MUTATION_MAX_PINNED_RATIO = 16;
+
 mutation::mutation()
 {
     next = nullptr;
     _private0 = 0; 
     _not_logged = 1;
-    _prepare_ts_ms = 0;
+    _prepare_ts_ns = 0;
     _prepare_request = nullptr;
     strcpy(_name, "0.0.0.0");
     _appro_data_bytes = sizeof(mutation_header);
@@ -73,7 +90,9 @@ mutation::~mutation()
 void mutation::copy_from(mutation_ptr& old)
 {
     data.updates = old->data.updates;
+    _encoded_updates = old->_encoded_updates;
     client_requests = old->client_requests;
+    dedup_ids = old->dedup_ids;
     _appro_data_bytes = old->_appro_data_bytes;
     _create_ts_ns = old->_create_ts_ns;
 
@@ -104,9 +123,17 @@ void mutation::copy_from(mutation_ptr& old)
     }
 }
 
-void mutation::add_client_request(task_code code, dsn_message_t request)
+void mutation::add_client_request(task_code code, dsn_message_t request, const write_dedup_id& id)
 {
+    if (id.is_valid() || !dedup_ids.empty())
+    {
+        dedup_ids.resize(data.updates.size());
+        dedup_ids.push_back(id);
+        _appro_data_bytes += sizeof(write_dedup_id);
+    }
+
     data.updates.push_back(mutation_update());
+    _encoded_updates = blob();
     mutation_update& update = data.updates.back();
     update.code = code;
     _appro_data_bytes += 32; // approximate code size
@@ -136,78 +163,315 @@ void mutation::add_client_request(task_code code, dsn_message_t request)
 
 void mutation::write_to(binary_writer& writer) const
 {
-    marshall(writer, data);
+    write_prefix(writer);
+    for (const mutation_update& update : data.updates)
+    {
+        writer.write(update.data.data(), update.data.length());
+    }
 }
 
-/*static*/ mutation_ptr mutation::read_from(binary_reader& reader, dsn_message_t from)
+void mutation::write_to(dsn_message_t msg) const
 {
-    mutation_ptr mu(new mutation());
-    unmarshall(reader, mu->data);
+    {
+        rpc_write_stream writer(msg);
+        write_prefix(writer);
+    }
+
+    // the small updates are copied in a row, and the large updates of the client requests
+    // are appended as they are, which are pinned by the requests until the message is sent
+    size_t count = data.updates.size();
+    size_t i = 0;
+    while (i < count)
+    {
+        if (client_requests[i] != nullptr && data.updates[i].data.length() >= MUTATION_ZERO_COPY_MIN_BYTES)
+        {
+            const blob& bb = data.updates[i].data;
+            dsn_msg_write_append(msg, bb.data(), static_cast<size_t>(bb.length()), client_requests[i]);
+            ++i;
+            continue;
+        }
+
+        rpc_write_stream writer(msg);
+        for (; i < count; ++i)
+        {
+            const blob& bb = data.updates[i].data;
+            if (client_requests[i] != nullptr && bb.length() >= MUTATION_ZERO_COPY_MIN_BYTES)
+                break;
+            writer.write(bb.data(), bb.length());
+        }
+    }
+}
+
+// the readers below check the remaining size first, as the data may come from the network
+static bool read_int(binary_reader& reader, /*out*/ int& val)
+{
+    if (reader.get_remaining_size() < static_cast<int>(sizeof(val)))
+        return false;
+    reader.read(val);
+    return true;
+}
 
-    for (const mutation_update& update : mu->data.updates)
+static bool read_update_code(binary_reader& reader, /*out*/ task_code& code)
+{
+    int len;
+    if (!read_int(reader, len) || len < 0 || len > reader.get_remaining_size())
+        return false;
+
+    std::string name(len, '\0');
+    if (len > 0)
+        reader.read(&name[0], len);
+    code = task_code(dsn_task_code_from_string(name.c_str(), TASK_CODE_INVALID));
+    return code != TASK_CODE_INVALID;
+}
+
+// the name of the mutation is set for logging once the header is read;
+// 'encoded_updates' returns the data from the update count on if present
+static bool read_header_and_count(binary_reader& reader, mutation_ptr& mu, /*out*/ int& size, blob* encoded_updates = nullptr)
+{
+    if (reader.get_remaining_size() < MUTATION_HEADER_BYTES + static_cast<int>(sizeof(size)))
     {
-        dassert(update.code != TASK_CODE_INVALID, "invalid mutation task code");
+        derror("invalid mutation with %d bytes", reader.get_remaining_size());
+        return false;
     }
 
-    mu->client_requests.resize(mu->data.updates.size());
+    unmarshall(reader, mu->data.header);
+    mu->set_id(mu->data.header.ballot, mu->data.header.decree);
 
-    if (nullptr != from)
+    if (encoded_updates != nullptr)
     {
-        mu->_prepare_request = from;
-        dsn_msg_add_ref(from); // released on dctor
+        *encoded_updates = reader.get_remaining_buffer();
+    }
+    reader.read(size);
+    return true;
+}
+
+/*static*/ mutation_ptr mutation::read_from(binary_reader& reader, dsn_message_t from)
+{
+    blob remaining = reader.get_remaining_buffer();
+    int32_t marker = 0;
+    if (remaining.length() >= static_cast<int>(sizeof(marker)))
+    {
+        memcpy(&marker, remaining.data(), sizeof(marker));
+    }
+    if (marker != MUTATION_LOG_ENCODING_MARKER)
+    {
+        // the old encoding without the format marker, i.e., the marshalled mutation_data
+        mutation_ptr mu(new mutation());
+        int size;
+        if (!read_header_and_count(reader, mu, size))
+        {
+            return nullptr;
+        }
+        if (size < 0 || size > reader.get_remaining_size() / static_cast<int>(2 * sizeof(int)))
+        {
+            derror("invalid update count %d in mutation %s", size, mu->name());
+            return nullptr;
+        }
+        mu->data.updates.resize(size);
+        for (auto& update : mu->data.updates)
+        {
+            int len;
+            if (!read_update_code(reader, update.code)
+                || !read_int(reader, len)
+                || len < 0 || len > reader.get_remaining_size())
+            {
+                derror("invalid update in mutation %s", mu->name());
+                return nullptr;
+            }
+            reader.backup(static_cast<int>(sizeof(len)));
+            reader.read(update.data);
+        }
+        init_read_mutation(mu, from);
+        return mu;
+    }
+    reader.skip(sizeof(marker));
+
+    mutation_ptr mu;
+    if (nullptr != from && !reader.get_buffer().has_holder())
+    {
+        // zero-copy: the updates refer to the message buffer directly,
+        // which is pinned by the holder (one more ref on the message)
+        remaining = reader.get_remaining_buffer();
+        dsn_msg_add_ref(from);
+        std::shared_ptr<char> holder(
+            const_cast<char*>(remaining.data()),
+            [from](char*) { dsn_msg_release_ref(from); }
+            );
+
+        binary_reader pinned_reader(blob(std::move(holder), 0, remaining.length()));
+        mu = read_from_log_file(pinned_reader, from);
+        reader.skip(pinned_reader.total_size() - pinned_reader.get_remaining_size());
+    }
+    else
+    {
+        mu = read_from_log_file(reader, from);
     }
-    
-    snprintf_p(mu->_name, sizeof(mu->_name),
-        "%" PRId32 ".%" PRId32 ".%" PRId64 ".%" PRId64,
-        mu->data.header.gpid.app_id,
-        mu->data.header.gpid.pidx,
-        mu->data.header.ballot,
-        mu->data.header.decree);
 
     return mu;
 }
 
+void mutation::cache_encoded_updates()
+{
+    _encoded_updates = encoded_updates();
+}
+
+blob mutation::encoded_updates() const
+{
+    if (_encoded_updates.length() > 0)
+    {
+        return _encoded_updates;
+    }
+
+    dassert(dedup_ids.empty() || dedup_ids.size() == data.updates.size(), "size must be equal");
+
+    binary_writer temp_writer;
+    int size = static_cast<int>(data.updates.size());
+    marshall(temp_writer, dedup_ids.empty() ? size : -size);
+    for (int i = 0; i < size; ++i)
+    {
+        marshall(temp_writer, data.updates[i].code);
+        marshall(temp_writer, static_cast<int>(data.updates[i].data.length()));
+        if (!dedup_ids.empty())
+        {
+            marshall(temp_writer, dedup_ids[i].client_id);
+            marshall(temp_writer, dedup_ids[i].request_seq);
+        }
+    }
+    return temp_writer.get_buffer();
+}
+
+void mutation::write_prefix(binary_writer& writer) const
+{
+    marshall(writer, MUTATION_LOG_ENCODING_MARKER);
+    marshall(writer, data.header);
+
+    blob bb = encoded_updates();
+    writer.write(bb.data(), bb.length());
+}
+
 void mutation::write_to_log_file(std::function<void(blob)> inserter) const
 {
     {
         binary_writer temp_writer;
         marshall(temp_writer, data.header);
-        marshall(temp_writer, static_cast<int>(data.updates.size()));
-        for (const mutation_update& update : data.updates)
-        {
-            marshall(temp_writer, update.code);
-            marshall(temp_writer, static_cast<int>(update.data.length()));
-        }
         inserter(temp_writer.get_buffer());
     }
 
+    inserter(encoded_updates());
+
     for (const mutation_update& update : data.updates)
     {
         inserter(update.data);
     }
 }
 
-/*static*/ mutation_ptr mutation::read_from_log_file(binary_reader& reader, dsn_message_t from)
+/*static*/ mutation_ptr mutation::read_from_log_file(binary_reader& reader, dsn_message_t from, int64_t pinned_size)
 {
     mutation_ptr mu(new mutation());
-    unmarshall(reader, mu->data.header);
+    blob encoded_updates;
     int size;
-    unmarshall(reader, size);
+    if (!read_header_and_count(reader, mu, size, &encoded_updates))
+    {
+        return nullptr;
+    }
+    bool has_dedup_ids = (size < 0);
+    if (has_dedup_ids)
+    {
+        size = (size == INT_MIN ? -1 : -size);
+    }
+
+    // the counts are validated against the data before any allocation, as they may come from
+    // the network, where each update takes at least its code and length (and the dedup id)
+    int min_update_bytes = static_cast<int>(2 * sizeof(int) + (has_dedup_ids ? sizeof(write_dedup_id) : 0));
+    if (size < 0 || size > reader.get_remaining_size() / min_update_bytes)
+    {
+        derror("invalid update count %d in mutation %s", size, mu->name());
+        return nullptr;
+    }
+
+    if (has_dedup_ids)
+    {
+        mu->dedup_ids.resize(size);
+    }
     mu->data.updates.resize(size);
     std::vector<int> lengths(size, 0);
+    int64_t total_length = 0;
     for (int i = 0; i < size; ++i)
     {
-        unmarshall(reader, mu->data.updates[i].code);
-        unmarshall(reader, lengths[i]);
+        if (!read_update_code(reader, mu->data.updates[i].code)
+            || !read_int(reader, lengths[i])
+            || (has_dedup_ids && reader.get_remaining_size() < static_cast<int>(sizeof(write_dedup_id))))
+        {
+            derror("invalid update in mutation %s", mu->name());
+            return nullptr;
+        }
+        if (has_dedup_ids)
+        {
+            unmarshall(reader, mu->dedup_ids[i].client_id);
+            unmarshall(reader, mu->dedup_ids[i].request_seq);
+        }
+        total_length += lengths[i];
+        if (lengths[i] < 0 || total_length > reader.get_remaining_size())
+        {
+            derror("invalid update length %d in mutation %s", lengths[i], mu->name());
+            return nullptr;
+        }
+    }
+    if (total_length > reader.get_remaining_size())
+    {
+        derror("invalid update lengths in mutation %s", mu->name());
+        return nullptr;
     }
-    for (int i = 0; i < size; ++i)
+    if (reader.get_buffer().has_holder())
+    {
+        int encoded_length = encoded_updates.length() - reader.get_remaining_size();
+        int mutation_length = encoded_length + static_cast<int>(total_length);
+        if (pinned_size <= 0)
+        {
+            pinned_size = reader.total_size();
+        }
+
+        // zero-copy: share the log block (or message) buffer when the mutation is large enough,
+        // or copy the mutation out at once so that it does not pin the whole buffer
+        blob buffer;
+        if (static_cast<int64_t>(mutation_length) * MUTATION_MAX_PINNED_RATIO >= pinned_size)
+        {
+            buffer = encoded_updates.range(0, mutation_length);
+        }
+        else
+        {
+            std::shared_ptr<char> holder(new char[mutation_length], [](char* ptr){ delete []ptr; });
+            memcpy(holder.get(), encoded_updates.data(), mutation_length);
+            buffer.assign(std::move(holder), 0, mutation_length);
+        }
+        reader.skip(static_cast<int>(total_length));
+
+        // no need to encode again when the mutation is written to the logs
+        mu->_encoded_updates = buffer.range(0, encoded_length);
+        int offset = encoded_length;
+        for (int i = 0; i < size; ++i)
+        {
+            mu->data.updates[i].data = buffer.range(offset, lengths[i]);
+            offset += lengths[i];
+        }
+    }
+    else
     {
-        int len = lengths[i];
-        std::shared_ptr<char> holder(new char[len], [](char* ptr){ delete []ptr; });
-        reader.read(holder.get(), len);
-        mu->data.updates[i].data.assign(holder, 0, len);
+        for (int i = 0; i < size; ++i)
+        {
+            int len = lengths[i];
+            std::shared_ptr<char> holder(new char[len], [](char* ptr){ delete []ptr; });
+            reader.read(holder.get(), len);
+            mu->data.updates[i].data.assign(holder, 0, len);
+        }
     }
 
+    init_read_mutation(mu, from);
+    return mu;
+}
+
+/*static*/ void mutation::init_read_mutation(mutation_ptr& mu, dsn_message_t from)
+{
     mu->client_requests.resize(mu->data.updates.size());
 
     if (nullptr != from)
@@ -215,15 +479,6 @@ void mutation::write_to_log_file(std::function<void(blob)> inserter) const
         mu->_prepare_request = from;
         dsn_msg_add_ref(from); // released on dctor
     }
-
-    snprintf_p(mu->_name, sizeof(mu->_name),
-        "%" PRId32 ".%" PRId32 ".%" PRId64 ".%" PRId64,
-        mu->data.header.gpid.app_id,
-        mu->data.header.gpid.pidx,
-        mu->data.header.ballot,
-        mu->data.header.decree);
-
-    return mu;
 }
 
 int mutation::clear_prepare_or_commit_tasks()
@@ -250,13 +505,25 @@ void mutation::wait_log_task() const
 }
 
 mutation_queue::mutation_queue(global_partition_id gpid, int max_concurrent_op /*= 2*/, bool batch_write_disabled /*= false*/)
-    : _max_concurrent_op(max_concurrent_op), _batch_write_disabled(batch_write_disabled)
+    : _max_concurrent_op(max_concurrent_op), _max_concurrent_op_limit(max_concurrent_op), _batch_write_disabled(batch_write_disabled)
 {
     std::stringstream ss;
     ss << gpid.app_id << "." << gpid.pidx << "." << "2pc#";
 
     _current_op_counter.init("eon.replication", ss.str().c_str(), COUNTER_TYPE_NUMBER, "current running 2pc#");
     _current_op_counter.set(0);
+
+    std::string prefix = ss.str();
+    _max_concurrent_op_counter.init("eon.replication", (prefix + ".max").c_str(), COUNTER_TYPE_NUMBER, "max concurrent 2pc#");
+    _max_concurrent_op_counter.set((uint64_t)max_concurrent_op);
+
+    ss.str("");
+    ss << gpid.app_id << "." << gpid.pidx << ".mutation.size(bytes)";
+    _mutation_size_counter.init("eon.replication", ss.str().c_str(), COUNTER_TYPE_NUMBER_PERCENTILES, "approximate size of the issued mutations");
+
+    ss.str("");
+    ss << gpid.app_id << "." << gpid.pidx << ".mutation.request#";
+    _mutation_request_count_counter.init("eon.replication", ss.str().c_str(), COUNTER_TYPE_NUMBER_PERCENTILES, "client requests per issued mutation");
     
     _current_op_count = 0;
     _pending_mutation = nullptr;
@@ -265,10 +532,40 @@ mutation_queue::mutation_queue(global_partition_id gpid, int max_concurrent_op /
         RPC_PREPARE,
         gpid_to_hash(gpid)
         );
+
+    _batch.max_kb = 1024;
+    _batch.max_requests = 0;
+    _batch.target_requests = 1;
+    _batch.max_delay_ms = 1;
+    _batch.adaptive = false;
+    _last_request_ts_ns = 0;
+    _avg_request_interval_ns = 0;
+    _avg_2pc_rtt_ns = 0;
+}
+
+void mutation_queue::set_batch_options(const mutation_batch_options& opts)
+{
+    _batch = opts;
+    if (!_batch.adaptive)
+    {
+        reset_max_concurrent_ops(_max_concurrent_op_limit);
+    }
 }
 
-mutation_ptr mutation_queue::add_work(task_code code, dsn_message_t request, replica* r)
+mutation_ptr mutation_queue::add_work(task_code code, dsn_message_t request, replica* r, const write_dedup_id& id)
 {
+    if (_batch.adaptive)
+    {
+        // idle periods longer than 1 second are not counted in full
+        uint64_t now = dsn_now_ns();
+        if (_last_request_ts_ns != 0)
+        {
+            double interval = static_cast<double>(std::min(now - _last_request_ts_ns, (uint64_t)1000000000));
+            _avg_request_interval_ns = (_avg_request_interval_ns == 0 ? interval : _avg_request_interval_ns * 0.9 + interval * 0.1);
+        }
+        _last_request_ts_ns = now;
+    }
+
     // batch and add to work queue
     if (!_pending_mutation)
     {
@@ -278,7 +575,7 @@ mutation_ptr mutation_queue::add_work(task_code code, dsn_message_t request, rep
     dinfo("add request with rpc_id=%016lx into mutation with mutation_tid=%" PRIu64,
           dsn_msg_rpc_id(request), _pending_mutation->tid());
 
-    _pending_mutation->add_client_request(code, request);
+    _pending_mutation->add_client_request(code, request, id);
 
     // short-cut
     if (_current_op_count < _max_concurrent_op 
@@ -287,13 +584,11 @@ mutation_ptr mutation_queue::add_work(task_code code, dsn_message_t request, rep
     {
         auto ret = _pending_mutation;
         _pending_mutation = nullptr;
-        _current_op_count++;
-        _current_op_counter.increment();
-        return ret;
+        return issue(ret);
     }
 
     // check if full
-    if (_batch_write_disabled || _pending_mutation->is_full())
+    if (_batch_write_disabled || is_full(_pending_mutation))
     {
         _pending_mutation->add_ref(); // released when unlink
         _hdr.add(_pending_mutation);
@@ -311,15 +606,11 @@ mutation_ptr mutation_queue::add_work(task_code code, dsn_message_t request, rep
 
         auto ret = _pending_mutation;
         _pending_mutation = nullptr;
-        _current_op_count++;
-        _current_op_counter.increment();
-        return ret;
+        return issue(ret);
     }
     else
     {
-        _current_op_count++;
-        _current_op_counter.increment();
-        return unlink_next_workload();
+        return issue(unlink_next_workload());
     }
 }
 
@@ -338,9 +629,7 @@ mutation_ptr mutation_queue::check_possible_work(int current_running_count)
         {
             auto ret = _pending_mutation;
             _pending_mutation = nullptr;
-            _current_op_count++;
-            _current_op_counter.increment();
-            return ret;
+            return issue(ret);
         }
         else
         {
@@ -351,9 +640,50 @@ mutation_ptr mutation_queue::check_possible_work(int current_running_count)
     // run further workload
     else
     {
-        _current_op_count++;
-        _current_op_counter.increment();
-        return unlink_next_workload();
+        return issue(unlink_next_workload());
+    }
+}
+
+void mutation_queue::on_mutation_committed(uint64_t rtt_ns)
+{
+    if (!_batch.adaptive)
+        return;
+
+    double rtt = static_cast<double>(rtt_ns);
+    _avg_2pc_rtt_ns = (_avg_2pc_rtt_ns == 0 ? rtt : _avg_2pc_rtt_ns * 0.9 + rtt * 0.1);
+    adapt_concurrency();
+}
+
+mutation_ptr mutation_queue::issue(mutation_ptr mu)
+{
+    _current_op_count++;
+    _current_op_counter.increment();
+
+    _mutation_size_counter.set((uint64_t)mu->appro_data_bytes());
+    _mutation_request_count_counter.set((uint64_t)mu->client_requests.size());
+    return mu;
+}
+
+void mutation_queue::adapt_concurrency()
+{
+    // mutations to be issued per ns
+    double rate = 1.0 / (_batch.max_delay_ms * 1000000.0);
+    if (_avg_request_interval_ns > 0)
+    {
+        rate = std::max(rate, 1.0 / (_avg_request_interval_ns * _batch.target_requests));
+    }
+
+    int c = static_cast<int>(std::ceil(rate * _avg_2pc_rtt_ns));
+    if (c < 1)
+        c = 1;
+    else if (c > _max_concurrent_op_limit)
+        c = _max_concurrent_op_limit;
+
+    if (c != _max_concurrent_op)
+    {
+        dinfo("2pc concurrency adapted from %d to %d, avg request interval = %.0lf ns, avg 2pc rtt = %.0lf ns",
+            _max_concurrent_op, c, _avg_request_interval_ns, _avg_2pc_rtt_ns);
+        reset_max_concurrent_ops(c);
     }
 }
 
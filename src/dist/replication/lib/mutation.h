@@ -45,6 +45,17 @@
 
 namespace dsn { namespace replication {
 
+// identifies a client write across its retries, see write_request_header
+struct write_dedup_id
+{
+    int64_t client_id; // 0 for no dedup
+    int64_t request_seq;
+
+    write_dedup_id() : client_id(0), request_seq(0) {}
+    write_dedup_id(int64_t cid, int64_t seq) : client_id(cid), request_seq(seq) {}
+    bool is_valid() const { return client_id != 0; }
+};
+
 class mutation : public ref_counter
 {
 public:
@@ -57,16 +68,18 @@ public:
     bool is_logged() const { return _not_logged == 0; }
     bool is_ready_for_commit() const { return _private0 == 0; }
     dsn_message_t prepare_msg() { return _prepare_request; }
+    ::dsn::rpc_address prepare_ack_address() const { return _prepare_ack_address; }
     unsigned int left_secondary_ack_count() const { return _left_secondary_ack_count; }
     unsigned int left_potential_secondary_ack_count() const { return _left_potential_secondary_ack_count; }
     ::dsn::task_ptr& log_task() { return _log_task; }
     node_tasks& remote_tasks() { return _prepare_or_commit_tasks; }
-    bool is_prepare_close_to_timeout(int gap_ms, int timeout_ms) { return dsn_now_ms() + gap_ms >= _prepare_ts_ms + timeout_ms; }
+    bool is_prepare_close_to_timeout(int gap_ms, int timeout_ms) { return dsn_now_ms() + gap_ms >= _prepare_ts_ns / 1000000 + timeout_ms; }
+    uint64_t prepare_ts_ns() const { return _prepare_ts_ns; }
     uint64_t create_ts_ns() const { return _create_ts_ns; }
 
     // state change
     void set_id(ballot b, decree c);
-    void add_client_request(task_code code, dsn_message_t request);
+    void add_client_request(task_code code, dsn_message_t request, const write_dedup_id& id = write_dedup_id());
     void copy_from(mutation_ptr& old);
     void set_logged() { dassert (!is_logged(), ""); _not_logged = 0; }
     unsigned int decrease_left_secondary_ack_count() { return --_left_secondary_ack_count; }
@@ -75,18 +88,40 @@ public:
     void set_left_potential_secondary_ack_count(unsigned int count) { _left_potential_secondary_ack_count = count; }
     int  clear_prepare_or_commit_tasks();
     void wait_log_task() const;
-    void set_prepare_ts() { _prepare_ts_ms = dsn_now_ms(); }
+    void set_prepare_ts() { _prepare_ts_ns = dsn_now_ns(); }
+    // the prepare is received in a batch, and is acked with RPC_BATCHED_PREPARE_ACK to the address
+    void set_prepare_ack_address(::dsn::rpc_address addr) { _prepare_ack_address = addr; }
 
-    // >= 1 MB
-    bool is_full() const { return _appro_data_bytes >= 1024 * 1024; }
+    // approximate size of the header and the updates
+    int appro_data_bytes() const { return _appro_data_bytes; }
     
-    // general reader & writer
+    // general reader & writer, e.g., for prepare messages and learning, which use the
+    // encoding of the mutation log file after a format marker, while the old encoding
+    // (marshalled mutation_data) without the marker is still readable;
+    // the message writer appends the large updates of the client requests to the message
+    // without copying them; the reader returns nullptr if the data is invalid
     void write_to(binary_writer& writer) const;
+    void write_to(dsn_message_t msg) const;
     static mutation_ptr read_from(binary_reader& reader, dsn_message_t from);
 
     // write-to/read-from mutation log file, for better performance
+    // the encoding is: header, update count, (code, length) of all updates, and the update data,
+    // where only the header is re-encoded for each log (as log_offset is different), 
+    // and the others are shared by reference (see encoded_updates);
+    // when dedup_ids is present, the update count is negated and each (code, length)
+    // is followed by (client_id, request_seq), so that the old logs are still readable;
+    // the reader returns nullptr if the counts or the lengths are beyond the data;
+    // when the reader buffer has a holder, the mutation shares it only if the mutation is a
+    // large part of the buffer pinned by the holder, whose size is 'pinned_size' (0 for the
+    // reader buffer size), or it is copied out, so a retained mutation never pins much more
+    // memory than its own size
     void write_to_log_file(std::function<void(blob)> inserter) const;
-    static mutation_ptr read_from_log_file(binary_reader& reader, dsn_message_t from);
+    static mutation_ptr read_from_log_file(binary_reader& reader, dsn_message_t from, int64_t pinned_size = 0);
+
+    // encode the update count and (code, length) of all updates once the updates are
+    // complete (before the mutation is prepared), so that the logs and the prepare messages
+    // share the encoding instead of encoding it each time
+    void cache_encoded_updates();
 
     // data
     mutation_data  data;
@@ -94,9 +129,22 @@ public:
     // user requests
     std::vector<dsn_message_t> client_requests;
 
+    // dedup ids of the updates, empty if none of them is to be deduplicated
+    std::vector<write_dedup_id> dedup_ids;
+
     // used by pending mutation queue only
     mutation*      next;
         
+private:
+    // update count and (code, length) of all updates, which is the cached one (see
+    // cache_encoded_updates), or is encoded again if it is not cached
+    blob encoded_updates() const;
+    // the format marker and the log encoding before the update data
+    void write_prefix(binary_writer& writer) const;
+    // set the states of a mutation read from a message or a log, after the header
+    // (with the name) is read
+    static void init_read_mutation(mutation_ptr& mu, dsn_message_t from);
+
 private:
     union
     {
@@ -109,12 +157,14 @@ private:
         uint32_t _private0;
     };
 
-    uint64_t        _prepare_ts_ms;
+    uint64_t        _prepare_ts_ns;
     ::dsn::task_ptr _log_task;
     node_tasks      _prepare_or_commit_tasks;
     dsn_message_t   _prepare_request;
+    ::dsn::rpc_address _prepare_ack_address;
     char            _name[60]; // app_id.pidx.ballot.decree
     int             _appro_data_bytes;
+    blob            _encoded_updates; // see cache_encoded_updates, or sliced from the data read
     uint64_t        _create_ts_ns; // for profiling
     uint64_t        _tid; // trace id, unique in process
     static std::atomic<uint64_t> s_tid;
@@ -134,7 +184,7 @@ public:
             );
     }
 
-    mutation_ptr add_work(task_code code, dsn_message_t request, replica* r);
+    mutation_ptr add_work(task_code code, dsn_message_t request, replica* r, const write_dedup_id& id = write_dedup_id());
 
     void clear();
 
@@ -142,6 +192,15 @@ public:
     // which triggers further round of operations as returned
     mutation_ptr check_possible_work(int current_running_count);
 
+    // limits of the mutation size, and the targets for the adaptive concurrency
+    void set_batch_options(const mutation_batch_options& opts);
+
+    // called on the primary when a mutation issued by this queue is committed
+    void on_mutation_committed(uint64_t rtt_ns);
+
+    // the current 2pc concurrency
+    int max_concurrent_op() const { return _max_concurrent_op; }
+
 private:
     mutation_ptr unlink_next_workload()
     {
@@ -157,18 +216,43 @@ private:
     void reset_max_concurrent_ops(int max_c)
     {
         _max_concurrent_op = max_c;
+        _max_concurrent_op_counter.set((uint64_t)max_c);
+    }
+
+    bool is_full(const mutation_ptr& mu) const
+    {
+        return mu->appro_data_bytes() >= _batch.max_kb * 1024
+            || (_batch.max_requests > 0 && static_cast<int>(mu->client_requests.size()) >= _batch.max_requests);
     }
 
+    // the mutation is to be prepared
+    mutation_ptr issue(mutation_ptr mu);
+
+    // Little's law: mutations in flight = issue rate * 2pc round-trip time,
+    // where the issue rate is for target_requests per mutation at the observed
+    // request rate, yet no lower than one per max_delay_ms
+    void adapt_concurrency();
+
 private:    
     int  _current_op_count;
     int  _max_concurrent_op;
+    int  _max_concurrent_op_limit; // staleness_for_commit
     bool _batch_write_disabled;
+    mutation_batch_options _batch;
+
+    // moving averages for adaptive concurrency
+    uint64_t _last_request_ts_ns;
+    double   _avg_request_interval_ns;
+    double   _avg_2pc_rtt_ns;
     
     volatile int*   _pcount;
     mutation_ptr    _pending_mutation;
     slist<mutation> _hdr;
 
     perf_counter_  _current_op_counter;
+    perf_counter_  _max_concurrent_op_counter;
+    perf_counter_  _mutation_size_counter;
+    perf_counter_  _mutation_request_count_counter;
 };
 
 // ---------------------- inline implementation ----------------------------
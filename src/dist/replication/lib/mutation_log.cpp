@@ -35,8 +35,14 @@
 
 
 #include "mutation_log.h"
+#include "block_compression.h"
+#include <deque>
+#include <fstream>
+#include <unordered_set>
 #ifdef _WIN32
 #include <io.h>
+#else
+#include <sys/mman.h>
 #endif
 
 # ifdef __TITLE__
@@ -48,6 +54,12 @@ namespace dsn { namespace replication {
 
 using namespace ::dsn::service;
 
+// group commit batches are never aimed below this size
+static const uint32_t min_group_commit_batch_bytes = 4 * 1024;
+
+// min distance between two indexed blocks of the decree index of private logs
+static const int64_t decree_index_interval_bytes = 16 * 1024;
+
 mutation_log::mutation_log(
     const std::string& dir,
     int32_t batch_buffer_size_kb,
@@ -63,9 +75,44 @@ mutation_log::mutation_log(
     _max_log_file_size_in_bytes = static_cast<int64_t>(max_log_file_mb) * 1024L * 1024L;
     _batch_buffer_bytes = static_cast<uint32_t>(batch_buffer_size_kb) * 1024u;
     _force_flush = force_flush;
+    _preallocate = false;
+    _recycle_file_count = 0;
+    _max_writes_in_flight = 1;
+    _group_commit_max_wait_us = 0;
+    _group_commit_max_batch_bytes = 0;
+    _compress_blocks = false;
+    _direct_io = false;
     init_states();
 }
 
+void mutation_log::set_preallocation(bool preallocate, int recycle_file_count)
+{
+    dassert(!_is_opened, "preallocation must be set before the log is opened");
+    _preallocate = preallocate;
+    _recycle_file_count = recycle_file_count;
+}
+
+void mutation_log::set_block_compression(bool compress)
+{
+    dassert(!_is_opened, "block compression must be set before the log is opened");
+    _compress_blocks = compress;
+}
+
+void mutation_log::set_direct_io(bool direct_io)
+{
+    dassert(!_is_opened, "direct io must be set before the log is opened");
+    _direct_io = direct_io;
+}
+
+void mutation_log::set_group_commit(int max_wait_us, int max_batch_kb, int max_writes_in_flight)
+{
+    dassert(!_is_opened, "group commit must be set before the log is opened");
+    dassert(max_writes_in_flight > 0, "max_writes_in_flight must be positive");
+    _group_commit_max_wait_us = max_wait_us > 0 ? static_cast<uint64_t>(max_wait_us) : 0;
+    _group_commit_max_batch_bytes = std::max(static_cast<uint32_t>(max_batch_kb) * 1024u, min_group_commit_batch_bytes);
+    _max_writes_in_flight = max_writes_in_flight;
+}
+
 void mutation_log::init_states()
 {
     _is_opened = false;
@@ -78,15 +125,35 @@ void mutation_log::init_states()
     _global_end_offset = 0;
 
     // buffering
-    _is_writing = false;
-    _issued_write.reset();
+    _writes_in_flight = 0;
+    _issued_writes.clear();
     _issued_write_task = nullptr;
     _pending_write.reset();
     _pending_write_callbacks = nullptr;
     _pending_write_max_commit = 0;
+    _pending_write_start_us = 0;
+    _pending_write_max_decree_before = 0;
+
+    // group commit, starting with the smallest batch and no wait
+    _group_commit_batch_bytes = min_group_commit_batch_bytes;
+    _write_latency_us = 0;
+    _is_group_commit_timer_armed = false;
+
+    // ordered write completion
+    _next_write_seq = 0;
+    _next_completion_seq = 0;
+    _completed_writes.clear();
+    _failed_write_fence = 0;
+    _failed_write_err = ERR_OK;
+
+    // spare files, which are found again on next open
+    _spare_files.clear();
+    _next_spare_file_seq = 1;
+    _is_preparing_spare_file = false;
 
     // replica states
     _shared_log_info_map.clear();
+    _decree_index.clear();
     _private_log_info = {0, 0};
     _private_max_commit_on_disk = 0;
 }
@@ -96,7 +163,7 @@ mutation_log::~mutation_log()
     close();
 }
 
-error_code mutation_log::open(replay_callback callback)
+error_code mutation_log::open(replay_callback callback, int replay_thread_count)
 {
     dassert(!_is_opened, "cannot open a opened mutation_log");
     dassert(nullptr == _current_log_file, "the current log file must be null at this point");
@@ -131,6 +198,24 @@ error_code mutation_log::open(replay_callback callback)
     error_code err = ERR_OK;
     for (auto& fpath : file_list)
     {
+        char splitters[] = { '\\', '/', 0 };
+        std::string name = utils::get_last_component(fpath, splitters);
+        if (name.substr(0, strlen("log.spare.")) == "log.spare.")
+        {
+            if (_preallocate || _recycle_file_count > 0)
+            {
+                int seq = atoi(name.substr(strlen("log.spare.")).c_str());
+                _next_spare_file_seq = std::max(_next_spare_file_seq, seq + 1);
+                _spare_files.push_back(fpath);
+                ddebug("find spare log file %s", fpath.c_str());
+            }
+            else
+            {
+                dsn::utils::filesystem::remove_path(fpath);
+            }
+            continue;
+        }
+
         log_file_ptr log = log_file::open_read(fpath.c_str(), err);
         if (log == nullptr)
         {
@@ -154,7 +239,9 @@ error_code mutation_log::open(replay_callback callback)
     file_list.clear();
 
     // replay with the found files
+    // the callback may run concurrently for different gpids, so the states are updated with lock
     int64_t end_offset = 0;
+    uint64_t replay_start_ns = dsn_now_ns();
     err = replay(
         _log_files,
         [this, callback](mutation_ptr& mu)
@@ -168,20 +255,49 @@ error_code mutation_log::open(replay_callback callback)
 
             if (ret)
             {
-                this->update_max_decree_no_lock(mu->data.header.gpid, mu->data.header.decree);
+                this->update_max_decree(mu->data.header.gpid, mu->data.header.decree);
                 if (this->_is_private)
                 {
-                    this->update_max_commit_on_disk_no_lock(mu->data.header.last_committed_decree);
+                    this->update_max_commit_on_disk(mu->data.header.last_committed_decree);
                 }
             }
 
             return ret;
         },
-        end_offset
+        end_offset,
+        replay_thread_count
         );
 
     if (ERR_OK == err)
     {
+        if (_log_files.size() > 0)
+        {
+            double mb = (end_offset - _log_files.begin()->second->start_offset()) / 1024.0 / 1024.0;
+            double seconds = (dsn_now_ns() - replay_start_ns) / 1000000000.0;
+            ddebug("replay mutation log %s done with %d thread(s), files = %d, size = %.1f MB, "
+                "time = %.3f seconds, throughput = %.1f MB/s",
+                _dir.c_str(),
+                replay_thread_count,
+                static_cast<int>(_log_files.size()),
+                mb,
+                seconds,
+                seconds > 0 ? mb / seconds : 0.0
+                );
+        }
+
+        // the decree index starts with the files, as the max decree before each file is in its header
+        if (_is_private)
+        {
+            for (auto& kv : _log_files)
+            {
+                auto it = kv.second->previous_log_max_decrees().find(_private_gpid);
+                if (it != kv.second->previous_log_max_decrees().end())
+                {
+                    _decree_index.push_back(decree_index_entry{ it->second.max_decree, kv.second->start_offset(), 0, 0 });
+                }
+            }
+        }
+
         _global_start_offset = _log_files.size() > 0 ? _log_files.begin()->second->start_offset() : 0;
         _global_end_offset = end_offset;
         _last_file_index = _log_files.size() > 0 ? _log_files.rbegin()->first : 0;
@@ -236,7 +352,7 @@ void mutation_log::flush()
 {
     while (true)
     {
-        if (_is_writing)
+        if (_writes_in_flight > 0)
         {
             // TODO(qinzuoyan): why need wait about 25ms?
             dsn_task_tracker_wait_all(tracker());
@@ -244,7 +360,7 @@ void mutation_log::flush()
         else
         {
             zauto_lock _(_lock);
-            if (_is_writing)
+            if (_writes_in_flight > 0)
             {
                 continue;
             }
@@ -271,17 +387,31 @@ error_code mutation_log::create_new_log_file()
         dassert(_current_log_file->end_offset() == _global_end_offset, "");
     }
 
-    // create file
+    // create file, reuse the spare file if any
+    std::string spare;
+    if (!_spare_files.empty())
+    {
+        spare = _spare_files.front();
+        _spare_files.pop_front();
+    }
     log_file_ptr logf = log_file::create_write(
         _dir.c_str(),
         _last_file_index + 1,
-        _global_end_offset
+        _global_end_offset,
+        spare.empty() ? nullptr : spare.c_str(),
+        _direct_io
         );
     if (logf == nullptr)
     {
         derror ("cannot create log file with index %d", _last_file_index);
         return ERR_FILE_OPERATION_FAILED;
     }
+
+    // get the next file ready before it is needed
+    if (_preallocate)
+    {
+        prepare_spare_file_no_lock();
+    }
     dassert(logf->end_offset() == logf->start_offset(), "");
     dassert(_global_end_offset == logf->end_offset(), "");
     ddebug("create new log file %s succeed", logf->path().c_str());
@@ -321,6 +451,70 @@ error_code mutation_log::create_new_log_file()
     return ERR_OK;
 }
 
+void mutation_log::prepare_spare_file_no_lock()
+{
+    if (_is_preparing_spare_file || !_spare_files.empty())
+    {
+        return;
+    }
+
+    _is_preparing_spare_file = true;
+    std::string path = _dir + "/log.spare." + std::to_string(_next_spare_file_seq++);
+    int64_t size = _max_log_file_size_in_bytes;
+    mutation_log_ptr self(this);
+    tasking::enqueue(
+        LPC_PREPARE_LOG_FILE,
+        this,
+        [self, path, size]()
+        {
+            bool ok = log_file::preallocate(path.c_str(), size);
+
+            zauto_lock l(self->_lock);
+            self->_is_preparing_spare_file = false;
+            if (ok)
+            {
+                self->_spare_files.push_back(path);
+            }
+        }
+        );
+}
+
+bool mutation_log::remove_or_recycle_file(const std::string& fpath)
+{
+    std::string spare;
+    {
+        zauto_lock l(_lock);
+        if (static_cast<int>(_spare_files.size()) < _recycle_file_count)
+        {
+            spare = _dir + "/log.spare." + std::to_string(_next_spare_file_seq++);
+        }
+    }
+
+    std::string path = fpath;
+    if (!spare.empty() && log_file::rename_if_not_mapped(fpath, spare))
+    {
+        if (log_file::zero_fill(spare.c_str()))
+        {
+            ddebug("gc: log file %s is recycled as %s", fpath.c_str(), spare.c_str());
+
+            zauto_lock l(_lock);
+            _spare_files.push_back(spare);
+            return true;
+        }
+
+        // the old blocks would be read as corruption after the new ones
+        path = spare;
+    }
+
+    if (!dsn::utils::filesystem::remove_path(path))
+    {
+        return false;
+    }
+
+    ddebug("gc: log file %s is removed", fpath.c_str());
+    return true;
+}
+
 void mutation_log::create_new_pending_buffer()
 {
     dassert(_pending_write == nullptr, "");
@@ -328,6 +522,8 @@ void mutation_log::create_new_pending_buffer()
 
     _pending_write = _current_log_file->prepare_log_block();
     _pending_write_callbacks.reset(new std::list< ::dsn::task_ptr>);
+    _pending_write_start_us = dsn_now_us();
+    _pending_write_max_decree_before = _private_log_info.max_decree;
     _global_end_offset += _pending_write->data().front().length();
 }
 
@@ -335,7 +531,7 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
 {
     dassert(_pending_write != nullptr, "");
     dassert(_pending_write_callbacks != nullptr, "");
-    dassert(!_is_writing, "");
+    dassert(_writes_in_flight < _max_writes_in_flight, "");
 
     uint64_t start_offset = _global_end_offset - _pending_write->size();
     bool new_log_file = create_new_log_when_necessary
@@ -346,11 +542,31 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
         LPC_WRITE_REPLICATION_LOG_FLUSH
         : LPC_WRITE_REPLICATION_LOG_WITHOUT_FLUSH;
 
-    _is_writing = true;
-    _issued_write = _pending_write;
+    if (_is_private)
+    {
+        // index the block if it is the first one of a file, or far enough from the last indexed one
+        auto hdr = (log_block_header*)_pending_write->front().data();
+        if (hdr->local_offset == 0
+            || _decree_index.empty()
+            || static_cast<int64_t>(start_offset) - _decree_index.back().offset >= decree_index_interval_bytes)
+        {
+            _decree_index.push_back(decree_index_entry{
+                _pending_write_max_decree_before,
+                static_cast<int64_t>(start_offset),
+                _current_log_file->file_size(),
+                _current_log_file->chained_crc()
+                });
+        }
+    }
+
+    uint64_t seq = _next_write_seq++;
+    uint64_t issue_time_us = dsn_now_us();
+    _writes_in_flight++;
+    _issued_writes.push_back(_pending_write);
     _issued_write_task = _current_log_file->commit_log_block(
         *_pending_write,
         start_offset,
+        _compress_blocks,
         code,
         this,
         std::bind(
@@ -360,7 +576,9 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
             _current_log_file,
             _pending_write,
             _pending_write_callbacks,
-            _pending_write_max_commit),
+            _pending_write_max_commit,
+            seq,
+            issue_time_us),
         -1
         );
 
@@ -376,7 +594,9 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
                 _current_log_file,
                 _pending_write,
                 _pending_write_callbacks,
-                _pending_write_max_commit)
+                _pending_write_max_commit,
+                seq,
+                issue_time_us)
             );
         return ERR_FILE_OPERATION_FAILED;
     }
@@ -402,6 +622,77 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
     return ERR_OK;
 }
 
+void mutation_log::try_write_pending_mutations(bool wait_expired)
+{
+    if (_pending_write == nullptr || _writes_in_flight >= _max_writes_in_flight)
+    {
+        // tried again when any in-flight write is completed
+        return;
+    }
+
+    uint32_t size = static_cast<uint32_t>(_pending_write->size());
+    if (_group_commit_max_wait_us == 0)
+    {
+        if (size >= _batch_buffer_bytes)
+        {
+            auto err = write_pending_mutations();
+            dassert(
+                err == ERR_OK,
+                "write pending mutation failed, err = %s",
+                err.to_string()
+                );
+        }
+        return;
+    }
+
+    // waiting longer than a write takes does not make the batches larger than
+    // those accumulated behind the in-flight writes, it only adds latency
+    uint64_t wait_us = std::min(_group_commit_max_wait_us, _write_latency_us);
+    uint64_t waited_us = dsn_now_us() - _pending_write_start_us;
+    if (size >= _group_commit_batch_bytes)
+    {
+        // the batch is full before the deadline, aim for larger ones
+        _group_commit_batch_bytes = std::min(_group_commit_batch_bytes * 2, _group_commit_max_batch_bytes);
+    }
+    else if (wait_expired || waited_us >= wait_us)
+    {
+        // the batch cannot be full within the wait, aim for what arrives in time
+        _group_commit_batch_bytes = std::max(std::max(size, _group_commit_batch_bytes / 2), min_group_commit_batch_bytes);
+    }
+    else
+    {
+        if (!_is_group_commit_timer_armed)
+        {
+            // the timer is in milliseconds, a shorter wait just gives the concurrent
+            // appends a chance to join the batch
+            _is_group_commit_timer_armed = true;
+            uint64_t start_us = _pending_write_start_us;
+            mutation_log_ptr self(this);
+            tasking::enqueue(
+                LPC_MUTATION_LOG_PENDING_TIMER,
+                this,
+                [self, start_us]()
+                {
+                    zauto_lock l(self->_lock);
+                    self->_is_group_commit_timer_armed = false;
+                    self->try_write_pending_mutations(
+                        self->_pending_write != nullptr && self->_pending_write_start_us == start_us);
+                },
+                0,
+                std::chrono::milliseconds((wait_us - waited_us) / 1000)
+                );
+        }
+        return;
+    }
+
+    auto err = write_pending_mutations();
+    dassert(
+        err == ERR_OK,
+        "write pending mutation failed, err = %s",
+        err.to_string()
+        );
+}
+
 // called in background thread
 void mutation_log::internal_write_callback(
     error_code err,
@@ -409,10 +700,12 @@ void mutation_log::internal_write_callback(
     log_file_ptr file,
     std::shared_ptr<log_block> block,
     mutation_log::pending_callbacks_ptr callbacks,
-    decree max_commit
+    decree max_commit,
+    uint64_t seq,
+    uint64_t issue_time_us
     )
 {
-    dassert(_is_writing, "");
+    dassert(_writes_in_flight > 0, "");
 
     dinfo(
         "%s mutation log write callback, err = %s, size = %d",
@@ -422,14 +715,16 @@ void mutation_log::internal_write_callback(
         );
 
     auto hdr = (log_block_header*)block->front().data();
-    dassert(hdr->magic == 0xdeadbeef, "header magic is changed: 0x%x", hdr->magic);
+    dassert(hdr->magic == log_block_header::magic_default || hdr->magic == log_block_header::magic_compressed,
+        "header magic is changed: 0x%x", hdr->magic);
 
     if (err == ERR_OK)
     {
-        dassert(size == block->size(),
+        // the block may be written compressed
+        dassert(size == sizeof(log_block_header) + hdr->length,
             "log write size must equal to the given size: %d vs %d",
             (int)size,
-            block->size()
+            (int)(sizeof(log_block_header) + hdr->length)
             );
 
         if(_force_flush)
@@ -440,58 +735,86 @@ void mutation_log::internal_write_callback(
             // FIXME : the file could have been closed
             file->flush();
         }
-
-        if (_is_private)
-        {
-            // update _private_max_commit_on_disk after writen into log file done
-            update_max_commit_on_disk(max_commit);
-        }
     }
 
-    // here we use _is_writing instead of _issued_write.expired() to check writing done,
-    // because the following callbacks may run before "block" released, which may cause
-    // the next init_prepare() not starting the write.
-    _is_writing = false;
-
-    if (err == ERR_OK)
+    // when more than one writes are in flight, they may be done out of order, while
+    // a write is complete only when all the writes before it are done, so the done
+    // writes are held here and completed in the order of being issued
+    zauto_lock cl(_completion_lock);
+    std::vector<completed_write> completed;
     {
         zauto_lock l(_lock);
+        _completed_writes[seq] = completed_write{ err, size, callbacks, max_commit, dsn_now_us() - issue_time_us };
 
-        // trigger another round of writing if possible
-        if (!_is_writing
-            && _pending_write != nullptr
-            && static_cast<uint32_t>(_pending_write->size()) >= _batch_buffer_bytes)
+        bool all_ok = true;
+        while (!_completed_writes.empty() && _completed_writes.begin()->first == _next_completion_seq)
         {
-            auto err = write_pending_mutations();
-            dassert(
-                err == ERR_OK,
-                "write pending mutation failed, err = %s",
-                err.to_string()
-                );
+            completed_write w = std::move(_completed_writes.begin()->second);
+            _completed_writes.erase(_completed_writes.begin());
+
+            if (w.err != ERR_OK)
+            {
+                // the writes issued so far are behind a hole in the log, so they fail as well
+                _failed_write_fence = _next_write_seq;
+                _failed_write_err = w.err;
+            }
+            else if (_next_completion_seq < _failed_write_fence)
+            {
+                w.err = _failed_write_err;
+            }
+
+            _next_completion_seq++;
+            _writes_in_flight--;
+            _issued_writes.pop_front();
+
+            if (w.err == ERR_OK)
+            {
+                _write_latency_us = (_write_latency_us * 7 + w.latency_us) / 8;
+                if (_is_private)
+                {
+                    // update _private_max_commit_on_disk after writen into log file done
+                    update_max_commit_on_disk_no_lock(w.max_commit);
+                }
+            }
+            else
+            {
+                all_ok = false;
+            }
+            completed.push_back(std::move(w));
         }
-    }
 
-    if (!_is_private)
-    {
-        for (auto& cb : *callbacks)
+        // trigger another round of writing if possible
+        if (all_ok)
         {
-            cb->enqueue_aio(err, size);
+            try_write_pending_mutations();
         }
     }
-    else
+
+    for (auto& w : completed)
     {
-        for (auto& cb : *callbacks)
+        err = w.err;
+        if (!_is_private)
         {
-            if (err == ERR_OK)
+            for (auto& cb : *w.callbacks)
             {
-                bool r = cb->cancel(false);
-                dassert(r, "cancel must success as the task has never been enqueued yet");
+                cb->enqueue_aio(err, w.size);
             }
-            else
+        }
+        else
+        {
+            for (auto& cb : *w.callbacks)
             {
-                cb->enqueue_aio(err, size);
-                err = ERR_OK; // to cancel further callbacks as one callback is enough
-                              // to notify the failure
+                if (err == ERR_OK)
+                {
+                    bool r = cb->cancel(false);
+                    dassert(r, "cancel must success as the task has never been enqueued yet");
+                }
+                else
+                {
+                    cb->enqueue_aio(err, w.size);
+                    err = ERR_OK; // to cancel further callbacks as one callback is enough
+                                  // to notify the failure
+                }
             }
         }
     }
@@ -533,8 +856,13 @@ void mutation_log::internal_write_callback(
         while (!reader->is_eof())
         {
             auto old_size = reader->get_remaining_size();
-            mutation_ptr mu = mutation::read_from_log_file(*reader, nullptr);
-            dassert(nullptr != mu, "");
+            mutation_ptr mu = mutation::read_from_log_file(*reader, nullptr, log->read_buffer_size());
+            if (nullptr == mu)
+            {
+                derror("invalid mutation in log entry at %" PRId64, end_offset);
+                err = ERR_INVALID_DATA;
+                break;
+            }
             mu->set_logged();
 
             if (mu->data.header.log_offset != end_offset)
@@ -550,6 +878,12 @@ void mutation_log::internal_write_callback(
             end_offset += old_size - reader->get_remaining_size();
         }
 
+        if (err != ERR_OK)
+        {
+            // an invalid mutation stops the replay instead of being skipped with its block
+            break;
+        }
+
         err = log->read_next_log_block(bb);
         if (err != ERR_OK)
         {
@@ -598,7 +932,8 @@ void mutation_log::internal_write_callback(
 /*static*/ error_code mutation_log::replay(
     std::map<int, log_file_ptr>& logs,
     replay_callback callback,
-    /*out*/ int64_t& end_offset
+    /*out*/ int64_t& end_offset,
+    int thread_count
     )
 {
     int64_t g_start_offset = 0;
@@ -610,7 +945,6 @@ void mutation_log::internal_write_callback(
     if (logs.size() > 0)
     {
         g_start_offset = logs.begin()->second->start_offset();
-        g_end_offset = logs.rbegin()->second->end_offset();
         last_file_index = logs.begin()->first - 1;
     }
 
@@ -626,6 +960,21 @@ void mutation_log::internal_write_callback(
 
     end_offset = g_start_offset;
 
+    // for parallel replay, the files are read, verified and decoded ahead
+    // (at most thread_count files at the same time to bound the memory usage),
+    // and each file is applied with its mutations sharded by gpid, so that
+    // the mutations of one gpid are still applied in log order; both run as
+    // tasks in THREAD_POOL_REPLICATION, so the caller must not be in that pool
+    struct decoded_log_file
+    {
+        error_code                err;
+        int64_t                   end_offset;
+        std::vector<mutation_ptr> mutations;
+    };
+    typedef std::pair< ::dsn::task_ptr, std::shared_ptr<decoded_log_file>> decoding_log_file;
+    std::deque<decoding_log_file> decoding;
+    auto next_decode = logs.begin();
+
     for (auto& kv : logs)
     {
         log_file_ptr& log = kv.second;
@@ -634,13 +983,79 @@ void mutation_log::internal_write_callback(
         {
             derror("offset mismatch in log file offset and global offset %" PRId64 " vs %" PRId64,
                 log->start_offset(), end_offset);
-            return ERR_INVALID_DATA;
+            err = ERR_INVALID_DATA;
+            break;
         }
 
         last = log;
-        err = mutation_log::replay(log, callback, end_offset);
+        if (thread_count <= 1)
+        {
+            err = mutation_log::replay(log, callback, end_offset);
 
-        log->close();
+            log->close();
+        }
+        else
+        {
+            while (next_decode != logs.end() && decoding.size() < static_cast<size_t>(thread_count))
+            {
+                log_file_ptr dlog = next_decode->second;
+                auto df = std::make_shared<decoded_log_file>();
+                auto tsk = tasking::enqueue(LPC_REPLAY_DECODE_LOG_FILE, nullptr, [dlog, df]()
+                {
+                    df->err = mutation_log::replay(
+                        dlog,
+                        [&df](mutation_ptr& mu)
+                        {
+                            df->mutations.push_back(mu);
+                            return true;
+                        },
+                        df->end_offset
+                        );
+                    dlog->close();
+                },
+                next_decode->first
+                );
+                decoding.emplace_back(tsk, df);
+                ++next_decode;
+            }
+
+            decoding.front().first->wait();
+            decoded_log_file df = std::move(*decoding.front().second);
+            decoding.pop_front();
+
+            std::vector<std::vector<mutation_ptr>> shards(thread_count);
+            for (auto& mu : df.mutations)
+            {
+                auto hash = static_cast<unsigned int>(gpid_to_hash(mu->data.header.gpid));
+                shards[hash % thread_count].push_back(mu);
+            }
+            df.mutations.clear();
+
+            std::vector< ::dsn::task_ptr> applying;
+            for (int i = 0; i < thread_count; i++)
+            {
+                auto& shard = shards[i];
+                if (shard.empty())
+                    continue;
+
+                applying.push_back(tasking::enqueue(LPC_REPLAY_APPLY_MUTATIONS, nullptr, [&shard, &callback]()
+                {
+                    for (auto& mu : shard)
+                    {
+                        callback(mu);
+                    }
+                },
+                i
+                ));
+            }
+            for (auto& t : applying)
+            {
+                t->wait();
+            }
+
+            err = df.err;
+            end_offset = df.end_offset;
+        }
 
         if (err == ERR_OK || err == ERR_HANDLE_EOF)
         {
@@ -659,8 +1074,17 @@ void mutation_log::internal_write_callback(
         }
     }
 
+    // the files decoded ahead are dropped on errors
+    for (auto& d : decoding)
+    {
+        d.first->wait();
+    }
+
     if (err == ERR_OK || err == ERR_HANDLE_EOF)
     {
+        // the end offset of preallocated files is known only after they are read
+        g_end_offset = logs.size() > 0 ? logs.rbegin()->second->end_offset() : 0;
+
         // the log may still be written when used for learning
         dassert(g_end_offset <= end_offset,
             "make sure the global end offset is correct: %" PRId64 " vs %" PRId64,
@@ -798,9 +1222,6 @@ void mutation_log::check_valid_start_offset(global_partition_id gpid, int64_t va
             );
     }
 
-    // update meta data
-    update_max_decree_no_lock(mu->data.header.gpid, d);
-
     //
     // write to buffer
     //
@@ -809,6 +1230,9 @@ void mutation_log::check_valid_start_offset(global_partition_id gpid, int64_t va
         create_new_pending_buffer();
     }
 
+    // update meta data
+    update_max_decree_no_lock(mu->data.header.gpid, d);
+
     mu->data.header.log_offset = _global_end_offset;
     mu->write_to_log_file([this](blob bb)
     {
@@ -830,15 +1254,7 @@ void mutation_log::check_valid_start_offset(global_partition_id gpid, int64_t va
     }
 
     // start to write if possible
-    if (!_is_writing && static_cast<uint32_t>(_pending_write->size()) >= _batch_buffer_bytes)
-    {
-        err = write_pending_mutations();
-        dassert(
-            err == ERR_OK,
-            "write pending mutation failed, err = %s",
-            err.to_string()
-            );
-    }
+    try_write_pending_mutations();
 
     return tsk;
 }
@@ -866,6 +1282,7 @@ int64_t mutation_log::on_partition_reset(global_partition_id gpid, decree max_de
         replica_log_info old_info = _private_log_info;
         _private_log_info.max_decree = max_decree;
         _private_log_info.valid_start_offset = _global_end_offset;
+        _decree_index.clear();
         dwarn("replica %d.%d has changed private log max_decree from %" PRId64 " to %" PRId64 ", valid_start_offset from %" PRId64 " to %" PRId64,
             gpid.app_id, gpid.pidx,
             old_info.max_decree, _private_log_info.max_decree,
@@ -947,7 +1364,8 @@ void mutation_log::update_max_commit_on_disk_no_lock(decree d)
 void mutation_log::get_learn_state(
     global_partition_id gpid,
     ::dsn::replication::decree start,
-    /*out*/ ::dsn::replication::learn_state& state
+    /*out*/ ::dsn::replication::learn_state& state,
+    int64_t max_inline_bytes
     ) const
 {
     dassert(_is_private, "this method is only valid for private logs");
@@ -956,6 +1374,12 @@ void mutation_log::get_learn_state(
     std::map<int, log_file_ptr> files;
     std::map<int, log_file_ptr>::reverse_iterator itr;
     log_file_ptr cfile = nullptr;
+    ::dsn::blob buffered;
+    bool learn_range = false;
+    int64_t range_start = 0;
+    int64_t range_end = 0;
+    int64_t range_file_offset = 0;
+    uint32_t range_crc_seed = 0;
 
     {
         zauto_lock l(_lock);
@@ -967,9 +1391,12 @@ void mutation_log::get_learn_state(
 
         // also learn pending buffer
         std::vector<std::shared_ptr<log_block>> pending_buffers;
-        if (auto locked_issued_ptr = _issued_write.lock())
+        for (auto& issued : _issued_writes)
         {
-            pending_buffers.emplace_back(std::move(locked_issued_ptr));
+            if (auto locked_issued_ptr = issued.lock())
+            {
+                pending_buffers.emplace_back(std::move(locked_issued_ptr));
+            }
         }
         if (_pending_write)
         {
@@ -978,9 +1405,11 @@ void mutation_log::get_learn_state(
         }
 
         binary_writer temp_writer;
+        int64_t buffered_size = 0;
         for (auto& block : pending_buffers) {
             dassert(!block->data().empty(), "log block can never be empty");
             auto hdr = (log_block_header*)block->front().data();
+            buffered_size += block->size();
 
             //skip the block header
             auto bb_iterator = std::next(block->data().begin());
@@ -997,9 +1426,46 @@ void mutation_log::get_learn_state(
                 temp_writer.write(bb_iterator->data(), bb_iterator->length());
             }
         }
-        state.meta.push_back(temp_writer.get_buffer());
+        buffered = temp_writer.get_buffer();
+
+        // the last indexed block with all decrees before it less than 'start', from which
+        // the log data on disk (up to the buffered blocks) is all to be learned, if small enough;
+        // the buffered blocks are always the last ones, as there is only one write in flight
+        if (max_inline_bytes > 0 && _max_writes_in_flight == 1 && !files.empty())
+        {
+            auto it = std::upper_bound(_decree_index.begin(), _decree_index.end(), start,
+                [](decree d, const decree_index_entry& e) { return d <= e.max_decree_before; });
+            if (it != _decree_index.begin())
+            {
+                --it;
+                range_start = it->offset;
+                range_file_offset = it->file_offset;
+                range_crc_seed = it->crc_seed;
+                range_end = _global_end_offset - buffered_size;
+                learn_range = (range_start >= files.begin()->second->start_offset()
+                    && range_start >= _private_log_info.valid_start_offset
+                    && range_end - range_start <= max_inline_bytes);
+            }
+        }
     }
 
+    if (learn_range)
+    {
+        binary_writer range_writer;
+        auto err = read_log_range(files, range_start, range_file_offset, range_crc_seed, range_end, range_writer);
+        if (err == ERR_OK)
+        {
+            range_writer.write(buffered.data(), buffered.length());
+            state.meta.push_back(range_writer.get_buffer());
+            dinfo("learn private log range [%" PRId64 ", %" PRId64 ") with %d buffered bytes from decree %" PRId64,
+                range_start, range_end, buffered.length(), start);
+            return;
+        }
+        dwarn("read private log range [%" PRId64 ", %" PRId64 ") failed, err = %s, learn log files instead",
+            range_start, range_end, err.to_string());
+    }
+    state.meta.push_back(buffered);
+
     // flush last file so learning can learn the on-disk state
     if (nullptr != cfile) cfile->flush();
 
@@ -1047,6 +1513,76 @@ void mutation_log::get_learn_state(
     }
 }
 
+/*static*/ error_code mutation_log::read_log_range(
+    const std::map<int, log_file_ptr>& files,
+    int64_t start_offset,
+    int64_t start_file_offset,
+    uint32_t crc_seed,
+    int64_t end_offset,
+    /*out*/ binary_writer& writer
+    )
+{
+    int64_t offset = start_offset;
+    for (auto& kv : files)
+    {
+        if (kv.second->end_offset() <= offset)
+            continue;
+        if (offset >= end_offset)
+            break;
+
+        error_code err;
+        log_file_ptr log = log_file::open_read(kv.second->path().c_str(), err);
+        if (log == nullptr)
+        {
+            return err;
+        }
+
+        if (offset == log->start_offset())
+        {
+            log->reset_stream();
+        }
+        else if (offset > log->start_offset() && offset == start_offset)
+        {
+            log->seek_stream(offset - log->start_offset(), start_file_offset, crc_seed);
+        }
+        else
+        {
+            // there is a hole between the files
+            log->close();
+            return ERR_INVALID_DATA;
+        }
+
+        while (offset < end_offset)
+        {
+            ::dsn::blob bb;
+            err = log->read_next_log_block(bb);
+            if (err == ERR_HANDLE_EOF)
+            {
+                // continue with the next file
+                break;
+            }
+            else if (err != ERR_OK)
+            {
+                log->close();
+                return err;
+            }
+
+            int64_t block_start = offset;
+            offset += sizeof(log_block_header) + bb.length();
+            if (block_start == log->start_offset())
+            {
+                // skip the file header
+                binary_reader reader(bb);
+                bb = bb.range(log->read_file_header(reader));
+            }
+            writer.write(bb.data(), bb.length());
+        }
+        log->close();
+    }
+
+    return offset >= end_offset ? ERR_OK : ERR_INCOMPLETE_DATA;
+}
+
 int mutation_log::garbage_collection(global_partition_id gpid, decree durable_decree, int64_t valid_start_offset)
 {
     dassert(_is_private, "this method is only valid for private log");
@@ -1142,22 +1678,25 @@ int mutation_log::garbage_collection(global_partition_id gpid, decree durable_de
         // close first
         log->close();
 
-        // delete file
+        // delete or recycle file
         auto& fpath = log->path();
-        if (!dsn::utils::filesystem::remove_path(fpath))
+        if (!remove_or_recycle_file(fpath))
         {
             derror("gc: fail to remove %s, stop current gc cycle ...", fpath.c_str());
             break;
         }
 
         // delete succeed
-        ddebug("gc: log file %s is removed", fpath.c_str());
         deleted++;
 
-        // erase from _log_files
+        // erase from _log_files, and the index entries of the file
         {
             zauto_lock l(_lock);
             _log_files.erase(it->first);
+            while (!_decree_index.empty() && _decree_index.front().offset < log->end_offset())
+            {
+                _decree_index.pop_front();
+            }
         }
     }
 
@@ -1318,16 +1857,15 @@ int mutation_log::garbage_collection(replica_log_info_map& gc_condition)
         // close first
         log->close();
 
-        // delete file
+        // delete or recycle file
         auto& fpath = log->path();
-        if (!dsn::utils::filesystem::remove_path(fpath))
+        if (!remove_or_recycle_file(fpath))
         {
             derror("gc: fail to remove %s, stop current gc cycle ...", fpath.c_str());
             break;
         }
 
         // delete succeed
-        ddebug("gc: log file %s is removed", fpath.c_str());
         deleted++;
 
         // erase from _log_files
@@ -1347,8 +1885,22 @@ public:
     {
         _current_buffer = _buffers + 0;
         _next_buffer = _buffers + 1;
+        _mapping_size = 0;
+        _mapping_offset = 0;
+        _last_buffer_size = 0;
         fill_buffers();
     }
+    // read from the whole file mapping instead of the file handle
+    file_streamer(std::shared_ptr<char> mapping, size_t mapping_size, size_t file_offset)
+        : _file_dispatched_bytes(file_offset), _file_handle(nullptr)
+    {
+        _current_buffer = _buffers + 0;
+        _next_buffer = _buffers + 1;
+        _mapping = std::move(mapping);
+        _mapping_size = mapping_size;
+        _mapping_offset = file_offset;
+        _last_buffer_size = 0;
+    }
     ~file_streamer()
     {
         _current_buffer->wait_ongoing_task().end_tracking();
@@ -1357,6 +1909,12 @@ public:
     //try to reset file_offset
     void reset(size_t file_offset)
     {
+        if (_mapping != nullptr)
+        {
+            _mapping_offset = std::min(file_offset, _mapping_size);
+            return;
+        }
+
         _current_buffer->wait_ongoing_task().end_tracking();
         _next_buffer->wait_ongoing_task().end_tracking();
         //fast path if we can just move the cursor
@@ -1377,13 +1935,25 @@ public:
     //  ERR_FILE_OPERATION_FAILED   filesystem failure
     error_code read_next(size_t size, /*out*/ blob& result)
     {
+        if (_mapping != nullptr)
+        {
+            // zero-copy, the result points into the mapping and keeps it alive
+            size_t len = std::min(size, _mapping_size - _mapping_offset);
+            result.assign(_mapping, static_cast<int>(_mapping_offset), static_cast<int>(len));
+            _mapping_offset += len;
+            _last_buffer_size = _mapping_size;
+            return len == size ? ERR_OK : ERR_HANDLE_EOF;
+        }
+
         binary_writer writer(size);
 #define TRY(x) do {auto _x = (x); if (_x != ERR_OK) { result = writer.get_current_buffer(); return _x; } } while(0)
         TRY(_current_buffer->wait_ongoing_task());
         if (size < _current_buffer->length())
         {
-            result.assign(_current_buffer->_buffer.get(), _current_buffer->_begin, size);
+            // zero-copy, the result shares the buffer which is never refilled while referenced
+            result.assign(_current_buffer->_buffer, _current_buffer->_begin, size);
             _current_buffer->_begin += size;
+            _last_buffer_size = block_size_bytes;
         }
         else
         {
@@ -1405,11 +1975,14 @@ public:
                 }
             }
             result = writer.get_current_buffer();
+            _last_buffer_size = size;
         }
         fill_buffers();
         return ERR_OK;
 #undef TRY
     }
+    // size of the buffer which the last result of read_next refers to
+    size_t last_buffer_size() const { return _last_buffer_size; }
 private:
     void fill_buffers()
     {
@@ -1418,6 +1991,11 @@ private:
             _current_buffer->_begin = _current_buffer->_end = 0;
             _current_buffer->_file_offset_of_buffer = _file_dispatched_bytes;
             _current_buffer->_have_ongoing_task = true;
+            // the old buffer is still referenced by the blobs returned from read_next
+            if (_current_buffer->_buffer == nullptr || _current_buffer->_buffer.use_count() > 1)
+            {
+                _current_buffer->alloc();
+            }
             _current_buffer->_task = file::read(_file_handle, _current_buffer->_buffer.get(), block_size_bytes, _file_dispatched_bytes, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, dsn::empty_callback);
             _file_dispatched_bytes += block_size_bytes;
             std::swap(_current_buffer, _next_buffer);
@@ -1426,15 +2004,20 @@ private:
 
     //buffer size, in bytes
     static const size_t block_size_bytes = 1024 * 1024;
+    size_t _last_buffer_size;
     struct buffer_t
     {
-        std::unique_ptr<char[]> _buffer;    //with block_size
+        std::shared_ptr<char> _buffer;      //with block_size
         size_t _begin, _end;                // [buffer[begin]..buffer[end]) contains unconsumed_data
         size_t _file_offset_of_buffer;      //file offset projected to buffer[0]
         bool _have_ongoing_task;
         task_ptr _task;
 
-        buffer_t() : _buffer(new char[block_size_bytes]), _begin(0), _end(0), _have_ongoing_task(false), _file_offset_of_buffer(0) {}
+        buffer_t() : _begin(0), _end(0), _have_ongoing_task(false), _file_offset_of_buffer(0) {}
+        void alloc()
+        {
+            _buffer.reset(new char[block_size_bytes], [](char* ptr){ delete []ptr; });
+        }
         size_t length() const
         {
             return _end - _begin;
@@ -1475,14 +2058,42 @@ private:
     //number of bytes we have issued read operations
     size_t _file_dispatched_bytes;
     dsn_handle_t _file_handle;
+
+    //whole file mapping when the file is read through mmap
+    std::shared_ptr<char> _mapping;
+    size_t _mapping_size;
+    size_t _mapping_offset;
 };
 
 
 //------------------- log_file --------------------------
+// the files mapped for read (path => mapping, which is alive until the log_file and all
+// the blobs read from it are released), and the files open for write, see map_for_read
+static ::dsn::utils::ex_lock_nr s_file_pins_lock;
+static std::unordered_map<std::string, std::weak_ptr<char>> s_mapped_files;
+static std::unordered_set<std::string> s_writing_files;
+
 log_file::~log_file()
 {
     close();
 }
+
+/*static*/ bool log_file::rename_if_not_mapped(const std::string& from, const std::string& to)
+{
+    ::dsn::utils::auto_lock< ::dsn::utils::ex_lock_nr> l(s_file_pins_lock);
+    auto it = s_mapped_files.find(from);
+    if (it != s_mapped_files.end())
+    {
+        if (!it->second.expired())
+        {
+            // removing the file is still safe, as the mapping keeps the data
+            ddebug("log file %s is still mapped for read, skip renaming it to %s", from.c_str(), to.c_str());
+            return false;
+        }
+        s_mapped_files.erase(it);
+    }
+    return dsn::utils::filesystem::rename_path(from, to);
+}
 /*static */log_file_ptr log_file::open_read(const char* path, /*out*/ error_code& err)
 {
     char splitters[] = { '\\', '/', 0 };
@@ -1542,6 +2153,17 @@ log_file::~log_file()
     }
 
     auto lf = new log_file(path, hfile, index, start_offset, true);
+
+    static bool read_mmap = dsn_config_get_value_bool("replication",
+        "log_read_mmap",
+        false,
+        "whether to read log files (for replay and learning) through mmap instead of aio"
+        );
+    if (read_mmap)
+    {
+        lf->map_for_read();
+    }
+
     lf->reset_stream();
     blob hdr_blob;
     err = lf->read_next_log_block(hdr_blob);
@@ -1574,16 +2196,65 @@ log_file::~log_file()
         return nullptr;
     }
 
+    lf->scan_end_offset();
+
     err = ERR_OK;
     return lf;
 }
 
+void log_file::scan_end_offset()
+{
+    std::ifstream is(_path.c_str(), std::ios::binary);
+    if (!is.is_open())
+    {
+        dwarn("open log file %s to scan its blocks failed, end offset is taken from the file size", _path.c_str());
+        return;
+    }
+
+    // only the block headers (and the uncompressed lengths of the compressed blocks) are read,
+    // and the scan stops at the first block which is not valid, e.g., the garbage tail of a
+    // preallocated file, which is then handled when the blocks are read
+    int64_t local_offset = 0;
+    int64_t file_offset = 0;
+    while (file_offset + static_cast<int64_t>(sizeof(log_block_header)) <= _file_size)
+    {
+        log_block_header hdr;
+        is.seekg(file_offset);
+        if (!is.read((char*)&hdr, sizeof(hdr)))
+            break;
+        if ((hdr.magic != log_block_header::magic_default && hdr.magic != log_block_header::magic_compressed)
+            || hdr.length < 0
+            || hdr.local_offset != static_cast<uint32_t>(local_offset)
+            || file_offset + static_cast<int64_t>(sizeof(hdr)) + hdr.length > _file_size)
+            break;
+
+        int64_t data_size = hdr.length;
+        if (hdr.magic == log_block_header::magic_compressed)
+        {
+            int32_t raw_size;
+            if (hdr.length < static_cast<int32_t>(sizeof(raw_size))
+                || !is.read((char*)&raw_size, sizeof(raw_size))
+                || raw_size < 0)
+                break;
+            data_size = raw_size;
+        }
+
+        local_offset += sizeof(hdr) + data_size;
+        file_offset += sizeof(hdr) + hdr.length;
+    }
+
+    _end_offset = _start_offset + local_offset;
+}
+
 /*static*/ log_file_ptr log_file::create_write(
     const char* dir,
     int index,
-    int64_t start_offset
+    int64_t start_offset,
+    const char* spare_path,
+    bool direct_io
     )
 {
+    int direct_flag = direct_io ? DSN_FILE_DIRECT_IO : 0;
     char path[512]; 
     sprintf (path, "%s/log.%d.%" PRId64, dir, index, start_offset);
 
@@ -1593,14 +2264,118 @@ log_file::~log_file()
         return nullptr;
     }
 
-    dsn_handle_t hfile = dsn_file_open(path, O_RDWR | O_CREAT | O_BINARY, 0666);
+    // reuse the spare file, whose space is already allocated
+    if (spare_path != nullptr)
+    {
+        if (dsn::utils::filesystem::rename_path(spare_path, path))
+        {
+            dsn_handle_t hfile = dsn_file_open(path, O_RDWR | O_BINARY | direct_flag, 0);
+            if (hfile)
+            {
+                auto lf = new log_file(path, hfile, index, start_offset, false);
+                lf->_is_preallocated = true;
+                return lf;
+            }
+
+            dwarn("open spare log file %s failed, create a new one", path);
+            dsn::utils::filesystem::remove_path(path);
+        }
+        else
+        {
+            dwarn("rename spare log file %s to %s failed, create a new one", spare_path, path);
+        }
+    }
+
+    dsn_handle_t hfile = dsn_file_open(path, O_RDWR | O_CREAT | O_BINARY | direct_flag, 0666);
     if (!hfile)
     {
         dwarn("create log %s failed", path);
         return nullptr;
     }
 
-    return new log_file(path, hfile, index, start_offset, false);
+    auto lf = new log_file(path, hfile, index, start_offset, false);
+
+    // the last block is padded with zeros until the file is closed
+    lf->_is_preallocated = direct_io;
+    return lf;
+}
+
+/*static*/ bool log_file::zero_fill(const char* path)
+{
+# if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    int fd = ::open(path, O_RDWR);
+    if (fd < 0)
+    {
+        dwarn("open spare log file %s failed, err = %d", path, errno);
+        return false;
+    }
+
+    // only the extents are changed, the data is not written
+    int r = -1;
+    struct stat st;
+    if (::fstat(fd, &st) == 0)
+    {
+# ifdef FALLOC_FL_ZERO_RANGE
+        r = ::fallocate(fd, FALLOC_FL_ZERO_RANGE, 0, st.st_size);
+# endif
+        if (r != 0)
+        {
+            r = ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, st.st_size);
+            if (r == 0)
+            {
+                r = ::fallocate(fd, 0, 0, st.st_size);
+            }
+        }
+        if (r == 0)
+        {
+            r = ::fsync(fd);
+        }
+    }
+    int err = errno;
+    ::close(fd);
+
+    if (r != 0)
+    {
+        dwarn("zero fill spare log file %s failed, err = %d", path, err);
+        return false;
+    }
+    return true;
+# else
+    return false;
+# endif
+}
+
+/*static*/ bool log_file::preallocate(const char* path, int64_t size)
+{
+# ifdef __linux__
+    int fd = ::open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0)
+    {
+        dwarn("create spare log file %s failed, err = %d", path, errno);
+        return false;
+    }
+
+    // the file size is also changed, so fsync instead of fdatasync
+    int r = ::fallocate(fd, 0, 0, static_cast<off_t>(size));
+    if (r == 0)
+    {
+        r = ::fsync(fd);
+    }
+    int err = errno;
+    ::close(fd);
+
+    if (r != 0)
+    {
+        dwarn("preallocate spare log file %s with size %" PRId64 " failed, err = %d", path, size, err);
+        dsn::utils::filesystem::remove_path(path);
+        return false;
+    }
+
+    ddebug("spare log file %s is preallocated with size %" PRId64, path, size);
+    return true;
+# else
+    return false;
+# endif
 }
 
 log_file::log_file(
@@ -1613,13 +2388,24 @@ log_file::log_file(
 {
     _start_offset = start_offset;
     _end_offset = start_offset;
+    _file_size = 0;
     _handle = handle;
     _is_read = is_read;
+    _is_preallocated = false;
+    _read_offset = 0;
+    _read_file_offset = 0;
+    _read_buffer_size = 0;
     _path = path;
     _index = index;
     _crc32 = 0;
     memset(&_header, 0, sizeof(_header));
 
+    if (!is_read)
+    {
+        ::dsn::utils::auto_lock< ::dsn::utils::ex_lock_nr> l(s_file_pins_lock);
+        s_writing_files.insert(_path);
+    }
+
     if (is_read)
     {
         int64_t sz;
@@ -1628,14 +2414,67 @@ log_file::log_file(
             dassert(false, "fail to get file size of %s.", _path.c_str());
         }
         _end_offset += sz;
+        _file_size = sz;
     }
 }
 
+void log_file::map_for_read()
+{
+    size_t size = static_cast<size_t>(_file_size);
+    if (size == 0)
+    {
+        return;
+    }
+
+# ifdef _WIN32
+    dwarn("mmap read of log file %s is not supported on windows, use aio read instead", _path.c_str());
+# else
+    // pinned against being recycled until unmapped, see rename_if_not_mapped
+    ::dsn::utils::auto_lock< ::dsn::utils::ex_lock_nr> l(s_file_pins_lock);
+    if (s_writing_files.find(_path) != s_writing_files.end())
+    {
+        ddebug("log file %s is still open for write, use aio read instead of mmap", _path.c_str());
+        return;
+    }
+
+    int fd = ::open(_path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        dwarn("open log file %s for mmap failed, err = %d, use aio read instead", _path.c_str(), errno);
+        return;
+    }
+
+    void* addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd); // the mapping is still valid after the file is closed
+    if (addr == MAP_FAILED)
+    {
+        dwarn("mmap log file %s failed, err = %d, use aio read instead", _path.c_str(), errno);
+        return;
+    }
+
+    // the whole file is read sequentially, so read ahead as much as possible
+    ::madvise(addr, size, MADV_SEQUENTIAL);
+    ::madvise(addr, size, MADV_WILLNEED);
+
+    // unmapped when both the log file and all the blobs read from it are released
+    _mapping.reset(static_cast<char*>(addr), [size](char* ptr) { ::munmap(ptr, size); });
+    for (auto it = s_mapped_files.begin(); it != s_mapped_files.end();)
+    {
+        if (it->second.expired())
+            it = s_mapped_files.erase(it);
+        else
+            ++it;
+    }
+    s_mapped_files[_path] = _mapping;
+# endif
+}
+
 void log_file::close()
 {
     //_stream implicitly refer to _handle so it needs to be cleaned up first.
     //TODO: We need better abstraction to avoid those manual stuffs..
     _stream.reset(nullptr);
+    _mapping = nullptr;
     if (_handle)
     {
         error_code err = dsn_file_close(_handle);
@@ -1646,6 +2485,12 @@ void log_file::close()
             );
 
         _handle = nullptr;
+
+        if (!_is_read)
+        {
+            ::dsn::utils::auto_lock< ::dsn::utils::ex_lock_nr> l(s_file_pins_lock);
+            s_writing_files.erase(_path);
+        }
     }
 }
 
@@ -1653,6 +2498,19 @@ void log_file::flush() const
 {
     dassert (!_is_read, "log file must be of write mode");
 
+# ifdef __linux__
+    // the space of preallocated files is already allocated, so the metadata
+    // (e.g., file size) is not changed in most cases and fdatasync is enough
+    if (_handle && _is_preallocated)
+    {
+        int fd = static_cast<int>(reinterpret_cast<uintptr_t>(dsn_file_native_handle(_handle)));
+        if (fd > 0 && ::fdatasync(fd) == 0)
+        {
+            return;
+        }
+    }
+# endif
+
     if (_handle)
     {
         error_code err = dsn_file_flush(_handle);
@@ -1667,6 +2525,89 @@ void log_file::flush() const
 error_code log_file::read_next_log_block(/*out*/::dsn::blob& bb)
 {
     dassert (_is_read, "log file must be of read mode");
+
+    // the space after the last valid block of a preallocated or recycled file is zero filled,
+    // which means the end of the file rather than invalid data, see is_garbage_tail
+    bool garbage_tail = (_read_offset > 0 && _header.version == log_file_header::version_preallocated);
+
+    int32_t disk_length = 0;
+    auto err = read_log_block(bb, garbage_tail, disk_length);
+    if (err == ERR_OK)
+    {
+        _read_offset += sizeof(log_block_header) + bb.length();
+        _read_file_offset += sizeof(log_block_header) + disk_length;
+    }
+    else if (err == ERR_HANDLE_EOF)
+    {
+        // the file is smaller than the blocks when they are compressed
+        _end_offset = _start_offset + _read_offset;
+    }
+    else if (garbage_tail && (err == ERR_INVALID_DATA || err == ERR_INCOMPLETE_DATA))
+    {
+        if (is_garbage_tail(_read_file_offset))
+        {
+            ddebug("preallocated log file %s ends at local offset %" PRId64 ", file size = %" PRId64,
+                _path.c_str(), _read_offset, _file_size);
+            _end_offset = _start_offset + _read_offset;
+            err = ERR_HANDLE_EOF;
+        }
+        else
+        {
+            derror("preallocated log file %s is corrupted at local offset %" PRId64 " (file offset %" PRId64 
+                "), as the data after it is not zero filled, err = %s",
+                _path.c_str(), _read_offset, _read_file_offset, err.to_string());
+        }
+    }
+    return err;
+}
+
+bool log_file::is_garbage_tail(int64_t file_offset) const
+{
+    std::ifstream is(_path, std::ios::in | std::ios::binary);
+    if (!is)
+    {
+        derror("open log file %s to check its tail failed", _path.c_str());
+        return false;
+    }
+
+    // the last block may be torn by a crash, i.e., its data is partially written, so
+    // the check starts after it when its header is of the block expected here
+    int64_t zero_offset = file_offset;
+    log_block_header hdr;
+    is.seekg(file_offset);
+    if (is.read((char*)&hdr, sizeof(hdr))
+        && (hdr.magic == log_block_header::magic_default || hdr.magic == log_block_header::magic_compressed)
+        && hdr.length >= 0
+        && hdr.local_offset == static_cast<uint32_t>(_read_offset)
+        && file_offset + static_cast<int64_t>(sizeof(hdr)) + hdr.length <= _file_size)
+    {
+        zero_offset = file_offset + static_cast<int64_t>(sizeof(hdr)) + hdr.length;
+    }
+    is.clear();
+    is.seekg(zero_offset);
+
+    char buffer[64 * 1024];
+    int64_t left = _file_size - zero_offset;
+    while (left > 0)
+    {
+        auto n = static_cast<std::streamsize>(std::min(left, static_cast<int64_t>(sizeof(buffer))));
+        if (!is.read(buffer, n))
+        {
+            derror("read log file %s to check its tail failed", _path.c_str());
+            return false;
+        }
+        for (std::streamsize i = 0; i < n; i++)
+        {
+            if (buffer[i] != 0)
+                return false;
+        }
+        left -= n;
+    }
+    return true;
+}
+
+error_code log_file::read_log_block(/*out*/::dsn::blob& bb, bool garbage_tail, /*out*/ int32_t& disk_length)
+{
     auto err = _stream->read_next(sizeof(log_block_header), bb);
     if (err != ERR_OK || bb.length() != sizeof(log_block_header))
     {
@@ -1685,17 +2626,23 @@ error_code log_file::read_next_log_block(/*out*/::dsn::blob& bb)
     }
     log_block_header hdr = *reinterpret_cast<const log_block_header*>(bb.data());
 
-    if (hdr.magic != 0xdeadbeef)
+    if (hdr.magic != log_block_header::magic_default && hdr.magic != log_block_header::magic_compressed)
     {
-        derror("invalid data header magic: 0x%x", hdr.magic);
+        if (!garbage_tail)
+        {
+            derror("invalid data header magic: 0x%x", hdr.magic);
+        }
         return ERR_INVALID_DATA;
     }
 
     err = _stream->read_next(hdr.length, bb);
     if (err != ERR_OK || hdr.length != bb.length())
     {
-        derror("read data block body failed, size = %d vs %d, err = %s",
-            bb.length(), (int)hdr.length, err.to_string());
+        if (!garbage_tail)
+        {
+            derror("read data block body failed, size = %d vs %d, err = %s",
+                bb.length(), (int)hdr.length, err.to_string());
+        }
 
         if (err == ERR_OK || err == ERR_HANDLE_EOF)
         {
@@ -1709,18 +2656,48 @@ error_code log_file::read_next_log_block(/*out*/::dsn::blob& bb)
     auto crc = dsn_crc32_compute(static_cast<const void*>(bb.data()), static_cast<size_t>(hdr.length), _crc32);
     if (crc != hdr.body_crc)
     {
-        derror("crc checking failed");
+        if (!garbage_tail)
+        {
+            derror("crc checking failed");
+        }
         return ERR_INVALID_DATA;
     }
     _crc32 = crc;
+    _read_buffer_size = static_cast<int64_t>(_stream->last_buffer_size());
 
+    if (hdr.magic == log_block_header::magic_compressed)
+    {
+        int32_t length = 0;
+        if (bb.length() >= static_cast<int>(sizeof(length)))
+        {
+            memcpy(&length, bb.data(), sizeof(length));
+        }
+        if (length <= 0)
+        {
+            derror("invalid uncompressed length of compressed block: %d", length);
+            return ERR_INVALID_DATA;
+        }
+
+        std::shared_ptr<char> buffer(new char[length], [](char* ptr) { delete[] ptr; });
+        int size = block_decompress(bb.data() + sizeof(length), bb.length() - static_cast<int>(sizeof(length)),
+            buffer.get(), length);
+        if (size != length)
+        {
+            derror("decompress block failed, size = %d vs %d", size, length);
+            return ERR_INVALID_DATA;
+        }
+        bb.assign(std::move(buffer), 0, length);
+        _read_buffer_size = length;
+    }
+
+    disk_length = hdr.length;
     return ERR_OK;
 }
 
 std::shared_ptr<log_block> log_file::prepare_log_block() const
 {
     log_block_header hdr;
-    hdr.magic = 0xdeadbeef;
+    hdr.magic = log_block_header::magic_default;
     hdr.length = 0;
     hdr.body_crc = 0;
     hdr.local_offset = static_cast<uint32_t>(_end_offset - _start_offset);
@@ -1733,6 +2710,7 @@ std::shared_ptr<log_block> log_file::prepare_log_block() const
 ::dsn::task_ptr log_file::commit_log_block(
                 log_block& block,
                 int64_t offset,
+                bool compress,
                 dsn_task_code_t evt,
                 clientlet* callback_host,
                 aio_handler callback,
@@ -1746,13 +2724,56 @@ std::shared_ptr<log_block> log_file::prepare_log_block() const
     int64_t local_offset = end_offset() - start_offset();
     auto hdr = reinterpret_cast<log_block_header*>(const_cast<char*>(block.front().data()));
 
-    dassert(hdr->magic == 0xdeadbeef, "");
+    dassert(hdr->magic == log_block_header::magic_default, "");
     dassert(hdr->local_offset == static_cast<uint32_t>(local_offset), "");
 
-    hdr->length = static_cast<int32_t>(block.size() - sizeof(log_block_header));
+    // the blobs to be written, where the block header is always the first one
+    std::vector<blob> buffers;
+    buffers.push_back(block.front());
+
+    int32_t length = static_cast<int32_t>(block.size() - sizeof(log_block_header));
+    if (compress && length > 0)
+    {
+        // the block data is mostly in several blobs, so it is gathered first
+        std::unique_ptr<char[]> data;
+        const char* src = nullptr;
+        if (block.data().size() == 2)
+        {
+            src = block.data()[1].data();
+        }
+        else
+        {
+            data.reset(new char[length]);
+            char* ptr = data.get();
+            for (auto it = std::next(block.data().begin()); it != block.data().end(); ++it)
+            {
+                memcpy(ptr, it->data(), it->length());
+                ptr += it->length();
+            }
+            src = data.get();
+        }
+
+        int capacity = static_cast<int>(sizeof(length)) + block_compress_bound(length);
+        std::shared_ptr<char> compressed(new char[capacity], [](char* ptr) { delete[] ptr; });
+        memcpy(compressed.get(), &length, sizeof(length));
+        int size = static_cast<int>(sizeof(length)) + block_compress(src, length, compressed.get() + sizeof(length));
+        if (size < length)
+        {
+            hdr->magic = log_block_header::magic_compressed;
+            buffers.push_back(blob(std::move(compressed), 0, size));
+        }
+    }
+
+    if (buffers.size() == 1)
+    {
+        buffers.insert(buffers.end(), std::next(block.data().begin()), block.data().end());
+    }
+
+    hdr->length = 0;
     hdr->body_crc = _crc32;
-    for (auto log_iter = std::next(block.data().begin()) ; log_iter != block.data().end(); ++ log_iter)
+    for (auto log_iter = std::next(buffers.begin()) ; log_iter != buffers.end(); ++ log_iter)
     {
+        hdr->length += log_iter->length();
         hdr->body_crc = dsn_crc32_compute(
             static_cast<const void*>(log_iter->data()),
             static_cast<size_t>(log_iter->length()), hdr->body_crc
@@ -1760,8 +2781,8 @@ std::shared_ptr<log_block> log_file::prepare_log_block() const
     }
     _crc32 = hdr->body_crc;
 
-    std::unique_ptr<dsn_file_buffer_t[]> buffer_vector(new dsn_file_buffer_t[block.data().size()]);
-    std::transform(block.data().begin(), block.data().end(), buffer_vector.get(), [](const blob& bb)
+    std::unique_ptr<dsn_file_buffer_t[]> buffer_vector(new dsn_file_buffer_t[buffers.size()]);
+    std::transform(buffers.begin(), buffers.end(), buffer_vector.get(), [](const blob& bb)
     {
         return dsn_file_buffer_t
             {
@@ -1771,12 +2792,32 @@ std::shared_ptr<log_block> log_file::prepare_log_block() const
     });
 
     task_ptr tsk;
-    if (callback) {
+    if (hdr->magic == log_block_header::magic_compressed) {
+        // the compressed data is not in the block, so it is held by the callback until written
+        blob compressed = buffers.back();
+        aio_handler handler = std::move(callback);
         tsk = file::write_vector(
             _handle,
             buffer_vector.get(),
-            static_cast<int>(block.data().size()),
-            static_cast<uint64_t>(local_offset),
+            static_cast<int>(buffers.size()),
+            static_cast<uint64_t>(_file_size),
+            evt,
+            callback_host,
+            [compressed, handler](error_code err, size_t size)
+            {
+                if (handler)
+                {
+                    handler(err, size);
+                }
+            },
+            hash
+            );
+    } else if (callback) {
+        tsk = file::write_vector(
+            _handle,
+            buffer_vector.get(),
+            static_cast<int>(buffers.size()),
+            static_cast<uint64_t>(_file_size),
             evt,
             callback_host,
             std::move(callback),
@@ -1786,15 +2827,17 @@ std::shared_ptr<log_block> log_file::prepare_log_block() const
         tsk = file::write_vector(
             _handle,
             buffer_vector.get(),
-            static_cast<int>(block.data().size()),
-            static_cast<uint64_t>(local_offset),
+            static_cast<int>(buffers.size()),
+            static_cast<uint64_t>(_file_size),
             evt,
             callback_host,
             dsn::empty_callback,
             hash
             );
     }
+
     _end_offset += block.size();
+    _file_size += sizeof(log_block_header) + hdr->length;
     return tsk;
 }
 
@@ -1802,13 +2845,31 @@ void log_file::reset_stream()
 {
     if (_stream == nullptr)
     {
-        _stream.reset(new file_streamer(_handle, 0));
+        if (_mapping != nullptr)
+        {
+            _stream.reset(new file_streamer(_mapping, static_cast<size_t>(_file_size), 0));
+        }
+        else
+        {
+            _stream.reset(new file_streamer(_handle, 0));
+        }
     }
     else
     {
         _stream->reset(0);
     }
     _crc32 = 0;
+    _read_offset = 0;
+    _read_file_offset = 0;
+}
+
+void log_file::seek_stream(int64_t local_offset, int64_t file_offset, uint32_t crc_seed)
+{
+    reset_stream();
+    _stream->reset(static_cast<size_t>(file_offset));
+    _crc32 = crc_seed;
+    _read_offset = local_offset;
+    _read_file_offset = file_offset;
 }
 
 int log_file::read_file_header(binary_reader& reader)
@@ -1864,7 +2925,7 @@ int log_file::write_file_header(
     _previous_log_max_decrees = init_max_decrees;
 
     _header.magic = 0xdeadbeef;
-    _header.version = 0x1;
+    _header.version = _is_preallocated ? log_file_header::version_preallocated : log_file_header::version_default;
     _header.start_global_offset = start_offset();
 
     writer.write_pod(_header);
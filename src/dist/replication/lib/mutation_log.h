@@ -37,6 +37,7 @@
 
 #include "replication_common.h"
 #include "mutation.h"
+#include <deque>
 
 namespace dsn { namespace replication {
 
@@ -67,19 +68,37 @@ struct replica_log_info
 typedef std::unordered_map<global_partition_id, replica_log_info> replica_log_info_map;
 
 // each block in log file has a log_block_header
+// the block data is compressed when magic is magic_compressed, where the data on disk
+// is the uncompressed length (int32_t) followed by the compressed data (see block_compression.h);
+// the offsets are always of the uncompressed data, so compression is transparent to
+// the readers of the blocks and the offsets in the global space
 struct log_block_header
 {
-    int32_t  magic; //0xdeadbeef
-    int32_t  length; // block data length (not including log_block_header)
-    int32_t  body_crc; // block data crc (not including log_block_header)
-    uint32_t local_offset; // start offset of the block in this log file
+    enum
+    {
+        magic_default = 0xdeadbeef,
+        magic_compressed = 0xdeadbeec
+    };
+
+    uint32_t magic; // magic_default or magic_compressed
+    int32_t  length; // block data length on disk (not including log_block_header)
+    int32_t  body_crc; // block data crc on disk (not including log_block_header)
+    uint32_t local_offset; // start offset of the block in this log file, as uncompressed
 };
 
 // each log file has a log_file_header stored at the beginning of the first block's data content
 struct log_file_header
 {
+    enum
+    {
+        version_default = 0x1,
+        // the file is preallocated or recycled, so the data after the last valid block
+        // is garbage (zeros or stale blocks) and is treated as the end of the file
+        version_preallocated = 0x2
+    };
+
     int32_t  magic; // 0xdeadbeef
-    int32_t  version; // current 0x1
+    int32_t  version; // version_default or version_preallocated
     int64_t  start_global_offset; // start offset in the global space, equals to the file name's postfix
 };
 
@@ -125,6 +144,8 @@ class mutation_log : public virtual clientlet, public ref_counter
 public:
     // return true when the mutation's offset is not less than
     // the remembered (shared or private) valid_start_offset therefore valid for the replica
+    // it may be called concurrently for mutations of different gpids when the log is replayed
+    // with more than one thread, while the mutations of the same gpid are always in log order
     typedef std::function<bool (mutation_ptr&)> replay_callback;
 
 public:
@@ -146,10 +167,38 @@ public:
     // initialization
     //
 
+    // preallocate the next log file to the full file size in the background,
+    // and keep at most recycle_file_count garbage collected log files to be reused
+    // as the next log files, so that no file is created on the write path
+    // must be called before open
+    void set_preallocation(bool preallocate, int recycle_file_count);
+
+    // group commit: instead of writing as soon as possible, the pending mutations are
+    // batched until the batch reaches a target size or has waited for max_wait_us,
+    // where the target size (up to max_batch_kb) and the wait adapt to the observed
+    // write (and flush) latency; at most max_writes_in_flight writes are issued at the
+    // same time, and they are always completed in order.
+    // max_wait_us == 0 disables group commit.
+    // must be called before open
+    void set_group_commit(int max_wait_us, int max_batch_kb, int max_writes_in_flight);
+
+    // compress each log block when it is written, if it gets smaller
+    // must be called before open
+    void set_block_compression(bool compress);
+
+    // write the log files with direct io (see DSN_FILE_DIRECT_IO), which keeps
+    // the log writes out of the page cache; the files are marked as preallocated
+    // so that the zero padding of the last block is taken as the end on replay
+    // must be called before open
+    void set_direct_io(bool direct_io);
+
     // open and replay
+    // when replay_thread_count > 1, the log files are read, verified and decoded concurrently
+    // (at most replay_thread_count files ahead), and the mutations are applied concurrently
+    // across gpids, both as tasks in THREAD_POOL_REPLICATION which the caller must not be in
     // returns ERR_OK if succeed
     // not thread safe, but only be called when init
-    error_code open(replay_callback callback);
+    error_code open(replay_callback callback, int replay_thread_count = 1);
 
     // close the log
     // thread safe
@@ -231,11 +280,15 @@ public:
 
     //
     //  when this is a private log, log files are learned by remote replicas
+    //  if the log data since 'start' (located by the decree index) is no larger than
+    //  'max_inline_bytes', only the data is read and learned in state.meta, instead
+    //  of the whole log files
     //
     void get_learn_state(
         global_partition_id gpid,
         ::dsn::replication::decree start,
-        /*out*/ ::dsn::replication::learn_state& state
+        /*out*/ ::dsn::replication::learn_state& state,
+        int64_t max_inline_bytes = 0
         ) const;
 
     //
@@ -276,7 +329,8 @@ private:
     static error_code replay(
         std::map<int, log_file_ptr>& log_files,
         replay_callback callback,
-        /*out*/ int64_t& end_offset
+        /*out*/ int64_t& end_offset,
+        int thread_count = 1
         );
 
     // init memory states
@@ -288,6 +342,13 @@ private:
     // update max commit on disk without lock
     void update_max_commit_on_disk_no_lock(decree d);
 
+    // prepare a spare log file in the background if there is none
+    void prepare_spare_file_no_lock();
+
+    // remove the garbage collected log file, or keep it as a spare log file for reuse
+    // returns false if the file can neither be removed nor recycled
+    bool remove_or_recycle_file(const std::string& fpath);
+
     // create new log file and set it as the current log file
     // returns ERR_OK if create succeed
     // Preconditions:
@@ -302,9 +363,28 @@ private:
     // async write pending mutations into log file
     // Preconditions:
     // - _pending_write != nullptr
-    // - _issued_write.expired() == true (because only one async write is allowed at the same time)
+    // - _writes_in_flight < _max_writes_in_flight
     error_code write_pending_mutations(bool create_new_log_when_necessary = true);
 
+    // write pending mutations if there is a free write slot and the batch is ready
+    // (or 'wait_expired'), otherwise arm the group commit timer to write it later
+    // Preconditions:
+    // - _lock is held
+    void try_write_pending_mutations(bool wait_expired = false);
+
+    // read the mutations in [start_offset, end_offset) from the log files into 'writer',
+    // without the block headers and file headers, where 'start_offset' is the start of a block,
+    // 'start_file_offset' is the position of the block in its file, and 'crc_seed' is the
+    // chained crc before the block
+    static error_code read_log_range(
+        const std::map<int, log_file_ptr>& files,
+        int64_t start_offset,
+        int64_t start_file_offset,
+        uint32_t crc_seed,
+        int64_t end_offset,
+        /*out*/ binary_writer& writer
+        );
+
     // callback of write_pending_mutations()
     typedef std::shared_ptr<std::list< ::dsn::task_ptr>> pending_callbacks_ptr;
     void internal_write_callback(error_code err,
@@ -312,7 +392,9 @@ private:
                                  log_file_ptr file,
                                  std::shared_ptr<log_block> block,
                                  pending_callbacks_ptr callbacks,
-                                 decree max_commit);
+                                 decree max_commit,
+                                 uint64_t seq,
+                                 uint64_t issue_time_us);
 
 private:
     std::string               _dir;
@@ -323,6 +405,11 @@ private:
     int64_t                   _max_log_file_size_in_bytes;    
     uint32_t                  _batch_buffer_bytes;
     bool                      _force_flush;
+    int                       _max_writes_in_flight;
+    uint64_t                  _group_commit_max_wait_us; // 0 if group commit is disabled
+    uint32_t                  _group_commit_max_batch_bytes;
+    bool                      _compress_blocks;
+    bool                      _direct_io;
 
     ///////////////////////////////////////////////
     //// memory states
@@ -339,12 +426,42 @@ private:
     
     
     // bufferring
-    volatile bool                  _is_writing;
-    std::weak_ptr<log_block>       _issued_write;
+    volatile int                   _writes_in_flight; // issued writes not completed yet
+    std::deque<std::weak_ptr<log_block>> _issued_writes; // in the order of being issued
     task_ptr                       _issued_write_task; // for debugging
     std::shared_ptr<log_block>     _pending_write;
     pending_callbacks_ptr          _pending_write_callbacks;
     decree                         _pending_write_max_commit; // only used for private log
+    uint64_t                       _pending_write_start_us; // when the pending block is created
+    decree                         _pending_write_max_decree_before; // only used for private log
+
+    // group commit
+    uint32_t                       _group_commit_batch_bytes; // adaptive target batch size
+    uint64_t                       _write_latency_us; // moving average of write (and flush) latency
+    bool                           _is_group_commit_timer_armed;
+
+    // ordered write completion
+    struct completed_write
+    {
+        error_code                 err;
+        size_t                     size;
+        pending_callbacks_ptr      callbacks;
+        decree                     max_commit;
+        uint64_t                   latency_us;
+    };
+    zlock                          _completion_lock; // held while completing writes, before _lock
+    uint64_t                       _next_write_seq; // seq of the next write to be issued
+    uint64_t                       _next_completion_seq; // seq of the next write to be completed
+    std::map<uint64_t, completed_write> _completed_writes; // done but waiting for earlier writes
+    uint64_t                       _failed_write_fence; // writes with smaller seq fail with _failed_write_err
+    error_code                     _failed_write_err;
+
+    // preallocation and recycling
+    bool                           _preallocate;
+    int                            _recycle_file_count;
+    std::deque<std::string>        _spare_files; // spare files to be used as the next log files
+    int                            _next_spare_file_seq; // spare file name is log.spare.{seq}
+    bool                           _is_preparing_spare_file;
 
     // replica log info
     // - log_info.max_decree: the max decree of mutations up to now
@@ -353,6 +470,19 @@ private:
     // replica log info for shared log
     replica_log_info_map           _shared_log_info_map;
 
+    // sparse decree index for learning private log, in increasing offset order,
+    // each entry is a block that all the decrees logged before it are no larger than max_decree_before;
+    // there is an entry for each log file, and for the blocks written since open, at most
+    // one per decree_index_interval_bytes
+    struct decree_index_entry
+    {
+        decree                     max_decree_before;
+        int64_t                    offset; // start offset of the block in the global space
+        int64_t                    file_offset; // position of the block in the file (compressed)
+        uint32_t                   crc_seed; // chained crc before the block in the file
+    };
+    std::deque<decree_index_entry> _decree_index;
+
     // replica log info for private log
     replica_log_info               _private_log_info;
     decree                         _private_max_commit_on_disk; // the max last_committed_decree of written mutations up to now
@@ -385,10 +515,23 @@ public:
 
     // open the log file for write
     // the file path is '{dir}/log.{index}.{start_offset}'
+    // when 'spare_path' is given, the spare file (preallocated or recycled) is renamed
+    // to the file path and reused, otherwise a new file is created
+    // when 'direct_io' is set, the file is written with direct io
     // returns:
     //   - non-null if open succeed
     //   - null if open failed
-    static log_file_ptr create_write(const char* dir, int index, int64_t start_offset);
+    static log_file_ptr create_write(const char* dir, int index, int64_t start_offset,
+        const char* spare_path = nullptr, bool direct_io = false);
+
+    // create a spare log file with the space of 'size' allocated
+    // returns false if failed or not supported
+    static bool preallocate(const char* path, int64_t size);
+
+    // zero fill a recycled spare log file keeping its space allocated, so that its old
+    // blocks are read as the unused space of a preallocated file rather than corruption
+    // returns false if failed or not supported
+    static bool zero_fill(const char* path);
 
     // close the log file
     void close();
@@ -422,6 +565,7 @@ public:
     // async write log entry into the file
     // 'block' is the date to be writen
     // 'offset' is start offset of the entry in the global space
+    // 'compress' is to compress the block data if it gets smaller
     // 'evt' is to indicate which thread pool to execute the callback
     // 'callback_host' is used to get tracer
     // 'callback' is to indicate the callback handler
@@ -432,6 +576,7 @@ public:
     ::dsn::task_ptr commit_log_block(
                     log_block& block,
                     int64_t offset,
+                    bool compress,
                     dsn_task_code_t evt,
                     clientlet* callback_host,
                     aio_handler callback,                    
@@ -443,8 +588,17 @@ public:
     //
     // reset file_streamer to point to the start of this log file.
     void reset_stream();
-    // end offset in the global space: end_offset = start_offset + file_size
+    // reset file_streamer to point to the block at 'local_offset' of this log file,
+    // which is at 'file_offset' of the file (they differ when blocks are compressed),
+    // where 'crc_seed' is the chained crc before the block
+    void seek_stream(int64_t local_offset, int64_t file_offset, uint32_t crc_seed);
+    // chained crc of the blocks written so far, for write
+    uint32_t chained_crc() const { return _crc32; }
+    // end offset in the global space: end_offset = start_offset + uncompressed size of all blocks,
+    // for read, it is computed from the block headers when the file is opened
     int64_t end_offset() const { return _end_offset; }
+    // size of the file data written so far, or the file size for read
+    int64_t file_size() const { return _file_size; }
     // start offset in the global space
     int64_t start_offset() const  { return _start_offset; }
     // file index
@@ -455,6 +609,9 @@ public:
     const replica_log_info_map& previous_log_max_decrees() { return _previous_log_max_decrees; }
     // file header
     log_file_header& header() { return _header;}
+    // size of the buffer which the last block read refers to (the read buffer, the file
+    // mapping, or the decompressed block), which is pinned by the blobs sliced from the block
+    int64_t read_buffer_size() const { return _read_buffer_size; }
 
     // read file header from reader, return byte count consumed
     int read_file_header(binary_reader& reader);
@@ -464,19 +621,48 @@ public:
     int get_file_header_size() const;
     // if the file header is valid
     bool is_right_header() const;
+
+    // rename the file unless it is mapped for read, as the blobs read from the mapping may outlive
+    // the log_file and must not see the file rewritten in place (e.g., recycled as a spare file)
+    static bool rename_if_not_mapped(const std::string& from, const std::string& to);
     
 private:
     // make private, user should create log_file through open_read() or open_write()
     log_file(const char* path, dsn_handle_t handle, int index, int64_t start_offset, bool is_read);
 
+    // map the whole file for read, so the blocks are read as blobs pointing into the mapping,
+    // keeps aio read when failed or when the file is still open for write (its padding may be
+    // truncated on close, see disk_engine::close)
+    void map_for_read();
+
+    // compute the end offset of a file opened for read from its block headers, as the
+    // file size is smaller than the uncompressed blocks when they are compressed
+    void scan_end_offset();
+
+    // read the next log block without handling the garbage tail, 'disk_length' returns
+    // the block data length in the file (which differs from bb when compressed)
+    // the errors are not logged as errors when 'garbage_tail' is true
+    error_code read_log_block(/*out*/::dsn::blob& bb, bool garbage_tail, /*out*/ int32_t& disk_length);
+
+    // whether the file is zero filled from the invalid block at 'file_offset' (except the
+    // data of the block itself if its header is valid, i.e., a torn write) to the end,
+    // which is the unused space of a preallocated or recycled file, or corrupted otherwise
+    bool is_garbage_tail(int64_t file_offset) const;
+
 private:        
     uint32_t         _crc32;
     int64_t          _start_offset; // start offset in the global space
-    int64_t          _end_offset; // end offset in the global space: end_offset = start_offset + file_size
+    int64_t          _end_offset; // end offset in the global space, see end_offset()
+    int64_t          _file_size; // see file_size()
     class file_streamer;
     std::unique_ptr  <file_streamer> _stream;
     dsn_handle_t     _handle; // file handle
+    std::shared_ptr<char> _mapping; // whole file mapping for read, null when read through aio
     bool             _is_read; // if opened for read or write
+    bool             _is_preallocated; // if opened for write from a spare file, or with direct io
+    int64_t          _read_offset; // local offset of the next block to read
+    int64_t          _read_file_offset; // file offset of the next block to read
+    int64_t          _read_buffer_size; // see read_buffer_size()
     std::string      _path; // file path
     int              _index; // file index
     log_file_header  _header; // file header
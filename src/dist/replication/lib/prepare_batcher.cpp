@@ -0,0 +1,253 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Node-level batching of the prepares to the secondaries, see prepare_batcher.h.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#include "prepare_batcher.h"
+#include "replica.h"
+#include "mutation.h"
+#include "mutation_log.h"
+#include "replica_stub.h"
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "replica.prepare.batch"
+
+namespace dsn { namespace replication {
+
+//----------------- prepare_batcher ------------------------
+bool prepare_batcher::prepare_key::operator < (const prepare_key& o) const
+{
+    if (target != o.target)
+        return target < o.target;
+    if (gpid.app_id != o.gpid.app_id)
+        return gpid.app_id < o.gpid.app_id;
+    if (gpid.pidx != o.gpid.pidx)
+        return gpid.pidx < o.gpid.pidx;
+    return d < o.d;
+}
+
+prepare_batcher::prepare_batcher(replica_stub* stub, int max_wait_ms, int max_batch_kb)
+    : _stub(stub), _max_wait_ms(max_wait_ms), _max_batch_bytes(max_batch_kb * 1024)
+{
+    _next_seq = 0;
+}
+
+prepare_batcher::~prepare_batcher()
+{
+    zauto_lock l(_lock);
+    for (auto& kv : _batches)
+    {
+        dsn_msg_release_ref(kv.second.msg);
+    }
+    _batches.clear();
+    _pending.clear();
+}
+
+void prepare_batcher::send(
+    ::dsn::rpc_address target,
+    replica* r,
+    mutation_ptr& mu,
+    const replica_configuration& rconfig,
+    int timeout_milliseconds
+    )
+{
+    batch full;
+    uint64_t timer_seq = 0;
+    {
+        zauto_lock l(_lock);
+        batch& b = _batches[target];
+        if (b.msg == nullptr)
+        {
+            // all prepares to secondaries are of the same timeout; the batches from
+            // this node are decoded in the same thread of the secondary to keep
+            // the prepares in order, and those from the other nodes in the others
+            b.msg = dsn_msg_create_request(RPC_PREPARE_BATCH, timeout_milliseconds,
+                static_cast<int>(std::hash< ::dsn::rpc_address>()(_stub->primary_address())));
+            dsn_msg_add_ref(b.msg); // released when sent
+            b.seq = ++_next_seq;
+            b.timeout_ms = timeout_milliseconds;
+            timer_seq = b.seq;
+
+            rpc_write_stream writer(b.msg);
+            marshall(writer, timeout_milliseconds);
+        }
+
+        {
+            rpc_write_stream writer(b.msg);
+            marshall(writer, r->get_gpid());
+            marshall(writer, rconfig);
+        }
+        mu->write_to(b.msg);
+        b.bytes = static_cast<int>(dsn_msg_body_size(b.msg));
+
+        prepare_key key;
+        key.target = target;
+        key.gpid = r->get_gpid();
+        key.d = mu->data.header.decree;
+        b.keys.push_back(key);
+
+        pending_prepare& p = _pending[key];
+        p.r = r;
+        p.mu = mu;
+        p.status = rconfig.status;
+        p.batch_seq = b.seq;
+
+        if (b.bytes >= _max_batch_bytes)
+        {
+            full = b;
+            _batches.erase(target);
+        }
+    }
+
+    if (full.msg != nullptr)
+    {
+        send_batch(target, full);
+    }
+    else if (timer_seq != 0)
+    {
+        tasking::enqueue(
+            LPC_PREPARE_BATCH_TIMER,
+            _stub,
+            [this, target, timer_seq]() { flush(target, timer_seq); },
+            0,
+            std::chrono::milliseconds(_max_wait_ms)
+            );
+    }
+}
+
+void prepare_batcher::flush(::dsn::rpc_address target, uint64_t seq)
+{
+    batch b;
+    {
+        zauto_lock l(_lock);
+        auto it = _batches.find(target);
+        if (it == _batches.end() || it->second.seq != seq)
+        {
+            // already sent as it is full
+            return;
+        }
+        b = it->second;
+        _batches.erase(it);
+    }
+
+    send_batch(target, b);
+}
+
+void prepare_batcher::send_batch(::dsn::rpc_address target, batch& b)
+{
+    dinfo("send %d prepares to %s in a batch of %d bytes",
+        static_cast<int>(b.keys.size()), target.to_string(), b.bytes);
+
+    dsn_rpc_call_one_way(target.c_addr(), b.msg);
+    dsn_msg_release_ref(b.msg); // added in send
+
+    auto keys = b.keys;
+    auto seq = b.seq;
+    tasking::enqueue(
+        LPC_PREPARE_BATCH_TIMER,
+        _stub,
+        [this, keys, seq]() { on_batch_timeout(keys, seq); },
+        0,
+        std::chrono::milliseconds(b.timeout_ms)
+        );
+}
+
+void prepare_batcher::on_ack(::dsn::rpc_address target, const prepare_ack& resp)
+{
+    prepare_key key;
+    key.target = target;
+    key.gpid = resp.gpid;
+    key.d = resp.decree;
+
+    pending_prepare p;
+    {
+        zauto_lock l(_lock);
+        auto it = _pending.find(key);
+        if (it == _pending.end())
+        {
+            // timed out already, or of an older prepare of the decree
+            return;
+        }
+        p = it->second;
+        _pending.erase(it);
+    }
+
+    dispatch(target, p, resp);
+}
+
+void prepare_batcher::on_batch_timeout(std::vector<prepare_key> keys, uint64_t seq)
+{
+    std::vector<std::pair<prepare_key, pending_prepare>> timeouts;
+    {
+        zauto_lock l(_lock);
+        for (auto& key : keys)
+        {
+            auto it = _pending.find(key);
+            if (it != _pending.end() && it->second.batch_seq == seq)
+            {
+                timeouts.push_back(*it);
+                _pending.erase(it);
+            }
+        }
+    }
+
+    for (auto& t : timeouts)
+    {
+        prepare_ack resp;
+        resp.gpid = t.first.gpid;
+        resp.decree = t.first.d;
+        resp.err = ERR_TIMEOUT;
+        dispatch(t.first.target, t.second, resp);
+    }
+}
+
+/*static*/ void prepare_batcher::dispatch(::dsn::rpc_address target, pending_prepare& p, const prepare_ack& resp)
+{
+    replica_ptr r = p.r;
+    mutation_ptr mu = p.mu;
+    partition_status status = p.status;
+    prepare_ack ack = resp;
+    tasking::enqueue(
+        LPC_PREPARE_BATCH_DISPATCH,
+        r.get(),
+        [r, mu, status, target, ack]() mutable
+        {
+            r->on_prepare_reply(std::make_pair(mu, status), target, ack);
+        },
+        gpid_to_hash(r->get_gpid())
+        );
+}
+
+}} // namespace
@@ -0,0 +1,125 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Node-level batching of the prepares to the secondaries, where the
+ *     prepares of all the primaries on this node to the same secondary are
+ *     sent in one RPC_PREPARE_BATCH message, and each of them is acked
+ *     separately with RPC_BATCHED_PREPARE_ACK as soon as it is logged.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+#pragma once
+
+#include "replication_common.h"
+#include <vector>
+#include <map>
+
+namespace dsn { namespace replication {
+
+class replica_stub;
+
+//
+// on the primary node: prepares to the same secondary are appended to the
+// same message, which is sent (one way) when it reaches max_batch_kb, or
+// max_wait_ms after the first prepare; the acks come back one by one in
+// RPC_BATCHED_PREPARE_ACK, so that a slow partition does not delay the acks of the
+// others, and are dispatched back to the threads of the replicas; the
+// prepares not acked by their deadline are taken as timed out
+//
+// the message body: timeout_ms, then (gpid, replica_configuration, mutation)
+// of all the prepares
+//
+class prepare_batcher
+{
+public:
+    prepare_batcher(replica_stub* stub, int max_wait_ms, int max_batch_kb);
+    ~prepare_batcher();
+
+    void send(
+        ::dsn::rpc_address target,
+        replica* r,
+        mutation_ptr& mu,
+        const replica_configuration& rconfig,
+        int timeout_milliseconds
+        );
+
+    // an ack of a batched prepare from target
+    void on_ack(::dsn::rpc_address target, const prepare_ack& resp);
+
+private:
+    struct pending_prepare
+    {
+        replica_ptr      r;
+        mutation_ptr     mu;
+        partition_status status;
+        uint64_t         batch_seq;
+    };
+
+    // (target, gpid, decree), only the latest prepare of a decree is waited for
+    struct prepare_key
+    {
+        ::dsn::rpc_address  target;
+        global_partition_id gpid;
+        decree              d;
+
+        bool operator < (const prepare_key& o) const;
+    };
+
+    struct batch
+    {
+        dsn_message_t    msg;
+        std::vector<prepare_key> keys;
+        int              bytes;
+        int              timeout_ms;
+        uint64_t         seq; // to tell whether the batch is the one when the timer is set
+
+        batch() : msg(nullptr), bytes(0), timeout_ms(0), seq(0) {}
+    };
+
+    // send the batch to target if it is still the one of seq
+    void flush(::dsn::rpc_address target, uint64_t seq);
+    void send_batch(::dsn::rpc_address target, batch& b);
+    // the prepares of the batch which are not acked yet are timed out
+    void on_batch_timeout(std::vector<prepare_key> keys, uint64_t seq);
+    static void dispatch(::dsn::rpc_address target, pending_prepare& p, const prepare_ack& resp);
+
+private:
+    replica_stub *_stub;
+    int          _max_wait_ms;
+    int          _max_batch_bytes;
+
+    zlock        _lock;
+    std::unordered_map< ::dsn::rpc_address, batch> _batches;
+    std::map<prepare_key, pending_prepare> _pending;
+    uint64_t     _next_seq;
+};
+
+}} // namespace
@@ -37,6 +37,7 @@
 #include "mutation.h"
 #include "mutation_log.h"
 #include "replica_stub.h"
+#include "apply_queue.h"
 #include <dsn/cpp/json_helper.h>
 
 # ifdef __TITLE__
@@ -58,10 +59,15 @@ replica::replica(replica_stub* stub, global_partition_id gpid, const char* app_t
     _options = &stub->options();
     init_state();
     _config.gpid = gpid;
+    _primary_states.write_queue.set_batch_options(_options->get_mutation_batch_options(app_type));
 
     std::stringstream ss;
     ss << _name << ".2pc.latency(ns)";
     _counter_commit_latency.init("eon.replication", ss.str().c_str(), COUNTER_TYPE_NUMBER_PERCENTILES, "commit latency (from mutation create to commit)");
+
+    ss.str("");
+    ss << _name << ".prepare.ack.latency(ns)";
+    _counter_prepare_ack_latency.init("eon.replication", ss.str().c_str(), COUNTER_TYPE_NUMBER_PERCENTILES, "latency of the prepare acks from the secondaries (from prepare to ack)");
 }
 
 void replica::json_state(std::stringstream& out) const
@@ -91,9 +97,12 @@ void replica::init_state()
     _config.gpid.pidx = 0;
     _config.gpid.app_id = 0;
     _config.status = PS_INACTIVE;
+    _read_state.store(static_cast<int>(PS_INACTIVE));
+    _read_ready_decree.store(0);
     _primary_states.membership.ballot = 0;
     _last_config_change_time_ms = now_ms();
     _private_log = nullptr;
+    _apply_queue = _options->apply_async_enabled ? new apply_queue(this, _options->apply_max_pending_count) : nullptr;
 }
 
 replica::~replica(void)
@@ -106,12 +115,23 @@ replica::~replica(void)
         _prepare_list = nullptr;
     }
 
+    if (nullptr != _apply_queue)
+    {
+        delete _apply_queue;
+        _apply_queue = nullptr;
+    }
+
     dinfo("%s: replica destroyed", name());
 }
 
 void replica::on_client_read(const read_request_header& meta, dsn_message_t request)
 {
-    if (status() == PS_INACTIVE || status() == PS_POTENTIAL_SECONDARY)
+    // the status is loaded before the ready decree, which is published first
+    partition_status read_status = static_cast<partition_status>(_read_state.load());
+    bool primary_ready = (read_status == PS_PRIMARY
+        && _app->last_committed_decree() >= _read_ready_decree.load());
+
+    if (read_status == PS_INACTIVE || read_status == PS_POTENTIAL_SECONDARY)
     {
         response_client_message(request, ERR_INVALID_STATE);
         return;
@@ -119,20 +139,67 @@ void replica::on_client_read(const read_request_header& meta, dsn_message_t requ
 
     if (meta.semantic == read_semantic::ReadLastUpdate)
     {
-        if (status() != PS_PRIMARY ||
-            last_committed_decree() < _primary_states.last_prepare_decree_on_new_primary)
+        if (!primary_ready)
         {
             response_client_message(request, ERR_INVALID_STATE);
             return;
         }
+
+        // a new primary may have been assigned if the lease expired
+        if (!_stub->is_read_lease_valid())
+        {
+            dwarn("%s: reject read as the lease from the meta server may have expired", name());
+            _stub->_counter_replicas_lease_read_rejected.increment();
+            response_client_message(request, ERR_INVALID_STATE);
+            return;
+        }
+    }
+
+    // primaries are never stale
+    else if (meta.semantic == read_semantic::ReadBoundedStaleness && read_status != PS_PRIMARY)
+    {
+        int64_t decrees;
+        uint64_t ms;
+        _read_staleness.get_staleness(_app->last_committed_decree(), decrees, ms);
+        if (read_status != PS_SECONDARY
+            || (meta.max_staleness_decrees >= 0 && decrees > meta.max_staleness_decrees)
+            || (meta.max_staleness_ms >= 0 && ms > static_cast<uint64_t>(meta.max_staleness_ms)))
+        {
+            dinfo("%s: reject bounded-staleness read, staleness = %" PRId64 " decrees, %" PRIu64 " ms",
+                name(), decrees, ms);
+            _stub->_counter_replicas_stale_read_rejected.increment();
+            response_client_message(request, ERR_STALE_READ);
+            return;
+        }
     }
 
     dassert (_app != nullptr, "");
 
+    if (read_status == PS_PRIMARY)
+        _stub->_counter_replicas_primary_read_qps.increment();
+    else
+        _stub->_counter_replicas_secondary_read_qps.increment();
+
     rpc_read_stream reader(request);
     _app->dispatch_rpc_call(meta.code, reader, dsn_msg_create_response(request));
 }
 
+bool replica::is_read_thread_safe() const
+{
+    return _app != nullptr && _app->is_read_thread_safe();
+}
+
+void replica::publish_read_state()
+{
+    // the app may apply the committed mutations later in the apply queue, so the
+    // readiness is checked against the decree applied to the app when reading
+    if (status() == PS_PRIMARY)
+    {
+        _read_ready_decree.store(_primary_states.last_prepare_decree_on_new_primary);
+    }
+    _read_state.store(static_cast<int>(status()));
+}
+
 void replica::response_client_message(dsn_message_t request, error_code error, decree d/* = invalid_decree*/)
 {
     if (nullptr == request)
@@ -191,9 +258,9 @@ void replica::check_state_completeness()
     dassert(max_prepared_decree() >= last_committed_decree(), "");
     dassert(last_committed_decree() >= last_durable_decree(), "");
 
-    auto mind = _stub->_log->max_gced_decree(get_gpid(), _app->init_info().init_offset_in_shared_log);
+    auto mind = _stub->shared_log(get_gpid())->max_gced_decree(get_gpid(), _app->init_info().init_offset_in_shared_log);
     dassert(mind <= last_durable_decree(), "");
-    _stub->_log->check_valid_start_offset(get_gpid(), _app->init_info().init_offset_in_shared_log);
+    _stub->shared_log(get_gpid())->check_valid_start_offset(get_gpid(), _app->init_info().init_offset_in_shared_log);
 
     if (_private_log != nullptr)
     {   
@@ -217,9 +284,9 @@ void replica::execute_mutation(mutation_ptr& mu)
     switch (status())
     {
     case PS_INACTIVE:
-        if (_app->last_committed_decree() + 1 == d)
+        if (last_committed_decree_in_app() + 1 == d)
         {
-            err = _app->write_internal(mu);
+            err = apply_mutation(mu);
         }
         else
         {
@@ -227,15 +294,15 @@ void replica::execute_mutation(mutation_ptr& mu)
                 "%s: mutation %s commit to %s skipped, app.last_committed_decree = %" PRId64,
                 name(), mu->name(),
                 enum_to_string(status()),
-                _app->last_committed_decree()
+                last_committed_decree_in_app()
                 );
         }
         break;
     case PS_PRIMARY:
         {
             check_state_completeness();
-            dassert(_app->last_committed_decree() + 1 == d, "");
-            err = _app->write_internal(mu);
+            dassert(last_committed_decree_in_app() + 1 == d, "");
+            err = apply_mutation(mu);
         }
         break;
 
@@ -243,8 +310,8 @@ void replica::execute_mutation(mutation_ptr& mu)
         if (!_secondary_states.checkpoint_is_running)
         {
             check_state_completeness();
-            dassert (_app->last_committed_decree() + 1 == d, "");
-            err = _app->write_internal(mu);
+            dassert (last_committed_decree_in_app() + 1 == d, "");
+            err = apply_mutation(mu);
         }
         else
         {
@@ -252,7 +319,7 @@ void replica::execute_mutation(mutation_ptr& mu)
                 "%s: mutation %s commit to %s skipped, app.last_committed_decree = %" PRId64,
                 name(), mu->name(),
                 enum_to_string(status()),
-                _app->last_committed_decree()
+                last_committed_decree_in_app()
                 );
 
             // make sure private log saves the state
@@ -264,8 +331,8 @@ void replica::execute_mutation(mutation_ptr& mu)
         if (_potential_secondary_states.learning_status == LearningSucceeded ||
             _potential_secondary_states.learning_status == LearningWithPrepareTransient)
         {
-            dassert(_app->last_committed_decree() + 1 == d, "");
-            err = _app->write_internal(mu);
+            dassert(last_committed_decree_in_app() + 1 == d, "");
+            err = apply_mutation(mu);
         }
         else
         {
@@ -277,7 +344,7 @@ void replica::execute_mutation(mutation_ptr& mu)
                 "%s: mutation %s commit to %s skipped, app.last_committed_decree = %" PRId64,
                 name(), mu->name(),
                 enum_to_string(status()),
-                _app->last_committed_decree()
+                last_committed_decree_in_app()
                 );
         }
         break;
@@ -296,6 +363,11 @@ void replica::execute_mutation(mutation_ptr& mu)
 
     if (status() == PS_PRIMARY)
     {
+        if (mu->prepare_ts_ns() != 0)
+        {
+            _primary_states.write_queue.on_mutation_committed(dsn_now_ns() - mu->prepare_ts_ns());
+        }
+
         mutation_ptr next = _primary_states.write_queue.check_possible_work(
             static_cast<int>(_prepare_list->max_decree() - d)
             );
@@ -307,6 +379,40 @@ void replica::execute_mutation(mutation_ptr& mu)
     }
 }
 
+error_code replica::apply_mutation(mutation_ptr& mu)
+{
+    if (_apply_queue != nullptr)
+    {
+        if (status() == PS_PRIMARY || status() == PS_SECONDARY)
+        {
+            _apply_queue->enqueue(mu);
+            return ERR_OK;
+        }
+        _apply_queue->drain();
+    }
+    return _app->write_internal(mu);
+}
+
+decree replica::last_committed_decree_in_app() const
+{
+    return _apply_queue != nullptr ? _apply_queue->last_committed_decree() : _app->last_committed_decree();
+}
+
+void replica::wait_for_apply()
+{
+    if (_apply_queue != nullptr)
+    {
+        _apply_queue->drain();
+        send_deferred_prepare_acks();
+    }
+}
+
+void replica::on_apply_queue_available()
+{
+    check_hashed_access();
+    send_deferred_prepare_acks();
+}
+
 mutation_ptr replica::new_mutation(decree decree)
 {
     mutation_ptr mu(new mutation());
@@ -365,6 +471,8 @@ void replica::close()
     cleanup_preparing_mutations(true);
     dassert(_primary_states.is_cleaned(), "primary context is not cleared");
 
+    wait_for_apply();
+
     if (PS_INACTIVE == status())
     {
         dassert(_secondary_states.is_cleaned(), "secondary context is not cleared");
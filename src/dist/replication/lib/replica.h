@@ -47,12 +47,16 @@
 # include "mutation.h"
 # include "prepare_list.h"
 # include "replica_context.h"
+# include <atomic>
 
 namespace dsn { namespace replication {
 
 class replication_app_base;
 class replica_stub;
 class replication_checker;
+class prepare_batcher;
+class apply_queue;
+class group_check_batcher;
 namespace test {
     class test_checker;
 }
@@ -69,6 +73,8 @@ public:
     //
     static replica* load(replica_stub* stub, const char* dir);
     static replica* newr(replica_stub* stub, const char* app_type, global_partition_id gpid);    
+    // neither initialized nor opened, for the tests of the replica registry of the stub
+    static replica* new_for_test(replica_stub* stub, const char* app_type, global_partition_id gpid);
     // return true when the mutation is valid for the current replica
     bool replay_mutation(mutation_ptr& mu, bool is_private);
     void reset_prepare_list_after_replay();
@@ -82,8 +88,9 @@ public:
     //
     //    requests from clients
     // 
-    void on_client_write(task_code code, dsn_message_t request);
+    void on_client_write(const write_request_header& hdr, dsn_message_t request);
     void on_client_read(const read_request_header& meta, dsn_message_t request);
+    bool is_read_thread_safe() const;
 
     //
     //    messages and tools from/for meta server
@@ -94,7 +101,8 @@ public:
     //
     //    messages from peers (primary or secondary)
     //
-    void on_prepare(dsn_message_t request);    
+    void on_prepare(dsn_message_t request);
+    void on_prepare(const replica_configuration& rconfig, mutation_ptr& mu);
     void on_learn(dsn_message_t msg, const learn_request& request);
     void on_learn_completion_notification(const group_check_response& report);
     void on_add_learner(const group_check_request& request);
@@ -138,6 +146,18 @@ private:
     void response_client_message(dsn_message_t request, error_code error, decree decree = -1);    
     void execute_mutation(mutation_ptr& mu);
     mutation_ptr new_mutation(decree decree);    
+
+    // committed mutations of primaries and secondaries are applied in the apply
+    // queue if it is enabled, and synchronously otherwise
+    error_code apply_mutation(mutation_ptr& mu);
+    decree last_committed_decree_in_app() const;
+    void wait_for_apply();
+    void on_apply_queue_available();
+
+    // reads may be served outside the replica thread, so they check the state
+    // published by the replica thread on status change, and the primary serves
+    // ReadLastUpdate only when the app has applied the decree published with it
+    void publish_read_state();
         
     // initialization
     replica(replica_stub* stub, global_partition_id gpid, const char* app_type, const char* dir);
@@ -151,8 +171,11 @@ private:
     void send_prepare_message(::dsn::rpc_address addr, partition_status status, mutation_ptr& mu, int timeout_milliseconds, int64_t learn_signature = invalid_signature);
     void on_append_log_completed(mutation_ptr& mu, error_code err, size_t size);
     void on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, error_code err, dsn_message_t request, dsn_message_t reply);
+    void on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, ::dsn::rpc_address node, prepare_ack& resp);
     void do_possible_commit_on_primary(mutation_ptr& mu);    
     void ack_prepare_message(error_code err, mutation_ptr& mu);
+    void reply_prepare_ack(error_code err, mutation_ptr& mu);
+    void send_deferred_prepare_acks();
     void cleanup_preparing_mutations(bool wait);
     
     /////////////////////////////////////////////////////////////////
@@ -209,6 +232,9 @@ private:
     friend class ::dsn::replication::replication_checker;
     friend class ::dsn::replication::test::test_checker;
     friend class ::dsn::replication::mutation_queue;
+    friend class ::dsn::replication::prepare_batcher;
+    friend class ::dsn::replication::apply_queue;
+    friend class ::dsn::replication::group_check_batcher;
 
     // replica configuration, updated by update_local_configuration ONLY    
     replica_configuration   _config;
@@ -226,6 +252,10 @@ private:
     // application
     std::unique_ptr<replication_app_base>  _app;
 
+    // applies committed mutations, null if apply_async_enabled is false
+    apply_queue*            _apply_queue;
+    std::vector<mutation_ptr> _deferred_prepare_acks; // of secondaries while the apply queue is full
+
     // constants
     replica_stub*           _stub;
     std::string             _app_type;
@@ -238,9 +268,13 @@ private:
     secondary_context           _secondary_states;
     potential_secondary_context _potential_secondary_states;
     bool                        _inactive_is_transient; // upgrade to P/S is allowed only iff true
+    staleness_tracker           _read_staleness;
+    std::atomic<int>            _read_state; // status
+    std::atomic<decree>         _read_ready_decree; // applied before the primary serves ReadLastUpdate
 
     // perf counters
     perf_counter_               _counter_commit_latency;
+    perf_counter_               _counter_prepare_ack_latency;
 };
 
 }} // namespace
@@ -37,6 +37,8 @@
 #include "mutation.h"
 #include "mutation_log.h"
 #include "replica_stub.h"
+#include "prepare_batcher.h"
+#include "apply_queue.h"
 
 # ifdef __TITLE__
 # undef __TITLE__
@@ -46,7 +48,7 @@
 namespace dsn { namespace replication {
 
 
-void replica::on_client_write(task_code code, dsn_message_t request)
+void replica::on_client_write(const write_request_header& hdr, dsn_message_t request)
 {
     check_hashed_access();
 
@@ -62,7 +64,55 @@ void replica::on_client_write(task_code code, dsn_message_t request)
         return;
     }
 
-    auto mu = _primary_states.write_queue.add_work(code, request, this);
+    // throttle client writes before the prepares to slow secondaries pile up in memory
+    if (_options->prepare_send_queue_throttling_bytes > 0)
+    {
+        for (auto& node : _primary_states.membership.secondaries)
+        {
+            if (dsn_rpc_get_send_queue_bytes(node.c_addr()) > _options->prepare_send_queue_throttling_bytes)
+            {
+                dinfo("%s: client write is throttled as the send queue to %s is full", name(), node.to_string());
+                response_client_message(request, ERR_CAPACITY_EXCEEDED);
+                return;
+            }
+        }
+    }
+
+    // throttle client writes while the committed mutations are not applied in time
+    if (_apply_queue != nullptr && _apply_queue->is_full())
+    {
+        dinfo("%s: client write is throttled as the apply queue is full", name());
+        response_client_message(request, ERR_CAPACITY_EXCEEDED);
+        return;
+    }
+
+    // a retry of an applied write is answered from the dedup table, while the retries
+    // which are still in flight are proposed again and skipped when applied
+    write_dedup_id id;
+    if (hdr.client_id != 0 && _app->dedup_table().is_enabled())
+    {
+        id = write_dedup_id(hdr.client_id, hdr.request_seq);
+
+        blob response;
+        auto state = _app->dedup_table().find(id.client_id, id.request_seq, response);
+        if (state == write_dedup_table::WS_APPLIED)
+        {
+            dinfo("%s: duplicate write answered from the dedup table: client_id = %" PRId64 ", request_seq = %" PRId64,
+                name(), id.client_id, id.request_seq);
+            _stub->_counter_replicas_write_deduplicated.increment();
+            replication_app_base::reply_duplicate_write(request, response);
+            return;
+        }
+        else if (state == write_dedup_table::WS_EXPIRED)
+        {
+            dwarn("%s: retried write is expired in the dedup table: client_id = %" PRId64 ", request_seq = %" PRId64,
+                name(), id.client_id, id.request_seq);
+            replication_app_base::reply_expired_write(request);
+            return;
+        }
+    }
+
+    auto mu = _primary_states.write_queue.add_work(hdr.code, request, this, id);
     if (mu)
     {
         init_prepare(mu);
@@ -88,6 +138,10 @@ void replica::init_prepare(mutation_ptr& mu)
     
     dinfo("%s: mutation %s init_prepare, mutation_tid=%" PRIu64, name(), mu->name(), mu->tid());
 
+    // the updates are complete, and the encoding is shared by the prepares and the logs
+    // which may be written in other threads
+    mu->cache_encoded_updates();
+
     // check bounded staleness
     if (mu->data.header.decree > last_committed_decree() + _options->staleness_for_commit)
     {
@@ -132,7 +186,7 @@ void replica::init_prepare(mutation_ptr& mu)
         dassert(mu->data.header.log_offset == invalid_offset, "");
         dassert(mu->log_task() == nullptr, "");
 
-        mu->log_task() = _stub->_log->append(mu,
+        mu->log_task() = _stub->shared_log(get_gpid())->append(mu,
             LPC_WRITE_REPLICATION_LOG,
             this,
             std::bind(&replica::on_append_log_completed, this, mu,
@@ -160,16 +214,29 @@ void replica::send_prepare_message(
     int timeout_milliseconds,
     int64_t learn_signature)
 {
-    dsn_message_t msg = dsn_msg_create_request(RPC_PREPARE, timeout_milliseconds, gpid_to_hash(get_gpid()));
     replica_configuration rconfig;
     _primary_states.get_replica_config(status, rconfig, learn_signature);
 
+    // prepares to the secondaries are batched with those of the other partitions
+    if (status == PS_SECONDARY && _stub->_prepare_batcher != nullptr)
+    {
+        _stub->_prepare_batcher->send(addr, this, mu, rconfig, timeout_milliseconds);
+        ddebug(
+            "%s: mutation %s send_prepare_message to %s as %s in batch",
+            name(), mu->name(),
+            addr.to_string(),
+            enum_to_string(rconfig.status)
+            );
+        return;
+    }
+
+    dsn_message_t msg = dsn_msg_create_request(RPC_PREPARE, timeout_milliseconds, gpid_to_hash(get_gpid()));
     {
         rpc_write_stream writer(msg);
         marshall(writer, get_gpid());
         marshall(writer, rconfig);
-        mu->write_to(writer);
     }
+    mu->write_to(msg);
     
     mu->remote_tasks()[addr] = rpc::call(addr, msg,
         this,
@@ -201,8 +268,6 @@ void replica::do_possible_commit_on_primary(mutation_ptr& mu)
 
 void replica::on_prepare(dsn_message_t request)
 {
-    check_hashed_access();
-
     replica_configuration rconfig;
     mutation_ptr mu;
 
@@ -212,6 +277,20 @@ void replica::on_prepare(dsn_message_t request)
         mu = mutation::read_from(reader, request);
     }
 
+    if (mu == nullptr)
+    {
+        derror("%s: invalid mutation in the prepare from %s, ignored",
+            name(), ::dsn::rpc_address(dsn_msg_from_address(request)).to_string());
+        return;
+    }
+
+    on_prepare(rconfig, mu);
+}
+
+void replica::on_prepare(const replica_configuration& rconfig, mutation_ptr& mu)
+{
+    check_hashed_access();
+
     decree decree = mu->data.header.decree;
 
     dinfo("%s: mutation %s on_prepare", name(), mu->name());
@@ -279,6 +358,11 @@ void replica::on_prepare(dsn_message_t request)
     }
 
     dassert (rconfig.status == status(), "");    
+    if (PS_SECONDARY == status())
+    {
+        _read_staleness.on_primary_committed(mu->data.header.last_committed_decree);
+    }
+
     if (decree <= last_committed_decree())
     {
         ack_prepare_message(ERR_OK, mu);
@@ -317,7 +401,7 @@ void replica::on_prepare(dsn_message_t request)
     }
 
     dassert(mu->log_task() == nullptr, "");
-    mu->log_task() = _stub->_log->append(mu,
+    mu->log_task() = _stub->shared_log(get_gpid())->append(mu,
         LPC_WRITE_REPLICATION_LOG,
         this,
         std::bind(&replica::on_append_log_completed, this, mu,
@@ -421,18 +505,6 @@ void replica::on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, err
 {
     check_hashed_access();
 
-    mutation_ptr mu = pr.first;
-    partition_status targetStatus = pr.second;
-
-    // skip callback for old mutations
-    if (mu->data.header.ballot < get_ballot() || PS_PRIMARY != status())
-        return;
-    
-    dassert (mu->data.header.ballot == get_ballot(), "");
-
-    ::dsn::rpc_address node = dsn_msg_to_address(request);
-    partition_status st = _primary_states.get_node_status(node);
-
     // handle reply
     prepare_ack resp;
 
@@ -445,7 +517,25 @@ void replica::on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, err
     {
         ::unmarshall(reply, resp);
     }
+
+    on_prepare_reply(pr, dsn_msg_to_address(request), resp);
+}
+
+void replica::on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, ::dsn::rpc_address node, prepare_ack& resp)
+{
+    check_hashed_access();
+
+    mutation_ptr mu = pr.first;
+    partition_status targetStatus = pr.second;
+
+    // skip callback for old mutations
+    if (mu->data.header.ballot < get_ballot() || PS_PRIMARY != status())
+        return;
     
+    dassert (mu->data.header.ballot == get_ballot(), "");
+
+    partition_status st = _primary_states.get_node_status(node);
+
     ddebug(
         "%s: mutation %s on_prepare_reply from %s, err = %s",
         name(), mu->name(),
@@ -463,6 +553,7 @@ void replica::on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, err
         case PS_SECONDARY:
             dassert (_primary_states.check_exist(node, PS_SECONDARY), "");
             dassert (mu->left_secondary_ack_count() > 0, "");
+            _counter_prepare_ack_latency.set(dsn_now_ns() - mu->prepare_ts_ns());
             if (0 == mu->decrease_left_secondary_ack_count())
             {
                 do_possible_commit_on_primary(mu);
@@ -517,6 +608,40 @@ void replica::on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, err
 }
 
 void replica::ack_prepare_message(error_code err, mutation_ptr& mu)
+{
+    // backpressure of the apply queue: the primary stops committing new mutations
+    // until the acks are sent when the queue is available again
+    if (err == ERR_OK && status() == PS_SECONDARY
+        && _apply_queue != nullptr && _apply_queue->is_full_and_notify())
+    {
+        dinfo("%s: mutation %s ack_prepare_message deferred as the apply queue is full", name(), mu->name());
+        _deferred_prepare_acks.push_back(mu);
+        return;
+    }
+
+    reply_prepare_ack(err, mu);
+}
+
+void replica::send_deferred_prepare_acks()
+{
+    std::vector<mutation_ptr> acks;
+    acks.swap(_deferred_prepare_acks);
+
+    // the acks are dropped after the status change, as the prepares are sent again
+    // by the new primary
+    if (status() != PS_SECONDARY)
+        return;
+
+    for (auto& mu : acks)
+    {
+        if (mu->data.header.ballot == get_ballot())
+        {
+            reply_prepare_ack(ERR_OK, mu);
+        }
+    }
+}
+
+void replica::reply_prepare_ack(error_code err, mutation_ptr& mu)
 {
     prepare_ack resp;
     resp.gpid = get_gpid();
@@ -528,8 +653,15 @@ void replica::ack_prepare_message(error_code err, mutation_ptr& mu)
     resp.last_committed_decree_in_app = _app->last_committed_decree(); 
     resp.last_committed_decree_in_prepare_list = last_committed_decree();
 
-    dassert(nullptr != mu->prepare_msg(), "");
-    reply(mu->prepare_msg(), resp);
+    if (!mu->prepare_ack_address().is_invalid())
+    {
+        _stub->send_prepare_ack(mu->prepare_ack_address(), resp);
+    }
+    else
+    {
+        dassert(nullptr != mu->prepare_msg(), "");
+        reply(mu->prepare_msg(), resp);
+    }
 
     ddebug("%s: mutation %s ack_prepare_message, err = %s", name(), mu->name(), err.to_string());
 }
@@ -550,7 +682,7 @@ void replica::cleanup_preparing_mutations(bool wait)
             // make sure the buffers from mutations are valid for underlying aio
             //
             if (wait) {
-                _stub->_log->flush();
+                _stub->shared_log(get_gpid())->flush();
                 mu->wait_log_task();
             }
         }
@@ -37,6 +37,7 @@
 #include "mutation.h"
 #include "mutation_log.h"
 #include "replica_stub.h"
+#include "group_check_batcher.h"
 
 # ifdef __TITLE__
 # undef __TITLE__
@@ -49,7 +50,8 @@ void replica::init_group_check()
 {
     check_hashed_access();
 
-    if (PS_PRIMARY != status() || _options->group_check_disabled)
+    // all primaries are checked together by the stub when batched
+    if (PS_PRIMARY != status() || _options->group_check_disabled || _stub->_group_check_batcher != nullptr)
         return;
 
     dassert (nullptr == _primary_states.group_check_task, "");
@@ -64,7 +66,7 @@ void replica::init_group_check()
 
 void replica::broadcast_group_check()
 {
-    dassert (nullptr != _primary_states.group_check_task, "");
+    dassert (nullptr != _primary_states.group_check_task || nullptr != _stub->_group_check_batcher, "");
 
     ddebug(
         "%s: start broadcast group check",
@@ -80,7 +82,9 @@ void replica::broadcast_group_check()
 
         for (auto it = _primary_states.group_check_pending_replies.begin(); it != _primary_states.group_check_pending_replies.end(); ++it)
         {
-            it->second->cancel(true);
+            // null when sent in a batch, whose reply is ignored once cleared
+            if (it->second != nullptr)
+                it->second->cancel(true);
         }
         _primary_states.group_check_pending_replies.clear();
     }
@@ -112,6 +116,22 @@ void replica::broadcast_group_check()
             enum_to_string(it->second)
         );
 
+        if (nullptr != _stub->_group_check_batcher)
+        {
+            if (!_stub->_group_check_batcher->add(this, request))
+            {
+                dwarn("%s: last group check batch to %s is still pending, skip it in this round",
+                    name(), addr.to_string());
+                continue;
+            }
+            _stub->_counter_replicas_group_check_request.increment();
+            _primary_states.group_check_pending_replies[addr] = nullptr;
+            continue;
+        }
+
+        _stub->_counter_replicas_group_check_request.increment();
+
+        _stub->_counter_replicas_group_check_rpc.increment();
         dsn::task_ptr callback_task = rpc::call(
             addr,
             RPC_GROUP_CHECK,
@@ -165,6 +185,7 @@ void replica::on_group_check(const group_check_request& request, /*out*/ group_c
         {
             _prepare_list->commit(request.last_committed_decree, COMMIT_TO_DECREE_HARD);
         }
+        _read_staleness.on_primary_committed(request.last_committed_decree);
         break;
     case PS_POTENTIAL_SECONDARY:
         init_learn(request.config.learner_signature);
@@ -199,7 +220,13 @@ void replica::on_group_check_reply(error_code err, const std::shared_ptr<group_c
     }
 
     auto r = _primary_states.group_check_pending_replies.erase(req->node);
-    dassert (r == 1, "");
+    if (r == 0)
+    {
+        // the batched request was cleared by a later round, in which the peer was skipped as
+        // the batch was still pending, and the reply is ignored like a cancelled one
+        dassert (nullptr != _stub->_group_check_batcher, "");
+        return;
+    }
 
     if (err != ERR_OK)
     {
@@ -73,6 +73,9 @@ namespace dsn {
             if (status() != PS_PRIMARY && status() != PS_SECONDARY)
                 return;
 
+            // the app is checkpointed with all committed mutations applied
+            wait_for_apply();
+
             // no need to checkpoint
             if (_app->is_delta_state_learning_supported())
                 return;
@@ -153,6 +156,7 @@ namespace dsn {
         void replica::on_copy_checkpoint(const replica_configuration& request, /*out*/ learn_response& response)
         {
             check_hashed_access();
+            wait_for_apply();
 
             if (request.ballot > get_ballot())
             {
@@ -514,6 +514,9 @@ bool replica::update_local_configuration(const replica_configuration& config, bo
         || (same_ballot && config.ballot == get_ballot()), "");
     dassert (config.gpid == get_gpid(), "");
 
+    // all committed mutations are applied before the status change
+    wait_for_apply();
+
     partition_status old_status = status();
     ballot old_ballot = get_ballot();
 
@@ -607,6 +610,7 @@ bool replica::update_local_configuration(const replica_configuration& config, bo
     uint64_t oldTs = _last_config_change_time_ms;
     _config = config;
     _last_config_change_time_ms = now_ms();
+    publish_read_state();
     dassert (max_prepared_decree() >= last_committed_decree(), "");
     
     switch (old_status)
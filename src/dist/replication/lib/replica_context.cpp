@@ -228,4 +228,45 @@ bool potential_secondary_context::is_cleaned()
         ;
 }
 
+void staleness_tracker::on_primary_committed(decree d)
+{
+    zauto_lock l(_lock);
+    uint64_t now = dsn_now_ms();
+    _last_received_ts_ms = now;
+    if (d < _primary_committed_decree)
+        return;
+
+    _primary_committed_decree = d;
+    if (!_history.empty() && _history.back().first == d)
+    {
+        _history.back().second = now;
+    }
+    else
+    {
+        // the oldest ones are dropped, which makes the staleness larger than it is
+        if (_history.size() >= 1024)
+        {
+            _history.pop_front();
+        }
+        _history.push_back(std::make_pair(d, now));
+    }
+}
+
+void staleness_tracker::get_staleness(decree d, /*out*/ int64_t& decrees, /*out*/ uint64_t& ms)
+{
+    zauto_lock l(_lock);
+    while (!_history.empty() && _history.front().first <= d)
+    {
+        _fresh_ts_ms = _history.front().second;
+        _history.pop_front();
+    }
+
+    decrees = (_primary_committed_decree > d ? _primary_committed_decree - d : 0);
+
+    // the state with all the commits known is as fresh as the last message from the primary
+    uint64_t fresh_ts_ms = (decrees == 0 ? _last_received_ts_ms : std::min(_fresh_ts_ms, _last_received_ts_ms));
+    uint64_t now = dsn_now_ms();
+    ms = (now > fresh_ts_ms ? now - fresh_ts_ms : 0);
+}
+
 }} // end namespace
@@ -36,6 +36,7 @@
 # pragma once
 
 # include "mutation.h"
+# include <deque>
 
 namespace dsn { namespace replication {
 
@@ -135,6 +136,35 @@ public:
     ::dsn::task_ptr       catchup_with_private_log_task;
 };
 
+//
+// how stale the local state of a secondary is, for bounded-staleness reads,
+// according to the last committed decrees of the primary learned from the
+// prepares and group checks; the local state is fresh as of the time when the
+// primary is known to have committed no more than the local committed decree,
+// which is never later than the last prepare or group check received, so the
+// state becomes stale in time when the primary is not heard from
+//
+// it is updated in the replica thread, and is checked in the read threads
+//
+class staleness_tracker
+{
+public:
+    staleness_tracker() : _primary_committed_decree(0), _fresh_ts_ms(0), _last_received_ts_ms(0) {}
+
+    // a prepare or group check is received, by which the primary has committed up to d
+    void on_primary_committed(decree d);
+
+    // staleness of the local state with last committed decree d
+    void get_staleness(decree d, /*out*/ int64_t& decrees, /*out*/ uint64_t& ms);
+
+private:
+    ::dsn::service::zlock   _lock;
+    decree                  _primary_committed_decree;
+    std::deque<std::pair<decree, uint64_t>> _history; // (primary committed decree, learned at ms)
+    uint64_t                _fresh_ts_ms;
+    uint64_t                _last_received_ts_ms; // of the last prepare or group check
+};
+
 //---------------inline impl----------------------------------------------------------------
 
 inline partition_status primary_context::get_node_status(::dsn::rpc_address addr) const
@@ -37,6 +37,7 @@
 #include "mutation.h"
 #include "mutation_log.h"
 #include "replica_stub.h"
+#include "apply_queue.h"
 #include <dsn/internal/factory_store.h>
 
 # ifdef __TITLE__
@@ -90,6 +91,11 @@ error_code replica::initialize_on_new()
     }
 }
 
+/*static*/ replica* replica::new_for_test(replica_stub* stub, const char* app_type, global_partition_id gpid)
+{
+    return new replica(stub, gpid, app_type, ".");
+}
+
 error_code replica::initialize_on_load()
 {
     if (!dsn::utils::filesystem::directory_exists(_dir))
@@ -163,6 +169,26 @@ error_code replica::init_app_and_prepare_list(bool create_new)
         return ERR_OBJECT_NOT_FOUND;
     }
 
+    // the reads of the other apps are serialized with the writes in the replica
+    // thread, so their writes must not be applied in the apply queue
+    if (_apply_queue != nullptr && !_app->is_read_thread_safe())
+    {
+        dwarn("%s: apply_async_enabled is ignored as the reads of app type %s are not thread safe",
+            name(), _app_type.c_str());
+        delete _apply_queue;
+        _apply_queue = nullptr;
+    }
+
+    // before open, as the writes replayed from the logs are deduplicated as well
+    if (_options->write_dedup_enabled && _app->is_write_dedup_supported())
+    {
+        _app->dedup_table().set_limits(
+            _options->write_dedup_max_clients,
+            _options->write_dedup_max_requests_per_client,
+            _options->write_dedup_max_response_bytes
+            );
+    }
+
     error_code err = _app->open_internal(
         this,
         create_new
@@ -188,19 +214,22 @@ error_code replica::init_app_and_prepare_list(bool create_new)
                 true,
                 get_gpid()
                 );
+            _private_log->set_preallocation(_options->log_preallocate, _options->log_recycle_file_count);
+            _private_log->set_block_compression(_options->log_private_compress);
+            _private_log->set_direct_io(_options->log_direct_io);
         }
 
         // sync valid_start_offset between app and logs
         if (create_new)
         {
             dassert(_app->last_committed_decree() == 0, "");
-            int64_t shared_log_offset = _stub->_log->on_partition_reset(get_gpid(), 0);
+            int64_t shared_log_offset = _stub->shared_log(get_gpid())->on_partition_reset(get_gpid(), 0);
             int64_t private_log_offset = _private_log ? _private_log->on_partition_reset(get_gpid(), 0) : 0;
             err = _app->update_init_info(this, shared_log_offset, private_log_offset);
         }
         else
         {
-            _stub->_log->set_valid_start_offset_on_open(get_gpid(), _app->init_info().init_offset_in_shared_log);
+            _stub->shared_log(get_gpid())->set_valid_start_offset_on_open(get_gpid(), _app->init_info().init_offset_in_shared_log);
             if (_private_log)
                 _private_log->set_valid_start_offset_on_open(get_gpid(), _app->init_info().init_offset_in_private_log);
         }
@@ -253,7 +282,7 @@ error_code replica::init_app_and_prepare_list(bool create_new)
                 _private_log->close();
                 _private_log = nullptr;
 
-                _stub->_log->on_partition_removed(get_gpid());
+                _stub->shared_log(get_gpid())->on_partition_removed(get_gpid());
             }
         }
 
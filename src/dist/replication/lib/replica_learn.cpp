@@ -202,6 +202,7 @@ void replica::init_learn(uint64_t signature)
 void replica::on_learn(dsn_message_t msg, const learn_request& request)
 {
     check_hashed_access();
+    wait_for_apply();
     
     learn_response response;
     if (PS_PRIMARY != status())
@@ -386,7 +387,12 @@ void replica::on_learn(dsn_message_t msg, const learn_request& request)
             name()
             );
 
-        _private_log->get_learn_state(get_gpid(), learn_start_decree, response.state);
+        _private_log->get_learn_state(
+            get_gpid(),
+            learn_start_decree,
+            response.state,
+            static_cast<int64_t>(_options->log_private_learn_inline_kb) * 1024
+            );
         response.type = LT_LOG;
         response.base_local_dir = _private_log->dir();
         ddebug(
@@ -523,7 +529,7 @@ void replica::on_learn_reply(
 
             err = _app->update_init_info(
                 this,
-                _stub->_log->on_partition_reset(get_gpid(), 0),
+                _stub->shared_log(get_gpid())->on_partition_reset(get_gpid(), 0),
                 _private_log ? _private_log->on_partition_reset(get_gpid(), 0) : 0
                 );
             if (err != ERR_OK)
@@ -574,6 +580,13 @@ void replica::on_learn_reply(
         while (!reader.is_eof())
         {
             auto mu = mutation::read_from(reader, nullptr);
+            if (mu == nullptr)
+            {
+                derror("%s: on_learn_reply[%016llx]: learnee = %s, invalid learned mutation cache",
+                    name(), req.signature, resp.config.primary.to_string());
+                handle_learning_error(ERR_INVALID_DATA);
+                return;
+            }
             mu->set_logged();
             dinfo("%s: on_learn_reply[%016llx]: apply learned mutation %s", name(), req.signature, mu->name());
             if (mu->data.header.decree > last_committed_decree())
@@ -593,7 +606,7 @@ void replica::on_learn_reply(
         // invalidate existing mutations in current logs
         err = _app->update_init_info(
             this,
-            _stub->_log->on_partition_reset(get_gpid(), resp.prepare_start_decree - 1),
+            _stub->shared_log(get_gpid())->on_partition_reset(get_gpid(), resp.prepare_start_decree - 1),
             _private_log ? _private_log->on_partition_reset(get_gpid(), resp.prepare_start_decree - 1) : 0
             );
 
@@ -953,6 +966,11 @@ error_code replica::apply_learned_state_from_private_log(learn_state& state)
         while (!reader.is_eof())
         {
             auto mu = mutation::read_from_log_file(reader, nullptr);
+            if (mu == nullptr)
+            {
+                err = ERR_INVALID_DATA;
+                break;
+            }
             auto d = mu->data.header.decree;
             if (d <= plist.last_committed_decree())
                 continue;
@@ -39,6 +39,8 @@
 #include "mutation_log.h"
 #include "mutation.h"
 #include "replication_failure_detector.h"
+#include "prepare_batcher.h"
+#include "group_check_batcher.h"
 #include <dsn/cpp/json_helper.h>
 
 # ifdef __TITLE__
@@ -53,19 +55,38 @@ using namespace dsn::service;
 bool replica_stub::s_not_exit_on_log_failure = false;
 
 replica_stub::replica_stub(replica_state_subscriber subscriber /*= nullptr*/, bool is_long_subscriber/* = true*/)
-    : serverlet("replica_stub"), _replicas_lock(true), _cli_replica_stub_json_state_handle(nullptr)
+    : serverlet("replica_stub"), _replicas_lock(true), _cli_replica_stub_json_state_handle(nullptr),
+    _cli_replica_stub_load_progress_handle(nullptr), _session_disconnected_handle(nullptr)
 {    
     _replica_state_subscriber = subscriber;
     _is_long_subscriber = is_long_subscriber;
     _failure_detector = nullptr;
+    _prepare_batcher = nullptr;
+    _group_check_batcher = nullptr;
     _state = NS_Disconnected;
-    _log = nullptr;
+    _load_replica_total = 0;
+    _load_replica_finished = 0;
+    _load_replica_failed = 0;
+    _load_replica_start_ms = 0;
+    _load_replica_end_ms = 0;
     install_perf_counters();
 }
 
 replica_stub::~replica_stub(void)
 {
     close();
+
+    if (_prepare_batcher != nullptr)
+    {
+        delete _prepare_batcher;
+        _prepare_batcher = nullptr;
+    }
+
+    if (_group_check_batcher != nullptr)
+    {
+        delete _group_check_batcher;
+        _group_check_batcher = nullptr;
+    }
 }
 
 void replica_stub::install_perf_counters()
@@ -74,6 +95,13 @@ void replica_stub::install_perf_counters()
     _counter_replicas_opening_count.init("eon.replication", "opening_replica#", COUNTER_TYPE_NUMBER, "# in replica_stub._opening_replicas");
     _counter_replicas_closing_count.init("eon.replication", "closing_replica#", COUNTER_TYPE_NUMBER, "# in replica_stub._closing_replicas");
     _counter_replicas_total_commit_throught.init("eon.replication", "replicas.commit(#/s)", COUNTER_TYPE_RATE, "app commit throughput for all replicas");
+    _counter_replicas_primary_read_qps.init("eon.replication", "replicas.read.primary(#/s)", COUNTER_TYPE_RATE, "reads served by primaries");
+    _counter_replicas_secondary_read_qps.init("eon.replication", "replicas.read.secondary(#/s)", COUNTER_TYPE_RATE, "reads served by secondaries");
+    _counter_replicas_stale_read_rejected.init("eon.replication", "replicas.read.stale.rejected(#/s)", COUNTER_TYPE_RATE, "bounded-staleness reads rejected as secondaries are too stale");
+    _counter_replicas_group_check_request.init("eon.replication", "replicas.group_check.request(#/s)", COUNTER_TYPE_RATE, "group check requests sent by primaries");
+    _counter_replicas_group_check_rpc.init("eon.replication", "replicas.group_check.rpc(#/s)", COUNTER_TYPE_RATE, "group check messages sent, fewer than the requests when batched");
+    _counter_replicas_lease_read_rejected.init("eon.replication", "replicas.read.lease.rejected(#/s)", COUNTER_TYPE_RATE, "primary reads rejected as the FD lease from the meta server may have expired");
+    _counter_replicas_write_deduplicated.init("eon.replication", "replicas.write.deduplicated(#/s)", COUNTER_TYPE_RATE, "retried writes answered from the dedup tables by primaries");
 
     _counter_replicas_learning_failed_latency.init("eon.replication", "replicas.learning.failed(ns)", COUNTER_TYPE_NUMBER_PERCENTILES, "learning time (failed)");
     _counter_replicas_learning_success_latency.init("eon.replication", "replicas.learning.success(ns)", COUNTER_TYPE_NUMBER_PERCENTILES, "learning time (success)");
@@ -93,12 +121,25 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
     set_options(opts);
     _primary_address = primary_address();
 
+    if (_options.prepare_batch_max_wait_ms > 0 && _prepare_batcher == nullptr)
+    {
+        _prepare_batcher = new prepare_batcher(this, _options.prepare_batch_max_wait_ms, _options.prepare_batch_max_kb);
+    }
+
+    if (!_options.group_check_disabled && _options.group_check_batch_enabled && _group_check_batcher == nullptr)
+    {
+        _group_check_batcher = new group_check_batcher(this);
+    }
+
     // clear dirs if need
     if (clear)
     {
-        if (!dsn::utils::filesystem::remove_path(_options.slog_dir))
+        for (auto& dir : _options.slog_dirs)
         {
-            dassert(false, "Fail to remove %s.", _options.slog_dir.c_str());
+            if (!dsn::utils::filesystem::remove_path(dir))
+            {
+                dassert(false, "Fail to remove %s.", dir.c_str());
+            }
         }
         for (auto& dir : _options.data_dirs)
         {
@@ -110,18 +151,23 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
     }
 
     // init dirs
-    if (!dsn::utils::filesystem::create_directory(_options.slog_dir))
-    {
-        dassert(false, "Fail to create directory %s.", _options.slog_dir.c_str());
-    }
-    std::string cdir;
-    if (!dsn::utils::filesystem::get_absolute_path(_options.slog_dir, cdir))
+    int count = 0;
+    for (auto& dir : _options.slog_dirs)
     {
-        dassert(false, "Fail to get absolute path from %s.", _options.slog_dir.c_str());
+        if (!dsn::utils::filesystem::create_directory(dir))
+        {
+            dassert(false, "Fail to create directory %s.", dir.c_str());
+        }
+        std::string cdir;
+        if (!dsn::utils::filesystem::get_absolute_path(dir, cdir))
+        {
+            dassert(false, "Fail to get absolute path from %s.", dir.c_str());
+        }
+        dir = cdir;
+        ddebug("app[%s]: slog_dirs[%d]=%s", _options.app_name.c_str(), count, dir.c_str());
+        count++;
     }
-    _options.slog_dir = cdir;
-    ddebug("app[%s]: slog_dir=%s", _options.app_name.c_str(), _options.slog_dir.c_str());
-    int count = 0;
+    count = 0;
     for (auto& dir : _options.data_dirs)
     {
         if (!dsn::utils::filesystem::create_directory(dir))
@@ -138,67 +184,109 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
         count++;
     }
 
-    _log = new mutation_log(
-        _options.slog_dir,
-        _options.log_shared_batch_buffer_kb,
-        _options.log_shared_file_size_mb,
-        _options.log_shared_force_flush
-        );
+    std::vector<std::string> stale_slog_dirs = find_stale_shared_log_dirs();
+    create_shared_logs();
+
+    // init rps, the loading progress can be watched with the cli command "load-progress"
+    if (_cli_replica_stub_load_progress_handle == nullptr)
+    {
+        _cli_replica_stub_load_progress_handle = dsn_cli_app_register("load-progress", "get the progress of loading the replicas on this node", "",
+            this, &static_replica_stub_load_progress, &static_replica_stub_json_state_freer);
+        dassert(_cli_replica_stub_load_progress_handle != nullptr, "register cli command failed");
+    }
 
-    // init rps
     replicas rps;
-    std::vector<std::string> dir_list;
+    load_replicas(rps);
 
-    for (auto& dir : _options.data_dirs)
+    // mutations in shared logs left by a different shared log count are merged
+    // into the current shared logs, so the replicas must replay the current ones
+    // from the start and the stale ones from their recorded init offsets, which
+    // are kept in a merge marker file until the merge is done in case of crash
+    std::unordered_map<global_partition_id, int64_t> stale_start_offsets;
+    for (auto it = rps.begin(); it != rps.end(); ++it)
     {
-        std::vector<std::string> tmp_list;
-        if (!dsn::utils::filesystem::get_subdirectories(dir, tmp_list, false))
+        auto app = it->second->get_app();
+        std::string marker = utils::filesystem::path_combine(it->second->dir(), ".info.slog_merge");
+        if (stale_slog_dirs.empty())
         {
-            dassert(false, "Fail to get subdirectories in %s.", dir.c_str());
+            if (utils::filesystem::file_exists(marker) && !utils::filesystem::remove_path(marker))
+            {
+                dassert(false, "remove file %s failed", marker.c_str());
+            }
+            continue;
+        }
+
+        replica_init_info old_info;
+        if (!utils::filesystem::file_exists(marker) || old_info.load(marker.c_str()) != ERR_OK)
+        {
+            old_info = app->init_info();
+            auto merr = old_info.store(marker.c_str());
+            dassert(merr == ERR_OK, "store file %s failed, err = %s", marker.c_str(), merr.to_string());
         }
-        dir_list.insert(dir_list.end(), tmp_list.begin(), tmp_list.end());
+        stale_start_offsets[it->first] = old_info.init_offset_in_shared_log;
+        shared_log(it->first)->set_valid_start_offset_on_open(it->first, 0);
+        app->update_init_info(it->second.get(), 0, app->init_info().init_offset_in_private_log);
     }
 
-    for (auto& dir : dir_list)
+    // init shared prepare logs, each opened by a task in THREAD_POOL_REPLICATION_LONG,
+    // and the mutations of different replicas may be replayed concurrently
+    int replay_thread_count = std::max(1, _options.log_replay_thread_count / static_cast<int>(_logs.size()));
+    std::vector<error_code> open_errs(_logs.size(), ERR_OK);
+    std::vector<task_ptr> opens;
+    for (size_t i = 0; i < _logs.size(); i++)
     {
-        if (dir.length() >= 4 && dir.substr(dir.length() - 4) == ".err")
-            continue;
-
-        auto r = replica::load(this, dir.c_str());
-        if (r != nullptr)
+        auto log = _logs[i];
+        auto& open_err = open_errs[i];
+        opens.push_back(tasking::enqueue(LPC_OPEN_SHARED_LOG, this, [log, &open_err, &rps, replay_thread_count]()
         {
-            if (rps.find(r->get_gpid()) != rps.end())
-            {
-                dassert(false, "conflict replica dir: %s <--> %s", r->dir().c_str(), rps[r->get_gpid()]->dir().c_str());
-            }
-            ddebug("%u.%u @ %s: load replica '%s' success, <durable, commit> = <%" PRId64 ", %" PRId64 ">, last_prepared_decree = %" PRId64,
-                r->get_gpid().app_id, r->get_gpid().pidx,
-                primary_address().to_string(),
-                dir.c_str(),
-                r->last_durable_decree(),
-                r->last_committed_decree(),
-                r->last_prepared_decree()
+            open_err = log->open(
+                [&rps](mutation_ptr& mu)
+                {
+                    auto it = rps.find(mu->data.header.gpid);
+                    if (it != rps.end())
+                    {
+                        return it->second->replay_mutation(mu, false);
+                    }
+                    else
+                    {
+                        return false;
+                    }
+                },
+                replay_thread_count
                 );
-            rps[r->get_gpid()] = r;
+        }));
+    }
+    for (auto& open : opens)
+    {
+        open->wait();
+    }
+    error_code err = ERR_OK;
+    for (auto& open_err : open_errs)
+    {
+        if (err == ERR_OK)
+        {
+            err = open_err;
         }
     }
-    dir_list.clear();
 
-    // init shared prepare log
-    error_code err = _log->open(
-        [&rps](mutation_ptr& mu)
+    if (err == ERR_OK && !stale_slog_dirs.empty())
+    {
+        // the stale logs are the only copy of their mutations, so the replicas are
+        // kept for the merge to be retried by the next start
+        auto merr = merge_stale_shared_logs(stale_slog_dirs, stale_start_offsets, rps);
+        dassert(merr == ERR_OK, "%s: merge stale shared logs failed, err = %s, cannot start",
+            primary_address().to_string(),
+            merr.to_string()
+            );
+        for (auto it = rps.begin(); it != rps.end(); ++it)
         {
-            auto it = rps.find(mu->data.header.gpid);
-            if (it != rps.end())
-            {
-                return it->second->replay_mutation(mu, false);
-            }
-            else
+            std::string marker = utils::filesystem::path_combine(it->second->dir(), ".info.slog_merge");
+            if (!utils::filesystem::remove_path(marker))
             {
-                return false;
+                dassert(false, "remove file %s failed", marker.c_str());
             }
         }
-        );
+    }
 
     if (err != ERR_OK)
     {
@@ -227,27 +315,38 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
         rps.clear();
 
         // restart log service
-        _log->close();
-        _log = nullptr;
-        if (!utils::filesystem::remove_path(_options.slog_dir))
+        for (auto& log : _logs)
         {
-            dassert(false, "remove directory %s failed", _options.slog_dir.c_str());
+            log->close();
+        }
+        _logs.clear();
+        for (auto& dir : _options.slog_dirs)
+        {
+            if (!utils::filesystem::remove_path(dir))
+            {
+                dassert(false, "remove directory %s failed", dir.c_str());
+            }
+        }
+        for (auto& dir : stale_slog_dirs)
+        {
+            if (!utils::filesystem::remove_path(dir))
+            {
+                dassert(false, "remove directory %s failed", dir.c_str());
+            }
+        }
+        create_shared_logs();
+        for (auto& log : _logs)
+        {
+            auto lerr = log->open(nullptr);
+            dassert(lerr == ERR_OK, "restart log service must succeed");
         }
-        _log = new mutation_log(
-            _options.slog_dir,
-            opts.log_shared_batch_buffer_kb,
-            opts.log_shared_file_size_mb,
-            opts.log_shared_force_flush
-            );
-        auto lerr = _log->open(nullptr);
-        dassert(lerr == ERR_OK, "restart log service must succeed");
     }
 
     for (auto it = rps.begin(); it != rps.end(); ++it)
     {
         it->second->reset_prepare_list_after_replay();
                 
-        decree smax = _log->max_decree(it->first);
+        decree smax = shared_log(it->first)->max_decree(it->first);
         decree pmax = invalid_decree;
         if (it->second->private_log())
         {
@@ -256,7 +355,7 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
             // possible when shared log is restarted
             if (smax == 0)
             {
-                _log->update_max_decree(it->first, pmax);
+                shared_log(it->first)->update_max_decree(it->first, pmax);
                 smax = pmax;
             }
         }
@@ -302,8 +401,17 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
     }
     
     // attach rps
-    _replicas = std::move(rps);
-    _counter_replicas_count.add((uint64_t)_replicas.size());
+    {
+        zauto_lock l(_replicas_lock);
+        _replicas = std::move(rps);
+        for (auto& kv : _replicas)
+        {
+            auto& shard = get_replicas_shard(kv.first);
+            zauto_lock sl(shard.lock);
+            shard.rps[kv.first] = kv.second;
+        }
+        _counter_replicas_count.add((uint64_t)_replicas.size());
+    }
 
     // start timer for configuration sync
     if (!_options.config_sync_disabled)
@@ -315,7 +423,27 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
             std::chrono::milliseconds(_options.config_sync_interval_ms)
             );
     }
+
+    // start timer for node-level group check, see replica::init_group_check
+    if (_group_check_batcher != nullptr)
+    {
+        _group_check_timer_task = tasking::enqueue_timer(
+            LPC_GROUP_CHECK,
+            this,
+            [this] {_group_check_batcher->start_round();},
+            std::chrono::milliseconds(_options.group_check_interval_ms)
+            );
+    }
     
+    // connect to the meta servers in advance, and the group members are
+    // connected once known from the meta server (see on_node_query_reply)
+    if (_session_disconnected_handle == nullptr)
+    {
+        _session_disconnected_handle = dsn_rpc_register_session_disconnected_handler(
+            static_replica_stub_on_session_disconnected, this);
+    }
+    warm_up(_options.meta_servers);
+
     // init livenessmonitor
     dassert (NS_Disconnected == _state, "");
     if (_options.fd_disabled == false)
@@ -339,6 +467,17 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
 
 replica_ptr replica_stub::get_replica(global_partition_id gpid, bool new_when_possible, const char* app_type)
 {
+    // fast path for existing replicas
+    {
+        auto& shard = get_replicas_shard(gpid);
+        zauto_lock sl(shard.lock);
+        auto it = shard.rps.find(gpid);
+        if (it != shard.rps.end())
+            return it->second;
+        else if (!new_when_possible)
+            return nullptr;
+    }
+
     zauto_lock l(_replicas_lock);
     auto it = _replicas.find(gpid);
     if (it != _replicas.end())
@@ -392,7 +531,7 @@ void replica_stub::on_client_write(dsn_message_t request)
     replica_ptr rep = get_replica(hdr.gpid);
     if (rep != nullptr)
     {
-        rep->on_client_write(hdr.code, request);
+        rep->on_client_write(hdr, request);
     }
     else
     {
@@ -414,7 +553,24 @@ void replica_stub::on_client_read(dsn_message_t request)
     replica_ptr rep = get_replica(hdr.gpid);
     if (rep != nullptr)
     {
-        rep->on_client_read(hdr, request);
+        if (rep->is_read_thread_safe())
+        {
+            rep->on_client_read(hdr, request);
+        }
+        else
+        {
+            dsn_msg_add_ref(request); // released after the read is served
+            tasking::enqueue(
+                LPC_REPLICATION_CLIENT_READ,
+                this,
+                [rep, hdr, request]()
+                {
+                    rep->on_client_read(hdr, request);
+                    dsn_msg_release_ref(request);
+                },
+                gpid_to_hash(hdr.gpid)
+                );
+        }
     }
     else
     {
@@ -477,11 +633,7 @@ void replica_stub::on_query_decree(const query_replica_decree_request& req, /*ou
 
 void replica_stub::on_query_replica_info(const query_replica_info_request& req, /*out*/ query_replica_info_response& resp)
 {
-    replicas rs;
-    {
-        zauto_lock l(_replicas_lock);
-        rs = _replicas;
-    }
+    replicas rs = get_replicas_copy();
     for (auto it = rs.begin(); it != rs.end(); ++it)
     {
         replica_ptr r = it->second;
@@ -515,6 +667,73 @@ void replica_stub::on_prepare(dsn_message_t request)
     }
 }
 
+void replica_stub::on_prepare_batch(dsn_message_t request)
+{
+    ::dsn::rpc_address from = dsn_msg_from_address(request);
+    int timeout_milliseconds;
+
+    rpc_read_stream reader(request);
+    unmarshall(reader, timeout_milliseconds);
+    while (reader.get_remaining_size() > 0)
+    {
+        global_partition_id gpid;
+        replica_configuration rconfig;
+        unmarshall(reader, gpid);
+        unmarshall(reader, rconfig);
+
+        // the updates are copied out, so that the batch message is not kept
+        // by the mutations in the prepare lists
+        mutation_ptr mu = mutation::read_from(reader, nullptr);
+        if (mu == nullptr)
+        {
+            derror("invalid mutation in the prepare batch from %s, the rest is ignored",
+                from.to_string());
+            break;
+        }
+
+        // dispatched to the replica threads in order, and acked one by one
+        replica_ptr rep = get_replica(gpid);
+        if (rep != nullptr)
+        {
+            mu->set_prepare_ack_address(from);
+            tasking::enqueue(
+                LPC_PREPARE_BATCH_DISPATCH,
+                rep.get(),
+                [rep, rconfig, mu]() mutable { rep->on_prepare(rconfig, mu); },
+                gpid_to_hash(gpid)
+                );
+        }
+        else
+        {
+            prepare_ack resp;
+            resp.gpid = gpid;
+            resp.err = ERR_OBJECT_NOT_FOUND;
+            resp.ballot = rconfig.ballot;
+            resp.decree = mu->data.header.decree;
+            resp.last_committed_decree_in_app = invalid_decree;
+            resp.last_committed_decree_in_prepare_list = invalid_decree;
+            send_prepare_ack(from, resp);
+        }
+    }
+}
+
+void replica_stub::send_prepare_ack(::dsn::rpc_address target, const prepare_ack& resp)
+{
+    dsn_message_t msg = dsn_msg_create_request(RPC_BATCHED_PREPARE_ACK, 0, gpid_to_hash(resp.gpid));
+    ::marshall(msg, resp);
+    dsn_rpc_call_one_way(target.c_addr(), msg);
+}
+
+void replica_stub::on_prepare_ack(dsn_message_t request)
+{
+    prepare_ack resp;
+    ::unmarshall(request, resp);
+    if (_prepare_batcher != nullptr)
+    {
+        _prepare_batcher->on_ack(dsn_msg_from_address(request), resp);
+    }
+}
+
 void replica_stub::on_group_check(const group_check_request& request, /*out*/ group_check_response& response)
 {
     if (!is_connected())
@@ -546,6 +765,38 @@ void replica_stub::on_group_check(const group_check_request& request, /*out*/ gr
     }
 }
 
+void replica_stub::on_group_check_batch(dsn_message_t request)
+{
+    std::vector<group_check_request> requests;
+    ::unmarshall(request, requests);
+
+    if (requests.empty())
+    {
+        reply(request, std::vector<group_check_response>());
+        return;
+    }
+
+    group_check_batch_responder_ptr responder(new group_check_batch_responder(request, static_cast<int>(requests.size())));
+
+    // handled in the replica threads as if they were sent separately
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        int index = static_cast<int>(i);
+        const group_check_request& req = requests[i];
+        tasking::enqueue(
+            LPC_GROUP_CHECK_BATCH_DISPATCH,
+            this,
+            [this, responder, index, req]()
+            {
+                group_check_response resp;
+                on_group_check(req, resp);
+                responder->respond(index, resp);
+            },
+            gpid_to_hash(req.config.gpid)
+            );
+    }
+}
+
 void replica_stub::on_learn(dsn_message_t msg)
 {
     learn_request request;
@@ -617,12 +868,9 @@ void replica_stub::on_remove(const replica_configuration& request)
 void replica_stub::json_state(std::stringstream& out) const
 {
     std::vector<replica_ptr> replicas_copy;
+    for (auto& rep : get_replicas_copy())
     {
-        zauto_lock _(_replicas_lock);
-        for (auto& rep : _replicas)
-        {
-            replicas_copy.push_back(rep.second);
-        }
+        replicas_copy.push_back(rep.second);
     }
     json_encode(out, replicas_copy);
 }
@@ -638,6 +886,32 @@ void replica_stub::static_replica_stub_json_state(void* context, int argc, const
     reply->context = danglingstr;
 }
 
+void replica_stub::static_replica_stub_load_progress(void* context, int argc, const char** argv, dsn_cli_reply* reply)
+{
+    auto stub = reinterpret_cast<replica_stub*>(context);
+    uint64_t start_ms = stub->_load_replica_start_ms.load();
+    uint64_t end_ms = stub->_load_replica_end_ms.load();
+    int finished = stub->_load_replica_finished.load();
+
+    std::stringstream ss;
+    if (start_ms == 0)
+    {
+        ss << "not started";
+    }
+    else
+    {
+        ss << (end_ms == 0 ? "loading" : "loaded") << " "
+            << finished << "/" << stub->_load_replica_total.load() << " replicas, "
+            << stub->_load_replica_failed.load() << " failed, elapsed "
+            << (end_ms == 0 ? dsn_now_ms() : end_ms) - start_ms << " ms";
+    }
+
+    auto danglingstr = new std::string(std::move(ss.str()));
+    reply->message = danglingstr->c_str();
+    reply->size = danglingstr->size();
+    reply->context = danglingstr;
+}
+
 void replica_stub::static_replica_stub_json_state_freer(dsn_cli_reply reply)
 {
     dassert(reply.context != nullptr, "corrupted cli reply");
@@ -646,6 +920,110 @@ void replica_stub::static_replica_stub_json_state_freer(dsn_cli_reply reply)
     delete danglingstr;
 }
 
+void replica_stub::load_replicas(/*out*/ replicas& rps)
+{
+    // the replica dirs are grouped by data dir, so that each disk is read by
+    // a bounded count of threads, and a slow disk does not block the others
+    std::vector<std::vector<std::string>> dir_lists;
+    int total = 0;
+    for (auto& dir : _options.data_dirs)
+    {
+        std::vector<std::string> tmp_list;
+        if (!dsn::utils::filesystem::get_subdirectories(dir, tmp_list, false))
+        {
+            dassert(false, "Fail to get subdirectories in %s.", dir.c_str());
+        }
+
+        std::vector<std::string> dir_list;
+        for (auto& rdir : tmp_list)
+        {
+            if (rdir.length() >= 4 && rdir.substr(rdir.length() - 4) == ".err")
+                continue;
+            dir_list.push_back(rdir);
+        }
+        total += static_cast<int>(dir_list.size());
+        dir_lists.push_back(std::move(dir_list));
+    }
+
+    _load_replica_total = total;
+    _load_replica_finished = 0;
+    _load_replica_failed = 0;
+    _load_replica_end_ms = 0;
+    _load_replica_start_ms = dsn_now_ms();
+
+    // each loader is a task in THREAD_POOL_REPLICATION_LONG which takes the next
+    // replica dir of its data dir until all are taken, so the loading is also
+    // bounded by the worker count of the pool
+    int load_thread_count = std::max(1, _options.replica_load_thread_count / std::max(1, static_cast<int>(_options.data_dirs.size())));
+    std::vector<std::atomic<int>> next_indexes(dir_lists.size());
+    std::vector<std::vector<replica_ptr>> loaded_lists(dir_lists.size() * load_thread_count);
+    std::vector<task_ptr> loaders;
+    size_t loader_index = 0;
+    for (size_t i = 0; i < dir_lists.size(); i++)
+    {
+        next_indexes[i] = 0;
+        int loader_count = std::min(load_thread_count, static_cast<int>(dir_lists[i].size()));
+        for (int j = 0; j < loader_count; j++)
+        {
+            auto& dir_list = dir_lists[i];
+            auto& next_index = next_indexes[i];
+            auto& loaded = loaded_lists[loader_index++];
+            loaders.push_back(tasking::enqueue(LPC_LOAD_REPLICA, this, [this, &dir_list, &next_index, &loaded]()
+            {
+                int index;
+                while ((index = next_index++) < static_cast<int>(dir_list.size()))
+                {
+                    replica_ptr r = replica::load(this, dir_list[index].c_str());
+                    if (r != nullptr)
+                    {
+                        loaded.push_back(r);
+                    }
+                    else
+                    {
+                        ++_load_replica_failed;
+                    }
+                    ++_load_replica_finished;
+                }
+            }));
+        }
+    }
+
+    for (auto& loader : loaders)
+    {
+        loader->wait();
+    }
+
+    for (auto& loaded : loaded_lists)
+    {
+        for (auto& r : loaded)
+        {
+            if (rps.find(r->get_gpid()) != rps.end())
+            {
+                dassert(false, "conflict replica dir: %s <--> %s", r->dir().c_str(), rps[r->get_gpid()]->dir().c_str());
+            }
+            ddebug("%u.%u @ %s: load replica '%s' success, <durable, commit> = <%" PRId64 ", %" PRId64 ">, last_prepared_decree = %" PRId64,
+                r->get_gpid().app_id, r->get_gpid().pidx,
+                primary_address().to_string(),
+                r->dir().c_str(),
+                r->last_durable_decree(),
+                r->last_committed_decree(),
+                r->last_prepared_decree()
+                );
+            rps[r->get_gpid()] = r;
+        }
+    }
+
+    _load_replica_end_ms = dsn_now_ms();
+    ddebug("%s: load %d replicas from %d data dirs with %d threads each, %d failed, elapsed %" PRIu64 " ms",
+        primary_address().to_string(),
+        total,
+        static_cast<int>(dir_lists.size()),
+        load_thread_count,
+        _load_replica_failed.load(),
+        _load_replica_end_ms - _load_replica_start_ms
+        );
+}
+
 void replica_stub::query_configuration_by_node()
 {
     if (_state == NS_Disconnected)
@@ -725,7 +1103,16 @@ void replica_stub::on_node_query_reply(error_code err, dsn_message_t request, ds
         if (resp.err != ERR_OK)
             return;
         
-        replicas rs = _replicas;
+        std::vector< ::dsn::rpc_address> members;
+        for (auto& config : resp.partitions)
+        {
+            if (!config.primary.is_invalid())
+                members.push_back(config.primary);
+            members.insert(members.end(), config.secondaries.begin(), config.secondaries.end());
+        }
+        warm_up(members);
+
+        replicas rs = get_replicas_copy();
         for (auto it = resp.partitions.begin(); it != resp.partitions.end(); ++it)
         {
             rs.erase(it->gpid);
@@ -750,6 +1137,34 @@ void replica_stub::on_node_query_reply(error_code err, dsn_message_t request, ds
     }
 }
 
+void replica_stub::warm_up(const std::vector< ::dsn::rpc_address>& servers)
+{
+    // the members are synced from the meta server periodically, and mostly warmed up before
+    std::vector<dsn_address_t> addrs;
+    {
+        zauto_lock l(_warmed_up_servers_lock);
+        for (auto& server : servers)
+        {
+            if (server != _primary_address && _warmed_up_servers.insert(server).second)
+                addrs.push_back(server.c_addr());
+        }
+    }
+
+    if (!addrs.empty())
+        dsn_rpc_warm_up(&addrs[0], (int)addrs.size());
+}
+
+void replica_stub::on_session_disconnected(::dsn::rpc_address server)
+{
+    zauto_lock l(_warmed_up_servers_lock);
+    _warmed_up_servers.erase(server);
+}
+
+void replica_stub::static_replica_stub_on_session_disconnected(dsn_address_t server, void* context)
+{
+    ((replica_stub*)context)->on_session_disconnected(::dsn::rpc_address(server));
+}
+
 void replica_stub::set_meta_server_connected_for_test(const configuration_query_by_node_response& resp)
 {
     zauto_lock l(_replicas_lock);
@@ -773,6 +1188,40 @@ void replica_stub::set_replica_state_subscriber_for_test(replica_state_subscribe
     _is_long_subscriber = is_long_subscriber;
 }
 
+void replica_stub::add_replica_for_test(replica_ptr r)
+{
+    add_replica(r);
+}
+
+bool replica_stub::remove_replica_for_test(replica_ptr r)
+{
+    return remove_replica(r);
+}
+
+replicas replica_stub::get_replicas_copy_for_test() const
+{
+    return get_replicas_copy();
+}
+
+void replica_stub::load_replicas_for_test(/*out*/ replicas& rps)
+{
+    if (_logs.empty())
+    {
+        create_shared_logs();
+    }
+    load_replicas(rps);
+}
+
+// the reply of the cli command "load-progress"
+std::string replica_stub::get_load_progress_for_test()
+{
+    dsn_cli_reply reply;
+    static_replica_stub_load_progress(this, 0, nullptr, &reply);
+    std::string progress(reply.message, reply.size);
+    static_replica_stub_json_state_freer(reply);
+    return progress;
+}
+
 // this_ is used to hold a ref to replica_stub so we don't need to cancel the task on replica_stub::close
 void replica_stub::on_node_query_reply_scatter(replica_stub_ptr this_, const partition_configuration& config)
 {
@@ -882,6 +1331,17 @@ void replica_stub::on_meta_server_disconnected_scatter(replica_stub_ptr this_, g
     }
 }
 
+// the meta server does not reassign the primaries on this node until grace (> lease) after
+// it stops receiving the beacons, so they are still the primaries before the lease expires,
+// and can serve reads locally without worrying about the disconnect being handled late
+bool replica_stub::is_read_lease_valid() const
+{
+    if (!_options.fd_read_lease_enabled || nullptr == _failure_detector)
+        return true;
+
+    return dsn_now_ms() < _failure_detector->lease_expire_time_ms();
+}
+
 void replica_stub::response_client_error(dsn_message_t request, error_code error)
 {
     if (nullptr == request)
@@ -909,18 +1369,15 @@ void replica_stub::init_gc_for_test()
 
 void replica_stub::on_gc()
 {
-    replicas rs;
-    {
-        zauto_lock l(_replicas_lock);
-        rs = _replicas;
-    }
+    replicas rs = get_replicas_copy();
 
-    // gc shared prepare log
-    if (_log != nullptr)
+    // gc shared prepare logs
+    if (!_logs.empty())
     {
         // gc condition is:
         //   d <= last_durable_decree && d <= private_log.max_commit_decree
-        replica_log_info_map gc_condition;
+        // and each shared log is gced with the replicas assigned to it
+        std::vector<replica_log_info_map> gc_conditions(_logs.size());
         for (auto it = rs.begin(); it != rs.end(); ++it)
         {
             replica_log_info ri;
@@ -935,9 +1392,12 @@ void replica_stub::on_gc()
                 ri.max_decree = r->last_durable_decree();
             }
             ri.valid_start_offset = r->get_app()->init_info().init_offset_in_shared_log;
-            gc_condition[it->first] = ri;
+            gc_conditions[static_cast<unsigned int>(gpid_to_hash(it->first)) % _logs.size()][it->first] = ri;
+        }
+        for (size_t i = 0; i < _logs.size(); i++)
+        {
+            _logs[i]->garbage_collection(gc_conditions[i]);
         }
-        _log->garbage_collection(gc_condition);
     }
     
     // gc on-disk rps
@@ -1147,6 +1607,10 @@ void replica_stub::add_replica(replica_ptr r)
     zauto_lock l(_replicas_lock);
     auto pr = _replicas.insert(replicas::value_type(r->get_gpid(), r));
     dassert(pr.second, "replica %s is already in the collection", r->name());
+
+    auto& shard = get_replicas_shard(r->get_gpid());
+    zauto_lock sl(shard.lock);
+    shard.rps[r->get_gpid()] = r;
 }
 
 bool replica_stub::remove_replica(replica_ptr r)
@@ -1154,6 +1618,11 @@ bool replica_stub::remove_replica(replica_ptr r)
     zauto_lock l(_replicas_lock);
     if (_replicas.erase(r->get_gpid()) > 0)
     {
+        auto& shard = get_replicas_shard(r->get_gpid());
+        {
+            zauto_lock sl(shard.lock);
+            shard.rps.erase(r->get_gpid());
+        }
         _counter_replicas_count.decrement();
         return true;
     }
@@ -1163,6 +1632,17 @@ bool replica_stub::remove_replica(replica_ptr r)
     }
 }
 
+replicas replica_stub::get_replicas_copy() const
+{
+    replicas rs;
+    for (auto& shard : _replicas_shards)
+    {
+        zauto_lock sl(shard.lock);
+        rs.insert(shard.rps.begin(), shard.rps.end());
+    }
+    return rs;
+}
+
 void replica_stub::notify_replica_state_update(const replica_configuration& config, bool is_closing)
 {
     if (nullptr != _replica_state_subscriber)
@@ -1195,11 +1675,14 @@ void replica_stub::open_service()
     register_rpc_handler(RPC_CONFIG_PROPOSAL, "ProposeConfig", &replica_stub::on_config_proposal);
 
     register_rpc_handler(RPC_PREPARE, "prepare", &replica_stub::on_prepare);
+    register_rpc_handler(RPC_PREPARE_BATCH, "prepare_batch", &replica_stub::on_prepare_batch);
+    register_rpc_handler(RPC_BATCHED_PREPARE_ACK, "batched_prepare_ack", &replica_stub::on_prepare_ack);
     register_rpc_handler(RPC_LEARN, "Learn", &replica_stub::on_learn);
     register_rpc_handler(RPC_LEARN_COMPLETION_NOTIFY, "LearnNotify", &replica_stub::on_learn_completion_notification);
     register_rpc_handler(RPC_LEARN_ADD_LEARNER, "LearnAdd", &replica_stub::on_add_learner);
     register_rpc_handler(RPC_REMOVE_REPLICA, "remove", &replica_stub::on_remove);
     register_rpc_handler(RPC_GROUP_CHECK, "GroupCheck", &replica_stub::on_group_check);
+    register_rpc_handler(RPC_GROUP_CHECK_BATCH, "GroupCheckBatch", &replica_stub::on_group_check_batch);
     register_rpc_handler(RPC_QUERY_PN_DECREE, "query_decree", &replica_stub::on_query_decree);
     register_rpc_handler(RPC_QUERY_REPLICA_INFO, "query_replica_info", &replica_stub::on_query_replica_info);
     register_rpc_handler(RPC_REPLICA_COPY_LAST_CHECKPOINT, "copy_checkpoint", &replica_stub::on_copy_checkpoint);
@@ -1211,6 +1694,18 @@ void replica_stub::open_service()
 
 void replica_stub::close()
 {
+    if (_cli_replica_stub_load_progress_handle != nullptr)
+    {
+        dsn_cli_deregister(_cli_replica_stub_load_progress_handle);
+        _cli_replica_stub_load_progress_handle = nullptr;
+    }
+
+    if (_session_disconnected_handle != nullptr)
+    {
+        dsn_rpc_unregister_session_disconnected_handler(_session_disconnected_handle);
+        _session_disconnected_handle = nullptr;
+    }
+
     // this replica may not be opened
     // or is already closed by calling tool_app::stop_all_apps()
     // in this case, just return
@@ -1228,6 +1723,12 @@ void replica_stub::close()
         _config_sync_timer_task = nullptr;
     }
 
+    if (_group_check_timer_task != nullptr)
+    {
+        _group_check_timer_task->cancel(true);
+        _group_check_timer_task = nullptr;
+    }
+
     if (_config_query_task != nullptr)
     {
         _config_query_task->cancel(true);
@@ -1275,6 +1776,11 @@ void replica_stub::close()
         {
             _replicas.begin()->second->close();
 
+            auto& shard = get_replicas_shard(_replicas.begin()->first);
+            {
+                zauto_lock sl(shard.lock);
+                shard.rps.erase(_replicas.begin()->first);
+            }
             _counter_replicas_count.decrement();
             _replicas.erase(_replicas.begin());
         }
@@ -1287,11 +1793,163 @@ void replica_stub::close()
         _failure_detector = nullptr;
     }
 
-    if (_log != nullptr)
+    for (auto& log : _logs)
+    {
+        log->close();
+    }
+    _logs.clear();
+}
+
+mutation_log_ptr replica_stub::shared_log(global_partition_id gpid) const
+{
+    return _logs[static_cast<unsigned int>(gpid_to_hash(gpid)) % _logs.size()];
+}
+
+void replica_stub::create_shared_logs()
+{
+    dassert(_logs.empty(), "shared logs are already created");
+    for (auto& dir : _options.slog_dirs)
+    {
+        mutation_log_ptr log = new mutation_log(
+            dir,
+            _options.log_shared_batch_buffer_kb,
+            _options.log_shared_file_size_mb,
+            _options.log_shared_force_flush
+            );
+        log->set_preallocation(_options.log_preallocate, _options.log_recycle_file_count);
+        log->set_group_commit(
+            _options.log_shared_group_commit_max_wait_us,
+            _options.log_shared_group_commit_max_batch_kb,
+            _options.log_shared_max_writes_in_flight
+            );
+        log->set_block_compression(_options.log_shared_compress);
+        log->set_direct_io(_options.log_direct_io);
+        _logs.push_back(log);
+    }
+}
+
+std::vector<std::string> replica_stub::find_stale_shared_log_dirs() const
+{
+    std::set<std::string> current(_options.slog_dirs.begin(), _options.slog_dirs.end());
+    std::set<std::string> parents;
+    for (auto& dir : _options.slog_dirs)
+    {
+        parents.insert(utils::filesystem::remove_file_name(dir));
+    }
+
+    std::vector<std::string> stale_dirs;
+    for (auto& parent : parents)
     {
-        _log->close();
-        _log = nullptr;
+        std::vector<std::string> sub_list;
+        if (!utils::filesystem::get_subdirectories(parent, sub_list, false))
+        {
+            dwarn("failed to get subdirectories in %s", parent.c_str());
+            continue;
+        }
+        for (auto& dir : sub_list)
+        {
+            std::string name = utils::filesystem::get_file_name(dir);
+            int index, count;
+            bool is_slog = (name == "slog"
+                || (sscanf(name.c_str(), "slog.%d.%d", &index, &count) == 2
+                    && name == "slog." + std::to_string(index) + "." + std::to_string(count)
+                    && index >= 0 && index < count));
+            if (is_slog && current.find(dir) == current.end())
+            {
+                stale_dirs.push_back(dir);
+            }
+        }
+    }
+    return stale_dirs;
+}
+
+error_code replica_stub::merge_stale_shared_logs(
+    const std::vector<std::string>& stale_dirs,
+    const std::unordered_map<global_partition_id, int64_t>& start_offsets,
+    replicas& rps
+    )
+{
+    for (auto& dir : stale_dirs)
+    {
+        ddebug("%s: merge stale shared log %s into the current shared logs",
+            primary_address().to_string(),
+            dir.c_str()
+            );
+
+        mutation_log_ptr stale_log = new mutation_log(
+            dir,
+            _options.log_shared_batch_buffer_kb,
+            _options.log_shared_file_size_mb,
+            _options.log_shared_force_flush
+            );
+        error_code err = ERR_OK;
+        ::dsn::service::zlock appends_lock;
+        std::vector<task_ptr> appends;
+        task_ptr open = tasking::enqueue(LPC_OPEN_SHARED_LOG, this, [this, stale_log, &err, &appends_lock, &appends, &start_offsets, &rps]()
+        {
+            err = stale_log->open(
+                [this, &appends_lock, &appends, &start_offsets, &rps](mutation_ptr& mu)
+                {
+                    auto gpid = mu->data.header.gpid;
+                    auto it = rps.find(gpid);
+                    auto oit = start_offsets.find(gpid);
+                    if (it == rps.end() || oit == start_offsets.end()
+                        || mu->data.header.log_offset < oit->second)
+                    {
+                        return false;
+                    }
+
+                    // the mutation is serialized on append, which also resets its
+                    // log offset to the one in the current shared log
+                    auto append = shared_log(gpid)->append(mu, LPC_WRITE_REPLICATION_LOG, nullptr,
+                        [](error_code, size_t) {}, gpid_to_hash(gpid));
+                    {
+                        ::dsn::service::zauto_lock l(appends_lock);
+                        appends.push_back(append);
+                    }
+                    return it->second->replay_mutation(mu, false);
+                }
+                );
+        });
+        open->wait();
+        stale_log->close();
+
+        for (auto& log : _logs)
+        {
+            log->flush();
+        }
+
+        // the stale dir is removed only when all its mutations are written
+        for (auto& append : appends)
+        {
+            if (append == nullptr)
+            {
+                err = (err == ERR_OK ? ERR_FILE_OPERATION_FAILED : err);
+                continue;
+            }
+            append->wait();
+            if (err == ERR_OK)
+            {
+                err = append->error();
+            }
+        }
+
+        if (err != ERR_OK)
+        {
+            derror("%s: merge stale shared log %s failed, err = %s",
+                primary_address().to_string(),
+                dir.c_str(),
+                err.to_string()
+                );
+            return err;
+        }
+
+        if (!utils::filesystem::remove_path(dir))
+        {
+            dassert(false, "remove directory %s failed", dir.c_str());
+        }
     }
+    return ERR_OK;
 }
 
 std::string replica_stub::get_replica_dir(const char* app_type, global_partition_id gpid) const
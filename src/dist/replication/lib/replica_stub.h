@@ -43,12 +43,16 @@
 
 # include "replication_common.h"
 # include <dsn/cpp/perf_counter_.h>
+# include <atomic>
+# include <unordered_set>
 
 namespace dsn { namespace replication {
 
 class mutation_log;
 class replication_failure_detector;
 class replication_checker;
+class prepare_batcher;
+class group_check_batcher;
 namespace test {
     class test_checker;
 }
@@ -95,7 +99,10 @@ public:
     //        - commit
     //        - learn
     //
-    void on_prepare(dsn_message_t request);    
+    void on_prepare(dsn_message_t request);
+    void on_prepare_batch(dsn_message_t request);
+    void on_prepare_ack(dsn_message_t request);
+    void on_group_check_batch(dsn_message_t request);
     void on_learn(dsn_message_t msg);
     void on_learn_completion_notification(const group_check_response& report);
     void on_add_learner(const group_check_request& request);
@@ -117,6 +124,11 @@ public:
     void set_meta_server_disconnected_for_test() { on_meta_server_disconnected(); }
     void set_meta_server_connected_for_test(const configuration_query_by_node_response& config);
     void set_replica_state_subscriber_for_test(replica_state_subscriber subscriber, bool is_long_subscriber);
+    void add_replica_for_test(replica_ptr r);
+    bool remove_replica_for_test(replica_ptr r);
+    replicas get_replicas_copy_for_test() const;
+    void load_replicas_for_test(/*out*/ replicas& rps);
+    std::string get_load_progress_for_test();
 
     //
     // common routines for inquiry
@@ -125,14 +137,20 @@ public:
     replica_ptr get_replica(int32_t app_id, int32_t partition_index);
     replication_options& options() { return _options; }
     bool is_connected() const { return NS_Connected == _state; }
+    bool is_read_lease_valid() const;
 
     void json_state(std::stringstream& out) const;
 
     static void static_replica_stub_json_state(void* context, int argc, const char** argv, dsn_cli_reply* reply);
     static void static_replica_stub_json_state_freer(dsn_cli_reply reply);
+    static void static_replica_stub_load_progress(void* context, int argc, const char** argv, dsn_cli_reply* reply);
+    static void static_replica_stub_on_session_disconnected(dsn_address_t server, void* context);
 
     std::string get_replica_dir(const char* app_type, global_partition_id gpid) const;
 
+    // the shared log which the partition is assigned to by gpid hash
+    mutation_log_ptr shared_log(global_partition_id gpid) const;
+
 private:    
     enum replica_node_state
     {
@@ -141,20 +159,42 @@ private:
         NS_Connected
     };
 
+    // load the replicas under _options.data_dirs in parallel, each data dir by its own threads
+    void load_replicas(/*out*/ replicas& rps);
     void query_configuration_by_node();
     void on_meta_server_disconnected_scatter(replica_stub_ptr this_, global_partition_id gpid);
     void on_node_query_reply(error_code err, dsn_message_t request, dsn_message_t response);
     void on_node_query_reply_scatter(replica_stub_ptr this_, const partition_configuration& config);
     void on_node_query_reply_scatter2(replica_stub_ptr this_, global_partition_id gpid);
     void remove_replica_on_meta_server(const partition_configuration& config);
+    // connect to the servers (except self and the ones warmed up before) in advance, see dsn_rpc_warm_up
+    void warm_up(const std::vector< ::dsn::rpc_address>& servers);
+    // the server is warmed up again when it is a member in the later config syncs
+    void on_session_disconnected(::dsn::rpc_address server);
     ::dsn::task_ptr begin_open_replica(const std::string& app_type, global_partition_id gpid, std::shared_ptr<group_check_request> req = nullptr);
     void    open_replica(const std::string app_type, global_partition_id gpid, std::shared_ptr<group_check_request> req);
     ::dsn::task_ptr begin_close_replica(replica_ptr r);
     void close_replica(replica_ptr r);
     void add_replica(replica_ptr r);
     bool remove_replica(replica_ptr r);
+    // a copy of the replicas gathered shard by shard, without holding _replicas_lock
+    replicas get_replicas_copy() const;
     void notify_replica_state_update(const replica_configuration& config, bool is_closing);
     void handle_log_failure(error_code err);
+    // ack a prepare received in RPC_PREPARE_BATCH
+    void send_prepare_ack(::dsn::rpc_address target, const prepare_ack& resp);
+    // create (but not open) the shared logs, one in each of _options.slog_dirs
+    void create_shared_logs();
+    // dirs of the shared logs with another count of shared logs, named "slog" or
+    // "slog.<i>.<n>", whose partitions were assigned to them differently
+    std::vector<std::string> find_stale_shared_log_dirs() const;
+    // replay the stale shared logs into the replicas and re-log their mutations
+    // into the current (opened) shared logs, then remove the stale dirs
+    error_code merge_stale_shared_logs(
+        const std::vector<std::string>& stale_dirs,
+        const std::unordered_map<global_partition_id, int64_t>& start_offsets,
+        replicas& rps
+        );
 
     void install_perf_counters();
 
@@ -162,6 +202,7 @@ private:
     friend class ::dsn::replication::replication_checker;    
     friend class ::dsn::replication::test::test_checker;
     friend class ::dsn::replication::replica;
+    friend class ::dsn::replication::group_check_batcher;
     typedef std::unordered_map<global_partition_id, ::dsn::task_ptr> opening_replicas;
     typedef std::unordered_map<global_partition_id, std::pair< ::dsn::task_ptr, replica_ptr>> closing_replicas; // <close, replica>
 
@@ -169,9 +210,29 @@ private:
     replicas                    _replicas;
     opening_replicas            _opening_replicas;
     closing_replicas            _closing_replicas;
+
+    // a read index of _replicas sharded by gpid, updated with _replicas_lock held, so that
+    // the lookups on the request paths only take the lock of one shard (see get_replica)
+    struct replicas_shard
+    {
+        mutable zlock lock;
+        replicas      rps;
+    };
+    static const int REPLICAS_SHARD_COUNT = 64;
+    replicas_shard              _replicas_shards[REPLICAS_SHARD_COUNT];
+    replicas_shard& get_replicas_shard(global_partition_id gpid) const
+    {
+        return const_cast<replicas_shard&>(_replicas_shards[static_cast<unsigned int>(gpid_to_hash(gpid)) % REPLICAS_SHARD_COUNT]);
+    }
     
-    mutation_log_ptr            _log;
+    std::vector<mutation_log_ptr> _logs; // shared logs
     ::dsn::rpc_address          _primary_address;
+    prepare_batcher             *_prepare_batcher; // null if prepare batching is disabled
+    group_check_batcher         *_group_check_batcher; // null if group check batching is disabled
+
+    // servers warmed up and still connected, removed upon the session disconnected
+    zlock                       _warmed_up_servers_lock;
+    std::unordered_set< ::dsn::rpc_address> _warmed_up_servers;
 
     replication_failure_detector *_failure_detector;
     volatile replica_node_state   _state;
@@ -184,16 +245,35 @@ private:
     // temproal states
     ::dsn::task_ptr _config_query_task;
     ::dsn::task_ptr _config_sync_timer_task;
+    ::dsn::task_ptr _group_check_timer_task;
     ::dsn::task_ptr _gc_timer_task;
 
     //cli handle, for deregister cli command
     dsn_handle_t    _cli_replica_stub_json_state_handle;
+    dsn_handle_t    _cli_replica_stub_load_progress_handle;
+
+    // session disconnected handle, for clearing _warmed_up_servers
+    dsn_handle_t    _session_disconnected_handle;
+
+    // progress of loading the replicas on startup, see load_replicas
+    std::atomic<int>      _load_replica_total;
+    std::atomic<int>      _load_replica_finished;
+    std::atomic<int>      _load_replica_failed;
+    std::atomic<uint64_t> _load_replica_start_ms;
+    std::atomic<uint64_t> _load_replica_end_ms;
 
     // performance counters
     perf_counter_    _counter_replicas_count;
     perf_counter_    _counter_replicas_opening_count;
     perf_counter_    _counter_replicas_closing_count;
     perf_counter_    _counter_replicas_total_commit_throught;
+    perf_counter_    _counter_replicas_primary_read_qps;
+    perf_counter_    _counter_replicas_secondary_read_qps;
+    perf_counter_    _counter_replicas_stale_read_rejected;
+    perf_counter_    _counter_replicas_lease_read_rejected;
+    perf_counter_    _counter_replicas_write_deduplicated;
+    perf_counter_    _counter_replicas_group_check_request;
+    perf_counter_    _counter_replicas_group_check_rpc;
     
     perf_counter_    _counter_replicas_learning_failed_latency;
     perf_counter_    _counter_replicas_learning_success_latency;
@@ -125,6 +125,8 @@ replication_app_base::replication_app_base(replica* replica)
     _dir_data = replica->dir() + "/data";
     _dir_learn = replica->dir() + "/learn";
     _is_delta_state_learning_supported = false;
+    _is_read_thread_safe = false;
+    _is_write_dedup_supported = false;
     _batch_state = BS_NOT_BATCH;
 
     _replica = replica;
@@ -148,6 +150,7 @@ void replication_app_base::reset_states()
     _physical_error = 0;
     _batch_state = BS_NOT_BATCH;
     _last_committed_decree = _last_durable_decree = 0;
+    _dedup_table.clear();
 }
 
 const char* replication_app_base::replica_name() const
@@ -213,22 +216,62 @@ error_code replication_app_base::write_internal(mutation_ptr& mu)
 
         const mutation_update& update = mu->data.updates[i];
         const dsn_message_t& req = mu->client_requests[i];
-        if (update.code != RPC_REPLICATION_WRITE_EMPTY)
+        const write_dedup_id* id = (_dedup_table.is_enabled() && !mu->dedup_ids.empty() && mu->dedup_ids[i].is_valid())
+            ? &mu->dedup_ids[i] : nullptr;
+        blob dedup_response;
+        write_dedup_table::write_state dedup_state = (id
+            ? _dedup_table.find(id->client_id, id->request_seq, dedup_response)
+            : write_dedup_table::WS_NOT_APPLIED);
+        if (update.code == RPC_REPLICATION_WRITE_EMPTY)
+        {
+            // empty mutation write
+        }
+        else if (dedup_state == write_dedup_table::WS_APPLIED)
+        {
+            // a retry proposed before the first try was applied, which is not executed again
+            dinfo("%s: mutation %s skip duplicate write: client_id = %" PRId64 ", request_seq = %" PRId64,
+                  _replica->name(), mu->name(), id->client_id, id->request_seq);
+            if (req)
+            {
+                reply_duplicate_write(req, dedup_response);
+            }
+        }
+        else if (dedup_state == write_dedup_table::WS_EXPIRED)
+        {
+            // a retry whose first try may have been applied, which is not executed either
+            dwarn("%s: mutation %s skip expired write: client_id = %" PRId64 ", request_seq = %" PRId64,
+                  _replica->name(), mu->name(), id->client_id, id->request_seq);
+            if (req)
+            {
+                reply_expired_write(req);
+            }
+        }
+        else
         {
             dinfo("%s: mutation %s dispatch rpc call: %s",
                   _replica->name(), mu->name(), update.code.to_string());
             binary_reader reader(update.data);
             dsn_message_t resp = (req ? dsn_msg_create_response(req) : nullptr);
+            if (id && resp)
+            {
+                dsn_msg_add_ref(resp); // released after the response is kept
+            }
 
             //uint64_t now = dsn_now_ns();
             dispatch_rpc_call(update.code, reader, resp);
             //now = dsn_now_ns() - now;
 
             //_app_commit_latency.set(now);
-        }
-        else
-        {
-            // empty mutation write
+
+            if (id)
+            {
+                if (resp)
+                {
+                    dedup_response = get_dedup_response(resp);
+                    dsn_msg_release_ref(resp);
+                }
+                _dedup_table.add(id->client_id, id->request_seq, dedup_response);
+            }
         }
 
         if (_physical_error != 0)
@@ -249,6 +292,46 @@ error_code replication_app_base::write_internal(mutation_ptr& mu)
     return ERR_OK;
 }
 
+blob replication_app_base::get_dedup_response(dsn_message_t response) const
+{
+    // the response body, including the replication error code, is kept only if
+    // it is in one buffer as it is for the small responses
+    size_t size = dsn_msg_body_size(response);
+    if (size == 0 || size > static_cast<size_t>(_dedup_table.max_response_bytes()))
+        return blob();
+
+    const char* first = (const char*)dsn_msg_rw_ptr(response, 0);
+    const char* last = (const char*)dsn_msg_rw_ptr(response, size - 1);
+    if (first == nullptr || last != first + size - 1)
+        return blob();
+
+    std::shared_ptr<char> buffer(new char[size], [](char* ptr){ delete[] ptr; });
+    memcpy(buffer.get(), first, size);
+    return blob(buffer, 0, static_cast<int>(size));
+}
+
+/*static*/ void replication_app_base::reply_duplicate_write(dsn_message_t request, const blob& response)
+{
+    dsn_message_t resp = dsn_msg_create_response(request);
+    if (response.length() > 0)
+    {
+        ::dsn::rpc_write_stream writer(resp);
+        writer.write(response.data(), response.length());
+    }
+    else
+    {
+        ::marshall(resp, ERR_DUPLICATE_WRITE);
+    }
+    dsn_rpc_reply(resp);
+}
+
+/*static*/ void replication_app_base::reply_expired_write(dsn_message_t request)
+{
+    dsn_message_t resp = dsn_msg_create_response(request);
+    ::marshall(resp, ERR_DEDUP_EXPIRED);
+    dsn_rpc_reply(resp);
+}
+
 error_code replication_app_base::update_init_info(replica* r, int64_t shared_log_offset, int64_t private_log_offset)
 {
     _info.crc = 0;
@@ -48,6 +48,7 @@ replication_failure_detector::replication_failure_detector(
 {
     _meta_servers.assign_group(dsn_group_build("meta.servers"));
     _stub = stub;
+    _lease_expire_ms.store(0);
     for (auto& s : meta_servers)
     {
         dsn_group_add(_meta_servers.group_handle(), s.c_addr());
@@ -94,7 +95,9 @@ void replication_failure_detector::end_ping(::dsn::error_code err, const fd::bea
     }
     else {
         if (ack.is_master) {
-            //do nothing
+            // the master will not declare this node dead within grace (> lease) since it
+            // received the beacon, which is no earlier than when the beacon was sent
+            _lease_expire_ms.store(ack.time + get_lease_ms());
         }
         else if (ack.primary_node.is_invalid()) {
             rpc_address next = dsn_group_next(_meta_servers.group_handle(), ack.this_node.c_addr());
@@ -125,6 +128,7 @@ void replication_failure_detector::on_master_disconnected( const std::vector< ::
 
     if (primaryDisconnected)
     {
+        _lease_expire_ms.store(0);
         _stub->on_meta_server_disconnected();
     }
 }
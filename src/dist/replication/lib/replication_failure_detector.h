@@ -37,6 +37,7 @@
 
 #include "replication_common.h"
 # include <dsn/dist/failure_detector.h>
+# include <atomic>
 
 namespace dsn { namespace replication {
 
@@ -61,9 +62,14 @@ public:
     ::dsn::rpc_address get_servers() const  { return _meta_servers; }
 
     void set_leader_for_test(dsn::rpc_address meta);
+
+    // until when (local time, ms) the leader meta server regards this node as alive,
+    // i.e., the send time of the last acked beacon plus the lease, or 0 when disconnected
+    uint64_t lease_expire_time_ms() const { return _lease_expire_ms.load(); }
 private:
     dsn::rpc_address         _meta_servers;
     replica_stub             *_stub;
+    std::atomic<uint64_t>    _lease_expire_ms;
 };
 
 }} // end namespace
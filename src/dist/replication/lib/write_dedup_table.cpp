@@ -0,0 +1,268 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Per-partition table of the applied client writes for deduplicating
+ *     the retries, see write_dedup_table.h.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <dsn/dist/replication/write_dedup_table.h>
+# include <algorithm>
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "replica.dedup"
+
+namespace dsn { namespace replication {
+
+static const int WRITE_DEDUP_TABLE_FORMAT_VERSION = 2;
+
+write_dedup_table::write_dedup_table()
+    : _max_clients(0), _max_requests_per_client(0), _max_response_bytes(0)
+{
+}
+
+void write_dedup_table::set_limits(int max_clients, int max_requests_per_client, int max_response_bytes)
+{
+    dassert(max_clients == 0 || max_requests_per_client > 0, "max_requests_per_client must be positive");
+
+    ::dsn::service::zauto_lock l(_lock);
+    _max_clients = max_clients;
+    _max_requests_per_client = max_requests_per_client;
+    _max_response_bytes = max_response_bytes;
+
+    if (_max_clients == 0)
+    {
+        _clients.clear();
+        _lru.clear();
+    }
+}
+
+write_dedup_table::write_state write_dedup_table::find(int64_t client_id, int64_t request_seq, /*out*/ blob& response) const
+{
+    ::dsn::service::zauto_lock l(_lock);
+    auto it = _clients.find(client_id);
+    if (it == _clients.end())
+        return WS_NOT_APPLIED;
+
+    // the lookups do not change the lru order, which must be the same on all replicas
+    const client_entry& entry = it->second;
+    auto rit = entry.responses.find(request_seq);
+    if (rit != entry.responses.end())
+    {
+        response = rit->second;
+        return WS_APPLIED;
+    }
+
+    response = blob();
+    if (request_seq <= entry.watermark)
+        return WS_APPLIED;
+    else if (request_seq <= entry.evicted)
+        return WS_EXPIRED;
+    else
+        return WS_NOT_APPLIED;
+}
+
+void write_dedup_table::add(int64_t client_id, int64_t request_seq, const blob& response)
+{
+    if (!is_enabled())
+        return;
+
+    ::dsn::service::zauto_lock l(_lock);
+    client_entry& entry = touch_client(client_id);
+    if (request_seq <= entry.watermark || request_seq <= entry.evicted)
+        return;
+
+    entry.responses[request_seq] = (response.length() <= _max_response_bytes ? response : blob());
+
+    // advance the watermark across the contiguous applied seqs only
+    for (auto it = entry.responses.upper_bound(entry.watermark);
+         it != entry.responses.end() && it->first == entry.watermark + 1;
+         ++it)
+    {
+        entry.watermark = it->first;
+    }
+    trim_client(entry);
+}
+
+void write_dedup_table::clear()
+{
+    ::dsn::service::zauto_lock l(_lock);
+    _clients.clear();
+    _lru.clear();
+}
+
+int write_dedup_table::client_count() const
+{
+    ::dsn::service::zauto_lock l(_lock);
+    return static_cast<int>(_clients.size());
+}
+
+write_dedup_table::client_entry& write_dedup_table::touch_client(int64_t client_id)
+{
+    auto it = _clients.find(client_id);
+    if (it != _clients.end())
+    {
+        _lru.splice(_lru.begin(), _lru, it->second.lru_pos);
+        return it->second;
+    }
+
+    while (static_cast<int>(_clients.size()) >= _max_clients)
+    {
+        _clients.erase(_lru.back());
+        _lru.pop_back();
+    }
+
+    _lru.push_front(client_id);
+    client_entry& entry = _clients[client_id];
+    entry.watermark = 0;
+    entry.evicted = 0;
+    entry.lru_pos = _lru.begin();
+    return entry;
+}
+
+void write_dedup_table::trim_client(client_entry& entry)
+{
+    if (entry.responses.empty())
+        return;
+
+    // slide the window to the latest seq
+    int64_t floor = entry.responses.rbegin()->first - _max_requests_per_client;
+    if (floor > entry.evicted)
+    {
+        entry.evicted = floor;
+        entry.responses.erase(entry.responses.begin(), entry.responses.upper_bound(floor));
+    }
+}
+
+// the format is: version, client count, and for each client from the least recently
+// written one: client id, watermark, max seq out of the window, request count, (request seq,
+// response) of the requests; version 1 has no max seq out of the window, and its watermark is
+// taken as that seq
+void write_dedup_table::write_to(binary_writer& writer) const
+{
+    ::dsn::service::zauto_lock l(_lock);
+    writer.write(WRITE_DEDUP_TABLE_FORMAT_VERSION);
+    writer.write(static_cast<int>(_clients.size()));
+    for (auto it = _lru.rbegin(); it != _lru.rend(); ++it)
+    {
+        const client_entry& entry = _clients.find(*it)->second;
+        writer.write(*it);
+        writer.write(entry.watermark);
+        writer.write(entry.evicted);
+        writer.write(static_cast<int>(entry.responses.size()));
+        for (auto& r : entry.responses)
+        {
+            writer.write(r.first);
+            writer.write(r.second);
+        }
+    }
+}
+
+error_code write_dedup_table::read_from(binary_reader& reader)
+{
+    ::dsn::service::zauto_lock l(_lock);
+    _clients.clear();
+    _lru.clear();
+
+    int version;
+    reader.read(version);
+    if (version != 1 && version != WRITE_DEDUP_TABLE_FORMAT_VERSION)
+    {
+        derror("unknown dedup table format version %d", version);
+        return ERR_INVALID_DATA;
+    }
+
+    int client_count;
+    reader.read(client_count);
+    for (int i = 0; i < client_count; i++)
+    {
+        int64_t client_id;
+        int64_t watermark;
+        int64_t evicted;
+        int request_count;
+        reader.read(client_id);
+        reader.read(watermark);
+        if (version == 1)
+        {
+            // the seqs below it are not known to be all applied
+            evicted = watermark;
+            watermark = 0;
+        }
+        else
+        {
+            reader.read(evicted);
+        }
+        reader.read(request_count);
+
+        // the entries are kept even if the table is disabled now, so that they are
+        // not lost in the next checkpoint if the table is enabled again
+        _lru.push_front(client_id);
+        client_entry& entry = _clients[client_id];
+        entry.watermark = watermark;
+        entry.evicted = evicted;
+        entry.lru_pos = _lru.begin();
+        for (int j = 0; j < request_count; j++)
+        {
+            int64_t request_seq;
+            blob response;
+            reader.read(request_seq);
+            reader.read(response);
+
+            // not to pin the whole buffer of the checkpoint
+            if (response.length() > 0)
+            {
+                std::shared_ptr<char> buffer(new char[response.length()], [](char* ptr){ delete[] ptr; });
+                memcpy(buffer.get(), response.data(), response.length());
+                response.assign(buffer, 0, response.length());
+            }
+            entry.responses[request_seq] = response;
+        }
+    }
+
+    // the limits may be smaller than when the table is written
+    if (is_enabled())
+    {
+        while (static_cast<int>(_clients.size()) > _max_clients)
+        {
+            _clients.erase(_lru.back());
+            _lru.pop_back();
+        }
+        for (auto& c : _clients)
+        {
+            trim_client(c.second);
+        }
+    }
+    return ERR_OK;
+}
+
+}} // namespace
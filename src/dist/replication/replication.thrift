@@ -73,6 +73,7 @@ enum read_semantic
     ReadLastUpdate,
     ReadOutdated,
     ReadSnapshot,
+    ReadBoundedStaleness,
 }
 
 struct read_request_header
@@ -81,12 +82,16 @@ struct read_request_header
     2:dsn.task_code       code;
     3:read_semantic       semantic = read_semantic.ReadLastUpdate;
     4:i64                 version_decree = -1;
+    5:i64                 max_staleness_decrees = -1; // only used when ReadBoundedStaleness, -1 for no limit
+    6:i32                 max_staleness_ms = -1; // only used when ReadBoundedStaleness, -1 for no limit
 }
 
 struct write_request_header
 {
     1:global_partition_id gpid;
     2:dsn.task_code       code;
+    3:i64                 client_id = 0; // with request_seq to dedup the retries of a write, 0 for no dedup
+    4:i64                 request_seq = 0;
 }
 
 struct rw_response_header
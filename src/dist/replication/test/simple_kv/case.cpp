@@ -786,6 +786,12 @@ std::string client_case_line::to_string() const
         oss << "id=" << _id
             << ",key=" << _key
             << ",timeout=" << _timeout;
+        if (!_read_target.is_invalid())
+            oss << ",target=" << address_to_node(_read_target);
+        if (_read_max_staleness_decrees != -1)
+            oss << ",max_staleness_decrees=" << _read_max_staleness_decrees;
+        if (_read_max_staleness_ms != -1)
+            oss << ",max_staleness_ms=" << _read_max_staleness_ms;
         break;
     }
     case end_write:
@@ -851,6 +857,18 @@ bool client_case_line::parse(const std::string& params)
         _id = boost::lexical_cast<int>(kv_map["id"]);
         _key = kv_map["key"];
         _timeout = boost::lexical_cast<int>(kv_map["timeout"]);
+        if (kv_map.find("target") != kv_map.end())
+        {
+            _read_target = node_to_address(kv_map["target"]);
+            if (_read_target.is_invalid())
+                parse_ok = false;
+        }
+        _read_max_staleness_decrees = -1;
+        if (kv_map.find("max_staleness_decrees") != kv_map.end())
+            _read_max_staleness_decrees = boost::lexical_cast<int64_t>(kv_map["max_staleness_decrees"]);
+        _read_max_staleness_ms = -1;
+        if (kv_map.find("max_staleness_ms") != kv_map.end())
+            _read_max_staleness_ms = boost::lexical_cast<int>(kv_map["max_staleness_ms"]);
         break;
     }
     case end_write:
@@ -960,12 +978,16 @@ void client_case_line::get_write_params(int& id, std::string& key, std::string&
     timeout_ms = _timeout;
 }
 
-void client_case_line::get_read_params(int& id, std::string& key, int& timeout_ms) const
+void client_case_line::get_read_params(int& id, std::string& key, int& timeout_ms, rpc_address& target,
+    int64_t& max_staleness_decrees, int& max_staleness_ms) const
 {
     dassert(_type == begin_read, "");
     id = _id;
     key = _key;
     timeout_ms = _timeout;
+    target = _read_target;
+    max_staleness_decrees = _read_max_staleness_decrees;
+    max_staleness_ms = _read_max_staleness_ms;
 }
 
 void client_case_line::get_replica_config_params(rpc_address& receiver, dsn::replication::config_type& type, rpc_address& node) const
@@ -1262,12 +1284,13 @@ bool test_case::check_replica_config(rpc_address& receiver, dsn::replication::co
     return true;
 }
 
-bool test_case::check_client_read(int& id, std::string& key, int& timeout_ms)
+bool test_case::check_client_read(int& id, std::string& key, int& timeout_ms, rpc_address& target,
+    int64_t& max_staleness_decrees, int& max_staleness_ms)
 {
     if ( !check_client_instruction(client_case_line::begin_read) )
         return false;
     client_case_line* cl = static_cast<client_case_line*>(_case_lines[_next]);
-    cl->get_read_params(id, key, timeout_ms);
+    cl->get_read_params(id, key, timeout_ms, target, max_staleness_decrees, max_staleness_ms);
     forward();
     return true;
 }
@@ -360,7 +360,7 @@ public:
     enum client_type
     {
         begin_write,      // id=xxx,key=xxx,value=xxx,timeout=xxx
-        begin_read,       // id=xxx,key=xxx,timeout=xxx
+        begin_read,       // id=xxx,key=xxx,timeout=xxx[,target=xxx][,max_staleness_decrees=xxx][,max_staleness_ms=xxx]
         end_write,        // id=xxx,err=xxx,resp=xxx
         end_read,         // id=xxx,err=xxx,resp=xxx
         replica_config,   // receiver=xxx,type=xxx,node=xxx
@@ -376,7 +376,8 @@ public:
     std::string type_name() const;
     bool parse_type_name(const std::string& name);
     void get_write_params(int& id, std::string& key, std::string& value, int& timeout_ms) const;
-    void get_read_params(int& id, std::string& key, int& timeout_ms) const;
+    void get_read_params(int& id, std::string& key, int& timeout_ms, rpc_address& target,
+        int64_t& max_staleness_decrees, int& max_staleness_ms) const;
     void get_replica_config_params(rpc_address& receiver, dsn::replication::config_type& type, rpc_address& node) const;
     bool check_write_result(int id, ::dsn::error_code err, int32_t resp);
     bool check_read_result(int id, ::dsn::error_code err, const std::string& resp);
@@ -392,6 +393,9 @@ private:
     dsn::error_code _err;
     int _write_resp;
     std::string _read_resp;
+    rpc_address _read_target; // read from the node directly if valid
+    int64_t _read_max_staleness_decrees; // bounded-staleness read if either is not -1
+    int _read_max_staleness_ms;
 
     rpc_address _config_receiver;
     dsn::replication::config_type _config_type;
@@ -423,7 +427,8 @@ public:
     void notify_check_client();
     bool check_client_write(int& id, std::string& key, std::string& value, int& timeout_ms);
     bool check_replica_config(rpc_address& receiver, dsn::replication::config_type& type, rpc_address& node);
-    bool check_client_read(int& id, std::string& key, int& timeout_ms);
+    bool check_client_read(int& id, std::string& key, int& timeout_ms, rpc_address& target,
+        int64_t& max_staleness_decrees, int& max_staleness_ms);
     void on_end_write(int id, ::dsn::error_code err, int32_t resp);
     void on_end_read(int id, ::dsn::error_code err, const std::string& resp);
 
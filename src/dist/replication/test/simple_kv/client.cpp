@@ -87,6 +87,9 @@ void simple_kv_client_app::run()
     rpc_address receiver;
     dsn::replication::config_type type;
     rpc_address node;
+    rpc_address target;
+    int64_t max_staleness_decrees;
+    int max_staleness_ms;
 
     while (!g_done)
     {
@@ -100,9 +103,9 @@ void simple_kv_client_app::run()
             send_config_to_meta(receiver, type, node);
             continue;
         }
-        if (test_case::fast_instance().check_client_read(id, key, timeout_ms))
+        if (test_case::fast_instance().check_client_read(id, key, timeout_ms, target, max_staleness_decrees, max_staleness_ms))
         {
-            begin_read(id, key, timeout_ms);
+            begin_read(id, key, timeout_ms, target, max_staleness_decrees, max_staleness_ms);
             continue;
         }
         test_case::fast_instance().wait_check_client();
@@ -148,13 +151,69 @@ struct read_context
     int timeout_ms;
 };
 
-void simple_kv_client_app::begin_read(int id, const std::string& key, int timeout_ms)
+void simple_kv_client_app::begin_read(int id, const std::string& key, int timeout_ms, const rpc_address& target,
+    int64_t max_staleness_decrees, int max_staleness_ms)
 {
-    ddebug("=== on_begin_read:id=%d,key=%s,timeout=%d", id, key.c_str(), timeout_ms);
+    ddebug("=== on_begin_read:id=%d,key=%s,timeout=%d,target=%s,max_staleness_decrees=%" PRId64 ",max_staleness_ms=%d",
+        id, key.c_str(), timeout_ms, target.is_invalid() ? "" : address_to_node(target).c_str(),
+        max_staleness_decrees, max_staleness_ms);
     std::unique_ptr<read_context> ctx(new read_context());
     ctx->id = id;
     ctx->key = key;
     ctx->timeout_ms = timeout_ms;
+    bool bounded_staleness = (max_staleness_decrees != -1 || max_staleness_ms != -1);
+
+    if (!target.is_invalid())
+    {
+        // the read request as sent by the replication client, whose error is returned as is
+        read_request_header header;
+        header.gpid = g_default_gpid;
+        header.code = task_code(RPC_SIMPLE_KV_SIMPLE_KV_READ);
+        header.semantic = (bounded_staleness ? read_semantic::ReadBoundedStaleness : read_semantic::ReadLastUpdate);
+        header.version_decree = invalid_decree;
+        header.max_staleness_decrees = max_staleness_decrees;
+        header.max_staleness_ms = max_staleness_ms;
+
+        dsn_message_t msg = dsn_msg_create_request(RPC_REPLICATION_CLIENT_READ, timeout_ms, gpid_to_hash(g_default_gpid));
+        ::marshall(msg, header);
+        ::marshall(msg, key);
+        rpc::call(
+            target,
+            msg,
+            this,
+            [ctx_cap = std::move(ctx)](error_code err, dsn_message_t request, dsn_message_t response)
+            {
+                std::string resp;
+                if (err == ERR_OK)
+                {
+                    ::unmarshall(response, err);
+                    if (err == ERR_OK)
+                        ::unmarshall(response, resp);
+                }
+                test_case::fast_instance().on_end_read(ctx_cap->id, err, resp);
+            }
+            );
+        return;
+    }
+
+    if (bounded_staleness)
+    {
+        // retried on the primary by the replication client if the chosen replica is too stale
+        _simple_kv_client->read_bounded_staleness(
+            _simple_kv_client->get_key_hash(key),
+            RPC_SIMPLE_KV_SIMPLE_KV_READ,
+            key,
+            _simple_kv_client.get(),
+            [ctx_cap = std::move(ctx)](error_code err, std::string&& resp)
+            {
+                test_case::fast_instance().on_end_read(ctx_cap->id, err, resp);
+            },
+            max_staleness_decrees,
+            max_staleness_ms,
+            std::chrono::milliseconds(timeout_ms));
+        return;
+    }
+
     _simple_kv_client->read(
         key,
         [ctx_cap = std::move(ctx)](error_code err, std::string&& resp)
@@ -60,7 +60,10 @@ public:
 
     void run();
 
-    void begin_read(int id, const std::string& key, int timeout_ms);
+    // read through the replication client, or from 'target' directly (without retry) if valid;
+    // the read is bounded-staleness if either of the staleness bounds is not -1
+    void begin_read(int id, const std::string& key, int timeout_ms, const rpc_address& target,
+        int64_t max_staleness_decrees, int max_staleness_ms);
     void begin_write(int id,const std::string& key,const std::string& value, int timeout_ms);
     void send_config_to_meta(const rpc_address& receiver, dsn::replication::config_type type, const rpc_address& node);
 private:
@@ -47,6 +47,11 @@ namespace dsn {
                 : simple_kv_service(replica), _lock(true)
             {
                 _test_file_learning = dsn_config_get_value_bool("test", "test_file_learning", true, "");
+                if (dsn_config_get_value_bool("test", "read_thread_safe", true, ""))
+                {
+                    set_read_thread_safe();
+                }
+                set_write_dedup_supported();
                 if (dsn_config_get_value_bool("test", "delta_state_learning_supported", false, ""))
                 {
                     set_delta_state_learning_supported();
@@ -114,7 +119,9 @@ namespace dsn {
                 }
                 else
                 {
-                    recover();
+                    auto err = recover();
+                    if (err != ERR_OK)
+                        return err;
                 }
                 ddebug("simple_kv_service_impl opened, create_new = %s", create_new ? "true" : "false");
                 return ERR_OK;
@@ -142,7 +149,7 @@ namespace dsn {
             }
 
             // checkpoint related
-            void simple_kv_service_impl::recover()
+            ::dsn::error_code simple_kv_service_impl::recover()
             {
                 dsn::service::zauto_lock l(_lock);
 
@@ -174,21 +181,24 @@ namespace dsn {
 
                 if (max_version > 0)
                 {
-                    recover(name, max_version);
+                    auto err = recover(name, max_version);
+                    if (err != ERR_OK)
+                        return err;
                     dassert(max_version == last_committed_decree(), "");
                     _last_durable_decree = max_version;
                 }
                 ddebug("simple_kv_service_impl recovered, last_committed_decree = %" PRId64 ", last_durable_decree = %" PRId64 "",
                        last_committed_decree(), _last_durable_decree.load());
+                return ERR_OK;
             }
 
-            void simple_kv_service_impl::recover(const std::string& name, decree version)
+            ::dsn::error_code simple_kv_service_impl::recover(const std::string& name, decree version)
             {
                 dsn::service::zauto_lock l(_lock);
 
                 std::ifstream is(name.c_str(), std::ios::binary);
                 if (!is.is_open())
-                    return;
+                    return ERR_OK;
 
                 _store.clear();
 
@@ -218,8 +228,28 @@ namespace dsn {
                     _store[key] = value;
                 }
 
+                // the dedup table, which is absent in the checkpoints of the older versions
+                uint32_t table_size;
+                if (is.read((char*)&table_size, (uint32_t)sizeof(table_size)))
+                {
+                    std::shared_ptr<char> buffer(new char[table_size], [](char* ptr){ delete[] ptr; });
+                    is.read(buffer.get(), table_size);
+                    binary_reader reader(blob(buffer, 0, (int)table_size));
+                    auto err = dedup_table().read_from(reader);
+                    if (err != ERR_OK)
+                    {
+                        derror("simple_kv_service_impl recover from checkpoint %s failed, err = %s", name.c_str(), err.to_string());
+                        return err;
+                    }
+                }
+                else
+                {
+                    dedup_table().clear();
+                }
+
                 init_last_commit_decree(version);
                 ddebug("simple_kv_service_impl recover from checkpoint succeed, last_committed_decree = %" PRId64 "", last_committed_decree());
+                return ERR_OK;
             }
 
             ::dsn::error_code simple_kv_service_impl::checkpoint()
@@ -258,6 +288,13 @@ namespace dsn {
                     os.write((const char*)&v[0], sz);
                 }
 
+                binary_writer writer;
+                dedup_table().write_to(writer);
+                blob table = writer.get_buffer();
+                uint32_t table_size = (uint32_t)table.length();
+                os.write((const char*)&table_size, (uint32_t)sizeof(table_size));
+                os.write(table.data(), table_size);
+
                 _last_durable_decree = last_committed_decree();
                 ddebug("simple_kv_service_impl create checkpoint succeed, last_durable_decree = %" PRId64 "", _last_durable_decree.load());
                 return ERR_OK;
@@ -314,7 +351,9 @@ namespace dsn {
 
                 if (mode == CHKPT_LEARN)
                 {
-                    recover(state.files[0], state.to_decree_included);
+                    auto err = recover(state.files[0], state.to_decree_included);
+                    if (err != ERR_OK)
+                        return err;
                     ddebug("simple_kv_service_impl learn checkpoint succeed, last_committed_decree = %" PRId64 "", last_committed_decree());
                     return ERR_OK;
                 }
@@ -59,8 +59,8 @@ namespace dsn {
                 virtual ::dsn::error_code apply_checkpoint(learn_state& state, chkpt_apply_mode mode) override;
 
             private:
-                void recover();
-                void recover(const std::string& name, decree version);
+                ::dsn::error_code recover();
+                ::dsn::error_code recover(const std::string& name, decree version);
 
             private:
                 typedef std::map<std::string, std::string> simple_kv;
@@ -0,0 +1,218 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for the encoding of mutations in messages.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+# include "mutation.h"
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include <climits>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+static mutation_ptr create_test_mutation(const std::vector<std::string>& values, bool with_dedup_ids)
+{
+    mutation_ptr mu(new mutation());
+    mu->data.header.gpid.app_id = 1;
+    mu->data.header.gpid.pidx = 2;
+    mu->data.header.ballot = 3;
+    mu->data.header.decree = 4;
+    mu->data.header.last_committed_decree = 3;
+    mu->data.header.log_offset = 100;
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        mu->data.updates.push_back(mutation_update());
+        mu->data.updates.back().code = RPC_REPLICATION_CLIENT_WRITE;
+        mu->data.updates.back().data.assign(values[i].c_str(), 0, (int)values[i].length());
+        mu->client_requests.push_back(nullptr);
+        if (with_dedup_ids)
+        {
+            mu->dedup_ids.push_back(write_dedup_id(10, (int64_t)i + 1));
+        }
+    }
+    return mu;
+}
+
+static void check_mutation(mutation_ptr& expected, mutation_ptr& actual)
+{
+    ASSERT_TRUE(actual != nullptr);
+    ASSERT_EQ(expected->data.header.gpid.app_id, actual->data.header.gpid.app_id);
+    ASSERT_EQ(expected->data.header.gpid.pidx, actual->data.header.gpid.pidx);
+    ASSERT_EQ(expected->data.header.ballot, actual->data.header.ballot);
+    ASSERT_EQ(expected->data.header.decree, actual->data.header.decree);
+    ASSERT_EQ(expected->data.header.last_committed_decree, actual->data.header.last_committed_decree);
+    ASSERT_EQ(expected->data.header.log_offset, actual->data.header.log_offset);
+    ASSERT_EQ(expected->data.updates.size(), actual->data.updates.size());
+    ASSERT_EQ(expected->data.updates.size(), actual->client_requests.size());
+    for (size_t i = 0; i < expected->data.updates.size(); i++)
+    {
+        ASSERT_EQ(expected->data.updates[i].code, actual->data.updates[i].code);
+        ASSERT_EQ(
+            std::string(expected->data.updates[i].data.data(), expected->data.updates[i].data.length()),
+            std::string(actual->data.updates[i].data.data(), actual->data.updates[i].data.length())
+            );
+    }
+    ASSERT_EQ(expected->dedup_ids.size(), actual->dedup_ids.size());
+    for (size_t i = 0; i < expected->dedup_ids.size(); i++)
+    {
+        ASSERT_EQ(expected->dedup_ids[i].client_id, actual->dedup_ids[i].client_id);
+        ASSERT_EQ(expected->dedup_ids[i].request_seq, actual->dedup_ids[i].request_seq);
+    }
+}
+
+TEST(replication, mutation_message_encoding)
+{
+    std::vector<std::string> values = { "hello", "", std::string(1000, 'x') };
+    for (int with_dedup_ids = 0; with_dedup_ids < 2; with_dedup_ids++)
+    {
+        mutation_ptr mu = create_test_mutation(values, with_dedup_ids != 0);
+
+        binary_writer writer;
+        mu->write_to(writer);
+        mu->write_to(writer);
+
+        // two mutations in a row, as in the learned mutation cache
+        binary_reader reader(writer.get_buffer());
+        mutation_ptr rmu = mutation::read_from(reader, nullptr);
+        check_mutation(mu, rmu);
+        rmu = mutation::read_from(reader, nullptr);
+        check_mutation(mu, rmu);
+        ASSERT_TRUE(reader.is_eof());
+    }
+}
+
+TEST(replication, mutation_message_old_encoding)
+{
+    std::vector<std::string> values = { "hello", std::string(1000, 'x') };
+    mutation_ptr mu = create_test_mutation(values, false);
+
+    // the marshalled mutation_data sent by the replicas of the previous version
+    binary_writer writer;
+    marshall(writer, mu->data);
+    marshall(writer, mu->data);
+
+    binary_reader reader(writer.get_buffer());
+    mutation_ptr rmu = mutation::read_from(reader, nullptr);
+    check_mutation(mu, rmu);
+    rmu = mutation::read_from(reader, nullptr);
+    check_mutation(mu, rmu);
+    ASSERT_TRUE(reader.is_eof());
+
+    // an invalid update count
+    binary_writer bad_writer;
+    marshall(bad_writer, mu->data.header);
+    marshall(bad_writer, INT_MAX);
+    binary_reader bad_reader(bad_writer.get_buffer());
+    ASSERT_TRUE(mutation::read_from(bad_reader, nullptr) == nullptr);
+}
+
+TEST(replication, mutation_message_invalid_counts)
+{
+    std::vector<std::string> values = { "hello", "world" };
+    mutation_ptr mu = create_test_mutation(values, true);
+
+    // the update count, the dedup-encoded update count, and the update length are
+    // replaced with the invalid ones, which are detected before any allocation
+    binary_writer header_writer;
+    marshall(header_writer, mu->data.header);
+    int header_size = header_writer.total_size();
+    int marker_size = sizeof(int32_t);
+
+    binary_writer writer;
+    mu->write_to(writer);
+    blob bb = writer.get_buffer();
+    std::string good(bb.data(), bb.length());
+
+    int bad_counts[] = { INT_MAX, INT_MIN, -INT_MAX, 3, -3 };
+    for (int count : bad_counts)
+    {
+        std::string bad = good;
+        memcpy(&bad[marker_size + header_size], &count, sizeof(count));
+        blob bad_bb(bad.c_str(), 0, (int)bad.length());
+        binary_reader reader(bad_bb);
+        ASSERT_TRUE(mutation::read_from(reader, nullptr) == nullptr) << "count = " << count;
+    }
+
+    // the length of the first update, after the update count and the update code
+    binary_writer code_writer;
+    marshall(code_writer, mu->data.updates[0].code);
+    int length_offset = marker_size + header_size + (int)sizeof(int) + code_writer.total_size();
+    int bad_lengths[] = { -1, INT_MAX, 100 };
+    for (int length : bad_lengths)
+    {
+        std::string bad = good;
+        memcpy(&bad[length_offset], &length, sizeof(length));
+        blob bad_bb(bad.c_str(), 0, (int)bad.length());
+        binary_reader reader(bad_bb);
+        ASSERT_TRUE(mutation::read_from(reader, nullptr) == nullptr) << "length = " << length;
+    }
+}
+
+TEST(replication, mutation_message_zero_copy)
+{
+    std::vector<std::string> values = { "hello", std::string(4096, 'x'), "world" };
+    mutation_ptr mu = create_test_mutation(values, false);
+
+    // the large update is of a client request, which owns the data
+    dsn_message_t request = dsn_msg_create_request(RPC_REPLICATION_CLIENT_WRITE, 0, 0);
+    dsn_msg_add_ref(request); // released by the mutation
+    mu->client_requests[1] = request;
+
+    dsn_message_t msg = dsn_msg_create_request(RPC_PREPARE, 0, 0);
+    dsn_msg_add_ref(msg);
+    mu->write_to(msg);
+
+    binary_writer writer;
+    mu->write_to(writer);
+    ASSERT_EQ((size_t)writer.total_size(), dsn_msg_body_size(msg));
+
+    // the body is the same as the copied one, and the large update is not copied
+    std::string body;
+    bool appended = false;
+    for (auto& bb : ((message_ex*)msg)->buffers)
+    {
+        if (bb.data() == mu->data.updates[1].data.data())
+        {
+            appended = true;
+        }
+        body.append(bb.data(), bb.length());
+    }
+    ASSERT_TRUE(appended);
+    // the header of the message is in the first buffer
+    body = body.substr(sizeof(message_header));
+    blob bb = writer.get_buffer();
+    ASSERT_EQ(std::string(bb.data(), bb.length()), body);
+
+    dsn_msg_release_ref(msg);
+}
@@ -33,8 +33,10 @@
  *     xxxx-xx-xx, author, fix bug about xxx
  */
 # include "mutation_log.h"
+# include "block_compression.h"
 # include <gtest/gtest.h>
 # include <cstdio>
+# include <set>
 
 using namespace ::dsn;
 using namespace ::dsn::replication;
@@ -122,7 +124,7 @@ TEST(replication, log_file)
         writer->add(temp_writer.get_buffer());
 
         task_ptr task = lf->commit_log_block(
-            *writer, offset, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, nullptr, 0
+            *writer, offset, false, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, nullptr, 0
             );
         task->wait();
         ASSERT_EQ(ERR_OK, task->error());
@@ -373,3 +375,535 @@ TEST(replication, mutation_log)
     // clear all
     utils::filesystem::remove_path(logp);
 }
+
+TEST(replication, mutation_decode_zero_copy)
+{
+    std::string value(1024, 'x');
+    mutation_ptr mu(new mutation());
+    mu->data.header.ballot = 1;
+    mu->data.header.decree = 2;
+    mu->data.header.gpid = { 1, 0 };
+    mu->data.header.last_committed_decree = 1;
+    mu->data.header.log_offset = 0;
+    mu->data.updates.push_back(mutation_update());
+    mu->data.updates.back().code = RPC_REPLICATION_CLIENT_WRITE;
+    mu->data.updates.back().data = blob(value.c_str(), 0, (int)value.length());
+    mu->client_requests.push_back(nullptr);
+
+    binary_writer writer;
+    mu->write_to_log_file([&writer](blob bb) { writer.write(bb.data(), bb.length()); });
+    blob block = writer.get_buffer();
+    ASSERT_TRUE(block.has_holder());
+
+    // the updates share the block buffer
+    {
+        binary_reader reader(block);
+        mutation_ptr rmu = mutation::read_from_log_file(reader, nullptr);
+        ASSERT_TRUE(reader.is_eof());
+        ASSERT_EQ(1u, rmu->data.updates.size());
+        ASSERT_EQ(block.buffer_ptr(), rmu->data.updates[0].data.buffer_ptr());
+        ASSERT_EQ(1024, rmu->data.updates[0].data.length());
+        ASSERT_EQ(0, memcmp(rmu->data.updates[0].data.data(), value.c_str(), 1024));
+
+        // encoded once, so the decoded mutation is written again with the same buffers
+        std::vector<blob> blobs;
+        rmu->write_to_log_file([&blobs](blob bb) { blobs.push_back(bb); });
+        ASSERT_EQ(3u, blobs.size());
+        ASSERT_EQ(block.buffer_ptr(), blobs[1].buffer_ptr());
+        ASSERT_EQ(block.buffer_ptr(), blobs[2].buffer_ptr());
+
+        // prepare messages use the same encoding after the format marker
+        binary_writer msg_writer;
+        rmu->write_to(msg_writer);
+        blob msg = msg_writer.get_buffer();
+        ASSERT_EQ(block.length() + (int)sizeof(int32_t), msg.length());
+        ASSERT_EQ(0, memcmp(block.data(), msg.data() + sizeof(int32_t), block.length()));
+    }
+
+    // the mutation is copied out at once when it is a small part of the pinned buffer
+    {
+        binary_reader reader(block);
+        mutation_ptr rmu = mutation::read_from_log_file(reader, nullptr, block.length() * 100);
+        ASSERT_TRUE(reader.is_eof());
+        ASSERT_NE(block.buffer_ptr(), rmu->data.updates[0].data.buffer_ptr());
+        ASSERT_EQ(0, memcmp(rmu->data.updates[0].data.data(), value.c_str(), 1024));
+
+        // the encoding and the updates share the copy
+        std::vector<blob> blobs;
+        rmu->write_to_log_file([&blobs](blob bb) { blobs.push_back(bb); });
+        ASSERT_EQ(3u, blobs.size());
+        ASSERT_EQ(rmu->data.updates[0].data.buffer_ptr(), blobs[1].buffer_ptr());
+        ASSERT_EQ(block.length(), blobs[0].length() + blobs[1].length() + blobs[2].length());
+        ASSERT_EQ(0, memcmp(block.data() + blobs[0].length(), blobs[1].data(), blobs[1].length()));
+    }
+
+    // the updates are copied when the buffer is not owned
+    {
+        binary_reader reader(blob(block.data(), 0, block.length()));
+        mutation_ptr rmu = mutation::read_from_log_file(reader, nullptr);
+        ASSERT_TRUE(reader.is_eof());
+        ASSERT_TRUE(rmu->data.updates[0].data.has_holder());
+        ASSERT_NE(block.buffer_ptr(), rmu->data.updates[0].data.buffer_ptr());
+        ASSERT_EQ(0, memcmp(rmu->data.updates[0].data.data(), value.c_str(), 1024));
+    }
+}
+
+// returns the size of the log files
+static int64_t mutation_log_learn_range_test(bool compress)
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string str = "hello, world!";
+    std::string logp = "./test-log-learn";
+    const int mutation_count = 2000;
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    mutation_log_ptr mlog = new mutation_log(logp, 1, 1, true, true, gpid);
+    mlog->set_block_compression(compress);
+    EXPECT_EQ(ERR_OK, mlog->open(nullptr));
+
+    for (int i = 0; i < mutation_count; i++)
+    {
+        mutation_ptr mu(new mutation());
+        mu->data.header.ballot = 1;
+        mu->data.header.decree = 1 + i;
+        mu->data.header.gpid = gpid;
+        mu->data.header.last_committed_decree = i;
+        mu->data.header.log_offset = 0;
+
+        binary_writer writer;
+        for (int j = 0; j < 100; j++)
+        {
+            writer.write(str);
+        }
+        mu->data.updates.push_back(mutation_update());
+        mu->data.updates.back().code = RPC_REPLICATION_CLIENT_WRITE;
+        mu->data.updates.back().data = writer.get_buffer();
+        mu->client_requests.push_back(nullptr);
+
+        mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, nullptr, 0);
+    }
+
+    // the learned data must contain all decrees from 'start' in order
+    auto check_learn_state = [&](std::string name, decree start, int64_t max_inline_bytes, bool inlined)
+    {
+        if (compress)
+        {
+            name += ", compressed";
+        }
+
+        learn_state state;
+        mlog->get_learn_state(gpid, start, state, max_inline_bytes);
+        ASSERT_EQ(inlined, state.files.empty());
+
+        int64_t file_bytes = 0;
+        for (auto& file : state.files)
+        {
+            int64_t sz;
+            ASSERT_TRUE(utils::filesystem::file_size(file, sz));
+            file_bytes += sz;
+        }
+        ASSERT_EQ(1u, state.meta.size());
+
+        if (state.files.empty())
+        {
+            decree next = start;
+            binary_reader reader(state.meta[0]);
+            while (!reader.is_eof())
+            {
+                mutation_ptr mu = mutation::read_from_log_file(reader, nullptr);
+                if (mu->data.header.decree >= start)
+                {
+                    ASSERT_EQ(next, mu->data.header.decree);
+                    next++;
+                }
+            }
+            ASSERT_EQ(mutation_count + 1, next);
+        }
+
+        std::cout << "learn private log (" << name << "): gap = " << mutation_count - start + 1
+            << ", files = " << state.files.size()
+            << ", bytes = " << file_bytes + state.meta[0].length()
+            << std::endl;
+    };
+
+    for (decree gap : { 1, 10, 100, 1000 })
+    {
+        check_learn_state("log files", mutation_count - gap + 1, 0, false);
+
+        // the data since the gap is over 1MB when gap = 1000
+        check_learn_state("indexed range", mutation_count - gap + 1, 1024 * 1024, gap < 1000);
+    }
+    mlog->close();
+
+    // after reopen, the log files are indexed by their headers
+    decree last_decree = 0;
+    mlog = new mutation_log(logp, 1, 1, true, true, gpid);
+    mlog->set_block_compression(compress);
+    EXPECT_EQ(ERR_OK, mlog->open(
+        [&last_decree](mutation_ptr& mu)
+        {
+            EXPECT_EQ(last_decree + 1, mu->data.header.decree);
+            last_decree = mu->data.header.decree;
+            return true;
+        }
+        ));
+    EXPECT_EQ(mutation_count, last_decree);
+    check_learn_state("indexed range after reopen", mutation_count - 99, 1024 * 1024, true);
+    mlog->close();
+
+    std::vector<std::string> files;
+    int64_t total_size = 0;
+    EXPECT_TRUE(utils::filesystem::get_subfiles(logp, files, false));
+    for (auto& file : files)
+    {
+        int64_t sz;
+        EXPECT_TRUE(utils::filesystem::file_size(file, sz));
+        total_size += sz;
+    }
+
+    utils::filesystem::remove_path(logp);
+    return total_size;
+}
+
+TEST(replication, mutation_log_learn_range)
+{
+    int64_t size = mutation_log_learn_range_test(false);
+
+    // the offsets of compressed logs are still of the uncompressed data
+    int64_t compressed_size = mutation_log_learn_range_test(true);
+    ASSERT_LT(compressed_size * 3, size);
+}
+
+TEST(replication, mutation_log_compressed_reopen)
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string str = "hello, world!";
+    std::string logp = "./test-log-compressed";
+    const int mutation_count = 2000;
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    mutation_log_ptr mlog = new mutation_log(logp, 1, 1, true, true, gpid);
+    mlog->set_block_compression(true);
+    ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+    for (int i = 0; i < mutation_count; i++)
+    {
+        mutation_ptr mu(new mutation());
+        mu->data.header.ballot = 1;
+        mu->data.header.decree = 1 + i;
+        mu->data.header.gpid = gpid;
+        mu->data.header.last_committed_decree = i;
+        mu->data.header.log_offset = 0;
+
+        binary_writer writer;
+        for (int j = 0; j < 100; j++)
+        {
+            writer.write(str);
+        }
+        mu->data.updates.push_back(mutation_update());
+        mu->data.updates.back().code = RPC_REPLICATION_CLIENT_WRITE;
+        mu->data.updates.back().data = writer.get_buffer();
+        mu->client_requests.push_back(nullptr);
+
+        mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, nullptr, 0);
+    }
+    mlog->close();
+
+    // the end offsets of the existing files are of the uncompressed data before they are read
+    std::vector<std::string> files;
+    ASSERT_TRUE(utils::filesystem::get_subfiles(logp, files, false));
+    std::map<int, log_file_ptr> logs;
+    for (auto& file : files)
+    {
+        error_code err;
+        log_file_ptr log = log_file::open_read(file.c_str(), err);
+        ASSERT_EQ(ERR_OK, err);
+        logs[log->index()] = log;
+    }
+    ASSERT_LT(2u, logs.size());
+    log_file_ptr first = logs.begin()->second;
+    ASSERT_GT(first->end_offset(), first->start_offset() + first->file_size());
+    for (auto it = logs.begin(); it != logs.end(); ++it)
+    {
+        auto next = it;
+        if (++next != logs.end())
+        {
+            ASSERT_EQ(next->second->start_offset(), it->second->end_offset());
+        }
+        it->second->close();
+    }
+    int64_t end_offset = logs.rbegin()->second->end_offset();
+
+    // reopen without compression, and learn from the compressed files
+    mlog = new mutation_log(logp, 1, 1, true, true, gpid);
+    ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+
+    learn_state state;
+    mlog->get_learn_state(gpid, mutation_count - 99, state, 1024 * 1024);
+    ASSERT_TRUE(state.files.empty());
+    ASSERT_EQ(1u, state.meta.size());
+    decree next = mutation_count - 99;
+    binary_reader reader(state.meta[0]);
+    while (!reader.is_eof())
+    {
+        mutation_ptr mu = mutation::read_from_log_file(reader, nullptr);
+        if (mu->data.header.decree >= next)
+        {
+            ASSERT_EQ(next, mu->data.header.decree);
+            next++;
+        }
+    }
+    ASSERT_EQ(mutation_count + 1, next);
+
+    // the compressed files before the valid start offset are garbage
+    ASSERT_LT(0, mlog->garbage_collection(gpid, 0, end_offset));
+    mlog->close();
+
+    utils::filesystem::remove_path(logp);
+}
+
+TEST(replication, log_block_compression)
+{
+    auto check = [](const std::string& data)
+    {
+        std::vector<char> compressed(block_compress_bound((int)data.size()));
+        int size = block_compress(data.data(), (int)data.size(), compressed.data());
+        ASSERT_LE(size, (int)compressed.size());
+
+        std::vector<char> decompressed(data.size() + 1);
+        ASSERT_EQ((int)data.size(), block_decompress(compressed.data(), size, decompressed.data(), (int)data.size()));
+        ASSERT_EQ(data, std::string(decompressed.data(), data.size()));
+
+        // the buffer is too small
+        if (data.size() > 0)
+        {
+            ASSERT_EQ(-1, block_decompress(compressed.data(), size, decompressed.data(), (int)data.size() - 1));
+        }
+    };
+
+    check("");
+    check("hello");
+    check(std::string(100000, 'x'));
+
+    std::string text, random;
+    for (int i = 0; i < 10000; i++)
+    {
+        text += "key" + std::to_string(i % 100) + "=value" + std::to_string(i) + ";";
+        random.push_back((char)dsn_random32(0, 255));
+    }
+    check(text);
+    check(random);
+
+    // invalid data is rejected, e.g., the match offset is beyond the decompressed data
+    char invalid[] = { 0x10, 'a', 0x10, 0x00 };
+    char out[64];
+    ASSERT_EQ(-1, block_decompress(invalid, sizeof(invalid), out, sizeof(out)));
+}
+
+// replays the log files in 'logp', returns the replay error and the count of the mutations replayed
+static error_code replay_log_dir(const std::string& logp, /*out*/ int& count)
+{
+    std::vector<std::string> files;
+    utils::filesystem::get_subfiles(logp, files, false);
+    std::vector<std::string> log_files;
+    for (auto& f : files)
+    {
+        if (f.find("log.spare.") == std::string::npos)
+            log_files.push_back(f);
+    }
+
+    count = 0;
+    int64_t end_offset;
+    return mutation_log::replay(log_files, [&count](mutation_ptr&) { count++; return true; }, end_offset);
+}
+
+TEST(replication, mutation_log_preallocated_tail)
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string logp = "./test-log-preallocated";
+    const int mutation_count = 1000;
+    std::string value(4096, 'v');
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // 1MB files, so most of the files are rotated to preallocated spare files
+    mutation_log_ptr mlog = new mutation_log(logp, 0, 1, true);
+    mlog->set_preallocation(true, 0);
+    mlog->set_valid_start_offset_on_open(gpid, 0);
+    ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+    for (int i = 0; i < mutation_count; i++)
+    {
+        mutation_ptr mu(new mutation());
+        mu->data.header.ballot = 1;
+        mu->data.header.decree = i + 1;
+        mu->data.header.gpid = gpid;
+        mu->data.header.last_committed_decree = i;
+        mu->data.header.log_offset = 0;
+        mu->data.updates.push_back(mutation_update());
+        mu->data.updates.back().code = RPC_REPLICATION_CLIENT_WRITE;
+        mu->data.updates.back().data.assign(value.c_str(), 0, (int)value.length());
+        mu->client_requests.push_back(nullptr);
+
+        auto t = mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, [](error_code, size_t) {}, 0);
+        ASSERT_NE(nullptr, t);
+        t->wait();
+    }
+    mlog->close();
+
+    // the zero filled tail of the preallocated files is the end of the files
+    int count;
+    ASSERT_EQ(ERR_OK, replay_log_dir(logp, count));
+    ASSERT_EQ(mutation_count, count);
+
+    // the last file, which is preallocated with several blocks and unused space, is checked,
+    // as the blocks dropped from the other files would break the offsets of the next files
+    std::vector<std::string> files;
+    utils::filesystem::get_subfiles(logp, files, false);
+    std::string fpath;
+    int last_index = 0;
+    for (auto& f : files)
+    {
+        if (f.find("log.spare.") != std::string::npos)
+            continue;
+
+        error_code err;
+        log_file_ptr lf = log_file::open_read(f.c_str(), err);
+        ASSERT_TRUE(lf != nullptr);
+        if (lf->index() > last_index)
+        {
+            last_index = lf->index();
+            fpath = f;
+        }
+        lf->close();
+    }
+    ASSERT_FALSE(fpath.empty());
+
+    std::vector<int64_t> block_offsets;
+    int64_t fsize = 0;
+    {
+        error_code err;
+        log_file_ptr lf = log_file::open_read(fpath.c_str(), err);
+        ASSERT_TRUE(lf != nullptr);
+        lf->reset_stream();
+        std::vector<int64_t> offsets;
+        int64_t offset = 0;
+        blob bb;
+        while (lf->read_next_log_block(bb) == ERR_OK)
+        {
+            if (offsets.empty())
+            {
+                binary_reader reader(bb);
+                lf->read_file_header(reader);
+            }
+            offsets.push_back(offset);
+            offset += sizeof(log_block_header) + bb.length();
+        }
+        offsets.push_back(offset);
+        lf->close();
+
+        ASSERT_TRUE(utils::filesystem::file_size(fpath, fsize));
+        ASSERT_EQ(log_file_header::version_preallocated, lf->header().version);
+        ASSERT_LT(4u, offsets.size());
+        ASSERT_LT(offset + 1024, fsize);
+        block_offsets = offsets;
+    }
+
+    // non-zero data in the unused space is corruption rather than the end of the file
+    char garbage[16];
+    memset(garbage, 0x5a, sizeof(garbage));
+    overwrite_file(fpath.c_str(), (int)(fsize - sizeof(garbage)), garbage, sizeof(garbage));
+    ASSERT_NE(ERR_OK, replay_log_dir(logp, count));
+
+    char zeros[16];
+    memset(zeros, 0, sizeof(zeros));
+    overwrite_file(fpath.c_str(), (int)(fsize - sizeof(zeros)), zeros, sizeof(zeros));
+    ASSERT_EQ(ERR_OK, replay_log_dir(logp, count));
+    ASSERT_EQ(mutation_count, count);
+
+    // a torn last block followed by the zero filled space is the end of the file
+    int64_t last_block = block_offsets[block_offsets.size() - 2];
+    overwrite_file(fpath.c_str(), (int)(last_block + sizeof(log_block_header) + 8), garbage, sizeof(garbage));
+    ASSERT_EQ(ERR_OK, replay_log_dir(logp, count));
+
+    // a corrupted block followed by valid blocks is not
+    overwrite_file(fpath.c_str(), (int)(block_offsets[1] + sizeof(log_block_header) + 8), garbage, sizeof(garbage));
+    ASSERT_EQ(ERR_INVALID_DATA, replay_log_dir(logp, count));
+
+    utils::filesystem::remove_path(logp);
+}
+
+TEST(replication, mutation_log_replay_retained_memory)
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string logp = "./test-log-retained";
+    const int mutation_count = 200;
+    std::string small_value(100, 's');
+    std::string large_value(128 * 1024, 'l');
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // every 10th mutation is large
+    mutation_log_ptr mlog = new mutation_log(logp, 0, 1, true);
+    mlog->set_valid_start_offset_on_open(gpid, 0);
+    ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+    for (int i = 0; i < mutation_count; i++)
+    {
+        const std::string& value = (i % 10 == 0 ? large_value : small_value);
+        mutation_ptr mu(new mutation());
+        mu->data.header.ballot = 1;
+        mu->data.header.decree = i + 1;
+        mu->data.header.gpid = gpid;
+        mu->data.header.last_committed_decree = i;
+        mu->data.header.log_offset = 0;
+        mu->data.updates.push_back(mutation_update());
+        mu->data.updates.back().code = RPC_REPLICATION_CLIENT_WRITE;
+        mu->data.updates.back().data.assign(value.c_str(), 0, (int)value.length());
+        mu->client_requests.push_back(nullptr);
+
+        auto t = mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, [](error_code, size_t) {}, 0);
+        ASSERT_NE(nullptr, t);
+        t->wait();
+    }
+    mlog->close();
+
+    std::vector<std::string> files;
+    utils::filesystem::get_subfiles(logp, files, false);
+    std::vector<std::string> log_files;
+    for (auto& f : files)
+    {
+        if (f.find("log.spare.") == std::string::npos)
+            log_files.push_back(f);
+    }
+
+    std::vector<mutation_ptr> mutations;
+    int64_t end_offset;
+    ASSERT_EQ(ERR_OK, mutation_log::replay(log_files,
+        [&mutations](mutation_ptr& mu) { mutations.push_back(mu); return true; }, end_offset));
+    ASSERT_EQ(mutation_count, (int)mutations.size());
+
+    // the small mutations are copied out of the read buffers (or the file mappings), so each
+    // of them only pins its own copy, while the large ones share the read buffers
+    std::set<const char*> small_buffers;
+    for (auto& mu : mutations)
+    {
+        ASSERT_EQ(1u, mu->data.updates.size());
+        const blob& data = mu->data.updates[0].data;
+        bool is_large = (mu->data.header.decree % 10 == 1);
+        const std::string& value = (is_large ? large_value : small_value);
+        ASSERT_EQ((int)value.length(), data.length());
+        ASSERT_EQ(0, memcmp(data.data(), value.c_str(), value.length()));
+        if (!is_large)
+        {
+            ASSERT_TRUE(small_buffers.insert(data.buffer_ptr()).second);
+            ASSERT_LT(data.data() - data.buffer_ptr(), 1024);
+        }
+    }
+
+    mutations.clear();
+    utils::filesystem::remove_path(logp);
+}
@@ -0,0 +1,484 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Shared log append latency across log file rotations, with new files,
+ *     preallocated files and recycled files, and replay of the logs written
+ *     into preallocated and recycled files; and the commits/sec and latency
+ *     of flushed appends at different concurrencies, with and without group
+ *     commit; and the write throughput of partitions sharded over several
+ *     shared logs; and the serialization cpu time per write of a partition
+ *     with 3 replicas, encoded once vs. re-encoded for each prepare and log;
+ *     and the write and replay throughput and the compression ratio of
+ *     compressed log blocks.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+# include "mutation_log.h"
+# include <gtest/gtest.h>
+# include <chrono>
+# include <algorithm>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+static mutation_ptr create_test_mutation(global_partition_id gpid, decree d, const std::string& value)
+{
+    mutation_ptr mu(new mutation());
+    mu->data.header.ballot = 1;
+    mu->data.header.decree = d;
+    mu->data.header.gpid = gpid;
+    mu->data.header.last_committed_decree = d - 1;
+    mu->data.header.log_offset = 0;
+
+    binary_writer writer;
+    writer.write(value);
+    mu->data.updates.push_back(mutation_update());
+    mu->data.updates.back().code = RPC_REPLICATION_CLIENT_WRITE;
+    mu->data.updates.back().data = writer.get_buffer();
+    mu->client_requests.push_back(nullptr);
+    return mu;
+}
+
+static void mutation_log_append_perf_test(const char* name, bool preallocate, int recycle_file_count)
+{
+    std::chrono::steady_clock clock;
+    global_partition_id gpid = { 1, 0 };
+    std::string logp = "./test-log-append";
+    const int mutation_count = 4000;
+    const int mutations_per_gc = 256;
+    std::string value(4096, 'v');
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // 1MB log files, so the files are rotated every ~256 mutations
+    mutation_log_ptr mlog = new mutation_log(logp, 0, 1, true);
+    mlog->set_preallocation(preallocate, recycle_file_count);
+    mlog->set_valid_start_offset_on_open(gpid, 0);
+    ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+
+    std::vector<int64_t> latencies;
+    for (int i = 0; i < mutation_count; i++)
+    {
+        mutation_ptr mu = create_test_mutation(gpid, i + 1, value);
+
+        auto tic = clock.now();
+        auto t = mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, [](error_code, size_t) {}, 0);
+        ASSERT_NE(nullptr, t);
+        t->wait();
+        latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(clock.now() - tic).count());
+
+        // all are durable, so the old files are garbage collected (or recycled)
+        if ((i + 1) % mutations_per_gc == 0)
+        {
+            replica_log_info_map gc_condition;
+            gc_condition[gpid] = replica_log_info(i, 0);
+            mlog->garbage_collection(gc_condition);
+        }
+    }
+    mlog->close();
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "log append perf test: " << name
+        << ", p50(us) = " << latencies[latencies.size() / 2]
+        << ", p99(us) = " << latencies[latencies.size() * 99 / 100]
+        << ", max(us) = " << latencies.back()
+        << std::endl;
+
+    // the garbage tail of preallocated and recycled files is not replayed
+    decree last_decree = 0;
+    mlog = new mutation_log(logp, 0, 1, true);
+    mlog->set_preallocation(preallocate, recycle_file_count);
+    mlog->set_valid_start_offset_on_open(gpid, 0);
+    ASSERT_EQ(ERR_OK, mlog->open(
+        [&last_decree](mutation_ptr& mu)->bool
+        {
+            EXPECT_TRUE(last_decree == 0 || mu->data.header.decree == last_decree + 1);
+            last_decree = mu->data.header.decree;
+            return true;
+        }
+        ));
+    ASSERT_EQ(mutation_count, last_decree);
+    mlog->close();
+
+    utils::filesystem::remove_path(logp);
+}
+
+TEST(replication, mutation_log_append_perf)
+{
+    mutation_log_append_perf_test("new files", false, 0);
+    mutation_log_append_perf_test("preallocated files", true, 0);
+    mutation_log_append_perf_test("preallocated and recycled files", true, 4);
+}
+
+static void mutation_log_group_commit_perf_test(
+    const char* name,
+    int concurrency,
+    int max_wait_us,
+    int max_writes_in_flight
+    )
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string logp = "./test-log-group-commit";
+    const int mutation_count = 4000;
+    std::string value(256, 'v');
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    mutation_log_ptr mlog = new mutation_log(logp, 0, 32, true);
+    mlog->set_group_commit(max_wait_us, 256, max_writes_in_flight);
+    mlog->set_valid_start_offset_on_open(gpid, 0);
+    ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+
+    // 'concurrency' clients, each appends the next mutation once its last one is done,
+    // and the completion time is recorded by the callback
+    std::vector<uint64_t> issue_us(mutation_count), done_us(mutation_count);
+    std::vector<task_ptr> tasks(mutation_count);
+    int next = 0;
+    auto append_next = [&]()
+    {
+        int i = next++;
+        mutation_ptr mu = create_test_mutation(gpid, i + 1, value);
+
+        issue_us[i] = dsn_now_us();
+        tasks[i] = mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr,
+            [&done_us, i](error_code err, size_t)
+            {
+                EXPECT_EQ(ERR_OK, err);
+                done_us[i] = dsn_now_us();
+            },
+            0);
+    };
+
+    uint64_t start_us = dsn_now_us();
+    while (next < concurrency)
+    {
+        append_next();
+    }
+    for (int i = 0; i < mutation_count; i++)
+    {
+        // the writes are completed in order
+        tasks[i]->wait();
+        if (next < mutation_count)
+        {
+            append_next();
+        }
+    }
+    uint64_t elapsed_us = dsn_now_us() - start_us;
+    mlog->close();
+
+    std::vector<uint64_t> latencies;
+    for (int i = 0; i < mutation_count; i++)
+    {
+        latencies.push_back(done_us[i] - issue_us[i]);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "log group commit perf test: " << name
+        << ", concurrency = " << concurrency
+        << ", commits/sec = " << (elapsed_us > 0 ? (uint64_t)mutation_count * 1000000 / elapsed_us : 0)
+        << ", p50(us) = " << latencies[latencies.size() / 2]
+        << ", p99(us) = " << latencies[latencies.size() * 99 / 100]
+        << std::endl;
+
+    utils::filesystem::remove_path(logp);
+}
+
+TEST(replication, mutation_log_group_commit_perf)
+{
+    for (int concurrency : { 1, 4, 16, 64 })
+    {
+        mutation_log_group_commit_perf_test("write as soon as possible", concurrency, 0, 1);
+        mutation_log_group_commit_perf_test("group commit", concurrency, 1000, 1);
+        mutation_log_group_commit_perf_test("group commit, 4 writes in flight", concurrency, 1000, 4);
+    }
+}
+
+static void mutation_log_sharded_write_perf_test(int log_count)
+{
+    std::string logp = "./test-log-shards";
+    const int partition_count = 16;
+    const int concurrency = 64;
+    const int mutation_count = 16000;
+    std::string value(4096, 'v');
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // as replica_stub, the partitions are assigned to the shared logs by gpid hash
+    std::vector<mutation_log_ptr> logs;
+    for (int i = 0; i < log_count; i++)
+    {
+        std::string dir = utils::filesystem::path_combine(logp,
+            "slog." + std::to_string(i) + "." + std::to_string(log_count));
+        mutation_log_ptr mlog = new mutation_log(dir, 0, 32, true);
+        for (int p = 0; p < partition_count; p++)
+        {
+            mlog->set_valid_start_offset_on_open(global_partition_id{ 1, p }, 0);
+        }
+        ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+        logs.push_back(mlog);
+    }
+
+    std::vector<task_ptr> tasks(mutation_count);
+    int next = 0;
+    auto append_next = [&]()
+    {
+        int i = next++;
+        global_partition_id gpid = { 1, i % partition_count };
+        mutation_ptr mu = create_test_mutation(gpid, i / partition_count + 1, value);
+        auto& mlog = logs[static_cast<unsigned int>(gpid_to_hash(gpid)) % logs.size()];
+        tasks[i] = mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr,
+            [](error_code err, size_t) { EXPECT_EQ(ERR_OK, err); }, 0);
+    };
+
+    uint64_t start_us = dsn_now_us();
+    while (next < concurrency)
+    {
+        append_next();
+    }
+    for (int i = 0; i < mutation_count; i++)
+    {
+        tasks[i]->wait();
+        if (next < mutation_count)
+        {
+            append_next();
+        }
+    }
+    uint64_t elapsed_us = dsn_now_us() - start_us;
+    for (auto& mlog : logs)
+    {
+        mlog->close();
+    }
+
+    std::cout << "log sharded write perf test: logs = " << log_count
+        << ", mutations = " << mutation_count
+        << ", throughput(MB/s) = "
+        << (elapsed_us > 0 ? (uint64_t)mutation_count * value.size() / elapsed_us : 0)
+        << std::endl;
+
+    utils::filesystem::remove_path(logp);
+}
+
+TEST(replication, mutation_log_sharded_write_perf)
+{
+    for (int log_count : { 1, 2, 4 })
+    {
+        mutation_log_sharded_write_perf_test(log_count);
+    }
+}
+
+// the previous encoding, where the mutation is marshalled for each prepare message,
+// and the updates are encoded again for each log
+static void reencode_to_log_file(const mutation_data& data, std::function<void(blob)> inserter)
+{
+    binary_writer temp_writer;
+    marshall(temp_writer, data.header);
+    marshall(temp_writer, static_cast<int>(data.updates.size()));
+    for (const mutation_update& update : data.updates)
+    {
+        marshall(temp_writer, update.code);
+        marshall(temp_writer, static_cast<int>(update.data.length()));
+    }
+    inserter(temp_writer.get_buffer());
+
+    for (const mutation_update& update : data.updates)
+    {
+        inserter(update.data);
+    }
+}
+
+static void mutation_serialize_perf_test(int value_size)
+{
+    const int round = 20000;
+    const int secondary_count = 2;
+    global_partition_id gpid = { 1, 0 };
+    std::string value(value_size, 'v');
+    std::chrono::steady_clock clock;
+    size_t log_bytes = 0;
+    auto inserter = [&log_bytes](blob bb) { log_bytes += bb.length(); };
+
+    // primary: prepare to the secondaries, append to the shared and private logs;
+    // secondary: decode the prepare, append to the shared and private logs
+    auto tic = clock.now();
+    for (int i = 0; i < round; i++)
+    {
+        mutation_ptr mu = create_test_mutation(gpid, i + 1, value);
+        mu->cache_encoded_updates();
+        for (int s = 0; s < secondary_count; s++)
+        {
+            binary_writer writer;
+            mu->write_to(writer);
+
+            binary_reader reader(writer.get_buffer());
+            mutation_ptr smu = mutation::read_from(reader, nullptr);
+            smu->write_to_log_file(inserter);
+            smu->write_to_log_file(inserter);
+        }
+        mu->write_to_log_file(inserter);
+        mu->write_to_log_file(inserter);
+    }
+    auto encode_once_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock.now() - tic).count();
+
+    tic = clock.now();
+    for (int i = 0; i < round; i++)
+    {
+        mutation_ptr mu = create_test_mutation(gpid, i + 1, value);
+        for (int s = 0; s < secondary_count; s++)
+        {
+            binary_writer writer;
+            marshall(writer, mu->data);
+
+            binary_reader reader(writer.get_buffer());
+            mutation_data sdata;
+            unmarshall(reader, sdata);
+            reencode_to_log_file(sdata, inserter);
+            reencode_to_log_file(sdata, inserter);
+        }
+        reencode_to_log_file(mu->data, inserter);
+        reencode_to_log_file(mu->data, inserter);
+    }
+    auto reencode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock.now() - tic).count();
+
+    std::cout << "mutation serialize perf test: value = " << value_size
+        << " bytes, cpu per write (3 replicas), encoded once = " << encode_once_ns / round
+        << " ns, re-encoded = " << reencode_ns / round
+        << " ns" << std::endl;
+}
+
+TEST(replication, mutation_serialize_perf)
+{
+    for (int value_size : { 32, 256, 4096, 65536 })
+    {
+        mutation_serialize_perf_test(value_size);
+    }
+}
+
+static void mutation_log_compression_perf_test(bool compress)
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string logp = "./test-log-compression";
+    const int mutation_count = 20000;
+    const int concurrency = 64;
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // records of a few fields, which compress a few times as typical values
+    std::vector<std::string> values;
+    for (int i = 0; i < 64; i++)
+    {
+        std::string value;
+        while (value.size() < 4096)
+        {
+            value += "{\"id\":" + std::to_string(dsn_random32(0, 1000000))
+                + ",\"name\":\"user" + std::to_string(dsn_random32(0, 10000))
+                + "\",\"status\":\"active\",\"score\":" + std::to_string(dsn_random32(0, 100)) + "}";
+        }
+        values.push_back(value);
+    }
+
+    mutation_log_ptr mlog = new mutation_log(logp, 0, 32, true);
+    mlog->set_block_compression(compress);
+    mlog->set_valid_start_offset_on_open(gpid, 0);
+    ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+
+    std::vector<task_ptr> tasks(mutation_count);
+    int64_t bytes = 0;
+    int next = 0;
+    auto append_next = [&]()
+    {
+        int i = next++;
+        const std::string& value = values[i % values.size()];
+        bytes += value.size();
+        mutation_ptr mu = create_test_mutation(gpid, i + 1, value);
+        tasks[i] = mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr,
+            [](error_code err, size_t) { EXPECT_EQ(ERR_OK, err); }, 0);
+    };
+
+    uint64_t start_us = dsn_now_us();
+    while (next < concurrency)
+    {
+        append_next();
+    }
+    for (int i = 0; i < mutation_count; i++)
+    {
+        tasks[i]->wait();
+        if (next < mutation_count)
+        {
+            append_next();
+        }
+    }
+    uint64_t write_us = dsn_now_us() - start_us;
+    mlog->close();
+
+    std::vector<std::string> files;
+    int64_t file_bytes = 0;
+    ASSERT_TRUE(utils::filesystem::get_subfiles(logp, files, false));
+    for (auto& file : files)
+    {
+        int64_t sz;
+        ASSERT_TRUE(utils::filesystem::file_size(file, sz));
+        file_bytes += sz;
+    }
+
+    decree last_decree = 0;
+    start_us = dsn_now_us();
+    mlog = new mutation_log(logp, 0, 32, true);
+    mlog->set_block_compression(compress);
+    mlog->set_valid_start_offset_on_open(gpid, 0);
+    ASSERT_EQ(ERR_OK, mlog->open(
+        [&last_decree](mutation_ptr& mu)->bool
+        {
+            EXPECT_EQ(last_decree + 1, mu->data.header.decree);
+            last_decree = mu->data.header.decree;
+            return true;
+        }
+        ));
+    uint64_t replay_us = dsn_now_us() - start_us;
+    ASSERT_EQ(mutation_count, last_decree);
+    mlog->close();
+
+    std::cout << "log compression perf test: " << (compress ? "compressed" : "uncompressed")
+        << ", data = " << bytes / 1024 / 1024
+        << " MB, files = " << file_bytes / 1024 / 1024
+        << " MB, ratio = " << (double)bytes / (double)file_bytes
+        << ", write throughput(MB/s) = " << (write_us > 0 ? bytes / (int64_t)write_us : 0)
+        << ", replay throughput(MB/s) = " << (replay_us > 0 ? bytes / (int64_t)replay_us : 0)
+        << std::endl;
+
+    utils::filesystem::remove_path(logp);
+}
+
+TEST(replication, mutation_log_compression_perf)
+{
+    mutation_log_compression_perf_test(false);
+    mutation_log_compression_perf_test(true);
+}
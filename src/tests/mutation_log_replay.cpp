@@ -0,0 +1,175 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Shared log replay benchmark, sequential vs. parallel replay on a
+ *     synthetic log of many partitions, the log size is configured by
+ *     [replication.test] log_replay_perf_test_mb. The payload buffers
+ *     of the replayed mutations are counted to show the allocations
+ *     made by decoding.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+# include "mutation_log.h"
+# include <gtest/gtest.h>
+# include <chrono>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+TEST(replication, mutation_log_replay_perf)
+{
+    std::chrono::steady_clock clock;
+    std::string logp = "./test-log-replay";
+    const int partition_count = 16;
+    const int mutation_size = 4096;
+    int64_t log_mb = (int64_t)dsn_config_get_value_uint64(
+        "replication.test",
+        "log_replay_perf_test_mb",
+        2048,
+        "synthetic shared log size (MB) for the replay benchmark"
+        );
+
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // writing a shared log with mutations of all partitions interleaved
+    auto time_tic = clock.now();
+    mutation_log_ptr mlog = new mutation_log(logp, 1024, 32, false);
+    for (int i = 0; i < partition_count; i++)
+    {
+        mlog->set_valid_start_offset_on_open(global_partition_id{ 1, i }, 0);
+    }
+    ASSERT_EQ(ERR_OK, mlog->open(nullptr));
+
+    std::string value(mutation_size, 'v');
+    int64_t mutation_count = log_mb * 1024 * 1024 / mutation_size;
+    for (int64_t i = 0; i < mutation_count; i++)
+    {
+        global_partition_id gpid = { 1, static_cast<int>(i % partition_count) };
+        decree d = i / partition_count + 1;
+
+        mutation_ptr mu(new mutation());
+        mu->data.header.ballot = 1;
+        mu->data.header.decree = d;
+        mu->data.header.gpid = gpid;
+        mu->data.header.last_committed_decree = d - 1;
+        mu->data.header.log_offset = 0;
+
+        binary_writer writer;
+        writer.write(value);
+        mu->data.updates.push_back(mutation_update());
+        mu->data.updates.back().code = RPC_REPLICATION_CLIENT_WRITE;
+        mu->data.updates.back().data = writer.get_buffer();
+        mu->client_requests.push_back(nullptr);
+
+        mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, nullptr, 0);
+    }
+    mlog->close();
+    mlog = nullptr;
+    std::cout << "log replay perf test: write " << log_mb << " MB, " << mutation_count
+        << " mutations, time(ms): "
+        << std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - time_tic).count()
+        << std::endl;
+
+    for (int thread_count : { 1, 2, 4, 8 })
+    {
+        // the decrees must be replayed in order for each partition
+        std::vector<decree> last_decrees(partition_count, 0);
+        std::vector<int64_t> replayed_counts(partition_count, 0);
+        std::vector<mutation_ptr> last_mutations(partition_count);
+        std::vector<int64_t> buffer_counts(partition_count, 0);
+        bool in_order = true;
+
+        // time-to-serve: all replicas can serve only after the shared log is opened and replayed
+        time_tic = clock.now();
+        mlog = new mutation_log(logp, 1024, 32, false);
+        for (int i = 0; i < partition_count; i++)
+        {
+            mlog->set_valid_start_offset_on_open(global_partition_id{ 1, i }, 0);
+        }
+        auto err = mlog->open(
+            [&](mutation_ptr& mu)->bool
+            {
+                // mimicing mutation replay time
+                auto tic = clock.now();
+                while (std::chrono::duration_cast<std::chrono::microseconds>(clock.now() - tic).count() < 2)
+                {
+                    ;
+                }
+
+                int pidx = mu->data.header.gpid.pidx;
+                if (mu->data.header.decree != last_decrees[pidx] + 1)
+                {
+                    in_order = false;
+                }
+                last_decrees[pidx] = mu->data.header.decree;
+                replayed_counts[pidx]++;
+
+                // payloads sliced from the same log block buffer share one allocation,
+                // the last mutation is kept so that its buffer cannot be reused by the next one
+                mutation_ptr& last = last_mutations[pidx];
+                if (last == nullptr
+                    || last->data.updates[0].data.buffer_ptr() != mu->data.updates[0].data.buffer_ptr())
+                {
+                    buffer_counts[pidx]++;
+                }
+                last = mu;
+                return true;
+            },
+            thread_count
+            );
+        auto serve_ms = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - time_tic).count();
+        ASSERT_EQ(ERR_OK, err);
+        ASSERT_TRUE(in_order);
+
+        int64_t replayed = 0;
+        int64_t buffers = 0;
+        for (int i = 0; i < partition_count; i++)
+        {
+            replayed += replayed_counts[i];
+            buffers += buffer_counts[i];
+            EXPECT_EQ(last_decrees[i], mlog->max_decree(global_partition_id{ 1, i }));
+        }
+        ASSERT_EQ(mutation_count, replayed);
+
+        mlog->close();
+        mlog = nullptr;
+
+        std::cout << "log replay perf test: threads = " << thread_count
+            << ", time-to-serve(ms): " << serve_ms
+            << ", replay throughput(MB/s): " << (serve_ms > 0 ? log_mb * 1000 / serve_ms : 0)
+            << ", payload allocations: " << buffers
+            << " (" << (double)buffers / (double)replayed << " per mutation)"
+            << std::endl;
+    }
+
+    // clear all
+    utils::filesystem::remove_path(logp);
+}
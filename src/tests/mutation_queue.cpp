@@ -0,0 +1,202 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for batching the client writes into mutations in mutation_queue,
+ *     and the adaptive 2pc concurrency.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+# include "replica.h"
+# include "mutation.h"
+# include "mutation_log.h"
+# include "replica_stub.h"
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include <thread>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+// a client write as received, with a payload of the given size
+static dsn_message_t create_write_request(int size)
+{
+    std::shared_ptr<char> buffer(new char[size], std::default_delete<char[]>());
+    memset(buffer.get(), 'x', size);
+    return message_ex::create_receive_message_with_standalone_header(blob(buffer, size));
+}
+
+static mutation_batch_options create_batch_options(int max_kb, int max_requests, int target_requests, int max_delay_ms, bool adaptive)
+{
+    mutation_batch_options opts;
+    opts.max_kb = max_kb;
+    opts.max_requests = max_requests;
+    opts.target_requests = target_requests;
+    opts.max_delay_ms = max_delay_ms;
+    opts.adaptive = adaptive;
+    return opts;
+}
+
+TEST(replication, mutation_queue_batch_limits)
+{
+    replica_stub_ptr stub = new replica_stub();
+    global_partition_id gpid = { 1, 0 };
+    replica_ptr r = replica::new_for_test(stub.get(), "test", gpid);
+
+    mutation_queue queue(gpid, 1);
+    queue.set_batch_options(create_batch_options(1, 3, 1, 1, false));
+    ASSERT_EQ(1, queue.max_concurrent_op());
+
+    // issued at once when nothing is running
+    mutation_ptr mu = queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get());
+    ASSERT_TRUE(mu != nullptr);
+    ASSERT_EQ(1u, mu->client_requests.size());
+
+    // batched while the concurrency is reached, full at max_requests
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_TRUE(queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get()) == nullptr);
+    }
+    ASSERT_TRUE(queue.check_possible_work(1) == nullptr);
+
+    mu = queue.check_possible_work(0);
+    ASSERT_TRUE(mu != nullptr);
+    ASSERT_EQ(3u, mu->client_requests.size());
+    mu = queue.check_possible_work(0);
+    ASSERT_TRUE(mu != nullptr);
+    ASSERT_EQ(1u, mu->client_requests.size());
+    ASSERT_TRUE(queue.check_possible_work(0) == nullptr);
+
+    // full at max_kb, with the requests after it in the next mutation
+    queue.check_possible_work(1);
+    ASSERT_TRUE(queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get()) == nullptr);
+    ASSERT_TRUE(queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(1024), r.get()) == nullptr);
+    ASSERT_TRUE(queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get()) == nullptr);
+
+    mu = queue.check_possible_work(0);
+    ASSERT_TRUE(mu != nullptr);
+    ASSERT_EQ(2u, mu->client_requests.size());
+    ASSERT_GE(mu->appro_data_bytes(), 1024);
+    mu = queue.check_possible_work(0);
+    ASSERT_TRUE(mu != nullptr);
+    ASSERT_EQ(1u, mu->client_requests.size());
+
+    // one request per mutation when batching is disabled
+    mutation_queue unbatched_queue(gpid, 1, true);
+    ASSERT_TRUE(unbatched_queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get()) != nullptr);
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE(unbatched_queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get()) == nullptr);
+    }
+    for (int i = 0; i < 3; i++)
+    {
+        mu = unbatched_queue.check_possible_work(0);
+        ASSERT_TRUE(mu != nullptr);
+        ASSERT_EQ(1u, mu->client_requests.size());
+    }
+    ASSERT_TRUE(unbatched_queue.check_possible_work(0) == nullptr);
+}
+
+TEST(replication, mutation_queue_adaptive_concurrency)
+{
+    replica_stub_ptr stub = new replica_stub();
+    global_partition_id gpid = { 1, 0 };
+    replica_ptr r = replica::new_for_test(stub.get(), "test", gpid);
+    const int limit = 10;
+    const uint64_t ms = 1000000;
+
+    // without requests, one mutation per max_delay_ms is issued: 10 ms rtt / 2 ms
+    {
+        mutation_queue queue(gpid, limit);
+        queue.set_batch_options(create_batch_options(1024, 0, 4, 2, true));
+        queue.on_mutation_committed(10 * ms);
+        ASSERT_EQ(5, queue.max_concurrent_op());
+
+        // not adapted any more once adaptive is off, and reset to the limit
+        queue.set_batch_options(create_batch_options(1024, 0, 4, 2, false));
+        ASSERT_EQ(limit, queue.max_concurrent_op());
+        queue.on_mutation_committed(100 * ms);
+        ASSERT_EQ(limit, queue.max_concurrent_op());
+    }
+
+    // a burst of requests is limited by staleness_for_commit
+    {
+        mutation_queue queue(gpid, limit);
+        queue.set_batch_options(create_batch_options(1024, 0, 4, 1000, true));
+        for (int i = 0; i < 100; i++)
+        {
+            queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get());
+        }
+        queue.on_mutation_committed(10 * ms);
+        ASSERT_EQ(limit, queue.max_concurrent_op());
+    }
+
+    // a request every 100 ms (up to 250 ms on a slow machine) with 4 requests per mutation,
+    // i.e., a mutation every 400 ~ 1000 ms, for 1 s rtt
+    {
+        mutation_queue queue(gpid, limit);
+        queue.set_batch_options(create_batch_options(1024, 0, 4, 1000, true));
+        queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        queue.add_work(RPC_REPLICATION_CLIENT_WRITE, create_write_request(10), r.get());
+        queue.on_mutation_committed(1000 * ms);
+        ASSERT_GE(queue.max_concurrent_op(), 1);
+        ASSERT_LE(queue.max_concurrent_op(), 3);
+    }
+
+    // never below 1
+    {
+        mutation_queue queue(gpid, limit);
+        queue.set_batch_options(create_batch_options(1024, 0, 4, 1000, true));
+        queue.on_mutation_committed(1);
+        ASSERT_EQ(1, queue.max_concurrent_op());
+    }
+}
+
+TEST(replication, mutation_batch_options)
+{
+    replication_options opts;
+    opts.mutation_batch = create_batch_options(512, 0, 16, 5, false);
+
+    // the defaults from [replication] when not overridden for the app type
+    mutation_batch_options batch = opts.get_mutation_batch_options("no_such_app");
+    ASSERT_EQ(512, batch.max_kb);
+    ASSERT_EQ(0, batch.max_requests);
+    ASSERT_EQ(16, batch.target_requests);
+    ASSERT_EQ(5, batch.max_delay_ms);
+    ASSERT_FALSE(batch.adaptive);
+
+    // overridden in [replication.batch_test] of config-test.ini, with the invalid target corrected
+    batch = opts.get_mutation_batch_options("batch_test");
+    ASSERT_EQ(16, batch.max_kb);
+    ASSERT_EQ(8, batch.max_requests);
+    ASSERT_EQ(1, batch.target_requests);
+    ASSERT_EQ(5, batch.max_delay_ms);
+    ASSERT_TRUE(batch.adaptive);
+}
@@ -0,0 +1,189 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit tests of loading the replicas in several data dirs on startup,
+ *     including the bad replica dirs and the "load-progress" cli command.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+# include "replica.h"
+# include "mutation.h"
+# include "mutation_log.h"
+# include "replica_stub.h"
+# include <gtest/gtest.h>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+// an empty app which opens with nothing committed
+class load_test_app : public replication_app_base
+{
+public:
+    load_test_app(replica* r) : replication_app_base(r) {}
+
+    virtual error_code open(bool create_new) override { return ERR_OK; }
+    virtual error_code close(bool clear_state) override { return ERR_OK; }
+    virtual error_code checkpoint() override { return ERR_OK; }
+    virtual error_code get_checkpoint(decree start, const blob& learn_req, /*out*/ learn_state& state) override
+    {
+        return ERR_NOT_IMPLEMENTED;
+    }
+    virtual error_code apply_checkpoint(learn_state& state, chkpt_apply_mode mode) override
+    {
+        return ERR_NOT_IMPLEMENTED;
+    }
+};
+
+static std::string create_replica_dir(const std::string& data_dir, const char* name, bool with_init_info)
+{
+    std::string dir = utils::filesystem::path_combine(data_dir, name);
+    EXPECT_TRUE(utils::filesystem::create_directory(dir));
+    if (with_init_info)
+    {
+        replica_init_info info;
+        info.magic = 0xdeadbeef;
+        std::string info_path = utils::filesystem::path_combine(dir, ".info");
+        EXPECT_EQ(ERR_OK, info.store(info_path.c_str()));
+    }
+    return dir;
+}
+
+static std::string dir_name(const std::string& dir)
+{
+    char splitters[] = { '\\', '/', 0 };
+    return utils::get_last_component(dir, splitters);
+}
+
+// count of the dirs moved away from the replica dir 'name' on failure, i.e., 'name.<timestamp>.err'
+static int get_err_dir_count(const std::string& data_dir, const std::string& name)
+{
+    std::vector<std::string> dirs;
+    utils::filesystem::get_subdirectories(data_dir, dirs, false);
+    int count = 0;
+    for (auto& dir : dirs)
+    {
+        std::string n = dir_name(dir);
+        if (n.compare(0, name.length() + 1, name + ".") == 0
+            && n.length() >= 4 && n.substr(n.length() - 4) == ".err")
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+TEST(replication, replica_stub_load_replicas)
+{
+    register_replica_provider<load_test_app>("load_test");
+
+    std::string root = "replica_load_test";
+    utils::filesystem::remove_path(root);
+
+    replication_options opts;
+    opts.checkpoint_disabled = true;
+    opts.replica_load_thread_count = 4;
+    opts.slog_dirs.push_back(utils::filesystem::path_combine(root, "slog"));
+    for (int i = 0; i < 3; i++)
+    {
+        std::string dir = utils::filesystem::path_combine(root, std::string("data") + (char)('0' + i));
+        ASSERT_TRUE(utils::filesystem::create_directory(dir));
+        opts.data_dirs.push_back(dir);
+    }
+
+    // data0: good replicas, and a replica moved away on an earlier failure
+    std::string dir0 = create_replica_dir(opts.data_dirs[0], "1.0.load_test", true);
+    std::string dir1 = create_replica_dir(opts.data_dirs[0], "1.1.load_test", true);
+    std::string old_err = create_replica_dir(opts.data_dirs[0], "1.5.load_test.123.err", true);
+
+    // data1: a good replica, a dir with an invalid name, a replica without the init info,
+    // and a replica of an unknown app type
+    std::string dir2 = create_replica_dir(opts.data_dirs[1], "1.2.load_test", true);
+    std::string invalid = create_replica_dir(opts.data_dirs[1], "invalid", false);
+    std::string no_info = create_replica_dir(opts.data_dirs[1], "1.3.load_test", false);
+    std::string no_app = create_replica_dir(opts.data_dirs[1], "1.4.no_such_app", true);
+
+    // data2: empty
+
+    replica_stub_ptr stub = new replica_stub();
+    stub->set_options(opts);
+    ASSERT_EQ("not started", stub->get_load_progress_for_test());
+
+    replicas rps;
+    stub->load_replicas_for_test(rps);
+
+    // only the good replicas are loaded, each from its own dir
+    ASSERT_EQ(3u, rps.size());
+    std::string dirs[] = { dir0, dir1, dir2 };
+    for (int32_t pidx = 0; pidx < 3; pidx++)
+    {
+        global_partition_id gpid = { 1, pidx };
+        auto it = rps.find(gpid);
+        ASSERT_TRUE(it != rps.end());
+        ASSERT_EQ(gpid, it->second->get_gpid());
+        ASSERT_EQ(dir_name(dirs[pidx]), dir_name(it->second->dir()));
+        ASSERT_EQ(0, it->second->last_committed_decree());
+    }
+
+    // the replicas failed to open are moved to .err dirs, which are skipped by the later loads,
+    // while the dirs with invalid names are left as they are
+    ASSERT_FALSE(utils::filesystem::directory_exists(no_info));
+    ASSERT_EQ(1, get_err_dir_count(opts.data_dirs[1], "1.3.load_test"));
+    ASSERT_FALSE(utils::filesystem::directory_exists(no_app));
+    ASSERT_EQ(1, get_err_dir_count(opts.data_dirs[1], "1.4.no_such_app"));
+    ASSERT_TRUE(utils::filesystem::directory_exists(invalid));
+    ASSERT_TRUE(utils::filesystem::directory_exists(old_err));
+
+    // the .err dirs are not counted
+    std::string progress = stub->get_load_progress_for_test();
+    ASSERT_EQ(0u, progress.find("loaded 6/6 replicas, 3 failed, elapsed ")) << progress;
+
+    for (auto& kv : rps)
+    {
+        kv.second->close();
+    }
+    rps.clear();
+
+    // loaded again with the bad replicas moved away, one data dir by one thread
+    opts.replica_load_thread_count = 1;
+    replica_stub_ptr stub2 = new replica_stub();
+    stub2->set_options(opts);
+    stub2->load_replicas_for_test(rps);
+    ASSERT_EQ(3u, rps.size());
+    progress = stub2->get_load_progress_for_test();
+    ASSERT_EQ(0u, progress.find("loaded 4/4 replicas, 1 failed, elapsed ")) << progress;
+
+    for (auto& kv : rps)
+    {
+        kv.second->close();
+    }
+    rps.clear();
+
+    utils::filesystem::remove_path(root);
+}
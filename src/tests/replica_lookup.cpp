@@ -0,0 +1,217 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for the replica registry of replica_stub: get_replica,
+ *     add_replica, remove_replica and get_replicas_copy over the gpid
+ *     sharded index, including the races across and within the shards.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+# include "replica.h"
+# include "mutation.h"
+# include "mutation_log.h"
+# include "replica_stub.h"
+# include <gtest/gtest.h>
+# include <atomic>
+# include <thread>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+static replica_ptr new_test_replica(replica_stub_ptr& stub, int32_t app_id, int32_t pidx)
+{
+    global_partition_id gpid = { app_id, pidx };
+    return replica::new_for_test(stub.get(), "test", gpid);
+}
+
+TEST(replication, replica_stub_registry)
+{
+    replica_stub_ptr stub = new replica_stub();
+    std::vector<replica_ptr> rps;
+    for (int32_t app_id = 1; app_id <= 2; app_id++)
+    {
+        for (int32_t pidx = 0; pidx < 100; pidx++)
+        {
+            replica_ptr r = new_test_replica(stub, app_id, pidx);
+            stub->add_replica_for_test(r);
+            rps.push_back(r);
+        }
+    }
+
+    for (auto& r : rps)
+    {
+        ASSERT_EQ(r, stub->get_replica(r->get_gpid()));
+        ASSERT_EQ(r, stub->get_replica(r->get_gpid().app_id, r->get_gpid().pidx));
+    }
+    global_partition_id unknown = { 3, 0 };
+    ASSERT_EQ(nullptr, stub->get_replica(unknown));
+    ASSERT_EQ(nullptr, stub->get_replica(1, 100));
+
+    replicas copy = stub->get_replicas_copy_for_test();
+    ASSERT_EQ(rps.size(), copy.size());
+    for (auto& r : rps)
+    {
+        ASSERT_EQ(r, copy[r->get_gpid()]);
+    }
+
+    // removed once only, and the others are not affected
+    for (size_t i = 0; i < rps.size(); i += 2)
+    {
+        ASSERT_TRUE(stub->remove_replica_for_test(rps[i]));
+        ASSERT_FALSE(stub->remove_replica_for_test(rps[i]));
+    }
+    for (size_t i = 0; i < rps.size(); i++)
+    {
+        ASSERT_EQ(i % 2 == 0 ? nullptr : rps[i], stub->get_replica(rps[i]->get_gpid()));
+    }
+    ASSERT_EQ(rps.size() / 2, stub->get_replicas_copy_for_test().size());
+
+    // added again after removed
+    stub->add_replica_for_test(rps[0]);
+    ASSERT_EQ(rps[0], stub->get_replica(rps[0]->get_gpid()));
+
+    for (auto& r : rps)
+    {
+        stub->remove_replica_for_test(r);
+    }
+    ASSERT_TRUE(stub->get_replicas_copy_for_test().empty());
+}
+
+TEST(replication, replica_stub_registry_races)
+{
+    replica_stub_ptr stub = new replica_stub();
+    const int writer_count = 8;
+    const int partitions_per_writer = 64;
+    const int round = 200;
+    std::atomic<bool> writers_done(false);
+
+    // each writer adds and removes its own partitions, which are spread over all the shards
+    // and share the shards with the other writers; the replicas of the even partitions are
+    // left in the registry in the end
+    std::vector<std::thread> writers;
+    std::vector<std::vector<replica_ptr>> owned(writer_count);
+    for (int t = 0; t < writer_count; t++)
+    {
+        for (int i = 0; i < partitions_per_writer; i++)
+        {
+            owned[t].push_back(new_test_replica(stub, 1, i * writer_count + t));
+        }
+        writers.push_back(std::thread([&stub, &owned, t]()
+        {
+            for (int n = 0; n < round; n++)
+            {
+                for (auto& r : owned[t])
+                {
+                    stub->add_replica_for_test(r);
+                    EXPECT_EQ(r, stub->get_replica(r->get_gpid()));
+                }
+                for (auto& r : owned[t])
+                {
+                    bool even = (r->get_gpid().pidx / writer_count) % 2 == 0;
+                    if (n + 1 < round || !even)
+                    {
+                        EXPECT_TRUE(stub->remove_replica_for_test(r));
+                        EXPECT_EQ(nullptr, stub->get_replica(r->get_gpid()));
+                    }
+                }
+            }
+        }));
+    }
+
+    // the readers only see the replicas of the gpids looked up, and consistent copies
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++)
+    {
+        readers.push_back(std::thread([&stub, &writers_done, t]()
+        {
+            int n = 0;
+            while (!writers_done.load())
+            {
+                global_partition_id gpid = { 1, (n++ * 7 + t) % (writer_count * partitions_per_writer) };
+                replica_ptr r = stub->get_replica(gpid);
+                if (r != nullptr)
+                {
+                    EXPECT_EQ(gpid, r->get_gpid());
+                }
+
+                if (n % 64 == 0)
+                {
+                    replicas copy = stub->get_replicas_copy_for_test();
+                    for (auto& kv : copy)
+                    {
+                        EXPECT_EQ(kv.first, kv.second->get_gpid());
+                    }
+                }
+            }
+        }));
+    }
+
+    for (auto& th : writers)
+    {
+        th.join();
+    }
+    writers_done.store(true);
+    for (auto& th : readers)
+    {
+        th.join();
+    }
+
+    replicas copy = stub->get_replicas_copy_for_test();
+    ASSERT_EQ((size_t)(writer_count * partitions_per_writer / 2), copy.size());
+    for (int t = 0; t < writer_count; t++)
+    {
+        for (auto& r : owned[t])
+        {
+            bool even = (r->get_gpid().pidx / writer_count) % 2 == 0;
+            ASSERT_EQ(even ? r : nullptr, stub->get_replica(r->get_gpid()));
+        }
+    }
+
+    // the same replica removed by several threads at the same time is removed only once
+    for (auto& kv : copy)
+    {
+        std::atomic<int> removed(0);
+        std::vector<std::thread> removers;
+        for (int t = 0; t < 4; t++)
+        {
+            removers.push_back(std::thread([&stub, &kv, &removed]()
+            {
+                if (stub->remove_replica_for_test(kv.second))
+                    removed++;
+            }));
+        }
+        for (auto& th : removers)
+        {
+            th.join();
+        }
+        ASSERT_EQ(1, removed.load());
+    }
+    ASSERT_TRUE(stub->get_replicas_copy_for_test().empty());
+}
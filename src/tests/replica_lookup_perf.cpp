@@ -0,0 +1,113 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Replica lookup throughput of replica_stub::get_replica with many
+ *     concurrent request threads, the lookup count of each thread is
+ *     configured by [replication.test] replica_lookup_perf_test_rounds.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+# include "replica.h"
+# include "mutation.h"
+# include "mutation_log.h"
+# include "replica_stub.h"
+# include <gtest/gtest.h>
+# include <atomic>
+# include <chrono>
+# include <thread>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+static void replica_lookup_perf_test(replica_stub_ptr& stub, int thread_count, int partition_count, int round)
+{
+    std::chrono::steady_clock clock;
+    std::vector<std::thread> threads;
+    std::atomic<int> found(0);
+
+    auto tic = clock.now();
+    for (int t = 0; t < thread_count; t++)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            int count = 0;
+            for (int i = 0; i < round; i++)
+            {
+                if (stub->get_replica(1, (i * 7 + t) % partition_count) != nullptr)
+                    count++;
+            }
+            found += count;
+        }));
+    }
+    for (auto& th : threads)
+    {
+        th.join();
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(clock.now() - tic).count();
+    ASSERT_EQ(thread_count * round, found.load());
+
+    std::cout << "replica lookup perf test: threads = " << thread_count
+        << ", partitions = " << partition_count
+        << ", lookups/s = " << (int64_t)((double)thread_count * round * 1000000000.0 / (double)ns)
+        << ", ns per lookup per thread = " << ns / round
+        << std::endl;
+}
+
+TEST(replication, replica_lookup_perf)
+{
+    int round = (int)dsn_config_get_value_uint64(
+        "replication.test",
+        "replica_lookup_perf_test_rounds",
+        100000,
+        "lookups of each thread in the replica lookup benchmark"
+        );
+
+    for (int partition_count : { 1000, 4000 })
+    {
+        replica_stub_ptr stub = new replica_stub();
+        std::vector<replica_ptr> rps;
+        for (int i = 0; i < partition_count; i++)
+        {
+            global_partition_id gpid = { 1, i };
+            rps.push_back(replica::new_for_test(stub.get(), "test", gpid));
+            stub->add_replica_for_test(rps.back());
+        }
+
+        for (int thread_count : { 1, 8, 32 })
+        {
+            replica_lookup_perf_test(stub, thread_count, partition_count, round);
+        }
+
+        for (auto& r : rps)
+        {
+            stub->remove_replica_for_test(r);
+        }
+    }
+}
@@ -0,0 +1,91 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit tests of the staleness of the secondaries for bounded-staleness reads.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "replica_context.h"
+# include <gtest/gtest.h>
+# include <thread>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+TEST(replication, staleness_tracker)
+{
+    staleness_tracker tracker;
+    int64_t decrees;
+    uint64_t ms;
+
+    // as stale as it can be before anything is heard from the primary
+    tracker.get_staleness(0, decrees, ms);
+    ASSERT_EQ(0, decrees);
+    ASSERT_LT(dsn_now_ms() - ms, 100u);
+
+    tracker.on_primary_committed(5);
+    tracker.get_staleness(5, decrees, ms);
+    ASSERT_EQ(0, decrees);
+    ASSERT_LT(ms, 100u);
+    tracker.get_staleness(3, decrees, ms);
+    ASSERT_EQ(2, decrees);
+
+    // stale in time when the primary is not heard from, though nothing more is committed
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    tracker.get_staleness(5, decrees, ms);
+    ASSERT_EQ(0, decrees);
+    ASSERT_GE(ms, 200u);
+
+    // fresh again by a group check with the same committed decree
+    tracker.on_primary_committed(5);
+    tracker.get_staleness(5, decrees, ms);
+    ASSERT_EQ(0, decrees);
+    ASSERT_LT(ms, 100u);
+
+    // the local state behind the primary is fresh as of when the primary was last known
+    // to have committed no more than it
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    tracker.on_primary_committed(8);
+    tracker.get_staleness(5, decrees, ms);
+    ASSERT_EQ(3, decrees);
+    ASSERT_GE(ms, 200u);
+
+    // an older message (e.g., a delayed prepare) keeps the local state with all the commits
+    // known fresh, but does not move the committed decree of the primary backward
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    tracker.on_primary_committed(7);
+    tracker.get_staleness(8, decrees, ms);
+    ASSERT_EQ(0, decrees);
+    ASSERT_LT(ms, 100u);
+    tracker.get_staleness(7, decrees, ms);
+    ASSERT_EQ(1, decrees);
+    ASSERT_GE(ms, 200u);
+}
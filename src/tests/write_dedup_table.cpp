@@ -0,0 +1,212 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit tests of the write dedup table (eviction and checkpointing) and
+ *     of the dedup ids carried in the mutations.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "mutation.h"
+# include <gtest/gtest.h>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+static blob make_response(const std::string& s)
+{
+    std::shared_ptr<char> buffer(new char[s.length()], [](char* ptr){ delete[] ptr; });
+    memcpy(buffer.get(), s.c_str(), s.length());
+    return blob(buffer, 0, (int)s.length());
+}
+
+TEST(replication, write_dedup_table)
+{
+    write_dedup_table table;
+    blob resp;
+
+    // disabled by default
+    table.add(1, 1, make_response("r1"));
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, table.find(1, 1, resp));
+
+    table.set_limits(2, 3, 4);
+    table.add(1, 1, make_response("r1"));
+    table.add(1, 2, make_response("too-long"));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(1, 1, resp));
+    ASSERT_EQ("r1", std::string(resp.data(), resp.length()));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(1, 2, resp));
+    ASSERT_EQ(0, resp.length());
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, table.find(1, 3, resp));
+
+    // the seqs out of the window are evicted, and those up to the watermark are still known as applied
+    table.add(1, 3, make_response("r3"));
+    table.add(1, 5, make_response("r5"));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(1, 1, resp));
+    ASSERT_EQ(0, resp.length());
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(1, 5, resp));
+    ASSERT_EQ("r5", std::string(resp.data(), resp.length()));
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, table.find(1, 4, resp));
+
+    // the least recently written client is evicted
+    table.add(2, 1, make_response("r1"));
+    table.add(1, 6, make_response("r6"));
+    table.add(3, 1, make_response("r1"));
+    ASSERT_EQ(2, table.client_count());
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, table.find(2, 1, resp));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(1, 6, resp));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(3, 1, resp));
+
+    // checkpointed and loaded with the lru order
+    binary_writer writer;
+    table.write_to(writer);
+    write_dedup_table loaded;
+    loaded.set_limits(2, 3, 4);
+    binary_reader reader(writer.get_buffer());
+    ASSERT_EQ(ERR_OK, loaded.read_from(reader));
+    ASSERT_TRUE(reader.is_eof());
+    ASSERT_EQ(2, loaded.client_count());
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, loaded.find(1, 2, resp));
+    ASSERT_EQ(0, resp.length());
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, loaded.find(1, 6, resp));
+    ASSERT_EQ("r6", std::string(resp.data(), resp.length()));
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, loaded.find(1, 4, resp));
+
+    loaded.add(4, 1, make_response("r1"));
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, loaded.find(1, 6, resp));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, loaded.find(3, 1, resp));
+}
+
+TEST(replication, write_dedup_table_window)
+{
+    write_dedup_table table;
+    blob resp;
+    table.set_limits(2, 4, 4);
+
+    // the writes are applied out of order, and the watermark stops at the first seq not applied
+    table.add(1, 1, make_response("r1"));
+    table.add(1, 3, make_response("r3"));
+    table.add(1, 4, make_response("r4"));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(1, 1, resp));
+    ASSERT_EQ("r1", std::string(resp.data(), resp.length()));
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, table.find(1, 2, resp));
+
+    // many more writes are applied, and a delayed first try in the window is still executed
+    table.add(1, 5, make_response("r5"));
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, table.find(1, 2, resp));
+
+    // the seqs out of the window are unknown unless they are up to the watermark
+    table.add(1, 6, make_response("r6"));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(1, 1, resp));
+    ASSERT_EQ(0, resp.length());
+    ASSERT_EQ(write_dedup_table::WS_EXPIRED, table.find(1, 2, resp));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(1, 3, resp));
+    ASSERT_EQ("r3", std::string(resp.data(), resp.length()));
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, table.find(1, 7, resp));
+
+    // the expired seq is not recorded when it is applied late
+    table.add(1, 2, make_response("r2"));
+    ASSERT_EQ(write_dedup_table::WS_EXPIRED, table.find(1, 2, resp));
+
+    // consecutive seqs move the watermark along with the window
+    table.add(2, 1, make_response("r1"));
+    table.add(2, 2, make_response("r2"));
+    table.add(2, 3, make_response("r3"));
+    table.add(2, 4, make_response("r4"));
+    table.add(2, 5, make_response("r5"));
+    table.add(2, 6, make_response("r6"));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(2, 1, resp));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, table.find(2, 2, resp));
+    ASSERT_EQ(0, resp.length());
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, table.find(2, 7, resp));
+
+    binary_writer writer;
+    table.write_to(writer);
+    write_dedup_table loaded;
+    loaded.set_limits(2, 4, 4);
+    binary_reader reader(writer.get_buffer());
+    ASSERT_EQ(ERR_OK, loaded.read_from(reader));
+    ASSERT_TRUE(reader.is_eof());
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, loaded.find(1, 1, resp));
+    ASSERT_EQ(write_dedup_table::WS_EXPIRED, loaded.find(1, 2, resp));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, loaded.find(1, 6, resp));
+    ASSERT_EQ(write_dedup_table::WS_NOT_APPLIED, loaded.find(1, 7, resp));
+    ASSERT_EQ(write_dedup_table::WS_APPLIED, loaded.find(2, 2, resp));
+}
+
+TEST(replication, write_dedup_table_unknown_version)
+{
+    binary_writer writer;
+    writer.write(99);
+    writer.write(0);
+
+    // the checkpoint is rejected instead of crashing the replica
+    write_dedup_table table;
+    table.set_limits(2, 4, 4);
+    binary_reader reader(writer.get_buffer());
+    ASSERT_EQ(ERR_INVALID_DATA, table.read_from(reader));
+    ASSERT_EQ(0, table.client_count());
+}
+
+TEST(replication, mutation_dedup_ids)
+{
+    mutation_ptr mu(new mutation());
+    mu->data.header.ballot = 1;
+    mu->data.header.decree = 2;
+    mu->data.header.gpid = { 1, 0 };
+    mu->data.header.last_committed_decree = 1;
+    mu->data.header.log_offset = 0;
+    mu->add_client_request(RPC_REPLICATION_WRITE_EMPTY, nullptr);
+    ASSERT_TRUE(mu->dedup_ids.empty());
+    mu->add_client_request(RPC_REPLICATION_WRITE_EMPTY, nullptr, write_dedup_id(7, 8));
+    ASSERT_EQ(2u, mu->dedup_ids.size());
+
+    binary_writer writer;
+    mu->write_to(writer);
+    binary_reader reader(writer.get_buffer());
+    mutation_ptr rmu = mutation::read_from(reader, nullptr);
+    ASSERT_TRUE(reader.is_eof());
+    ASSERT_EQ(2u, rmu->data.updates.size());
+    ASSERT_EQ(2u, rmu->dedup_ids.size());
+    ASSERT_FALSE(rmu->dedup_ids[0].is_valid());
+    ASSERT_EQ(7, rmu->dedup_ids[1].client_id);
+    ASSERT_EQ(8, rmu->dedup_ids[1].request_seq);
+
+    // without dedup ids, the encoding is the same as before
+    mutation_ptr mu2(new mutation());
+    mu2->data.header = mu->data.header;
+    mu2->add_client_request(RPC_REPLICATION_WRITE_EMPTY, nullptr);
+    binary_writer writer2;
+    mu2->write_to(writer2);
+    binary_reader reader2(writer2.get_buffer());
+    mutation_ptr rmu2 = mutation::read_from(reader2, nullptr);
+    ASSERT_TRUE(reader2.is_eof());
+    ASSERT_EQ(1u, rmu2->data.updates.size());
+    ASSERT_TRUE(rmu2->dedup_ids.empty());
+}